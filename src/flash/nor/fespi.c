@@ -29,6 +29,7 @@
 #include "imp.h"
 #include "spi.h"
 #include <jtag/jtag.h>
+#include <helper/align.h>
 #include <helper/time_support.h>
 #include <target/algorithm.h>
 #include "target/riscv/riscv.h"
@@ -478,6 +479,121 @@ static const uint8_t riscv64_bin[] = {
 #include "../../../contrib/loaders/flash/fespi/riscv64_fespi.inc"
 };
 
+static const uint8_t riscv32_async_bin[] = {
+#include "../../../contrib/loaders/flash/fespi/riscv32_fespi_async.inc"
+};
+
+static const uint8_t riscv64_async_bin[] = {
+#include "../../../contrib/loaders/flash/fespi/riscv64_fespi_async.inc"
+};
+
+/* Stream the data through a FIFO in target memory while the loader keeps
+ * running. This avoids halting and resuming the hart for every block, but
+ * requires that memory can be accessed while the target is running.
+ * Returns ERROR_TARGET_RESOURCE_NOT_AVAILABLE if the caller should fall back
+ * to the block based loader. */
+static int fespi_write_async(struct flash_bank *bank, const uint8_t *buffer,
+		uint32_t offset, uint32_t count, uint32_t page_size)
+{
+	struct target *target = bank->target;
+	struct fespi_flash_bank *fespi_info = bank->driver_priv;
+
+	if (!riscv_can_access_memory_while_running(target, 4))
+		return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
+
+	/* The loader gets the page size in the upper half of a5. */
+	if (!IS_PWR_OF_2(page_size) || page_size > 0xffff)
+		return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
+
+	unsigned int xlen = riscv_xlen(target);
+	const uint8_t *bin;
+	size_t bin_size;
+	if (xlen == 32) {
+		bin = riscv32_async_bin;
+		bin_size = sizeof(riscv32_async_bin);
+	} else {
+		bin = riscv64_async_bin;
+		bin_size = sizeof(riscv64_async_bin);
+	}
+
+	struct working_area *algorithm_wa;
+	if (target_alloc_working_area(target, bin_size, &algorithm_wa) != ERROR_OK)
+		return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
+
+	struct working_area *fifo_wa = NULL;
+	uint32_t fifo_size = MIN(target_get_working_area_avail(target), count + 8);
+	fifo_size &= ~3u;
+	if (fifo_size < 128 ||
+			target_alloc_working_area(target, fifo_size, &fifo_wa) != ERROR_OK) {
+		target_free_working_area(target, algorithm_wa);
+		return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
+	}
+
+	/* The FIFO pointers are 32 bits wide. */
+	int retval = ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
+	if (algorithm_wa->address + bin_size > UINT32_MAX ||
+			fifo_wa->address + fifo_size > UINT32_MAX)
+		goto out;
+
+	retval = target_write_buffer(target, algorithm_wa->address, bin_size, bin);
+	if (retval != ERROR_OK) {
+		LOG_ERROR("Failed to write code to " TARGET_ADDR_FMT ": %d",
+				algorithm_wa->address, retval);
+		goto out;
+	}
+
+	struct reg_param reg_params[6];
+	init_reg_param(&reg_params[0], "a0", xlen, PARAM_IN_OUT);
+	init_reg_param(&reg_params[1], "a1", xlen, PARAM_OUT);
+	init_reg_param(&reg_params[2], "a2", xlen, PARAM_OUT);
+	init_reg_param(&reg_params[3], "a3", xlen, PARAM_OUT);
+	init_reg_param(&reg_params[4], "a4", xlen, PARAM_OUT);
+	init_reg_param(&reg_params[5], "a5", xlen, PARAM_OUT);
+
+	buf_set_u64(reg_params[0].value, 0, xlen, fespi_info->ctrl_base);
+	buf_set_u64(reg_params[1].value, 0, xlen, fifo_wa->address);
+	buf_set_u64(reg_params[2].value, 0, xlen, fifo_wa->address + fifo_size);
+	buf_set_u64(reg_params[3].value, 0, xlen, offset);
+	buf_set_u64(reg_params[4].value, 0, xlen, count);
+	buf_set_u64(reg_params[5].value, 0, xlen,
+			fespi_info->dev->pprog_cmd | (bank->size > 0x1000000 ? 0x100 : 0) |
+			(page_size << 16));
+
+	LOG_DEBUG("async write(ctrl_base=0x%" TARGET_PRIxADDR ", page_size=0x%x, "
+			"fifo=0x%" TARGET_PRIxADDR ", fifo_size=0x%" PRIx32 ", offset=0x%" PRIx32
+			", count=0x%" PRIx32 ")",
+			fespi_info->ctrl_base, page_size, fifo_wa->address, fifo_size,
+			offset, count);
+
+	retval = target_run_flash_async_algorithm(target, buffer, count, 1,
+			0, NULL,
+			ARRAY_SIZE(reg_params), reg_params,
+			fifo_wa->address, fifo_size,
+			algorithm_wa->address, 0, NULL);
+	if (retval != ERROR_OK) {
+		LOG_ERROR("Failed to execute async algorithm at " TARGET_ADDR_FMT ": %d",
+				algorithm_wa->address, retval);
+	} else {
+		uint64_t algorithm_result = buf_get_u64(reg_params[0].value, 0, xlen);
+		if (algorithm_result != 0) {
+			LOG_ERROR("Algorithm returned error %" PRId64, algorithm_result);
+			retval = ERROR_FAIL;
+		}
+	}
+
+	for (unsigned int i = 0; i < ARRAY_SIZE(reg_params); i++)
+		destroy_reg_param(&reg_params[i]);
+
+	/* The loader may have been stopped before it could switch back. */
+	if (retval != ERROR_OK)
+		fespi_enable_hw_mode(bank);
+
+out:
+	target_free_working_area(target, fifo_wa);
+	target_free_working_area(target, algorithm_wa);
+	return retval;
+}
+
 static int fespi_write(struct flash_bank *bank, const uint8_t *buffer,
 		uint32_t offset, uint32_t count)
 {
@@ -518,6 +634,15 @@ static int fespi_write(struct flash_bank *bank, const uint8_t *buffer,
 		return ERROR_FAIL;
 	}
 
+	/* If no valid page_size, use reasonable default. */
+	page_size = fespi_info->dev->pagesize ?
+		fespi_info->dev->pagesize : SPIFLASH_DEF_PAGESIZE;
+
+	retval = fespi_write_async(bank, buffer, offset, count, page_size);
+	if (retval != ERROR_TARGET_RESOURCE_NOT_AVAILABLE)
+		return retval;
+	retval = ERROR_OK;
+
 	unsigned int xlen = riscv_xlen(target);
 	struct working_area *algorithm_wa = NULL;
 	struct working_area *data_wa = NULL;
@@ -557,10 +682,6 @@ static int fespi_write(struct flash_bank *bank, const uint8_t *buffer,
 		algorithm_wa = NULL;
 	}
 
-	/* If no valid page_size, use reasonable default. */
-	page_size = fespi_info->dev->pagesize ?
-		fespi_info->dev->pagesize : SPIFLASH_DEF_PAGESIZE;
-
 	if (algorithm_wa) {
 		struct reg_param reg_params[6];
 		init_reg_param(&reg_params[0], "a0", xlen, PARAM_IN_OUT);
@@ -0,0 +1,90 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+/*
+ * Encoding of the RISC-V DMI traces.
+ *
+ * A trace starts with the 8 bytes "RVDMITR\x01". Then each record is:
+ *   u64 timestamp: microseconds since the trace was started, when the
+ *       results of the scan were available
+ *   u32 batch latency: microseconds from queueing the batch the scan is in
+ *       to the results of the batch being available
+ *   u32 DMI address
+ *   u32 data shifted out
+ *   u32 data shifted in (the result of the previous operation)
+ *   u16 position of the TAP in the JTAG chain
+ *   u8  op shifted out (0 nop, 1 read, 2 write)
+ *   u8  op shifted in (0 success, 2 failed, 3 busy, 0xff not captured)
+ *   u8  delay class (0 DM access, 1 abstract command, 2 system bus read,
+ *       3 system bus write)
+ *   u8  reserved, 0
+ *   u16 Run-Test/Idle cycles after the scan, saturated
+ * All the multi-byte fields are little endian.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+
+#include "log.h"
+#include "types.h"
+#include "riscv_dmi_trace_format.h"
+
+#define RISCV_DMI_TRACE_VERSION		1
+
+const uint8_t riscv_dmi_trace_header[RISCV_DMI_TRACE_HEADER_SIZE] = {
+	'R', 'V', 'D', 'M', 'I', 'T', 'R', RISCV_DMI_TRACE_VERSION
+};
+
+void riscv_dmi_trace_encode(const struct riscv_dmi_trace_record *record,
+		uint8_t *out)
+{
+	h_u64_to_le(out, record->timestamp_us);
+	h_u32_to_le(out + 8, record->batch_latency_us);
+	h_u32_to_le(out + 12, record->address);
+	h_u32_to_le(out + 16, record->data_out);
+	h_u32_to_le(out + 20, record->data_in);
+	h_u16_to_le(out + 24, record->tap_position);
+	out[26] = record->op;
+	out[27] = record->status;
+	out[28] = record->delay_class;
+	out[29] = 0;
+	h_u16_to_le(out + 30, record->idle_cycles);
+}
+
+FILE *riscv_dmi_trace_open_read(const char *filename)
+{
+	FILE *file = fopen(filename, "rb");
+	if (!file) {
+		LOG_ERROR("Can't open %s for reading.", filename);
+		return NULL;
+	}
+	uint8_t header[RISCV_DMI_TRACE_HEADER_SIZE];
+	if (fread(header, 1, sizeof(header), file) != sizeof(header) ||
+			memcmp(header, riscv_dmi_trace_header, sizeof(header))) {
+		LOG_ERROR("%s is not a DMI trace (or has an unknown version).",
+				filename);
+		fclose(file);
+		return NULL;
+	}
+	return file;
+}
+
+bool riscv_dmi_trace_read(FILE *file, struct riscv_dmi_trace_record *record)
+{
+	uint8_t in[RISCV_DMI_TRACE_RECORD_SIZE];
+	if (fread(in, 1, sizeof(in), file) != sizeof(in))
+		return false;
+	record->timestamp_us = le_to_h_u64(in);
+	record->batch_latency_us = le_to_h_u32(in + 8);
+	record->address = le_to_h_u32(in + 12);
+	record->data_out = le_to_h_u32(in + 16);
+	record->data_in = le_to_h_u32(in + 20);
+	record->tap_position = le_to_h_u16(in + 24);
+	record->op = in[26];
+	record->status = in[27];
+	record->delay_class = in[28];
+	record->idle_cycles = le_to_h_u16(in + 30);
+	return true;
+}
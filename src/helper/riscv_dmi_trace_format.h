@@ -0,0 +1,60 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+
+#ifndef OPENOCD_HELPER_RISCV_DMI_TRACE_FORMAT_H
+#define OPENOCD_HELPER_RISCV_DMI_TRACE_FORMAT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/* Format of the RISC-V DMI traces written by `riscv dmi_trace` and replayed
+ * by the riscv_dmsim adapter driver. It lives here so the driver doesn't
+ * depend on the RISC-V target. */
+
+#define RISCV_DMI_TRACE_HEADER_SIZE	8
+#define RISCV_DMI_TRACE_RECORD_SIZE	32
+
+#define RISCV_DMI_TRACE_NOT_CAPTURED	0xff
+
+/* One DMI scan. */
+struct riscv_dmi_trace_record {
+	/* Host time the results of the scan were available at, in
+	 * microseconds since the trace was started. */
+	uint64_t timestamp_us;
+	/* From queueing the batch of the scan to the results of the whole batch
+	 * being available. The host can't tell when a single scan completed. */
+	uint32_t batch_latency_us;
+	uint32_t address;
+	uint32_t data_out;
+	/* What was captured while shifting this scan out, i.e. the result of
+	 * the previous operation. Only valid if "status" isn't
+	 * RISCV_DMI_TRACE_NOT_CAPTURED. */
+	uint32_t data_in;
+	/* Position of the TAP in the JTAG chain. */
+	uint16_t tap_position;
+	/* DTM_DMI_OP_NOP, DTM_DMI_OP_READ or DTM_DMI_OP_WRITE. */
+	uint8_t op;
+	/* The op field that was captured: DTM_DMI_OP_SUCCESS, DTM_DMI_OP_FAILED,
+	 * DTM_DMI_OP_BUSY or RISCV_DMI_TRACE_NOT_CAPTURED. */
+	uint8_t status;
+	/* enum riscv_scan_delay_class */
+	uint8_t delay_class;
+	/* Run-Test/Idle cycles after the scan, saturated. */
+	uint16_t idle_cycles;
+};
+
+/* What a trace starts with. */
+extern const uint8_t riscv_dmi_trace_header[RISCV_DMI_TRACE_HEADER_SIZE];
+
+/* Store "record" in the RISCV_DMI_TRACE_RECORD_SIZE bytes at "out". */
+void riscv_dmi_trace_encode(const struct riscv_dmi_trace_record *record,
+		uint8_t *out);
+
+/* Open a trace for reading and check its header. Returns NULL, after
+ * logging why, if it can't be read. */
+FILE *riscv_dmi_trace_open_read(const char *filename);
+
+/* Read the next record. Returns false at the end of the trace. */
+bool riscv_dmi_trace_read(FILE *file, struct riscv_dmi_trace_record *record);
+
+#endif /* OPENOCD_HELPER_RISCV_DMI_TRACE_FORMAT_H */
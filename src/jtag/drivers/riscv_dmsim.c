@@ -0,0 +1,1854 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+/*
+ * Simulator of a RISC-V Debug Transport Module and Debug Module (version
+ * 0.13), running inside OpenOCD behind a bit-banged JTAG TAP.
+ *
+ * It's meant for measuring and testing the RISC-V debug code without
+ * hardware: every run is deterministic, and the latency of the DMI, of
+ * abstract commands and of system bus reads and writes is configurable in
+ * TCK cycles, so busy responses and the learning of delays can be exercised
+ * on purpose.
+ *
+ * The simulated harts have a small RV32/RV64 IM interpreter, used for the
+ * program buffer, for single steps and for running code out of the
+ * simulated RAM, which is also accessible through the system bus.
+ * Running harts execute a configurable number of instructions per TCK
+ * cycle.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <jtag/interface.h>
+#include <helper/bits.h>
+#include <helper/riscv_dmi_trace_format.h>
+#include <target/riscv/debug_defines.h>
+#include <target/riscv/field_helpers.h>
+#include "bitbang.h"
+
+#define DMSIM_IR_LENGTH			5
+#define DMSIM_IR_BYPASS			0x1f
+#define DMSIM_ABITS			7
+#define DMSIM_MAX_HARTS			32
+#define DMSIM_MAX_PROGBUF		16
+#define DMSIM_MAX_DATA			12
+/* Where the program buffer appears to be, as seen by auipc. It's not
+ * accessible with loads and stores. */
+#define DMSIM_PROGBUF_ADDRESS		0xfffff000
+/* Upper bound of the instructions a program buffer may execute, in case it
+ * loops. */
+#define DMSIM_PROGBUF_MAX_STEPS		1024
+/* Upper bound of the instructions executed by a running hart between two
+ * DMI accesses. */
+#define DMSIM_RUN_MAX_STEPS		100000
+
+#define DMSIM_CSR_MISA			0x301
+#define DMSIM_CSR_MTVEC			0x305
+#define DMSIM_CSR_MEPC			0x341
+#define DMSIM_CSR_MCAUSE		0x342
+#define DMSIM_CSR_MTVAL			0x343
+#define DMSIM_CSR_MHARTID		0xf14
+
+#define DMSIM_CAUSE_INSN_ACCESS		1
+#define DMSIM_CAUSE_ILLEGAL_INSN	2
+#define DMSIM_CAUSE_BREAKPOINT		3
+#define DMSIM_CAUSE_LOAD_ACCESS		5
+#define DMSIM_CAUSE_STORE_ACCESS	7
+#define DMSIM_CAUSE_ECALL_M		11
+
+enum dmsim_delay_class {
+	DMSIM_DELAY_BASE,
+	DMSIM_DELAY_ABSTRACT,
+	DMSIM_DELAY_SYSBUS_READ,
+	DMSIM_DELAY_SYSBUS_WRITE,
+	DMSIM_DELAY_COUNT
+};
+
+static const char * const dmsim_delay_names[DMSIM_DELAY_COUNT] = {
+	[DMSIM_DELAY_BASE] = "base",
+	[DMSIM_DELAY_ABSTRACT] = "abstract",
+	[DMSIM_DELAY_SYSBUS_READ] = "sysbus_read",
+	[DMSIM_DELAY_SYSBUS_WRITE] = "sysbus_write",
+};
+
+struct dmsim_hart {
+	bool halted;
+	bool resumeack;
+	bool havereset;
+	bool resethaltreq;
+	uint64_t pc;
+	uint64_t x[32];
+	uint64_t csr[4096];
+};
+
+enum dmsim_exec_result {
+	DMSIM_EXEC_OK,
+	DMSIM_EXEC_EBREAK,
+	DMSIM_EXEC_EXCEPTION
+};
+
+struct dmsim_stats {
+	uint64_t dmi_ops;
+	uint64_t dmi_busy;
+	uint64_t abstract_commands;
+	uint64_t abstract_busy;
+	uint64_t sysbus_accesses;
+	uint64_t sysbus_busy;
+	uint64_t instructions;
+};
+
+static struct dmsim_state {
+	/* Configuration. */
+	unsigned int hart_count;
+	unsigned int xlen;
+	unsigned int progbufsize;
+	unsigned int datacount;
+	uint32_t idcode;
+	uint64_t mem_base;
+	uint64_t mem_size;
+	unsigned int latency[DMSIM_DELAY_COUNT];
+	unsigned int insns_per_cycle;
+
+	/* TAP. */
+	tap_state_t state;
+	int clock;
+	uint64_t cycle;
+	uint32_t ir;
+	uint64_t shift;
+	unsigned int shift_length;
+
+	/* DTM. */
+	bool dmi_busy;
+	bool dmi_failed;
+	uint64_t dmi_done_cycle;
+	uint32_t dmi_address;
+	uint32_t dmi_data;
+
+	/* DM. */
+	bool dmactive;
+	bool ndmreset;
+	bool hasel;
+	uint32_t hartsel;
+	uint32_t hawindow;
+	uint32_t data[DMSIM_MAX_DATA];
+	uint32_t progbuf[DMSIM_MAX_PROGBUF];
+	uint32_t command;
+	uint32_t abstractauto;
+	unsigned int cmderr;
+	uint64_t abstract_done_cycle;
+	uint32_t sbcs;
+	uint64_t sbaddress;
+	uint64_t sbdata;
+	uint64_t sb_done_cycle;
+
+	struct dmsim_hart *harts;
+	uint8_t *mem;
+	uint64_t run_cycle;
+
+	struct dmsim_stats stats;
+} sim = {
+	.hart_count = 1,
+	.xlen = 64,
+	.progbufsize = 16,
+	.datacount = 2,
+	.idcode = 0x10e31913,
+	.mem_base = 0x80000000,
+	.mem_size = 1024 * 1024,
+	.insns_per_cycle = 1,
+	.state = TAP_RESET,
+};
+
+static uint64_t xlen_mask(void)
+{
+	return sim.xlen == 64 ? UINT64_MAX : UINT32_MAX;
+}
+
+/* Value of a register as a signed number. */
+static int64_t xlen_signed(uint64_t value)
+{
+	return sim.xlen == 64 ? (int64_t)value : (int32_t)value;
+}
+
+/*** Memory ***/
+
+static bool mem_range_valid(uint64_t address, unsigned int size)
+{
+	return address >= sim.mem_base && address - sim.mem_base < sim.mem_size &&
+		sim.mem_size - (address - sim.mem_base) >= size;
+}
+
+static bool mem_read(uint64_t address, unsigned int size, uint64_t *value)
+{
+	if (!mem_range_valid(address, size))
+		return false;
+	const uint8_t *p = sim.mem + (address - sim.mem_base);
+	*value = 0;
+	for (unsigned int i = 0; i < size; i++)
+		*value |= (uint64_t)p[i] << (8 * i);
+	return true;
+}
+
+static bool mem_write(uint64_t address, unsigned int size, uint64_t value)
+{
+	if (!mem_range_valid(address, size))
+		return false;
+	uint8_t *p = sim.mem + (address - sim.mem_base);
+	for (unsigned int i = 0; i < size; i++)
+		p[i] = value >> (8 * i);
+	return true;
+}
+
+/*** Harts ***/
+
+static unsigned int hart_index(const struct dmsim_hart *hart)
+{
+	return hart - sim.harts;
+}
+
+static uint64_t csr_read(const struct dmsim_hart *hart, unsigned int csr)
+{
+	switch (csr) {
+	case DMSIM_CSR_MISA:
+		return (sim.xlen == 64 ? 2ULL << 62 : 1ULL << 30) |
+			BIT('I' - 'A') | BIT('M' - 'A');
+	case DMSIM_CSR_MHARTID:
+		return hart_index(hart);
+	case CSR_TSELECT:
+	case CSR_TDATA1:
+		/* No triggers. */
+		return 0;
+	default:
+		return hart->csr[csr];
+	}
+}
+
+static void csr_write(struct dmsim_hart *hart, unsigned int csr, uint64_t value)
+{
+	switch (csr) {
+	case DMSIM_CSR_MISA:
+	case DMSIM_CSR_MHARTID:
+	case CSR_TSELECT:
+	case CSR_TDATA1:
+		break;
+	case CSR_DCSR: {
+		const uint64_t writable = CSR_DCSR_EBREAKM | CSR_DCSR_EBREAKS |
+			CSR_DCSR_EBREAKU | CSR_DCSR_STEPIE | CSR_DCSR_STOPCOUNT |
+			CSR_DCSR_STOPTIME | CSR_DCSR_STEP | CSR_DCSR_PRV;
+		hart->csr[csr] = (hart->csr[csr] & ~writable) | (value & writable);
+		break;
+	}
+	default:
+		hart->csr[csr] = value & xlen_mask();
+		break;
+	}
+}
+
+static void hart_reset(struct dmsim_hart *hart)
+{
+	memset(hart->x, 0, sizeof(hart->x));
+	memset(hart->csr, 0, sizeof(hart->csr));
+	hart->csr[CSR_DCSR] = set_field(0, CSR_DCSR_DEBUGVER, CSR_DCSR_DEBUGVER_1_0) |
+		set_field(0, CSR_DCSR_PRV, 3);
+	hart->pc = sim.mem_base;
+	hart->halted = false;
+	hart->resumeack = false;
+	hart->havereset = true;
+}
+
+static void hart_halt(struct dmsim_hart *hart, unsigned int cause)
+{
+	hart->halted = true;
+	hart->csr[CSR_DCSR] = set_field(hart->csr[CSR_DCSR], CSR_DCSR_CAUSE, cause);
+	hart->csr[CSR_DPC] = hart->pc;
+}
+
+static void hart_trap(struct dmsim_hart *hart, unsigned int cause, uint64_t tval)
+{
+	hart->csr[DMSIM_CSR_MEPC] = hart->pc;
+	hart->csr[DMSIM_CSR_MCAUSE] = cause;
+	hart->csr[DMSIM_CSR_MTVAL] = tval & xlen_mask();
+	hart->pc = hart->csr[DMSIM_CSR_MTVEC] & ~3ULL;
+}
+
+static void set_x(struct dmsim_hart *hart, unsigned int rd, uint64_t value)
+{
+	if (rd)
+		hart->x[rd] = value & xlen_mask();
+}
+
+static int32_t imm_i(uint32_t insn)
+{
+	return (int32_t)insn >> 20;
+}
+
+static int32_t imm_s(uint32_t insn)
+{
+	return (((int32_t)insn >> 25) << 5) | ((insn >> 7) & 0x1f);
+}
+
+static int32_t imm_b(uint32_t insn)
+{
+	return (((int32_t)insn >> 31) << 12) | (((insn >> 7) & 1) << 11) |
+		(((insn >> 25) & 0x3f) << 5) | (((insn >> 8) & 0xf) << 1);
+}
+
+static int32_t imm_j(uint32_t insn)
+{
+	return (((int32_t)insn >> 31) << 20) | (((insn >> 12) & 0xff) << 12) |
+		(((insn >> 20) & 1) << 11) | (((insn >> 21) & 0x3ff) << 1);
+}
+
+static uint64_t alu(uint64_t a, uint64_t b, unsigned int funct3, bool alt,
+		bool word)
+{
+	const unsigned int shamt_mask = (word || sim.xlen == 32) ? 0x1f : 0x3f;
+	uint64_t result;
+	switch (funct3) {
+	case 0:
+		result = alt ? a - b : a + b;
+		break;
+	case 1:
+		result = a << (b & shamt_mask);
+		break;
+	case 2:
+		return xlen_signed(a) < xlen_signed(b);
+	case 3:
+		return a < b;
+	case 4:
+		result = a ^ b;
+		break;
+	case 5:
+		if (word)
+			result = alt ? (uint64_t)((int32_t)a >> (b & shamt_mask)) :
+				(uint32_t)a >> (b & shamt_mask);
+		else if (alt)
+			result = xlen_signed(a) >> (b & shamt_mask);
+		else
+			result = (a & xlen_mask()) >> (b & shamt_mask);
+		break;
+	case 6:
+		result = a | b;
+		break;
+	default:
+		result = a & b;
+		break;
+	}
+	if (word)
+		result = (uint64_t)(int32_t)result;
+	return result;
+}
+
+/* Upper 64 bits of the unsigned 128-bit product of "a" and "b", built from
+ * 32-bit halves so no 128-bit type is needed. */
+static uint64_t mulhu64(uint64_t a, uint64_t b)
+{
+	const uint64_t a_lo = (uint32_t)a, a_hi = a >> 32;
+	const uint64_t b_lo = (uint32_t)b, b_hi = b >> 32;
+	const uint64_t lo_lo = a_lo * b_lo;
+	const uint64_t hi_lo = a_hi * b_lo;
+	const uint64_t lo_hi = a_lo * b_hi;
+	const uint64_t hi_hi = a_hi * b_hi;
+	/* Sum of the middle partial products and the carry out of the low
+	 * word. It can't overflow: each term is less than 2^32. */
+	const uint64_t middle = (lo_lo >> 32) + (uint32_t)hi_lo + (uint32_t)lo_hi;
+	return hi_hi + (hi_lo >> 32) + (lo_hi >> 32) + (middle >> 32);
+}
+
+/* Upper 64 bits of the signed product. A negative operand in two's
+ * complement stands for its unsigned value minus 2^64, which takes the
+ * other operand off the upper half. */
+static uint64_t mulh64(int64_t a, int64_t b)
+{
+	uint64_t result = mulhu64(a, b);
+	if (a < 0)
+		result -= b;
+	if (b < 0)
+		result -= a;
+	return result;
+}
+
+/* Upper 64 bits of the product of signed "a" and unsigned "b". */
+static uint64_t mulhsu64(int64_t a, uint64_t b)
+{
+	uint64_t result = mulhu64(a, b);
+	if (a < 0)
+		result -= b;
+	return result;
+}
+
+static uint64_t muldiv(uint64_t a, uint64_t b, unsigned int funct3, bool word)
+{
+	const int64_t sa = word ? (int32_t)a : xlen_signed(a);
+	const int64_t sb = word ? (int32_t)b : xlen_signed(b);
+	const uint64_t ua = word ? (uint32_t)a : a & xlen_mask();
+	const uint64_t ub = word ? (uint32_t)b : b & xlen_mask();
+	const unsigned int bits = word ? 32 : sim.xlen;
+	uint64_t result;
+	switch (funct3) {
+	case 0:
+		result = ua * ub;
+		break;
+	case 1:
+		result = bits == 64 ? mulh64(sa, sb) : (uint64_t)((sa * sb) >> 32);
+		break;
+	case 2:
+		result = bits == 64 ? mulhsu64(sa, ub) :
+			(uint64_t)((sa * (int64_t)ub) >> 32);
+		break;
+	case 3:
+		result = bits == 64 ? mulhu64(ua, ub) : (ua * ub) >> 32;
+		break;
+	case 4:
+		if (sb == 0)
+			result = UINT64_MAX;
+		else if (sb == -1)
+			result = -(uint64_t)sa;
+		else
+			result = sa / sb;
+		break;
+	case 5:
+		result = ub == 0 ? UINT64_MAX : ua / ub;
+		break;
+	case 6:
+		if (sb == 0)
+			result = sa;
+		else if (sb == -1)
+			result = 0;
+		else
+			result = sa % sb;
+		break;
+	default:
+		result = ub == 0 ? ua : ua % ub;
+		break;
+	}
+	if (word)
+		result = (uint64_t)(int32_t)result;
+	return result;
+}
+
+/* Execute "insn" located at "pc". "next_pc" is set to the address of the
+ * next instruction. "cause" and "tval" are set on an exception. */
+static enum dmsim_exec_result execute(struct dmsim_hart *hart, uint32_t insn,
+		uint64_t pc, uint64_t *next_pc, unsigned int *cause, uint64_t *tval)
+{
+	const unsigned int opcode = insn & 0x7f;
+	const unsigned int rd = (insn >> 7) & 0x1f;
+	const unsigned int funct3 = (insn >> 12) & 7;
+	const unsigned int rs1 = (insn >> 15) & 0x1f;
+	const unsigned int rs2 = (insn >> 20) & 0x1f;
+	const unsigned int funct7 = insn >> 25;
+	const uint64_t a = hart->x[rs1];
+	const uint64_t b = hart->x[rs2];
+	const bool rv64 = sim.xlen == 64;
+
+	sim.stats.instructions++;
+	*next_pc = pc + 4;
+	*tval = 0;
+
+	switch (opcode) {
+	case 0x03: {	/* LOAD */
+		static const unsigned int sizes[8] = {1, 2, 4, 8, 1, 2, 4, 0};
+		const uint64_t address = (a + imm_i(insn)) & xlen_mask();
+		uint64_t value;
+		if (!sizes[funct3] || (funct3 == 3 && !rv64) || (funct3 == 6 && !rv64))
+			break;
+		if (!mem_read(address, sizes[funct3], &value)) {
+			*cause = DMSIM_CAUSE_LOAD_ACCESS;
+			*tval = address;
+			return DMSIM_EXEC_EXCEPTION;
+		}
+		if (funct3 == 0)
+			value = (int8_t)value;
+		else if (funct3 == 1)
+			value = (int16_t)value;
+		else if (funct3 == 2)
+			value = (int32_t)value;
+		set_x(hart, rd, value);
+		return DMSIM_EXEC_OK;
+	}
+	case 0x23: {	/* STORE */
+		const uint64_t address = (a + imm_s(insn)) & xlen_mask();
+		if (funct3 > 3 || (funct3 == 3 && !rv64))
+			break;
+		if (!mem_write(address, 1 << funct3, b)) {
+			*cause = DMSIM_CAUSE_STORE_ACCESS;
+			*tval = address;
+			return DMSIM_EXEC_EXCEPTION;
+		}
+		return DMSIM_EXEC_OK;
+	}
+	case 0x13:	/* OP-IMM */
+		set_x(hart, rd, alu(a, imm_i(insn), funct3,
+					funct3 == 5 && (insn & BIT(30)), false));
+		return DMSIM_EXEC_OK;
+	case 0x1b:	/* OP-IMM-32 */
+		if (!rv64 || (funct3 != 0 && funct3 != 1 && funct3 != 5))
+			break;
+		set_x(hart, rd, alu(a, imm_i(insn), funct3,
+					funct3 == 5 && (insn & BIT(30)), true));
+		return DMSIM_EXEC_OK;
+	case 0x33:	/* OP */
+		if (funct7 == 1)
+			set_x(hart, rd, muldiv(a, b, funct3, false));
+		else if (funct7 == 0 || (funct7 == 0x20 && (funct3 == 0 || funct3 == 5)))
+			set_x(hart, rd, alu(a, b, funct3, funct7 == 0x20, false));
+		else
+			break;
+		return DMSIM_EXEC_OK;
+	case 0x3b:	/* OP-32 */
+		if (!rv64)
+			break;
+		if (funct7 == 1 && (funct3 == 0 || funct3 >= 4))
+			set_x(hart, rd, muldiv(a, b, funct3, true));
+		else if ((funct7 == 0 && (funct3 == 0 || funct3 == 1 || funct3 == 5)) ||
+				(funct7 == 0x20 && (funct3 == 0 || funct3 == 5)))
+			set_x(hart, rd, alu(a, b, funct3, funct7 == 0x20, true));
+		else
+			break;
+		return DMSIM_EXEC_OK;
+	case 0x37:	/* LUI */
+		set_x(hart, rd, (int32_t)(insn & 0xfffff000));
+		return DMSIM_EXEC_OK;
+	case 0x17:	/* AUIPC */
+		set_x(hart, rd, pc + (int32_t)(insn & 0xfffff000));
+		return DMSIM_EXEC_OK;
+	case 0x6f:	/* JAL */
+		set_x(hart, rd, pc + 4);
+		*next_pc = (pc + imm_j(insn)) & xlen_mask();
+		return DMSIM_EXEC_OK;
+	case 0x67:	/* JALR */
+		if (funct3)
+			break;
+		*next_pc = (a + imm_i(insn)) & xlen_mask() & ~1ULL;
+		set_x(hart, rd, pc + 4);
+		return DMSIM_EXEC_OK;
+	case 0x63: {	/* BRANCH */
+		bool taken;
+		switch (funct3) {
+		case 0:
+			taken = a == b;
+			break;
+		case 1:
+			taken = a != b;
+			break;
+		case 4:
+			taken = xlen_signed(a) < xlen_signed(b);
+			break;
+		case 5:
+			taken = xlen_signed(a) >= xlen_signed(b);
+			break;
+		case 6:
+			taken = a < b;
+			break;
+		case 7:
+			taken = a >= b;
+			break;
+		default:
+			*cause = DMSIM_CAUSE_ILLEGAL_INSN;
+			*tval = insn;
+			return DMSIM_EXEC_EXCEPTION;
+		}
+		if (taken)
+			*next_pc = (pc + imm_b(insn)) & xlen_mask();
+		return DMSIM_EXEC_OK;
+	}
+	case 0x0f:	/* MISC-MEM: fence, fence.i */
+		return DMSIM_EXEC_OK;
+	case 0x73:	/* SYSTEM */
+		if (funct3 == 0) {
+			switch (insn) {
+			case 0x00100073:	/* ebreak */
+				return DMSIM_EXEC_EBREAK;
+			case 0x00000073:	/* ecall */
+				*cause = DMSIM_CAUSE_ECALL_M;
+				return DMSIM_EXEC_EXCEPTION;
+			case 0x30200073:	/* mret */
+				*next_pc = hart->csr[DMSIM_CSR_MEPC];
+				return DMSIM_EXEC_OK;
+			case 0x10500073:	/* wfi */
+				return DMSIM_EXEC_OK;
+			}
+			break;
+		}
+		if (funct3 == 4)
+			break;
+		{
+			const unsigned int csr = insn >> 20;
+			const uint64_t operand = (funct3 & 4) ? rs1 : a;
+			const uint64_t old = csr_read(hart, csr);
+			switch (funct3 & 3) {
+			case 1:
+				csr_write(hart, csr, operand);
+				break;
+			case 2:
+				if (rs1)
+					csr_write(hart, csr, old | operand);
+				break;
+			case 3:
+				if (rs1)
+					csr_write(hart, csr, old & ~operand);
+				break;
+			}
+			set_x(hart, rd, old);
+		}
+		return DMSIM_EXEC_OK;
+	}
+
+	*cause = DMSIM_CAUSE_ILLEGAL_INSN;
+	*tval = insn;
+	return DMSIM_EXEC_EXCEPTION;
+}
+
+/* Execute one instruction of a hart that isn't halted, or of one that is
+ * single stepping. Return true when the hart entered debug mode. */
+static bool hart_step(struct dmsim_hart *hart)
+{
+	uint64_t insn, next_pc, tval;
+	unsigned int cause;
+	if (!mem_read(hart->pc, 4, &insn)) {
+		hart_trap(hart, DMSIM_CAUSE_INSN_ACCESS, hart->pc);
+		return false;
+	}
+	switch (execute(hart, insn, hart->pc, &next_pc, &cause, &tval)) {
+	case DMSIM_EXEC_OK:
+		hart->pc = next_pc;
+		return false;
+	case DMSIM_EXEC_EBREAK:
+		if (hart->csr[CSR_DCSR] & CSR_DCSR_EBREAKM) {
+			hart_halt(hart, CSR_DCSR_CAUSE_EBREAK);
+			return true;
+		}
+		hart_trap(hart, DMSIM_CAUSE_BREAKPOINT, hart->pc);
+		return false;
+	default:
+		hart_trap(hart, cause, tval);
+		return false;
+	}
+}
+
+/* Let the running harts catch up with the TCK cycles that went by. */
+static void run_harts(void)
+{
+	const uint64_t cycles = sim.cycle - sim.run_cycle;
+	sim.run_cycle = sim.cycle;
+	if (!sim.insns_per_cycle)
+		return;
+	const uint64_t steps = MIN(cycles * sim.insns_per_cycle,
+			(uint64_t)DMSIM_RUN_MAX_STEPS);
+	for (unsigned int i = 0; i < sim.hart_count; i++) {
+		struct dmsim_hart *hart = &sim.harts[i];
+		for (uint64_t n = 0; n < steps && !hart->halted; n++)
+			hart_step(hart);
+	}
+}
+
+/* Execute the program buffer on a halted hart. */
+static enum dmsim_exec_result execute_progbuf(struct dmsim_hart *hart)
+{
+	uint64_t pc = DMSIM_PROGBUF_ADDRESS;
+	for (unsigned int n = 0; n < DMSIM_PROGBUF_MAX_STEPS; n++) {
+		const uint64_t index = (pc - DMSIM_PROGBUF_ADDRESS) / 4;
+		uint32_t insn;
+		if (pc % 4 != 0 || pc < DMSIM_PROGBUF_ADDRESS || index > sim.progbufsize)
+			return DMSIM_EXEC_EXCEPTION;
+		if (index == sim.progbufsize)
+			/* impebreak */
+			insn = 0x00100073;
+		else
+			insn = sim.progbuf[index];
+
+		uint64_t next_pc, tval;
+		unsigned int cause;
+		enum dmsim_exec_result result = execute(hart, insn, pc, &next_pc,
+				&cause, &tval);
+		if (result != DMSIM_EXEC_OK)
+			return result;
+		pc = next_pc;
+	}
+	return DMSIM_EXEC_EXCEPTION;
+}
+
+/*** Debug Module ***/
+
+static bool hart_selected(unsigned int index)
+{
+	if (index == sim.hartsel)
+		return true;
+	return sim.hasel && index < 32 && (sim.hawindow & BIT(index));
+}
+
+/* The one hart selected by hartsel, if it exists. */
+static struct dmsim_hart *current_hart(void)
+{
+	return sim.hartsel < sim.hart_count ? &sim.harts[sim.hartsel] : NULL;
+}
+
+static void dm_reset(void)
+{
+	sim.hasel = false;
+	sim.hartsel = 0;
+	sim.hawindow = 0;
+	memset(sim.data, 0, sizeof(sim.data));
+	memset(sim.progbuf, 0, sizeof(sim.progbuf));
+	sim.command = 0;
+	sim.abstractauto = 0;
+	sim.cmderr = 0;
+	sim.abstract_done_cycle = 0;
+	sim.sbcs = 0;
+	sim.sbaddress = 0;
+	sim.sbdata = 0;
+	sim.sb_done_cycle = 0;
+}
+
+static void reset_harts(void)
+{
+	for (unsigned int i = 0; i < sim.hart_count; i++) {
+		struct dmsim_hart *hart = &sim.harts[i];
+		hart_reset(hart);
+		if (hart->resethaltreq)
+			hart_halt(hart, CSR_DCSR_CAUSE_RESETHALTREQ);
+	}
+}
+
+static uint32_t read_dmstatus(void)
+{
+	bool any[5] = {false}, all[5] = {true, true, true, true, true};
+	enum { HALTED, RUNNING, NONEXISTENT, RESUMEACK, HAVERESET };
+
+	for (unsigned int i = 0; i < DMSIM_MAX_HARTS || i <= sim.hartsel; i++) {
+		if (!hart_selected(i))
+			continue;
+		bool state[5] = {false};
+		if (i >= sim.hart_count) {
+			state[NONEXISTENT] = true;
+		} else {
+			const struct dmsim_hart *hart = &sim.harts[i];
+			state[HALTED] = hart->halted;
+			state[RUNNING] = !hart->halted;
+			state[RESUMEACK] = hart->resumeack;
+			state[HAVERESET] = hart->havereset;
+		}
+		for (unsigned int s = 0; s < ARRAY_SIZE(state); s++) {
+			any[s] |= state[s];
+			all[s] &= state[s];
+		}
+		if (i >= DMSIM_MAX_HARTS)
+			break;
+	}
+
+	uint32_t dmstatus = set_field32(0, DM_DMSTATUS_VERSION, DM_DMSTATUS_VERSION_0_13) |
+		DM_DMSTATUS_AUTHENTICATED | DM_DMSTATUS_HASRESETHALTREQ |
+		DM_DMSTATUS_IMPEBREAK;
+	if (any[HALTED])
+		dmstatus |= DM_DMSTATUS_ANYHALTED;
+	if (all[HALTED])
+		dmstatus |= DM_DMSTATUS_ALLHALTED;
+	if (any[RUNNING])
+		dmstatus |= DM_DMSTATUS_ANYRUNNING;
+	if (all[RUNNING])
+		dmstatus |= DM_DMSTATUS_ALLRUNNING;
+	if (any[NONEXISTENT])
+		dmstatus |= DM_DMSTATUS_ANYNONEXISTENT;
+	if (all[NONEXISTENT])
+		dmstatus |= DM_DMSTATUS_ALLNONEXISTENT;
+	if (any[RESUMEACK])
+		dmstatus |= DM_DMSTATUS_ANYRESUMEACK;
+	if (all[RESUMEACK])
+		dmstatus |= DM_DMSTATUS_ALLRESUMEACK;
+	if (any[HAVERESET])
+		dmstatus |= DM_DMSTATUS_ANYHAVERESET;
+	if (all[HAVERESET])
+		dmstatus |= DM_DMSTATUS_ALLHAVERESET;
+	return dmstatus;
+}
+
+static void write_dmcontrol(uint32_t value)
+{
+	if (!get_field32(value, DM_DMCONTROL_DMACTIVE)) {
+		sim.dmactive = false;
+		dm_reset();
+		return;
+	}
+	sim.dmactive = true;
+
+	sim.hasel = get_field32(value, DM_DMCONTROL_HASEL);
+	/* Only hartsello is implemented. */
+	sim.hartsel = get_field32(value, DM_DMCONTROL_HARTSELLO);
+
+	const bool ndmreset = get_field32(value, DM_DMCONTROL_NDMRESET);
+	if (ndmreset && !sim.ndmreset)
+		reset_harts();
+	sim.ndmreset = ndmreset;
+
+	for (unsigned int i = 0; i < sim.hart_count; i++) {
+		if (!hart_selected(i))
+			continue;
+		struct dmsim_hart *hart = &sim.harts[i];
+		if (get_field32(value, DM_DMCONTROL_ACKHAVERESET))
+			hart->havereset = false;
+		if (get_field32(value, DM_DMCONTROL_SETRESETHALTREQ))
+			hart->resethaltreq = true;
+		if (get_field32(value, DM_DMCONTROL_CLRRESETHALTREQ))
+			hart->resethaltreq = false;
+
+		if (get_field32(value, DM_DMCONTROL_HALTREQ)) {
+			if (!hart->halted)
+				hart_halt(hart, CSR_DCSR_CAUSE_HALTREQ);
+		} else if (get_field32(value, DM_DMCONTROL_RESUMEREQ) && hart->halted) {
+			hart->halted = false;
+			hart->pc = hart->csr[CSR_DPC];
+			hart->resumeack = true;
+			if (hart->csr[CSR_DCSR] & CSR_DCSR_STEP) {
+				if (!hart_step(hart))
+					hart_halt(hart, CSR_DCSR_CAUSE_STEP);
+			}
+		}
+	}
+}
+
+static uint32_t read_dmcontrol(void)
+{
+	uint32_t value = 0;
+	if (sim.dmactive)
+		value |= DM_DMCONTROL_DMACTIVE;
+	if (sim.ndmreset)
+		value |= DM_DMCONTROL_NDMRESET;
+	if (sim.hasel)
+		value |= DM_DMCONTROL_HASEL;
+	return set_field32(value, DM_DMCONTROL_HARTSELLO, sim.hartsel);
+}
+
+static bool abstract_busy(void)
+{
+	return sim.cycle < sim.abstract_done_cycle;
+}
+
+static void abstract_set_cmderr(unsigned int cmderr)
+{
+	if (!sim.cmderr)
+		sim.cmderr = cmderr;
+}
+
+/* Check for an access to an abstract command register while a command is
+ * running. */
+static bool abstract_access_ok(void)
+{
+	if (!abstract_busy())
+		return true;
+	sim.stats.abstract_busy++;
+	abstract_set_cmderr(DM_ABSTRACTCS_CMDERR_BUSY);
+	return false;
+}
+
+static uint64_t abstract_arg(unsigned int size_bits)
+{
+	uint64_t value = sim.data[0];
+	if (size_bits > 32)
+		value |= (uint64_t)sim.data[1] << 32;
+	return value;
+}
+
+static void abstract_set_arg(unsigned int size_bits, uint64_t value)
+{
+	sim.data[0] = value;
+	if (size_bits > 32)
+		sim.data[1] = value >> 32;
+}
+
+static void execute_command(void)
+{
+	if (sim.cmderr)
+		return;
+	sim.stats.abstract_commands++;
+	sim.abstract_done_cycle = sim.cycle + sim.latency[DMSIM_DELAY_ABSTRACT];
+
+	struct dmsim_hart *hart = current_hart();
+	if (!hart || !hart->halted) {
+		abstract_set_cmderr(DM_ABSTRACTCS_CMDERR_HALT_RESUME);
+		return;
+	}
+	if (get_field32(sim.command, DM_COMMAND_CMDTYPE) != 0) {
+		/* Only Access Register is implemented. */
+		abstract_set_cmderr(DM_ABSTRACTCS_CMDERR_NOT_SUPPORTED);
+		return;
+	}
+
+	const uint32_t command = sim.command;
+	const unsigned int aarsize = get_field32(command, AC_ACCESS_REGISTER_AARSIZE);
+	const unsigned int regno = get_field32(command, AC_ACCESS_REGISTER_REGNO);
+	if (get_field32(command, AC_ACCESS_REGISTER_TRANSFER)) {
+		const unsigned int size_bits = 8 << aarsize;
+		if (size_bits > sim.xlen || size_bits < 32) {
+			abstract_set_cmderr(DM_ABSTRACTCS_CMDERR_NOT_SUPPORTED);
+			return;
+		}
+		const bool write = get_field32(command, AC_ACCESS_REGISTER_WRITE);
+		if (regno < 0x1000) {
+			if (write)
+				csr_write(hart, regno, abstract_arg(size_bits));
+			else
+				abstract_set_arg(size_bits, csr_read(hart, regno));
+		} else if (regno < 0x1020) {
+			if (write)
+				set_x(hart, regno - 0x1000, abstract_arg(size_bits));
+			else
+				abstract_set_arg(size_bits, hart->x[regno - 0x1000]);
+		} else {
+			abstract_set_cmderr(DM_ABSTRACTCS_CMDERR_EXCEPTION);
+			return;
+		}
+	}
+
+	if (get_field32(command, AC_ACCESS_REGISTER_AARPOSTINCREMENT))
+		sim.command = set_field32(command, AC_ACCESS_REGISTER_REGNO, regno + 1);
+
+	if (get_field32(command, AC_ACCESS_REGISTER_POSTEXEC) &&
+			execute_progbuf(hart) != DMSIM_EXEC_EBREAK)
+		abstract_set_cmderr(DM_ABSTRACTCS_CMDERR_EXCEPTION);
+}
+
+static void maybe_autoexec_data(unsigned int index)
+{
+	if (get_field32(sim.abstractauto, DM_ABSTRACTAUTO_AUTOEXECDATA) & BIT(index))
+		execute_command();
+}
+
+static void maybe_autoexec_progbuf(unsigned int index)
+{
+	if (get_field32(sim.abstractauto, DM_ABSTRACTAUTO_AUTOEXECPROGBUF) & BIT(index))
+		execute_command();
+}
+
+static unsigned int sb_access_bytes(void)
+{
+	return 1 << get_field32(sim.sbcs, DM_SBCS_SBACCESS);
+}
+
+static bool sb_busy(void)
+{
+	return sim.cycle < sim.sb_done_cycle;
+}
+
+/* Check whether a system bus access may start now. */
+static bool sb_access_ok(void)
+{
+	if (get_field32(sim.sbcs, DM_SBCS_SBBUSYERROR) || get_field32(sim.sbcs, DM_SBCS_SBERROR))
+		return false;
+	if (sb_busy()) {
+		sim.stats.sysbus_busy++;
+		sim.sbcs = set_field32(sim.sbcs, DM_SBCS_SBBUSYERROR, 1);
+		return false;
+	}
+	return true;
+}
+
+static void sb_access(bool write)
+{
+	const unsigned int size = sb_access_bytes();
+	sim.stats.sysbus_accesses++;
+	sim.sb_done_cycle = sim.cycle + sim.latency[write ? DMSIM_DELAY_SYSBUS_WRITE :
+		DMSIM_DELAY_SYSBUS_READ];
+	if (size > sim.xlen / 8) {
+		sim.sbcs = set_field32(sim.sbcs, DM_SBCS_SBERROR, DM_SBCS_SBERROR_SIZE);
+		return;
+	}
+	if (sim.sbaddress % size) {
+		sim.sbcs = set_field32(sim.sbcs, DM_SBCS_SBERROR, DM_SBCS_SBERROR_ALIGNMENT);
+		return;
+	}
+	bool ok;
+	if (write) {
+		ok = mem_write(sim.sbaddress, size, sim.sbdata);
+	} else {
+		uint64_t value;
+		ok = mem_read(sim.sbaddress, size, &value);
+		if (ok)
+			sim.sbdata = value;
+	}
+	if (!ok) {
+		sim.sbcs = set_field32(sim.sbcs, DM_SBCS_SBERROR, DM_SBCS_SBERROR_ADDRESS);
+		return;
+	}
+	if (get_field32(sim.sbcs, DM_SBCS_SBAUTOINCREMENT))
+		sim.sbaddress = (sim.sbaddress + size) & xlen_mask();
+}
+
+static uint32_t read_sbcs(void)
+{
+	uint32_t sbcs = sim.sbcs & (DM_SBCS_SBBUSYERROR | DM_SBCS_SBREADONADDR |
+			DM_SBCS_SBACCESS | DM_SBCS_SBAUTOINCREMENT | DM_SBCS_SBREADONDATA |
+			DM_SBCS_SBERROR);
+	sbcs = set_field32(sbcs, DM_SBCS_SBVERSION, 1);
+	sbcs = set_field32(sbcs, DM_SBCS_SBASIZE, sim.xlen);
+	sbcs |= DM_SBCS_SBACCESS32 | DM_SBCS_SBACCESS16 | DM_SBCS_SBACCESS8;
+	if (sim.xlen == 64)
+		sbcs |= DM_SBCS_SBACCESS64;
+	if (sb_busy())
+		sbcs |= DM_SBCS_SBBUSY;
+	return sbcs;
+}
+
+static void write_sbcs(uint32_t value)
+{
+	const uint32_t writable = DM_SBCS_SBREADONADDR | DM_SBCS_SBACCESS |
+		DM_SBCS_SBAUTOINCREMENT | DM_SBCS_SBREADONDATA;
+	uint32_t sbcs = (sim.sbcs & ~writable) | (value & writable);
+	/* Both error fields are write 1 to clear. */
+	if (get_field32(value, DM_SBCS_SBBUSYERROR))
+		sbcs = set_field32(sbcs, DM_SBCS_SBBUSYERROR, 0);
+	sbcs = set_field32(sbcs, DM_SBCS_SBERROR, get_field32(sbcs, DM_SBCS_SBERROR) &
+			~get_field32(value, DM_SBCS_SBERROR));
+	sim.sbcs = sbcs;
+}
+
+static uint32_t dm_read(uint32_t address)
+{
+	if (address >= DM_DATA0 && address < DM_DATA0 + sim.datacount) {
+		const unsigned int index = address - DM_DATA0;
+		if (!abstract_access_ok())
+			return sim.data[index];
+		const uint32_t value = sim.data[index];
+		maybe_autoexec_data(index);
+		return value;
+	}
+	if (address >= DM_PROGBUF0 && address < DM_PROGBUF0 + sim.progbufsize) {
+		const unsigned int index = address - DM_PROGBUF0;
+		if (!abstract_access_ok())
+			return sim.progbuf[index];
+		const uint32_t value = sim.progbuf[index];
+		maybe_autoexec_progbuf(index);
+		return value;
+	}
+
+	switch (address) {
+	case DM_DMCONTROL:
+		return read_dmcontrol();
+	case DM_DMSTATUS:
+		return read_dmstatus();
+	case DM_HARTINFO:
+		return set_field32(0, DM_HARTINFO_NSCRATCH, 1);
+	case DM_HALTSUM0: {
+		const unsigned int base = sim.hartsel & ~0x1fU;
+		uint32_t value = 0;
+		for (unsigned int i = 0; i < 32 && base + i < sim.hart_count; i++)
+			if (sim.harts[base + i].halted)
+				value |= BIT(i);
+		return value;
+	}
+	case DM_HALTSUM1: {
+		uint32_t value = 0;
+		for (unsigned int i = 0; i < sim.hart_count; i++)
+			if (sim.harts[i].halted)
+				value |= BIT(i / 32);
+		return value;
+	}
+	case DM_HAWINDOWSEL:
+		return 0;
+	case DM_HAWINDOW:
+		return sim.hawindow;
+	case DM_ABSTRACTCS: {
+		uint32_t value = set_field32(0, DM_ABSTRACTCS_PROGBUFSIZE, sim.progbufsize);
+		value = set_field32(value, DM_ABSTRACTCS_DATACOUNT, sim.datacount);
+		value = set_field32(value, DM_ABSTRACTCS_CMDERR, sim.cmderr);
+		if (abstract_busy())
+			value |= DM_ABSTRACTCS_BUSY;
+		return value;
+	}
+	case DM_ABSTRACTAUTO:
+		return sim.abstractauto;
+	case DM_SBCS:
+		return read_sbcs();
+	case DM_SBADDRESS0:
+		return sim.sbaddress;
+	case DM_SBADDRESS1:
+		return sim.xlen == 64 ? sim.sbaddress >> 32 : 0;
+	case DM_SBDATA0: {
+		if (!sb_access_ok())
+			return sim.sbdata;
+		const uint32_t value = sim.sbdata;
+		if (get_field32(sim.sbcs, DM_SBCS_SBREADONDATA))
+			sb_access(false);
+		return value;
+	}
+	case DM_SBDATA1:
+		return sim.sbdata >> 32;
+	default:
+		return 0;
+	}
+}
+
+static void dm_write(uint32_t address, uint32_t value)
+{
+	if (address != DM_DMCONTROL && !sim.dmactive)
+		return;
+
+	if (address >= DM_DATA0 && address < DM_DATA0 + sim.datacount) {
+		const unsigned int index = address - DM_DATA0;
+		if (!abstract_access_ok())
+			return;
+		sim.data[index] = value;
+		maybe_autoexec_data(index);
+		return;
+	}
+	if (address >= DM_PROGBUF0 && address < DM_PROGBUF0 + sim.progbufsize) {
+		const unsigned int index = address - DM_PROGBUF0;
+		if (!abstract_access_ok())
+			return;
+		sim.progbuf[index] = value;
+		maybe_autoexec_progbuf(index);
+		return;
+	}
+
+	switch (address) {
+	case DM_DMCONTROL:
+		write_dmcontrol(value);
+		break;
+	case DM_HAWINDOW:
+		sim.hawindow = value;
+		break;
+	case DM_ABSTRACTCS:
+		if (abstract_busy()) {
+			abstract_access_ok();
+			break;
+		}
+		sim.cmderr &= ~get_field32(value, DM_ABSTRACTCS_CMDERR);
+		break;
+	case DM_COMMAND:
+		if (!abstract_access_ok())
+			break;
+		sim.command = value;
+		execute_command();
+		break;
+	case DM_ABSTRACTAUTO:
+		if (!abstract_access_ok())
+			break;
+		sim.abstractauto = value & (DM_ABSTRACTAUTO_AUTOEXECPROGBUF |
+				DM_ABSTRACTAUTO_AUTOEXECDATA);
+		break;
+	case DM_SBCS:
+		write_sbcs(value);
+		break;
+	case DM_SBADDRESS0:
+		if (!sb_access_ok())
+			break;
+		sim.sbaddress = (sim.sbaddress & ~(uint64_t)UINT32_MAX) | value;
+		if (get_field32(sim.sbcs, DM_SBCS_SBREADONADDR))
+			sb_access(false);
+		break;
+	case DM_SBADDRESS1:
+		if (sim.xlen == 64 && sb_access_ok())
+			sim.sbaddress = (sim.sbaddress & UINT32_MAX) | (uint64_t)value << 32;
+		break;
+	case DM_SBDATA0:
+		if (!sb_access_ok())
+			break;
+		sim.sbdata = (sim.sbdata & ~(uint64_t)UINT32_MAX) | value;
+		sb_access(true);
+		break;
+	case DM_SBDATA1:
+		if (sb_access_ok())
+			sim.sbdata = (sim.sbdata & UINT32_MAX) | (uint64_t)value << 32;
+		break;
+	}
+}
+
+/*** DTM and TAP ***/
+
+static unsigned int dr_length(void)
+{
+	switch (sim.ir) {
+	case DTM_IDCODE:
+	case DTM_DTMCS:
+		return 32;
+	case DTM_DMI:
+		return DMSIM_ABITS + DTM_DMI_DATA_LENGTH + DTM_DMI_OP_LENGTH;
+	default:
+		return 1;
+	}
+}
+
+static void capture_dr(void)
+{
+	sim.shift_length = dr_length();
+	switch (sim.ir) {
+	case DTM_IDCODE:
+		sim.shift = sim.idcode;
+		break;
+	case DTM_DTMCS: {
+		unsigned int dmistat = 0;
+		if (sim.dmi_busy)
+			dmistat = DTM_DMI_OP_BUSY;
+		else if (sim.dmi_failed)
+			dmistat = DTM_DMI_OP_FAILED;
+		sim.shift = set_field32(0, DTM_DTMCS_VERSION, DTM_DTMCS_VERSION_1_0) |
+			set_field32(0, DTM_DTMCS_ABITS, DMSIM_ABITS) |
+			set_field32(0, DTM_DTMCS_DMISTAT, dmistat);
+		break;
+	}
+	case DTM_DMI: {
+		if (!sim.dmi_busy && sim.cycle < sim.dmi_done_cycle) {
+			/* The previous operation is still in progress. */
+			sim.dmi_busy = true;
+			sim.stats.dmi_busy++;
+		}
+		unsigned int op = DTM_DMI_OP_SUCCESS;
+		if (sim.dmi_busy)
+			op = DTM_DMI_OP_BUSY;
+		else if (sim.dmi_failed)
+			op = DTM_DMI_OP_FAILED;
+		sim.shift = op | (uint64_t)sim.dmi_data << DTM_DMI_DATA_OFFSET |
+			(uint64_t)sim.dmi_address << DTM_DMI_ADDRESS_OFFSET;
+		break;
+	}
+	default:
+		sim.shift = 0;
+		break;
+	}
+}
+
+/* Start a DMI operation that the DTM accepted. */
+static void dmi_execute(unsigned int op, uint32_t address, uint32_t data)
+{
+	run_harts();
+	sim.stats.dmi_ops++;
+	sim.dmi_address = address;
+	if (op == DTM_DMI_OP_READ) {
+		sim.dmi_data = dm_read(address);
+	} else if (op == DTM_DMI_OP_WRITE) {
+		dm_write(address, data);
+		sim.dmi_data = data;
+	} else {
+		sim.dmi_failed = true;
+	}
+	sim.dmi_done_cycle = sim.cycle + sim.latency[DMSIM_DELAY_BASE];
+}
+
+static void update_dr(void)
+{
+	switch (sim.ir) {
+	case DTM_DTMCS:
+		if (get_field(sim.shift, DTM_DTMCS_DMIRESET) ||
+				get_field(sim.shift, DTM_DTMCS_DTMHARDRESET)) {
+			sim.dmi_busy = false;
+			sim.dmi_failed = false;
+		}
+		if (get_field(sim.shift, DTM_DTMCS_DTMHARDRESET))
+			sim.dmi_done_cycle = 0;
+		break;
+	case DTM_DMI: {
+		if (sim.dmi_busy || sim.dmi_failed)
+			/* Ignored until dmireset. */
+			break;
+		const unsigned int op = get_field(sim.shift, DTM_DMI_OP);
+		if (op == DTM_DMI_OP_NOP)
+			break;
+		const uint32_t address = (sim.shift >> DTM_DMI_ADDRESS_OFFSET) &
+			(BIT(DMSIM_ABITS) - 1);
+		dmi_execute(op, address, get_field(sim.shift, DTM_DMI_DATA));
+		break;
+	}
+	default:
+		break;
+	}
+}
+
+static bb_value_t dmsim_read(void)
+{
+	return (sim.shift & 1) ? BB_HIGH : BB_LOW;
+}
+
+static int dmsim_write(int tck, int tms, int tdi)
+{
+	/* TAP standard: "state transitions occur on rising edge of clock" */
+	if (tck == sim.clock)
+		return ERROR_OK;
+	sim.clock = tck;
+	if (!tck)
+		return ERROR_OK;
+
+	sim.cycle++;
+	if (sim.state == TAP_DRSHIFT || sim.state == TAP_IRSHIFT) {
+		sim.shift >>= 1;
+		if (tdi)
+			sim.shift |= 1ULL << (sim.shift_length - 1);
+	}
+
+	const tap_state_t old_state = sim.state;
+	sim.state = tap_state_transition(old_state, tms);
+	if (sim.state == old_state)
+		return ERROR_OK;
+
+	switch (sim.state) {
+	case TAP_RESET:
+		sim.ir = DTM_IDCODE;
+		break;
+	case TAP_IRCAPTURE:
+		sim.shift = 1;
+		sim.shift_length = DMSIM_IR_LENGTH;
+		break;
+	case TAP_IRUPDATE:
+		sim.ir = sim.shift & (BIT(DMSIM_IR_LENGTH) - 1);
+		break;
+	case TAP_DRCAPTURE:
+		capture_dr();
+		break;
+	case TAP_DRUPDATE:
+		update_dr();
+		break;
+	default:
+		break;
+	}
+	return ERROR_OK;
+}
+
+static int dmsim_reset(int trst, int srst)
+{
+	sim.clock = 0;
+
+	if (trst || (srst && (jtag_get_reset_config() & RESET_SRST_PULLS_TRST))) {
+		sim.state = TAP_RESET;
+		sim.ir = DTM_IDCODE;
+	}
+	if (srst && sim.harts)
+		reset_harts();
+	return ERROR_OK;
+}
+
+static int dmsim_led(int on)
+{
+	return ERROR_OK;
+}
+
+static struct bitbang_interface dmsim_bitbang = {
+	.read = &dmsim_read,
+	.write = &dmsim_write,
+	.blink = &dmsim_led,
+};
+
+static int dmsim_khz(int khz, int *jtag_speed)
+{
+	*jtag_speed = khz;
+	return ERROR_OK;
+}
+
+static int dmsim_speed_div(int speed, int *khz)
+{
+	*khz = speed;
+	return ERROR_OK;
+}
+
+static int dmsim_speed(int speed)
+{
+	return ERROR_OK;
+}
+
+static int dmsim_init(void)
+{
+	sim.harts = calloc(sim.hart_count, sizeof(*sim.harts));
+	sim.mem = calloc(1, sim.mem_size);
+	if (!sim.harts || !sim.mem) {
+		LOG_ERROR("Failed to allocate the simulated harts and memory.");
+		free(sim.harts);
+		sim.harts = NULL;
+		free(sim.mem);
+		sim.mem = NULL;
+		return ERROR_FAIL;
+	}
+	for (unsigned int i = 0; i < sim.hart_count; i++)
+		hart_reset(&sim.harts[i]);
+	dm_reset();
+	sim.ir = DTM_IDCODE;
+
+	bitbang_interface = &dmsim_bitbang;
+	LOG_INFO("RISC-V DM simulator: %u RV%u harts, %" PRIu64 " bytes of RAM at 0x%"
+			PRIx64, sim.hart_count, sim.xlen, sim.mem_size, sim.mem_base);
+	return ERROR_OK;
+}
+
+static int dmsim_quit(void)
+{
+	free(sim.harts);
+	sim.harts = NULL;
+	free(sim.mem);
+	sim.mem = NULL;
+	return ERROR_OK;
+}
+
+/*** Replay of a DMI trace ***/
+
+/* TCK cycles of a DMI scan from Run-Test/Idle to Capture-DR, and from the
+ * end of the shift to Update-DR. */
+#define DMSIM_REPLAY_CAPTURE_CYCLES	2
+#define DMSIM_REPLAY_UPDATE_CYCLES	2
+/* Mismatches that are logged one by one. */
+#define DMSIM_REPLAY_MAX_LOGGED		20
+
+/* How the operations of one kind (read or write of one DM register) went in
+ * the simulated DM. */
+struct dmsim_replay_timing {
+	uint64_t operations;
+	/* Operations that got a busy response from the simulated DTM. */
+	uint64_t busy;
+	/* Operations the target accepted, which the simulator executed, and the
+	 * TCK cycles from shifting them in until the DM was done with them,
+	 * including the abstract command or system bus access they started. */
+	uint64_t executed;
+	uint64_t cycles;
+	uint64_t max_cycles;
+};
+
+struct dmsim_replay {
+	uint64_t records;
+	/* Timestamp of the JTAG queue execution being replayed. */
+	uint64_t timestamp_us;
+	/* The last read or write, until the next scan returns its result. */
+	bool pending;
+	struct riscv_dmi_trace_record op;
+	uint64_t op_record;
+	/* Cycle the operation was shifted in at. */
+	uint64_t op_cycle;
+	/* The simulated DTM was still busy when the operation was shifted in. */
+	bool op_busy;
+
+	uint64_t operations;
+	uint64_t status_mismatches;
+	uint64_t reads;
+	uint64_t data_mismatches;
+
+	/* Indexed by op - DTM_DMI_OP_READ and by DM register address. */
+	struct dmsim_replay_timing timing[2][BIT(DMSIM_ABITS)];
+};
+
+static const char *replay_status_name(unsigned int status)
+{
+	switch (status) {
+	case DTM_DMI_OP_SUCCESS:
+		return "success";
+	case DTM_DMI_OP_FAILED:
+		return "failed";
+	case DTM_DMI_OP_BUSY:
+		return "busy";
+	default:
+		return "?";
+	}
+}
+
+/* "record" holds what the DTM returned for the pending operation. The
+ * simulator follows the recording: the operation is executed if the target
+ * accepted it, whatever the simulated DTM would have answered. */
+static void replay_result(struct dmsim_replay *replay,
+		const struct riscv_dmi_trace_record *record)
+{
+	const struct riscv_dmi_trace_record *op = &replay->op;
+	if (op->address >= BIT(DMSIM_ABITS))
+		/* Another DM behind the same DTM. */
+		return;
+
+	const uint64_t capture_cycle = sim.cycle;
+	bool busy = replay->op_busy;
+	struct dmsim_replay_timing *timing =
+		&replay->timing[op->op - DTM_DMI_OP_READ][op->address];
+	timing->operations++;
+	if (record->status == DTM_DMI_OP_SUCCESS ||
+			record->status == RISCV_DMI_TRACE_NOT_CAPTURED) {
+		sim.cycle = replay->op_cycle;
+		const uint64_t abstract_done_cycle = sim.abstract_done_cycle;
+		const uint64_t sb_done_cycle = sim.sb_done_cycle;
+		dmi_execute(op->op, op->address, op->data_out);
+		uint64_t done_cycle = sim.dmi_done_cycle;
+		if (sim.abstract_done_cycle != abstract_done_cycle)
+			done_cycle = MAX(done_cycle, sim.abstract_done_cycle);
+		if (sim.sb_done_cycle != sb_done_cycle)
+			done_cycle = MAX(done_cycle, sim.sb_done_cycle);
+		const uint64_t cycles = done_cycle - replay->op_cycle;
+		timing->executed++;
+		timing->cycles += cycles;
+		timing->max_cycles = MAX(timing->max_cycles, cycles);
+		sim.cycle = capture_cycle;
+		busy |= capture_cycle < sim.dmi_done_cycle;
+	}
+	if (busy)
+		timing->busy++;
+	if (record->status == RISCV_DMI_TRACE_NOT_CAPTURED)
+		return;
+
+	replay->operations++;
+	const unsigned int status = busy ? DTM_DMI_OP_BUSY : DTM_DMI_OP_SUCCESS;
+	if (status != record->status) {
+		if (replay->status_mismatches + replay->data_mismatches <
+				DMSIM_REPLAY_MAX_LOGGED)
+			LOG_INFO("record %" PRIu64 ": %s of 0x%" PRIx32 " returned %s, "
+					"simulated %s", replay->op_record,
+					op->op == DTM_DMI_OP_READ ? "read" : "write", op->address,
+					replay_status_name(record->status),
+					replay_status_name(status));
+		replay->status_mismatches++;
+		return;
+	}
+	if (op->op != DTM_DMI_OP_READ || status != DTM_DMI_OP_SUCCESS)
+		return;
+	replay->reads++;
+	if (sim.dmi_data != record->data_in) {
+		if (replay->status_mismatches + replay->data_mismatches <
+				DMSIM_REPLAY_MAX_LOGGED)
+			LOG_INFO("record %" PRIu64 ": read of 0x%" PRIx32 " returned 0x%08"
+					PRIx32 ", simulated 0x%08" PRIx32, replay->op_record,
+					op->address, record->data_in, sim.dmi_data);
+		replay->data_mismatches++;
+	}
+}
+
+static void replay_record(struct dmsim_replay *replay,
+		const struct riscv_dmi_trace_record *record)
+{
+	/* Between two JTAG queue executions the host spends far more time
+	 * than the DTM needs to finish an operation. */
+	if (record->timestamp_us != replay->timestamp_us) {
+		replay->timestamp_us = record->timestamp_us;
+		sim.cycle = MAX(sim.cycle, sim.dmi_done_cycle);
+	}
+
+	sim.cycle += DMSIM_REPLAY_CAPTURE_CYCLES;
+	if (replay->pending) {
+		replay->pending = false;
+		replay_result(replay, record);
+	}
+	const bool busy = sim.cycle < sim.dmi_done_cycle;
+	sim.cycle += dr_length() + DMSIM_REPLAY_UPDATE_CYCLES;
+	if (record->op == DTM_DMI_OP_READ || record->op == DTM_DMI_OP_WRITE) {
+		replay->pending = true;
+		replay->op = *record;
+		replay->op_record = replay->records;
+		replay->op_cycle = sim.cycle;
+		replay->op_busy = busy;
+	}
+	sim.cycle += record->idle_cycles;
+	replay->records++;
+}
+
+COMMAND_HANDLER(dmsim_handle_replay_command)
+{
+	if (CMD_ARGC < 1 || CMD_ARGC > 2)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+	if (!sim.harts) {
+		command_print(CMD, "The simulator isn't initialized yet.");
+		return ERROR_FAIL;
+	}
+	unsigned int tap_position = 0;
+	bool tap_known = CMD_ARGC == 2;
+	if (tap_known)
+		COMMAND_PARSE_NUMBER(uint, CMD_ARGV[1], tap_position);
+
+	FILE *file = riscv_dmi_trace_open_read(CMD_ARGV[0]);
+	if (!file)
+		return ERROR_FAIL;
+
+	struct dmsim_replay *replay = calloc(1, sizeof(*replay));
+	/* Replay on a simulator of its own, with the same configuration, so the
+	 * DM and the harts a target may be using are left alone. */
+	const struct dmsim_state saved = sim;
+	sim.harts = calloc(sim.hart_count, sizeof(*sim.harts));
+	sim.mem = calloc(1, sim.mem_size);
+	if (!replay || !sim.harts || !sim.mem) {
+		LOG_ERROR("Failed to allocate the replay simulator.");
+		free(sim.harts);
+		free(sim.mem);
+		sim = saved;
+		free(replay);
+		fclose(file);
+		return ERROR_FAIL;
+	}
+
+	/* The trace is expected to start with the DM and the harts out of
+	 * reset, as when `riscv dmi_trace` was run before `init`. */
+	for (unsigned int i = 0; i < sim.hart_count; i++)
+		hart_reset(&sim.harts[i]);
+	dm_reset();
+	sim.dmactive = false;
+	sim.ndmreset = false;
+	sim.dmi_busy = false;
+	sim.dmi_failed = false;
+	sim.dmi_done_cycle = 0;
+	sim.cycle = 0;
+	sim.run_cycle = 0;
+	sim.ir = DTM_DMI;
+	memset(&sim.stats, 0, sizeof(sim.stats));
+
+	struct riscv_dmi_trace_record record;
+	while (riscv_dmi_trace_read(file, &record)) {
+		if (!tap_known) {
+			tap_position = record.tap_position;
+			tap_known = true;
+		}
+		if (record.tap_position == tap_position)
+			replay_record(replay, &record);
+	}
+	fclose(file);
+
+	free(sim.harts);
+	free(sim.mem);
+	sim = saved;
+
+	command_print(CMD, "%" PRIu64 " operations compared, %" PRIu64
+			" with a different status, %" PRIu64 " of %" PRIu64
+			" reads with different data", replay->operations,
+			replay->status_mismatches, replay->data_mismatches, replay->reads);
+	command_print(CMD, "register op    count   busy  avg cycles  max cycles");
+	for (unsigned int address = 0; address < BIT(DMSIM_ABITS); address++) {
+		for (unsigned int i = 0; i < ARRAY_SIZE(replay->timing); i++) {
+			const struct dmsim_replay_timing *timing =
+				&replay->timing[i][address];
+			if (!timing->operations)
+				continue;
+			command_print(CMD, "0x%02x     %-5s %6" PRIu64 " %6" PRIu64
+					" %11" PRIu64 " %11" PRIu64, address,
+					i == 0 ? "read" : "write", timing->operations,
+					timing->busy,
+					timing->executed ? timing->cycles / timing->executed : 0,
+					timing->max_cycles);
+		}
+	}
+	free(replay);
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(dmsim_handle_harts_command)
+{
+	if (CMD_ARGC != 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+	unsigned int count;
+	COMMAND_PARSE_NUMBER(uint, CMD_ARGV[0], count);
+	if (count < 1 || count > DMSIM_MAX_HARTS) {
+		command_print(CMD, "The hart count must be between 1 and %d.", DMSIM_MAX_HARTS);
+		return ERROR_COMMAND_ARGUMENT_INVALID;
+	}
+	sim.hart_count = count;
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(dmsim_handle_xlen_command)
+{
+	if (CMD_ARGC != 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+	unsigned int xlen;
+	COMMAND_PARSE_NUMBER(uint, CMD_ARGV[0], xlen);
+	if (xlen != 32 && xlen != 64) {
+		command_print(CMD, "XLEN must be 32 or 64.");
+		return ERROR_COMMAND_ARGUMENT_INVALID;
+	}
+	sim.xlen = xlen;
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(dmsim_handle_progbufsize_command)
+{
+	if (CMD_ARGC != 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+	unsigned int size;
+	COMMAND_PARSE_NUMBER(uint, CMD_ARGV[0], size);
+	if (size > DMSIM_MAX_PROGBUF) {
+		command_print(CMD, "The program buffer can have at most %d words.",
+				DMSIM_MAX_PROGBUF);
+		return ERROR_COMMAND_ARGUMENT_INVALID;
+	}
+	sim.progbufsize = size;
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(dmsim_handle_datacount_command)
+{
+	if (CMD_ARGC != 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+	unsigned int count;
+	COMMAND_PARSE_NUMBER(uint, CMD_ARGV[0], count);
+	if (count < 1 || count > DMSIM_MAX_DATA) {
+		command_print(CMD, "The data count must be between 1 and %d.", DMSIM_MAX_DATA);
+		return ERROR_COMMAND_ARGUMENT_INVALID;
+	}
+	sim.datacount = count;
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(dmsim_handle_memory_command)
+{
+	if (CMD_ARGC != 2)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+	uint64_t base, size;
+	COMMAND_PARSE_NUMBER(u64, CMD_ARGV[0], base);
+	COMMAND_PARSE_NUMBER(u64, CMD_ARGV[1], size);
+	if (size == 0 || base + size < base) {
+		command_print(CMD, "Invalid memory range.");
+		return ERROR_COMMAND_ARGUMENT_INVALID;
+	}
+	sim.mem_base = base;
+	sim.mem_size = size;
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(dmsim_handle_idcode_command)
+{
+	if (CMD_ARGC != 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+	COMMAND_PARSE_NUMBER(u32, CMD_ARGV[0], sim.idcode);
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(dmsim_handle_latency_command)
+{
+	if (CMD_ARGC == 0) {
+		for (unsigned int i = 0; i < DMSIM_DELAY_COUNT; i++)
+			command_print(CMD, "%s %u", dmsim_delay_names[i], sim.latency[i]);
+		return ERROR_OK;
+	}
+	if (CMD_ARGC != 2)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+	for (unsigned int i = 0; i < DMSIM_DELAY_COUNT; i++) {
+		if (!strcmp(CMD_ARGV[0], dmsim_delay_names[i])) {
+			COMMAND_PARSE_NUMBER(uint, CMD_ARGV[1], sim.latency[i]);
+			return ERROR_OK;
+		}
+	}
+	command_print(CMD, "Unknown delay class: %s", CMD_ARGV[0]);
+	return ERROR_COMMAND_ARGUMENT_INVALID;
+}
+
+COMMAND_HANDLER(dmsim_handle_ipc_command)
+{
+	if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+	if (CMD_ARGC == 1)
+		COMMAND_PARSE_NUMBER(uint, CMD_ARGV[0], sim.insns_per_cycle);
+	command_print(CMD, "%u", sim.insns_per_cycle);
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(dmsim_handle_stats_command)
+{
+	if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+	if (CMD_ARGC == 1) {
+		if (strcmp(CMD_ARGV[0], "reset"))
+			return ERROR_COMMAND_SYNTAX_ERROR;
+		memset(&sim.stats, 0, sizeof(sim.stats));
+		return ERROR_OK;
+	}
+	command_print(CMD, "tck_cycles %" PRIu64, sim.cycle);
+	command_print(CMD, "dmi_ops %" PRIu64, sim.stats.dmi_ops);
+	command_print(CMD, "dmi_busy %" PRIu64, sim.stats.dmi_busy);
+	command_print(CMD, "abstract_commands %" PRIu64, sim.stats.abstract_commands);
+	command_print(CMD, "abstract_busy %" PRIu64, sim.stats.abstract_busy);
+	command_print(CMD, "sysbus_accesses %" PRIu64, sim.stats.sysbus_accesses);
+	command_print(CMD, "sysbus_busy %" PRIu64, sim.stats.sysbus_busy);
+	command_print(CMD, "instructions %" PRIu64, sim.stats.instructions);
+	return ERROR_OK;
+}
+
+static const struct command_registration dmsim_subcommand_handlers[] = {
+	{
+		.name = "harts",
+		.handler = &dmsim_handle_harts_command,
+		.mode = COMMAND_CONFIG,
+		.help = "set the number of simulated harts",
+		.usage = "count",
+	},
+	{
+		.name = "xlen",
+		.handler = &dmsim_handle_xlen_command,
+		.mode = COMMAND_CONFIG,
+		.help = "set the XLEN of the simulated harts",
+		.usage = "32|64",
+	},
+	{
+		.name = "progbufsize",
+		.handler = &dmsim_handle_progbufsize_command,
+		.mode = COMMAND_CONFIG,
+		.help = "set the number of program buffer words",
+		.usage = "words",
+	},
+	{
+		.name = "datacount",
+		.handler = &dmsim_handle_datacount_command,
+		.mode = COMMAND_CONFIG,
+		.help = "set the number of abstract data registers",
+		.usage = "count",
+	},
+	{
+		.name = "memory",
+		.handler = &dmsim_handle_memory_command,
+		.mode = COMMAND_CONFIG,
+		.help = "set the address range of the simulated RAM",
+		.usage = "base size",
+	},
+	{
+		.name = "idcode",
+		.handler = &dmsim_handle_idcode_command,
+		.mode = COMMAND_CONFIG,
+		.help = "set the JTAG IDCODE of the simulated DTM",
+		.usage = "idcode",
+	},
+	{
+		.name = "latency",
+		.handler = &dmsim_handle_latency_command,
+		.mode = COMMAND_ANY,
+		.help = "set how many TCK cycles an operation of a delay class "
+			"takes before the next one is accepted",
+		.usage = "[base|abstract|sysbus_read|sysbus_write cycles]",
+	},
+	{
+		.name = "ipc",
+		.handler = &dmsim_handle_ipc_command,
+		.mode = COMMAND_ANY,
+		.help = "set how many instructions running harts execute per TCK cycle",
+		.usage = "[count]",
+	},
+	{
+		.name = "replay",
+		.handler = &dmsim_handle_replay_command,
+		.mode = COMMAND_EXEC,
+		.help = "replay a trace written by `riscv dmi_trace` against the "
+			"simulated DM, comparing the status and read data of every "
+			"operation and printing how long the operations take",
+		.usage = "filename [tap_position]",
+	},
+	{
+		.name = "stats",
+		.handler = &dmsim_handle_stats_command,
+		.mode = COMMAND_ANY,
+		.help = "print or reset the simulator statistics",
+		.usage = "[reset]",
+	},
+	COMMAND_REGISTRATION_DONE
+};
+
+static const struct command_registration dmsim_command_handlers[] = {
+	{
+		.name = "riscv_dmsim",
+		.mode = COMMAND_ANY,
+		.help = "RISC-V Debug Module simulator commands",
+		.chain = dmsim_subcommand_handlers,
+		.usage = "",
+	},
+	COMMAND_REGISTRATION_DONE
+};
+
+static struct jtag_interface dmsim_interface = {
+	.supported = DEBUG_CAP_TMS_SEQ,
+	.execute_queue = &bitbang_execute_queue,
+};
+
+struct adapter_driver riscv_dmsim_adapter_driver = {
+	.name = "riscv_dmsim",
+	.transports = jtag_only,
+	.commands = dmsim_command_handlers,
+
+	.init = &dmsim_init,
+	.quit = &dmsim_quit,
+	.reset = &dmsim_reset,
+	.speed = &dmsim_speed,
+	.khz = &dmsim_khz,
+	.speed_div = &dmsim_speed_div,
+
+	.jtag_ops = &dmsim_interface,
+};
@@ -42,6 +42,9 @@ struct adapter_driver *adapter_drivers[] = {
 #if BUILD_DUMMY == 1
 		&dummy_adapter_driver,
 #endif
+#if BUILD_RISCV_DMSIM == 1
+		&riscv_dmsim_adapter_driver,
+#endif
 #if BUILD_FTDI == 1
 		&ftdi_adapter_driver,
 #endif
@@ -3047,7 +3047,10 @@ static bool gdb_handle_vcont_packet(struct connection *connection, const char *p
 	if (parse[0] == '?') {
 		if (target->type->step) {
 			/* gdb doesn't accept c without C and s without S */
-			gdb_put_packet(connection, "vCont;c;C;s;S", 13);
+			if (target->type->step_range)
+				gdb_put_packet(connection, "vCont;c;C;s;S;r", 15);
+			else
+				gdb_put_packet(connection, "vCont;c;C;s;S", 13);
 			return true;
 		}
 		return false;
@@ -3102,15 +3105,28 @@ static bool gdb_handle_vcont_packet(struct connection *connection, const char *p
 		return true;
 	}
 
-	/* single-step or step-over-breakpoint */
-	if (parse[0] == 's') {
+	/* single-step, step-over-breakpoint or range step */
+	if (parse[0] == 's' || parse[0] == 'r') {
 		gdb_running_type = 's';
 		bool fake_step = false;
 
 		struct target *ct = target;
 		int current_pc = 1;
 		int64_t thread_id;
+		/* vCont;rstart,end: keep stepping while start <= pc < end */
+		bool range = parse[0] == 'r';
+		target_addr_t range_start = 0, range_end = 0;
 		parse++;
+		if (range) {
+			char *endp;
+			range_start = strtoull(parse, &endp, 16);
+			if (endp[0] != ',') {
+				LOG_ERROR("Malformed vCont;r packet");
+				return false;
+			}
+			range_end = strtoull(endp + 1, &endp, 16);
+			parse = endp;
+		}
 		if (parse[0] == ':') {
 			char *endp;
 			parse++;
@@ -3181,7 +3197,11 @@ static bool gdb_handle_vcont_packet(struct connection *connection, const char *p
 			}
 		}
 
-		LOG_TARGET_DEBUG(ct, "single-step thread %" PRIx64, thread_id);
+		if (range)
+			LOG_TARGET_DEBUG(ct, "range-step thread %" PRIx64 " in 0x%" TARGET_PRIxADDR
+					"-0x%" TARGET_PRIxADDR, thread_id, range_start, range_end);
+		else
+			LOG_TARGET_DEBUG(ct, "single-step thread %" PRIx64, thread_id);
 		gdb_connection->output_flag = GDB_OUTPUT_ALL;
 		target_call_event_callbacks(ct, TARGET_EVENT_GDB_START);
 
@@ -3222,7 +3242,10 @@ static bool gdb_handle_vcont_packet(struct connection *connection, const char *p
 					     "Pretending to gdb that it is running until it's available again.");
 			retval = ERROR_FAIL;
 		} else {
-			retval = target_step(ct, current_pc, 0, 0);
+			if (range)
+				retval = target_step_range(ct, range_start, range_end);
+			else
+				retval = target_step(ct, current_pc, 0, 0);
 			if (retval == ERROR_TARGET_NOT_HALTED)
 				LOG_TARGET_INFO(ct, "target was not halted when step was requested");
 		}
@@ -541,6 +541,188 @@ struct breakpoint *breakpoint_find(struct target *target, target_addr_t address)
 	return NULL;
 }
 
+struct breakpoint_batch_entry {
+	struct list_head list;
+	target_addr_t address;
+	unsigned int length;
+	/* Whether the memory holds the breakpoint instruction, and whether it
+	 * should. */
+	bool in_memory;
+	bool wanted;
+	/* The breakpoint this entry is for, NULL once it was cleared. */
+	struct breakpoint *breakpoint;
+	/* The breakpoint instruction, followed by the original one. */
+	uint8_t data[];
+};
+
+static bool batch_entry_is_pending(const struct breakpoint_batch_entry *entry)
+{
+	return entry->in_memory != entry->wanted;
+}
+
+static void batch_entry_free(struct breakpoint_batch_entry *entry)
+{
+	list_del(&entry->list);
+	free(entry);
+}
+
+void breakpoint_batch_init(struct breakpoint_batch *batch)
+{
+	INIT_LIST_HEAD(&batch->entries);
+	batch->flushing = false;
+}
+
+void breakpoint_batch_free(struct breakpoint_batch *batch)
+{
+	struct breakpoint_batch_entry *entry, *tmp;
+	list_for_each_entry_safe(entry, tmp, &batch->entries, list)
+		batch_entry_free(entry);
+}
+
+int breakpoint_batch_set(struct breakpoint_batch *batch,
+		struct breakpoint *breakpoint, const uint8_t *instr,
+		const uint8_t *orig_instr)
+{
+	struct breakpoint_batch_entry *entry;
+	list_for_each_entry(entry, &batch->entries, list) {
+		if (entry->wanted || entry->address != breakpoint->address ||
+				entry->length != breakpoint->length ||
+				memcmp(entry->data, instr, entry->length))
+			continue;
+		/* Cleared, but still in memory: nothing needs to be written. */
+		entry->wanted = true;
+		entry->breakpoint = breakpoint;
+		memcpy(breakpoint->orig_instr, entry->data + entry->length, entry->length);
+		breakpoint->is_set = true;
+		return ERROR_OK;
+	}
+
+	entry = malloc(sizeof(*entry) + 2 * breakpoint->length);
+	if (!entry) {
+		LOG_ERROR("Out of memory");
+		return ERROR_FAIL;
+	}
+	entry->address = breakpoint->address;
+	entry->length = breakpoint->length;
+	entry->in_memory = false;
+	entry->wanted = true;
+	entry->breakpoint = breakpoint;
+	memcpy(entry->data, instr, breakpoint->length);
+	memcpy(entry->data + breakpoint->length, orig_instr, breakpoint->length);
+	memcpy(breakpoint->orig_instr, orig_instr, breakpoint->length);
+	list_add_tail(&entry->list, &batch->entries);
+	breakpoint->is_set = true;
+	return ERROR_OK;
+}
+
+int breakpoint_batch_clear(struct breakpoint_batch *batch,
+		struct breakpoint *breakpoint)
+{
+	struct breakpoint_batch_entry *entry;
+	list_for_each_entry(entry, &batch->entries, list) {
+		if (entry->breakpoint != breakpoint)
+			continue;
+		if (entry->in_memory) {
+			entry->wanted = false;
+			entry->breakpoint = NULL;
+		} else {
+			/* Never written. */
+			batch_entry_free(entry);
+		}
+		breakpoint->is_set = false;
+		return ERROR_OK;
+	}
+	return ERROR_BREAKPOINT_NOT_FOUND;
+}
+
+int breakpoint_batch_flush(struct breakpoint_batch *batch,
+		struct target *target, const struct breakpoint_batch_ops *ops)
+{
+	struct breakpoint_batch_entry *entry, *tmp;
+	int retval = ERROR_OK;
+
+	batch->flushing = true;
+
+	/* The clears go first, so a breakpoint set again at the same address
+	 * finds the original instruction. */
+	list_for_each_entry_safe(entry, tmp, &batch->entries, list) {
+		if (entry->wanted)
+			continue;
+		if (ops->write(target, entry->address, entry->length,
+					entry->data + entry->length) != ERROR_OK) {
+			LOG_TARGET_ERROR(target, "Failed to restore the instruction at "
+					TARGET_ADDR_FMT, entry->address);
+			/* Keep it, to try again on the next flush. */
+			retval = ERROR_FAIL;
+			continue;
+		}
+		batch_entry_free(entry);
+	}
+
+	list_for_each_entry_safe(entry, tmp, &batch->entries, list) {
+		if (entry->in_memory)
+			continue;
+		if (ops->write(target, entry->address, entry->length,
+					entry->data) != ERROR_OK) {
+			LOG_TARGET_ERROR(target, "Failed to set the breakpoint at "
+					TARGET_ADDR_FMT, entry->address);
+			entry->breakpoint->is_set = false;
+			batch_entry_free(entry);
+			retval = ERROR_FAIL;
+			continue;
+		}
+		entry->in_memory = true;
+	}
+
+	batch->flushing = false;
+	return retval;
+}
+
+bool breakpoint_batch_is_pending(const struct breakpoint_batch *batch)
+{
+	const struct breakpoint_batch_entry *entry;
+	list_for_each_entry(entry, &batch->entries, list) {
+		if (batch_entry_is_pending(entry))
+			return true;
+	}
+	return false;
+}
+
+static bool batch_entry_overlaps(const struct breakpoint_batch_entry *entry,
+		target_addr_t address, target_addr_t length)
+{
+	return entry->address - address < length ||
+		address - entry->address < entry->length;
+}
+
+bool breakpoint_batch_overlaps(const struct breakpoint_batch *batch,
+		target_addr_t address, target_addr_t length)
+{
+	const struct breakpoint_batch_entry *entry;
+	list_for_each_entry(entry, &batch->entries, list) {
+		if (batch_entry_is_pending(entry) &&
+				batch_entry_overlaps(entry, address, length))
+			return true;
+	}
+	return false;
+}
+
+void breakpoint_batch_mask(const struct breakpoint_batch *batch,
+		target_addr_t address, target_addr_t length, uint8_t *buffer)
+{
+	const struct breakpoint_batch_entry *entry;
+	list_for_each_entry(entry, &batch->entries, list) {
+		if (entry->wanted || !batch_entry_overlaps(entry, address, length))
+			continue;
+		const uint8_t *orig_instr = entry->data + entry->length;
+		for (unsigned int i = 0; i < entry->length; i++) {
+			const target_addr_t offset = entry->address + i - address;
+			if (offset < length)
+				buffer[offset] = orig_instr[i];
+		}
+	}
+}
+
 static int watchpoint_add_internal(struct target *target, target_addr_t address,
 		unsigned int length, enum watchpoint_rw rw, uint64_t value, uint64_t mask)
 {
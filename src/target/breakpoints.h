@@ -10,6 +10,7 @@
 
 #include <stdint.h>
 
+#include "helper/list.h"
 #include "helper/types.h"
 
 struct target;
@@ -86,6 +87,48 @@ static inline void watchpoint_set(struct watchpoint *watchpoint, unsigned int nu
 	watchpoint->number = number;
 }
 
+/* Software breakpoint memory updates that a target chose to defer, so it can
+ * make them all at once right before it runs. A breakpoint that is cleared
+ * before it was written costs nothing, and one that is cleared and set again
+ * (which GDB does around every stop) leaves the memory alone. */
+struct breakpoint_batch {
+	/* struct breakpoint_batch_entry, in the order they were added. */
+	struct list_head entries;
+	/* Set while breakpoint_batch_flush() accesses memory. */
+	bool flushing;
+};
+
+/* How breakpoint_batch_flush() writes target memory. */
+struct breakpoint_batch_ops {
+	int (*write)(struct target *target, target_addr_t address, uint32_t size,
+			uint8_t *buffer);
+};
+
+void breakpoint_batch_init(struct breakpoint_batch *batch);
+/* Forget about the deferred updates, without making them. */
+void breakpoint_batch_free(struct breakpoint_batch *batch);
+/* Set "breakpoint" (writing "instr" over "orig_instr", which the caller read
+ * from memory) on the next flush. */
+int breakpoint_batch_set(struct breakpoint_batch *batch,
+		struct breakpoint *breakpoint, const uint8_t *instr,
+		const uint8_t *orig_instr);
+/* Clear "breakpoint" on the next flush. Returns ERROR_BREAKPOINT_NOT_FOUND
+ * when it wasn't set through the batch. */
+int breakpoint_batch_clear(struct breakpoint_batch *batch,
+		struct breakpoint *breakpoint);
+/* Make the deferred updates, the clears first. */
+int breakpoint_batch_flush(struct breakpoint_batch *batch,
+		struct target *target, const struct breakpoint_batch_ops *ops);
+bool breakpoint_batch_is_pending(const struct breakpoint_batch *batch);
+/* Whether a deferred update touches [address, address + length). */
+bool breakpoint_batch_overlaps(const struct breakpoint_batch *batch,
+		target_addr_t address, target_addr_t length);
+/* Replace the breakpoint instructions that are still in memory, but already
+ * cleared, by the original instructions in "buffer", which holds what was
+ * read from [address, address + length). */
+void breakpoint_batch_mask(const struct breakpoint_batch *batch,
+		target_addr_t address, target_addr_t length, uint8_t *buffer);
+
 #define ERROR_BREAKPOINT_NOT_FOUND (-1600)
 #define ERROR_WATCHPOINT_NOT_FOUND (-1601)
 
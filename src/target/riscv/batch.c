@@ -7,6 +7,7 @@
 #include "batch.h"
 #include "debug_defines.h"
 #include "debug_reg_printer.h"
+#include "dmi_trace.h"
 #include "riscv.h"
 #include "field_helpers.h"
 
@@ -37,6 +38,8 @@ struct riscv_batch *riscv_batch_alloc(struct target *target, size_t scans)
 	out->fields = NULL;
 	out->delay_classes = NULL;
 	out->bscan_ctxt = NULL;
+	out->packed_frames = NULL;
+	out->packed_frame_count = 0;
 	out->read_keys = NULL;
 
 	/* FIXME: There is potential for memory usage reduction. We could allocate
@@ -82,8 +85,18 @@ alloc_error:
 	return NULL;
 }
 
+static void free_packed_frames(struct riscv_batch *batch)
+{
+	for (size_t i = 0; i < batch->packed_frame_count; ++i)
+		riscv_bscan_packed_frame_free(&batch->packed_frames[i]);
+	free(batch->packed_frames);
+	batch->packed_frames = NULL;
+	batch->packed_frame_count = 0;
+}
+
 void riscv_batch_free(struct riscv_batch *batch)
 {
+	free_packed_frames(batch);
 	free(batch->data_in);
 	free(batch->data_out);
 	free(batch->fields);
@@ -269,9 +282,94 @@ static void log_batch(const struct riscv_batch *batch, size_t start_idx,
 	}
 }
 
-int riscv_batch_run_from(struct riscv_batch *batch, size_t start_idx,
+static void trace_batch(const struct riscv_batch *batch, size_t start_idx,
 		const struct riscv_scan_delays *delays, bool resets_delays,
 		size_t reset_delays_after)
+{
+	if (!riscv_dmi_trace_active())
+		return;
+
+	const unsigned int abits = batch->fields->num_bits - DTM_DMI_OP_LENGTH
+			- DTM_DMI_DATA_LENGTH;
+	const uint64_t done_us = riscv_dmi_trace_timestamp_us();
+	for (size_t i = start_idx; i < batch->used_scans; ++i) {
+		const struct scan_field * const field = &batch->fields[i];
+		const int delay = get_delay(batch, i, delays, resets_delays,
+				reset_delays_after);
+		struct riscv_dmi_trace_record record = {
+			.timestamp_us = done_us,
+			.batch_latency_us = MIN(done_us - batch->trace_queued_us,
+					UINT32_MAX),
+			.address = buf_get_u32(field->out_value, DTM_DMI_ADDRESS_OFFSET,
+					abits),
+			.data_out = buf_get_u32(field->out_value, DTM_DMI_DATA_OFFSET,
+					DTM_DMI_DATA_LENGTH),
+			.tap_position = batch->target->tap->abs_chain_position,
+			.op = buf_get_u32(field->out_value, DTM_DMI_OP_OFFSET,
+					DTM_DMI_OP_LENGTH),
+			.status = RISCV_DMI_TRACE_NOT_CAPTURED,
+			.delay_class = batch->delay_classes[i],
+			.idle_cycles = MIN(delay, UINT16_MAX),
+		};
+		if (field->in_value) {
+			record.data_in = buf_get_u32(field->in_value,
+					DTM_DMI_DATA_OFFSET, DTM_DMI_DATA_LENGTH);
+			record.status = buf_get_u32(field->in_value,
+					DTM_DMI_OP_OFFSET, DTM_DMI_OP_LENGTH);
+		}
+		riscv_dmi_trace_add(&record);
+	}
+}
+
+/* Adds the scans [start_idx, used_scans) of the batch to the JTAG queue as
+ * packed BSCAN tunnel frames. All the scans in a frame are followed by the
+ * longest delay any of them needs. Returns false, without queueing anything,
+ * if the frames can't be built. Otherwise "last_delay" is set to the number of
+ * idle cycles after the last scan. */
+static bool riscv_batch_queue_packed(struct riscv_batch *batch,
+		size_t start_idx, const struct riscv_scan_delays *delays,
+		bool resets_delays, size_t reset_delays_after,
+		unsigned int *last_delay)
+{
+	free_packed_frames(batch);
+	batch->packed_frames = calloc(batch->used_scans - start_idx,
+			sizeof(*batch->packed_frames));
+	if (!batch->packed_frames)
+		return false;
+
+	const unsigned int scan_bits = batch->fields[start_idx].num_bits;
+	for (size_t i = start_idx; i < batch->used_scans; ) {
+		unsigned int idle = 0;
+		unsigned int count = 0;
+		while (i + count < batch->used_scans) {
+			const unsigned int delay = MAX(idle, (unsigned int)get_delay(batch,
+						i + count, delays, resets_delays, reset_delays_after));
+			if (count + 1 > riscv_bscan_packed_max_scans(scan_bits, delay))
+				break;
+			idle = delay;
+			count++;
+		}
+		riscv_bscan_packed_frame_t *frame =
+			&batch->packed_frames[batch->packed_frame_count];
+		if (count == 0 || riscv_bscan_packed_frame_init(frame,
+					batch->fields + i, count, idle) != ERROR_OK) {
+			free_packed_frames(batch);
+			return false;
+		}
+		frame->first_scan = i;
+		batch->packed_frame_count++;
+		i += count;
+	}
+
+	for (size_t i = 0; i < batch->packed_frame_count; ++i)
+		riscv_add_bscan_packed_frame(batch->target, &batch->packed_frames[i]);
+	*last_delay = batch->packed_frames[batch->packed_frame_count - 1].idle;
+	return true;
+}
+
+unsigned int riscv_batch_queue_from(struct riscv_batch *batch,
+		size_t start_idx, const struct riscv_scan_delays *delays,
+		bool resets_delays, size_t reset_delays_after)
 {
 	assert(batch->used_scans);
 	assert(start_idx < batch->used_scans);
@@ -284,8 +382,15 @@ int riscv_batch_run_from(struct riscv_batch *batch, size_t start_idx,
 
 	LOG_TARGET_DEBUG(batch->target, "Running batch of scans [%zu, %zu)",
 			start_idx, batch->used_scans);
+	riscv_info(batch->target)->stats.dmi_scans += batch->used_scans - start_idx;
+	if (riscv_dmi_trace_active())
+		batch->trace_queued_us = riscv_dmi_trace_timestamp_us();
 
 	unsigned int delay = 0 /* to silence maybe-uninitialized */;
+	if (riscv_bscan_tunnel_is_packed() && riscv_batch_queue_packed(batch,
+				start_idx, delays, resets_delays, reset_delays_after, &delay))
+		return delay;
+
 	for (size_t i = start_idx; i < batch->used_scans; ++i) {
 		if (bscan_tunnel_ir_width != 0)
 			riscv_add_bscan_tunneled_scan(batch->target, batch->fields + i, batch->bscan_ctxt + i);
@@ -297,30 +402,104 @@ int riscv_batch_run_from(struct riscv_batch *batch, size_t start_idx,
 		if (delay > 0)
 			jtag_add_runtest(delay, TAP_IDLE);
 	}
+	return delay;
+}
+
+void riscv_batch_collect_from(struct riscv_batch *batch,
+		size_t start_idx, const struct riscv_scan_delays *delays,
+		bool resets_delays, size_t reset_delays_after,
+		unsigned int last_scan_delay)
+{
+	if (batch->packed_frames) {
+		for (size_t i = 0; i < batch->packed_frame_count; ++i) {
+			const riscv_bscan_packed_frame_t *frame = &batch->packed_frames[i];
+			riscv_bscan_packed_frame_collect(frame,
+					batch->fields + frame->first_scan);
+		}
+		free_packed_frames(batch);
+	} else if (bscan_tunnel_ir_width != 0) {
+		/* need to right-shift "in" by one bit, because of clock skew between BSCAN TAP and DM TAP */
+		for (size_t i = start_idx; i < batch->used_scans; ++i) {
+			if ((batch->fields + i)->in_value)
+				buffer_shr((batch->fields + i)->in_value, DMI_SCAN_BUF_SIZE, 1);
+		}
+	}
+
+	log_batch(batch, start_idx, delays, resets_delays, reset_delays_after);
+	trace_batch(batch, start_idx, delays, resets_delays, reset_delays_after);
+	batch->was_run = true;
+	batch->last_scan_delay = last_scan_delay;
+}
+
+int riscv_batch_run_from(struct riscv_batch *batch, size_t start_idx,
+		const struct riscv_scan_delays *delays, bool resets_delays,
+		size_t reset_delays_after)
+{
+	const unsigned int delay = riscv_batch_queue_from(batch, start_idx,
+			delays, resets_delays, reset_delays_after);
 
 	keep_alive();
 
-	if (jtag_execute_queue() != ERROR_OK) {
+	if (riscv_stats_execute_queue(batch->target) != ERROR_OK) {
 		LOG_TARGET_ERROR(batch->target, "Unable to execute JTAG queue");
 		return ERROR_FAIL;
 	}
 
 	keep_alive();
 
-	if (bscan_tunnel_ir_width != 0) {
-		/* need to right-shift "in" by one bit, because of clock skew between BSCAN TAP and DM TAP */
-		for (size_t i = start_idx; i < batch->used_scans; ++i) {
-			if ((batch->fields + i)->in_value)
-				buffer_shr((batch->fields + i)->in_value, DMI_SCAN_BUF_SIZE, 1);
-		}
+	riscv_batch_collect_from(batch, start_idx, delays, resets_delays,
+			reset_delays_after, delay);
+	return ERROR_OK;
+}
+
+int riscv_batch_run_pipelined(struct riscv_batch * const *batches, size_t count,
+		const struct riscv_scan_delays *delays, bool resets_delays,
+		size_t reset_delays_after)
+{
+	assert(count > 0 && count <= RISCV_BATCH_PIPELINE_DEPTH);
+
+	/* The scan counter used for delay resetting is shared by the whole
+	 * pipeline, so shift it for every batch that follows the first one. */
+	unsigned int delays_after_scan[RISCV_BATCH_PIPELINE_DEPTH];
+	size_t reset_after[RISCV_BATCH_PIPELINE_DEPTH];
+	size_t start_idx[RISCV_BATCH_PIPELINE_DEPTH];
+	size_t queued_scans = 0;
+	for (size_t i = 0; i < count; ++i) {
+		struct riscv_batch * const batch = batches[i];
+		/* A batch that was already run is resumed from its first failed
+		 * scan. */
+		start_idx[i] = batch->was_run ? riscv_batch_finished_scans(batch) : 0;
+		reset_after[i] = reset_delays_after > queued_scans
+			? reset_delays_after - queued_scans : 0;
+		delays_after_scan[i] = riscv_batch_queue_from(batch, start_idx[i],
+				delays, resets_delays, reset_after[i]);
+		queued_scans += batch->used_scans - start_idx[i];
 	}
 
-	log_batch(batch, start_idx, delays, resets_delays, reset_delays_after);
-	batch->was_run = true;
-	batch->last_scan_delay = delay;
+	keep_alive();
+
+	if (riscv_stats_execute_queue(batches[0]->target) != ERROR_OK) {
+		LOG_TARGET_ERROR(batches[0]->target, "Unable to execute JTAG queue");
+		return ERROR_FAIL;
+	}
+
+	keep_alive();
+
+	for (size_t i = 0; i < count; ++i)
+		riscv_batch_collect_from(batches[i], start_idx[i], delays,
+				resets_delays, reset_after[i], delays_after_scan[i]);
 	return ERROR_OK;
 }
 
+/* Every access in the abstract command delay class starts one: a write of
+ * command, or a data/progbuf access that re-runs it through abstractauto. */
+static void count_abstract_command(struct riscv_batch *batch,
+		enum riscv_scan_delay_class delay_class)
+{
+	if (delay_class == RISCV_DELAY_ABSTRACT_COMMAND)
+		riscv_info(batch->target)->stats.abstract_commands++;
+}
+
 void riscv_batch_add_dmi_write(struct riscv_batch *batch, uint64_t address, uint32_t data,
 		bool read_back, enum riscv_scan_delay_class delay_class)
 {
@@ -336,6 +515,7 @@ void riscv_batch_add_dmi_write(struct riscv_batch *batch, uint64_t address, uint
 		field->in_value = NULL;
 	}
 	batch->delay_classes[batch->used_scans] = delay_class;
+	count_abstract_command(batch, delay_class);
 	batch->last_scan = RISCV_SCAN_TYPE_WRITE;
 	batch->used_scans++;
 }
@@ -351,6 +531,7 @@ size_t riscv_batch_add_dmi_read(struct riscv_batch *batch, uint64_t address,
 	riscv_fill_dmi_read(batch->target, (char *)field->out_value, address);
 	riscv_fill_dm_nop(batch->target, (char *)field->in_value);
 	batch->delay_classes[batch->used_scans] = delay_class;
+	count_abstract_command(batch, delay_class);
 	batch->last_scan = RISCV_SCAN_TYPE_READ;
 	batch->used_scans++;
 
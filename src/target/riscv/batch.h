@@ -139,6 +139,10 @@ struct riscv_batch {
 	   and utilized to tunnel all the scans in the batch.  If not in
 	   BSCAN mode, this field is unallocated and stays NULL */
 	riscv_bscan_tunneled_scan_context_t *bscan_ctxt;
+	/* In packed BSCAN tunnel mode, the frames the scans were queued in, until
+	 * their results are collected. */
+	riscv_bscan_packed_frame_t *packed_frames;
+	size_t packed_frame_count;
 
 	/* In JTAG we scan out the previous value's output when performing a
 	 * scan.  This is a pain for users, so we just provide them the
@@ -159,6 +163,9 @@ struct riscv_batch {
 	 * Only valid when `was_run` is set.
 	 */
 	unsigned int last_scan_delay;
+
+	/* When the scans were last queued, for `riscv dmi_trace`. */
+	uint64_t trace_queued_us;
 };
 
 /* Allocates (or frees) a new scan set.  "scans" is the maximum number of JTAG
@@ -186,6 +193,42 @@ int riscv_batch_run_from(struct riscv_batch *batch, size_t start_idx,
 		const struct riscv_scan_delays *delays, bool resets_delays,
 		size_t reset_delays_after);
 
+/* Maximum number of batches that riscv_batch_run_pipelined() keeps in
+ * flight. */
+#define RISCV_BATCH_PIPELINE_DEPTH 4
+
+/* Executes up to RISCV_BATCH_PIPELINE_DEPTH batches with a single JTAG queue
+ * execution, so the adapter round trip is paid once for all of them.
+ *
+ * Each batch is expected to end with a DMI NOP operation. A batch that was
+ * already run is resumed from its first failed scan (see
+ * riscv_batch_finished_scans()).
+ *
+ * Once a scan results in DMI busy the DTM ignores all the following
+ * operations until "dmireset" is written, so every scan queued after it
+ * reports busy as well and has no side effects. The caller is therefore
+ * expected to handle the batches in order, recover from the first busy one
+ * and run the remaining ones again.
+ */
+int riscv_batch_run_pipelined(struct riscv_batch * const *batches, size_t count,
+		const struct riscv_scan_delays *delays, bool resets_delays,
+		size_t reset_delays_after);
+
+/* The two halves of riscv_batch_run_from(), for callers that put other JTAG
+ * operations (e.g. scans of batches for a different TAP) in the same queue.
+ *
+ * riscv_batch_queue_from() adds the scans [start_idx, used_scans) to the JTAG
+ * queue and returns the number of RTI cycles added after the last one.
+ * riscv_batch_collect_from() processes their results once the queue has been
+ * executed, and must be given the same arguments and the returned delay. */
+unsigned int riscv_batch_queue_from(struct riscv_batch *batch,
+		size_t start_idx, const struct riscv_scan_delays *delays,
+		bool resets_delays, size_t reset_delays_after);
+void riscv_batch_collect_from(struct riscv_batch *batch,
+		size_t start_idx, const struct riscv_scan_delays *delays,
+		bool resets_delays, size_t reset_delays_after,
+		unsigned int last_scan_delay);
+
 /* Get the number of scans successfully executed form this batch. */
 size_t riscv_batch_finished_scans(const struct riscv_batch *batch);
 
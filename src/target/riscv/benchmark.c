@@ -0,0 +1,322 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+/*
+ * Measure how fast each memory access method is on the current target.
+ *
+ * Which of progbuf, sysbus and abstract is fastest depends on the Debug
+ * Module implementation, the adapter and the access width, so the only way
+ * to pick the order for `riscv set_mem_access` is to try. `riscv benchmark`
+ * writes and reads back a scratch region with each method, access width and
+ * a few block sizes, and reports the throughput, the number of DMI scans per
+ * word and how many busy conditions had to be retried.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <helper/log.h>
+#include <helper/time_support.h>
+#include "target/target.h"
+#include "debug_defines.h"
+#include "benchmark.h"
+#include "riscv.h"
+
+static const unsigned int widths[] = {1, 2, 4, 8};
+/* Each block is a single read_memory()/write_memory() call. */
+static const unsigned int block_sizes[] = {16, 256, 4096, 65536};
+
+enum benchmark_op {
+	BENCHMARK_WRITE,
+	BENCHMARK_READ,
+	BENCHMARK_OP_COUNT
+};
+
+static const char * const op_names[BENCHMARK_OP_COUNT] = {
+	[BENCHMARK_WRITE] = "write",
+	[BENCHMARK_READ] = "read",
+};
+
+struct benchmark_result {
+	bool done;
+	uint64_t bytes;
+	float seconds;
+	uint64_t scans;
+	uint64_t busy_retries;
+};
+
+struct benchmark {
+	struct benchmark_result results[RISCV_MEM_ACCESS_MAX_METHODS_NUM]
+		[BENCHMARK_OP_COUNT][ARRAY_SIZE(widths)][ARRAY_SIZE(block_sizes)];
+};
+
+static float mb_per_s(const struct benchmark_result *result)
+{
+	return result->seconds > 0 ? result->bytes / result->seconds / 1e6 : 0;
+}
+
+static float scans_per_word(const struct benchmark_result *result,
+		unsigned int width)
+{
+	return (float)result->scans * width / result->bytes;
+}
+
+/* Busy conditions (DMI busy, abstract command busy, sbbusyerror) that had to
+ * be retried. */
+static uint64_t total_busy_retries(const struct riscv_stats *stats)
+{
+	uint64_t total = 0;
+	for (unsigned int i = 0; i < RISCV_STATS_DELAY_CLASS_COUNT; i++)
+		total += stats->busy_retries[i];
+	return total;
+}
+
+/* Access [address, address + length) in blocks of "block" bytes, using only
+ * the memory access method currently configured. */
+static int sweep(struct target *target, enum benchmark_op op,
+		target_addr_t address, uint32_t length, unsigned int width,
+		unsigned int block, uint8_t *buffer, struct benchmark_result *result)
+{
+	RISCV_INFO(r);
+	const uint64_t scans = r->stats.dmi_scans;
+	const uint64_t busy_retries = total_busy_retries(&r->stats);
+
+	struct duration duration;
+	duration_start(&duration);
+	for (uint32_t offset = 0; offset < length; offset += block) {
+		int res;
+		if (op == BENCHMARK_WRITE)
+			res = target_write_phys_memory(target, address + offset, width,
+					block / width, buffer + offset);
+		else
+			/* Not through the target API, so the memory cache doesn't
+			 * get in the way. */
+			res = r->read_memory(target, address + offset, width,
+					block / width, buffer + offset, width);
+		if (res != ERROR_OK)
+			return res;
+	}
+	duration_measure(&duration);
+
+	result->done = true;
+	result->bytes = length;
+	result->seconds = duration_elapsed(&duration);
+	result->scans = r->stats.dmi_scans - scans;
+	result->busy_retries = total_busy_retries(&r->stats) - busy_retries;
+	return ERROR_OK;
+}
+
+static void fill_pattern(uint8_t *buffer, uint32_t length, unsigned int seed)
+{
+	for (uint32_t i = 0; i < length; i++)
+		buffer[i] = (i * 7 + seed * 13 + (i >> 8)) & 0xff;
+}
+
+static int run_benchmark(struct target *target, target_addr_t address,
+		uint32_t size, struct benchmark *benchmark)
+{
+	RISCV_INFO(r);
+	uint8_t *written = malloc(size);
+	uint8_t *read = malloc(size);
+	if (!written || !read) {
+		LOG_TARGET_ERROR(target, "Failed to allocate %" PRIu32 " bytes.", size);
+		free(written);
+		free(read);
+		return ERROR_FAIL;
+	}
+
+	/* Memory regions would pick their own methods. */
+	LIST_HEAD(regions);
+	list_splice_init(&r->mem_regions, &regions);
+
+	unsigned int seed = 0;
+	for (unsigned int m = 0; m < r->num_enabled_mem_access_methods; m++) {
+		const riscv_mem_access_method_t method = r->mem_access_methods[m];
+		/* Make the method being measured the only one. */
+		riscv_mem_access_method_t saved_methods[RISCV_MEM_ACCESS_MAX_METHODS_NUM];
+		memcpy(saved_methods, r->mem_access_methods, sizeof(saved_methods));
+		const unsigned int saved_count = r->num_enabled_mem_access_methods;
+		r->mem_access_methods[0] = method;
+		r->num_enabled_mem_access_methods = 1;
+
+		for (unsigned int w = 0; w < ARRAY_SIZE(widths); w++) {
+			if (widths[w] * 8 > riscv_xlen(target))
+				continue;
+			for (unsigned int b = 0; b < ARRAY_SIZE(block_sizes); b++) {
+				const unsigned int block = block_sizes[b];
+				const uint32_t length = size / block * block;
+				if (length == 0)
+					continue;
+
+				struct benchmark_result *write_result =
+					&benchmark->results[method][BENCHMARK_WRITE][w][b];
+				struct benchmark_result *read_result =
+					&benchmark->results[method][BENCHMARK_READ][w][b];
+				/* Change the data every time, so stale data can't pass. */
+				fill_pattern(written, length, seed++);
+				if (sweep(target, BENCHMARK_WRITE, address, length, widths[w],
+							block, written, write_result) != ERROR_OK ||
+						sweep(target, BENCHMARK_READ, address, length, widths[w],
+							block, read, read_result) != ERROR_OK) {
+					LOG_TARGET_INFO(target, "%s doesn't support %u byte accesses "
+							"at 0x%" TARGET_PRIxADDR ".",
+							riscv_mem_access_method_name(method), widths[w],
+							address);
+					write_result->done = false;
+					read_result->done = false;
+					/* Larger blocks won't work any better. */
+					break;
+				}
+				if (memcmp(written, read, length)) {
+					LOG_TARGET_ERROR(target, "Data read back with %s (%u byte "
+							"accesses, %u byte blocks) doesn't match what was "
+							"written.", riscv_mem_access_method_name(method),
+							widths[w], block);
+					read_result->done = false;
+				}
+			}
+		}
+
+		memcpy(r->mem_access_methods, saved_methods, sizeof(saved_methods));
+		r->num_enabled_mem_access_methods = saved_count;
+	}
+
+	list_splice(&regions, &r->mem_regions);
+	free(written);
+	free(read);
+	return ERROR_OK;
+}
+
+static void print_table(struct command_invocation *cmd,
+		const struct benchmark *benchmark)
+{
+	command_print(cmd, "%-9s %-6s %5s %6s %10s %10s %8s", "method", "op",
+			"width", "block", "MB/s", "scans/word", "busy");
+	for (unsigned int m = 0; m < RISCV_MEM_ACCESS_MAX_METHODS_NUM; m++)
+		for (unsigned int op = 0; op < BENCHMARK_OP_COUNT; op++)
+			for (unsigned int w = 0; w < ARRAY_SIZE(widths); w++)
+				for (unsigned int b = 0; b < ARRAY_SIZE(block_sizes); b++) {
+					const struct benchmark_result *result =
+						&benchmark->results[m][op][w][b];
+					if (!result->done)
+						continue;
+					command_print(cmd, "%-9s %-6s %5u %6u %10.3f %10.2f %8" PRIu64,
+							riscv_mem_access_method_name(m), op_names[op], widths[w],
+							block_sizes[b], mb_per_s(result),
+							scans_per_word(result, widths[w]),
+							result->busy_retries);
+				}
+}
+
+/* Print the results as a nested dict:
+ * method -> op -> width -> block -> {mb_per_s scans_per_word busy_retries} */
+static void print_dict(struct command_invocation *cmd,
+		const struct benchmark *benchmark)
+{
+	for (unsigned int m = 0; m < RISCV_MEM_ACCESS_MAX_METHODS_NUM; m++) {
+		command_print_sameline(cmd, "%s {", riscv_mem_access_method_name(m));
+		for (unsigned int op = 0; op < BENCHMARK_OP_COUNT; op++) {
+			command_print_sameline(cmd, "%s {", op_names[op]);
+			for (unsigned int w = 0; w < ARRAY_SIZE(widths); w++) {
+				command_print_sameline(cmd, "%u {", widths[w]);
+				for (unsigned int b = 0; b < ARRAY_SIZE(block_sizes); b++) {
+					const struct benchmark_result *result =
+						&benchmark->results[m][op][w][b];
+					if (!result->done)
+						continue;
+					command_print_sameline(cmd, "%u {mb_per_s %.3f "
+							"scans_per_word %.2f busy_retries %" PRIu64 "} ",
+							block_sizes[b], mb_per_s(result),
+							scans_per_word(result, widths[w]),
+							result->busy_retries);
+				}
+				command_print_sameline(cmd, "} ");
+			}
+			command_print_sameline(cmd, "} ");
+		}
+		command_print_sameline(cmd, "} ");
+	}
+}
+
+COMMAND_HANDLER(riscv_benchmark_command)
+{
+	struct target *target = get_current_target(CMD_CTX);
+	RISCV_INFO(r);
+
+	bool dict = false;
+	if (CMD_ARGC == 3) {
+		if (strcmp(CMD_ARGV[2], "-dict"))
+			return ERROR_COMMAND_SYNTAX_ERROR;
+		dict = true;
+	} else if (CMD_ARGC != 2) {
+		return ERROR_COMMAND_SYNTAX_ERROR;
+	}
+
+	target_addr_t address;
+	uint32_t size;
+	COMMAND_PARSE_ADDRESS(CMD_ARGV[0], address);
+	COMMAND_PARSE_NUMBER(u32, CMD_ARGV[1], size);
+
+	if (r->dtm_version != DTM_DTMCS_VERSION_1_0) {
+		LOG_TARGET_ERROR(target, "Memory access methods are only supported on "
+				"v0.13 or v1.0 targets.");
+		return ERROR_FAIL;
+	}
+	if (target->state != TARGET_HALTED) {
+		LOG_TARGET_ERROR(target, "The target must be halted.");
+		return ERROR_TARGET_NOT_HALTED;
+	}
+	if (address % 8 || size % 8 || size < block_sizes[0]) {
+		LOG_ERROR("The scratch region must be 8 byte aligned, a multiple of 8 "
+				"bytes long and at least %u bytes long.", block_sizes[0]);
+		return ERROR_COMMAND_ARGUMENT_INVALID;
+	}
+
+	struct benchmark *benchmark = calloc(1, sizeof(*benchmark));
+	uint8_t *backup = malloc(size);
+	if (!benchmark || !backup) {
+		LOG_TARGET_ERROR(target, "Failed to allocate memory.");
+		free(benchmark);
+		free(backup);
+		return ERROR_FAIL;
+	}
+
+	/* Leave the scratch region as it was found. */
+	int result = r->read_memory(target, address, 4, size / 4, backup, 4);
+	if (result != ERROR_OK) {
+		LOG_TARGET_ERROR(target, "Failed to back up the scratch region.");
+		goto out;
+	}
+
+	result = run_benchmark(target, address, size, benchmark);
+
+	if (target_write_phys_memory(target, address, 4, size / 4, backup) != ERROR_OK) {
+		LOG_TARGET_ERROR(target, "Failed to restore the scratch region.");
+		result = ERROR_FAIL;
+	}
+
+	if (result == ERROR_OK) {
+		if (dict)
+			print_dict(CMD, benchmark);
+		else
+			print_table(CMD, benchmark);
+	}
+
+out:
+	free(benchmark);
+	free(backup);
+	return result;
+}
+
+const struct command_registration riscv_benchmark_command_handlers[] = {
+	{
+		.name = "benchmark",
+		.handler = riscv_benchmark_command,
+		.mode = COMMAND_EXEC,
+		.usage = "address size [-dict]",
+		.help = "Measure reads and writes of the given scratch region with "
+			"each memory access method, access width and a few block "
+			"sizes. The region is restored afterwards."
+	},
+	COMMAND_REGISTRATION_DONE
+};
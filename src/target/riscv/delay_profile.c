@@ -0,0 +1,337 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+/*
+ * Persistent profiles of the scan delays learned by the RISC-V debug code.
+ *
+ * Learning the delays from scratch means going through a busy response (and
+ * a retry) for every step, which is slow on targets that need large delays.
+ * The learned values are therefore remembered per DTM/adapter speed and can
+ * be stored in a file, so the next session starts close to the right values.
+ * The delays still grow as usual if busy responses show up. A while into the
+ * session the preloaded delays are reset and learned again, and only what
+ * was learned after that is stored, so that a burst of busy responses (e.g.
+ * while the target is reset with a slow clock) doesn't raise the profile for
+ * good.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <helper/list.h>
+#include <helper/log.h>
+#include <jtag/adapter.h>
+#include "target/target.h"
+#include "target/target_type.h"
+#include "debug_defines.h"
+#include "delay_profile.h"
+#include "riscv.h"
+
+struct riscv_delay_profile {
+	struct list_head list;
+	struct riscv_delay_profile_key key;
+	struct riscv_scan_delays delays;
+};
+
+static LIST_HEAD(profile_list);
+static char *profile_file;
+/* Set when the profiles differ from what is stored in "profile_file". */
+static bool profiles_dirty;
+static unsigned int profile_generation;
+
+void riscv_delay_profile_make_key(struct riscv_delay_profile_key *key,
+		const struct target *target, uint32_t dtmcs)
+{
+	key->idcode = target->tap ? target->tap->idcode : 0;
+	key->dtmcs = dtmcs & (DTM_DTMCS_VERSION | DTM_DTMCS_ABITS | DTM_DTMCS_IDLE);
+	key->adapter_khz = adapter_get_speed_khz();
+}
+
+static bool key_matches(const struct riscv_delay_profile_key *a,
+		const struct riscv_delay_profile_key *b)
+{
+	return a->idcode == b->idcode && a->dtmcs == b->dtmcs &&
+		a->adapter_khz == b->adapter_khz;
+}
+
+static struct riscv_delay_profile *find_profile(
+		const struct riscv_delay_profile_key *key)
+{
+	struct riscv_delay_profile *entry;
+	list_for_each_entry(entry, &profile_list, list) {
+		if (key_matches(&entry->key, key))
+			return entry;
+	}
+	return NULL;
+}
+
+static bool delays_equal(const struct riscv_scan_delays *a,
+		const struct riscv_scan_delays *b)
+{
+	return a->base_delay == b->base_delay && a->ac_delay == b->ac_delay &&
+		a->sb_read_delay == b->sb_read_delay &&
+		a->sb_write_delay == b->sb_write_delay;
+}
+
+static int set_profile(const struct riscv_delay_profile_key *key,
+		const struct riscv_scan_delays *delays)
+{
+	struct riscv_delay_profile *profile = find_profile(key);
+	if (!profile) {
+		profile = calloc(1, sizeof(*profile));
+		if (!profile) {
+			LOG_ERROR("Failed to allocate a delay profile.");
+			return ERROR_FAIL;
+		}
+		profile->key = *key;
+		list_add_tail(&profile->list, &profile_list);
+	} else if (delays_equal(&profile->delays, delays)) {
+		return ERROR_OK;
+	}
+	profile->delays = *delays;
+	profiles_dirty = true;
+	return ERROR_OK;
+}
+
+static void clear_profiles(void)
+{
+	struct riscv_delay_profile *entry, *tmp;
+	list_for_each_entry_safe(entry, tmp, &profile_list, list) {
+		list_del(&entry->list);
+		free(entry);
+	}
+}
+
+bool riscv_delay_profile_preload(const struct riscv_delay_profile_key *key,
+		struct riscv_scan_delays *delays)
+{
+	const struct riscv_delay_profile *profile = find_profile(key);
+	if (!profile)
+		return false;
+	delays->base_delay = MAX(delays->base_delay, profile->delays.base_delay);
+	delays->ac_delay = MAX(delays->ac_delay, profile->delays.ac_delay);
+	delays->sb_read_delay = MAX(delays->sb_read_delay,
+			profile->delays.sb_read_delay);
+	delays->sb_write_delay = MAX(delays->sb_write_delay,
+			profile->delays.sb_write_delay);
+	LOG_DEBUG("Preloaded delays for idcode=0x%08" PRIx32 " dtmcs=0x%08" PRIx32
+			" at %u kHz: base=%u abstract=%u sysbus read=%u sysbus write=%u",
+			key->idcode, key->dtmcs, key->adapter_khz, delays->base_delay,
+			delays->ac_delay, delays->sb_read_delay, delays->sb_write_delay);
+	return true;
+}
+
+unsigned int riscv_delay_profile_generation(void)
+{
+	return profile_generation;
+}
+
+void riscv_delay_profile_update(const struct riscv_delay_profile_key *key,
+		const struct riscv_scan_delays *delays)
+{
+	set_profile(key, delays);
+}
+
+/* Pull the current delays of all the examined RISC-V targets into the
+ * profiles. */
+static void update_from_targets(void)
+{
+	for (struct target *target = all_targets; target; target = target->next) {
+		if (strcmp(target_type_name(target), "riscv") || !target->arch_info)
+			continue;
+		RISCV_INFO(r);
+		if (r->update_delay_profile)
+			r->update_delay_profile(target);
+	}
+}
+
+static int load_profiles(const char *path)
+{
+	FILE *f = fopen(path, "r");
+	if (!f) {
+		/* Nothing has been learned yet. */
+		LOG_DEBUG("Delay profile file %s doesn't exist yet.", path);
+		return ERROR_OK;
+	}
+
+	char line[256];
+	unsigned int line_number = 0;
+	int result = ERROR_OK;
+	while (fgets(line, sizeof(line), f)) {
+		line_number++;
+		const char *p = line;
+		while (*p == ' ' || *p == '\t')
+			p++;
+		if (*p == '#' || *p == '\n' || *p == '\0')
+			continue;
+
+		struct riscv_delay_profile_key key;
+		struct riscv_scan_delays delays;
+		if (sscanf(p, "%" SCNx32 " %" SCNx32 " %u %u %u %u %u", &key.idcode,
+					&key.dtmcs, &key.adapter_khz, &delays.base_delay,
+					&delays.ac_delay, &delays.sb_read_delay,
+					&delays.sb_write_delay) != 7 ||
+				delays.base_delay > RISCV_SCAN_DELAY_MAX ||
+				delays.ac_delay > RISCV_SCAN_DELAY_MAX ||
+				delays.sb_read_delay > RISCV_SCAN_DELAY_MAX ||
+				delays.sb_write_delay > RISCV_SCAN_DELAY_MAX) {
+			LOG_ERROR("%s:%u: malformed delay profile.", path, line_number);
+			result = ERROR_FAIL;
+			break;
+		}
+		if (set_profile(&key, &delays) != ERROR_OK) {
+			result = ERROR_FAIL;
+			break;
+		}
+	}
+	fclose(f);
+	return result;
+}
+
+static int save_profiles(const char *path)
+{
+	FILE *f = fopen(path, "w");
+	if (!f) {
+		LOG_ERROR("Can't open %s for writing.", path);
+		return ERROR_FAIL;
+	}
+
+	fprintf(f, "# RISC-V learned scan delays\n");
+	fprintf(f, "# idcode dtmcs adapter_khz base abstract sysbus_read sysbus_write\n");
+	const struct riscv_delay_profile *entry;
+	list_for_each_entry(entry, &profile_list, list)
+		fprintf(f, "0x%08" PRIx32 " 0x%08" PRIx32 " %u %u %u %u %u\n",
+				entry->key.idcode, entry->key.dtmcs, entry->key.adapter_khz,
+				entry->delays.base_delay, entry->delays.ac_delay,
+				entry->delays.sb_read_delay, entry->delays.sb_write_delay);
+
+	if (fclose(f) != 0) {
+		LOG_ERROR("Failed to write %s.", path);
+		return ERROR_FAIL;
+	}
+	return ERROR_OK;
+}
+
+void riscv_delay_profile_save_if_dirty(void)
+{
+	if (!profile_file || !profiles_dirty)
+		return;
+	if (save_profiles(profile_file) == ERROR_OK)
+		profiles_dirty = false;
+}
+
+void riscv_delay_profile_free(void)
+{
+	riscv_delay_profile_save_if_dirty();
+	clear_profiles();
+	free(profile_file);
+	profile_file = NULL;
+	profiles_dirty = false;
+}
+
+COMMAND_HANDLER(riscv_delay_profile_file)
+{
+	if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (CMD_ARGC == 0) {
+		command_print(CMD, "%s", profile_file ? profile_file : "");
+		return ERROR_OK;
+	}
+
+	char *path = strdup(CMD_ARGV[0]);
+	if (!path) {
+		LOG_ERROR("Failed to allocate memory.");
+		return ERROR_FAIL;
+	}
+	free(profile_file);
+	profile_file = path;
+
+	const int result = load_profiles(profile_file);
+	/* What was just loaded is what the file contains. */
+	profiles_dirty = false;
+	return result;
+}
+
+COMMAND_HANDLER(riscv_delay_profile_list)
+{
+	if (CMD_ARGC != 0)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	update_from_targets();
+
+	const struct riscv_delay_profile *entry;
+	list_for_each_entry(entry, &profile_list, list)
+		command_print(CMD, "idcode=0x%08" PRIx32 " dtmcs=0x%08" PRIx32
+				" adapter_khz=%u: base=%u abstract=%u sysbus_read=%u sysbus_write=%u",
+				entry->key.idcode, entry->key.dtmcs, entry->key.adapter_khz,
+				entry->delays.base_delay, entry->delays.ac_delay,
+				entry->delays.sb_read_delay, entry->delays.sb_write_delay);
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(riscv_delay_profile_export)
+{
+	if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	const char *path = CMD_ARGC == 1 ? CMD_ARGV[0] : profile_file;
+	if (!path) {
+		LOG_ERROR("No file given and no delay profile file is set.");
+		return ERROR_FAIL;
+	}
+
+	update_from_targets();
+
+	const int result = save_profiles(path);
+	if (result == ERROR_OK && profile_file && !strcmp(path, profile_file))
+		profiles_dirty = false;
+	return result;
+}
+
+COMMAND_HANDLER(riscv_delay_profile_clear)
+{
+	if (CMD_ARGC != 0)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	clear_profiles();
+	profile_generation++;
+	profiles_dirty = true;
+	return ERROR_OK;
+}
+
+const struct command_registration riscv_delay_profile_command_handlers[] = {
+	{
+		.name = "delay_profile_file",
+		.handler = riscv_delay_profile_file,
+		.mode = COMMAND_ANY,
+		.usage = "[filename]",
+		.help = "Load learned scan delay profiles from the file and store "
+			"them back there on shutdown. Without an argument, print the "
+			"current file name."
+	},
+	{
+		.name = "delay_profile_list",
+		.handler = riscv_delay_profile_list,
+		.mode = COMMAND_ANY,
+		.usage = "",
+		.help = "List the known scan delay profiles."
+	},
+	{
+		.name = "delay_profile_export",
+		.handler = riscv_delay_profile_export,
+		.mode = COMMAND_ANY,
+		.usage = "[filename]",
+		.help = "Write the scan delay profiles to the file (by default the "
+			"one set with delay_profile_file)."
+	},
+	{
+		.name = "delay_profile_clear",
+		.handler = riscv_delay_profile_clear,
+		.mode = COMMAND_ANY,
+		.usage = "",
+		.help = "Forget all the scan delay profiles. Delays already learned "
+			"by the targets are not changed."
+	},
+	COMMAND_REGISTRATION_DONE
+};
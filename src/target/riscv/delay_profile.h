@@ -0,0 +1,49 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+
+#ifndef OPENOCD_TARGET_RISCV_DELAY_PROFILE_H
+#define OPENOCD_TARGET_RISCV_DELAY_PROFILE_H
+
+#include <helper/command.h>
+#include "batch.h"
+
+/* Learned scan delays depend on the DTM implementation and on how fast the
+ * adapter clocks it, so that's what a profile is keyed by. */
+struct riscv_delay_profile_key {
+	uint32_t idcode;
+	/* "dtmcs" with only the version, abits and idle fields kept. */
+	uint32_t dtmcs;
+	unsigned int adapter_khz;
+};
+
+void riscv_delay_profile_make_key(struct riscv_delay_profile_key *key,
+		const struct target *target, uint32_t dtmcs);
+
+/* Scans after which the delays preloaded from a profile are reset, so they
+ * can also go down again: what is learned from then on is what the session
+ * converged to. */
+#define RISCV_DELAY_PROFILE_SETTLE_SCANS	10000
+
+/* If a profile matching "key" is known, raise "delays" to its values and
+ * return true. */
+bool riscv_delay_profile_preload(const struct riscv_delay_profile_key *key,
+		struct riscv_scan_delays *delays);
+
+/* Incremented by `riscv delay_profile_clear`. Delays of targets examined
+ * before the profiles were cleared aren't stored again. */
+unsigned int riscv_delay_profile_generation(void);
+
+/* Remember "delays" as the profile for "key". */
+void riscv_delay_profile_update(const struct riscv_delay_profile_key *key,
+		const struct riscv_scan_delays *delays);
+
+/* Write the profiles to the file set with `riscv delay_profile_file` if any
+ * of them changed since it was loaded or last saved. */
+void riscv_delay_profile_save_if_dirty(void);
+
+/* Save the profiles if they changed, then forget them and the file name.
+ * Called when the last RISC-V target is deinitialized. */
+void riscv_delay_profile_free(void);
+
+extern const struct command_registration riscv_delay_profile_command_handlers[];
+
+#endif /* OPENOCD_TARGET_RISCV_DELAY_PROFILE_H */
@@ -0,0 +1,146 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+/*
+ * Binary trace of the DMI scans.
+ *
+ * Logging every scan at debug level makes a session many times slower and
+ * produces huge logs, so it's no use for finding out why a session in the
+ * field is slow. `riscv dmi_trace` records each scan of each batch as a
+ * fixed size record instead. Records are collected in a buffer that's
+ * written to the file whenever it fills up, so the cost per scan is a few
+ * stores. tools/riscv_dmi_trace.py decodes a trace and prints statistics
+ * per DM register and operation. `riscv_dmsim replay` runs a trace against
+ * the DM simulator, compares the results and prints how long each operation
+ * takes in the simulated DM.
+ *
+ * The format is described in helper/riscv_dmi_trace_format.c.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <helper/log.h>
+#include <helper/time_support.h>
+#include <helper/types.h>
+#include "dmi_trace.h"
+
+/* Written out in blocks of 64 KiB. */
+#define DMI_TRACE_BUFFER_RECORDS	2048
+
+static struct {
+	char *filename;
+	FILE *file;
+	/* Host time the trace was started at, in microseconds. */
+	int64_t start_us;
+	uint64_t records;
+	unsigned int buffered;
+	uint8_t buffer[DMI_TRACE_BUFFER_RECORDS * RISCV_DMI_TRACE_RECORD_SIZE];
+} trace;
+
+bool riscv_dmi_trace_active(void)
+{
+	return trace.file;
+}
+
+uint64_t riscv_dmi_trace_timestamp_us(void)
+{
+	return timeval_us() - trace.start_us;
+}
+
+static void write_buffer(void)
+{
+	if (trace.buffered == 0)
+		return;
+	const size_t size = trace.buffered * RISCV_DMI_TRACE_RECORD_SIZE;
+	trace.buffered = 0;
+	if (fwrite(trace.buffer, 1, size, trace.file) != size) {
+		LOG_ERROR("Error writing the DMI trace to %s. Tracing stopped.",
+				trace.filename);
+		riscv_dmi_trace_close();
+	}
+}
+
+void riscv_dmi_trace_add(const struct riscv_dmi_trace_record *record)
+{
+	if (!trace.file)
+		return;
+	riscv_dmi_trace_encode(record,
+			trace.buffer + trace.buffered * RISCV_DMI_TRACE_RECORD_SIZE);
+	trace.records++;
+	if (++trace.buffered == DMI_TRACE_BUFFER_RECORDS)
+		write_buffer();
+}
+
+void riscv_dmi_trace_close(void)
+{
+	if (!trace.file)
+		return;
+	write_buffer();
+	/* write_buffer() closes the file if it fails. */
+	if (trace.file) {
+		fclose(trace.file);
+		trace.file = NULL;
+	}
+	free(trace.filename);
+	trace.filename = NULL;
+}
+
+static int open_trace(const char *filename)
+{
+	trace.filename = strdup(filename);
+	if (!trace.filename) {
+		LOG_ERROR("Failed to allocate memory.");
+		return ERROR_FAIL;
+	}
+	trace.file = fopen(filename, "wb");
+	if (!trace.file) {
+		LOG_ERROR("Can't open %s for writing.", filename);
+		free(trace.filename);
+		trace.filename = NULL;
+		return ERROR_FAIL;
+	}
+	if (fwrite(riscv_dmi_trace_header, 1, sizeof(riscv_dmi_trace_header),
+				trace.file) != sizeof(riscv_dmi_trace_header)) {
+		LOG_ERROR("Error writing the DMI trace to %s.", filename);
+		riscv_dmi_trace_close();
+		return ERROR_FAIL;
+	}
+	trace.start_us = timeval_us();
+	trace.records = 0;
+	trace.buffered = 0;
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(riscv_dmi_trace_command)
+{
+	if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (CMD_ARGC == 0) {
+		if (riscv_dmi_trace_active())
+			command_print(CMD, "tracing DMI scans to %s, %" PRIu64 " records",
+					trace.filename, trace.records);
+		else
+			command_print(CMD, "DMI scans are not traced");
+		return ERROR_OK;
+	}
+
+	riscv_dmi_trace_close();
+	if (!strcmp(CMD_ARGV[0], "off"))
+		return ERROR_OK;
+	return open_trace(CMD_ARGV[0]);
+}
+
+const struct command_registration riscv_dmi_trace_command_handlers[] = {
+	{
+		.name = "dmi_trace",
+		.handler = riscv_dmi_trace_command,
+		.mode = COMMAND_ANY,
+		.usage = "[filename|off]",
+		.help = "Record every DMI scan of every RISC-V target to a binary "
+			"file, for tools/riscv_dmi_trace.py. Without an argument, print "
+			"where the trace goes."
+	},
+	COMMAND_REGISTRATION_DONE
+};
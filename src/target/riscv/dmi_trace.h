@@ -0,0 +1,23 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+
+#ifndef OPENOCD_TARGET_RISCV_DMI_TRACE_H
+#define OPENOCD_TARGET_RISCV_DMI_TRACE_H
+
+#include <helper/command.h>
+#include <helper/riscv_dmi_trace_format.h>
+#include "target/target.h"
+
+bool riscv_dmi_trace_active(void);
+
+/* Microseconds since the trace was started. */
+uint64_t riscv_dmi_trace_timestamp_us(void);
+
+/* Append a record. It's buffered and written out in blocks. */
+void riscv_dmi_trace_add(const struct riscv_dmi_trace_record *record);
+
+/* Write out what is buffered and close the trace file. */
+void riscv_dmi_trace_close(void);
+
+extern const struct command_registration riscv_dmi_trace_command_handlers[];
+
+#endif /* OPENOCD_TARGET_RISCV_DMI_TRACE_H */
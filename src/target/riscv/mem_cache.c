@@ -0,0 +1,359 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+/*
+ * GDB re-reads the same stack and data lines many times per stop (unwinding,
+ * locals, RTOS awareness), and every read pays the full setup cost of a
+ * program buffer or system bus access. When enabled, this cache keeps whole
+ * lines of memory on the host while the hart is halted.
+ *
+ * Memory can only be trusted not to change while every hart that can write
+ * it is halted, and nothing else writes it. OpenOCD doesn't know which harts
+ * share which memory, so the cache is only used while all the targets are
+ * halted, and only for the ranges the user marked as cacheable, i.e. free of
+ * DMA and MMIO. It's invalidated when any hart is resumed, stepped or reset,
+ * on writes, on program buffer execution and on satp writes.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <helper/log.h>
+#include "target/target.h"
+#include "target/target_type.h"
+#include "mem_cache.h"
+#include "riscv.h"
+
+#define MEM_CACHE_LINE_SIZE		64
+#define MEM_CACHE_LINE_COUNT	512
+
+struct riscv_mem_cache_range {
+	struct list_head list;
+	target_addr_t start;
+	target_addr_t size;
+};
+
+void riscv_mem_cache_init(struct riscv_mem_cache *cache)
+{
+	memset(cache, 0, sizeof(*cache));
+	cache->line_size = MEM_CACHE_LINE_SIZE;
+	cache->line_count = MEM_CACHE_LINE_COUNT;
+	INIT_LIST_HEAD(&cache->cacheable);
+}
+
+static void free_lines(struct riscv_mem_cache *cache)
+{
+	free(cache->tags);
+	cache->tags = NULL;
+	free(cache->valid);
+	cache->valid = NULL;
+	free(cache->data);
+	cache->data = NULL;
+}
+
+static void free_ranges(struct riscv_mem_cache *cache)
+{
+	struct riscv_mem_cache_range *entry, *tmp;
+	list_for_each_entry_safe(entry, tmp, &cache->cacheable, list) {
+		list_del(&entry->list);
+		free(entry);
+	}
+}
+
+void riscv_mem_cache_free(struct riscv_mem_cache *cache)
+{
+	free_lines(cache);
+	cache->enabled = false;
+	free_ranges(cache);
+}
+
+static int enable(struct riscv_mem_cache *cache)
+{
+	if (cache->enabled)
+		return ERROR_OK;
+
+	cache->tags = calloc(cache->line_count, sizeof(*cache->tags));
+	cache->valid = calloc(cache->line_count, sizeof(*cache->valid));
+	cache->data = malloc((size_t)cache->line_count * cache->line_size);
+	if (!cache->tags || !cache->valid || !cache->data) {
+		LOG_ERROR("Failed to allocate the memory cache.");
+		free_lines(cache);
+		return ERROR_FAIL;
+	}
+	cache->enabled = true;
+	return ERROR_OK;
+}
+
+static void disable(struct riscv_mem_cache *cache)
+{
+	free_lines(cache);
+	cache->enabled = false;
+}
+
+static bool is_cacheable(const struct riscv_mem_cache *cache,
+		target_addr_t address, target_addr_t size)
+{
+	const struct riscv_mem_cache_range *range;
+	list_for_each_entry(range, &cache->cacheable, list) {
+		if (range->start <= address &&
+				address + (size - 1) <= range->start + (range->size - 1))
+			return true;
+	}
+	return false;
+}
+
+/* A running target, RISC-V or not, may write any memory it shares with the
+ * harts. */
+static bool all_targets_halted(void)
+{
+	for (struct target *target = all_targets; target; target = target->next) {
+		if (target_was_examined(target) && target->state != TARGET_HALTED &&
+				target->state != TARGET_UNAVAILABLE)
+			return false;
+	}
+	return true;
+}
+
+static unsigned int line_index(const struct riscv_mem_cache *cache,
+		target_addr_t line)
+{
+	return (line / cache->line_size) % cache->line_count;
+}
+
+static bool line_present(const struct riscv_mem_cache *cache,
+		target_addr_t line)
+{
+	const unsigned int index = line_index(cache, line);
+	return cache->valid[index] && cache->tags[index] == line;
+}
+
+/* Read the lines [first, last] from the target and store them. */
+static int fill_lines(struct target *target, struct riscv_mem_cache *cache,
+		target_addr_t first, target_addr_t last, uint32_t size)
+{
+	RISCV_INFO(r);
+	const target_addr_t bytes = last - first + cache->line_size;
+	uint8_t *buffer = malloc(bytes);
+	if (!buffer) {
+		LOG_TARGET_ERROR(target, "Failed to allocate %" TARGET_PRIuADDR " bytes.",
+				bytes);
+		return ERROR_FAIL;
+	}
+
+	const int result = r->read_memory(target, first, size, bytes / size,
+			buffer, size);
+	if (result == ERROR_OK) {
+		for (target_addr_t offset = 0; offset < bytes; offset += cache->line_size) {
+			const unsigned int index = line_index(cache, first + offset);
+			cache->tags[index] = first + offset;
+			cache->valid[index] = true;
+			memcpy(cache->data + (size_t)index * cache->line_size,
+					buffer + offset, cache->line_size);
+		}
+	}
+	free(buffer);
+	return result;
+}
+
+int riscv_mem_cache_read(struct target *target, target_addr_t address,
+		uint32_t size, uint32_t count, uint8_t *buffer)
+{
+	RISCV_INFO(r);
+	struct riscv_mem_cache *cache = &r->mem_cache;
+	const target_addr_t length = (target_addr_t)size * count;
+
+	/* Large reads (memory dumps, verification) would only evict what's
+	 * useful, so they go straight to the target. */
+	if (!cache->enabled || !all_targets_halted() || length == 0 ||
+			size > cache->line_size ||
+			length > (target_addr_t)cache->line_size * cache->line_count / 2 ||
+			address + length < address)
+		return r->read_memory(target, address, size, count, buffer, size);
+
+	const target_addr_t line_mask = ~(target_addr_t)(cache->line_size - 1);
+	const target_addr_t first_line = address & line_mask;
+	const target_addr_t last_line = (address + length - 1) & line_mask;
+
+	/* Whole lines are read, so they must be cacheable entirely. */
+	if (!is_cacheable(cache, first_line, last_line - first_line + cache->line_size))
+		return r->read_memory(target, address, size, count, buffer, size);
+
+	/* Fetch runs of missing lines with a single access each. */
+	for (target_addr_t line = first_line; ; line += cache->line_size) {
+		if (line_present(cache, line)) {
+			cache->hits++;
+		} else {
+			target_addr_t run_end = line;
+			while (run_end != last_line &&
+					!line_present(cache, run_end + cache->line_size))
+				run_end += cache->line_size;
+			if (fill_lines(target, cache, line, run_end, size) != ERROR_OK) {
+				/* The whole line may not be accessible. Just read what
+				 * was asked for. */
+				LOG_TARGET_DEBUG(target, "Failed to fill memory cache lines "
+						"0x%" TARGET_PRIxADDR "-0x%" TARGET_PRIxADDR ".",
+						line, run_end + cache->line_size - 1);
+				return r->read_memory(target, address, size, count, buffer, size);
+			}
+			cache->misses += (run_end - line) / cache->line_size + 1;
+			line = run_end;
+		}
+		if (line == last_line)
+			break;
+	}
+
+	for (target_addr_t offset = 0; offset < length; ) {
+		const target_addr_t current = address + offset;
+		const target_addr_t line = current & line_mask;
+		const unsigned int index = line_index(cache, line);
+		const target_addr_t in_line = current - line;
+		const target_addr_t chunk = MIN(cache->line_size - in_line,
+				length - offset);
+		memcpy(buffer + offset,
+				cache->data + (size_t)index * cache->line_size + in_line, chunk);
+		offset += chunk;
+	}
+	return ERROR_OK;
+}
+
+static struct riscv_mem_cache *target_cache(struct target *target)
+{
+	if (strcmp(target_type_name(target), "riscv") || !target->arch_info)
+		return NULL;
+	RISCV_INFO(r);
+	return r->mem_cache.enabled ? &r->mem_cache : NULL;
+}
+
+void riscv_mem_cache_invalidate_all(void)
+{
+	for (struct target *target = all_targets; target; target = target->next) {
+		struct riscv_mem_cache *cache = target_cache(target);
+		if (cache)
+			memset(cache->valid, 0, cache->line_count * sizeof(*cache->valid));
+	}
+}
+
+void riscv_mem_cache_invalidate_range(target_addr_t address, target_addr_t size)
+{
+	if (size == 0)
+		return;
+	for (struct target *target = all_targets; target; target = target->next) {
+		struct riscv_mem_cache *cache = target_cache(target);
+		if (!cache)
+			continue;
+		for (unsigned int i = 0; i < cache->line_count; i++) {
+			if (cache->valid[i] &&
+					address <= cache->tags[i] + (cache->line_size - 1) &&
+					cache->tags[i] <= address + (size - 1))
+				cache->valid[i] = false;
+		}
+	}
+}
+
+COMMAND_HELPER(riscv_mem_cache_print_info, struct target *target)
+{
+	RISCV_INFO(r);
+	const struct riscv_mem_cache *cache = &r->mem_cache;
+	if (!cache->enabled)
+		return ERROR_OK;
+	command_print(CMD, "%-21s %3" PRIu64, "mem_cache.hits", cache->hits);
+	command_print(CMD, "%-21s %3" PRIu64, "mem_cache.misses", cache->misses);
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(riscv_mem_cache_command)
+{
+	struct target *target = get_current_target(CMD_CTX);
+	RISCV_INFO(r);
+	struct riscv_mem_cache *cache = &r->mem_cache;
+
+	if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (CMD_ARGC == 1) {
+		if (!strcmp(CMD_ARGV[0], "reset_counters")) {
+			cache->hits = 0;
+			cache->misses = 0;
+			return ERROR_OK;
+		}
+		bool enable_cache;
+		COMMAND_PARSE_ON_OFF(CMD_ARGV[0], enable_cache);
+		if (!enable_cache) {
+			disable(cache);
+			return ERROR_OK;
+		}
+		return enable(cache);
+	}
+
+	command_print(CMD, "memory cache is %s, %" PRIu64 " hits, %" PRIu64 " misses",
+			cache->enabled ? "on" : "off", cache->hits, cache->misses);
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(riscv_mem_cache_region)
+{
+	struct target *target = get_current_target(CMD_CTX);
+	RISCV_INFO(r);
+	struct riscv_mem_cache *cache = &r->mem_cache;
+
+	if (CMD_ARGC == 0) {
+		const struct riscv_mem_cache_range *range;
+		list_for_each_entry(range, &cache->cacheable, list)
+			command_print(CMD, "0x%" TARGET_PRIxADDR " 0x%" TARGET_PRIxADDR,
+					range->start, range->size);
+		return ERROR_OK;
+	}
+
+	if (CMD_ARGC == 1) {
+		if (strcmp(CMD_ARGV[0], "clear"))
+			return ERROR_COMMAND_SYNTAX_ERROR;
+		free_ranges(cache);
+		/* What was cached may not be cacheable any more. */
+		if (cache->enabled)
+			memset(cache->valid, 0, cache->line_count * sizeof(*cache->valid));
+		return ERROR_OK;
+	}
+
+	if (CMD_ARGC != 2)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	target_addr_t start, size;
+	COMMAND_PARSE_ADDRESS(CMD_ARGV[0], start);
+	COMMAND_PARSE_ADDRESS(CMD_ARGV[1], size);
+	if (size == 0 || start + (size - 1) < start) {
+		LOG_ERROR("Invalid cacheable range.");
+		return ERROR_COMMAND_ARGUMENT_INVALID;
+	}
+
+	struct riscv_mem_cache_range *range = calloc(1, sizeof(*range));
+	if (!range) {
+		LOG_ERROR("Failed to allocate memory.");
+		return ERROR_FAIL;
+	}
+	range->start = start;
+	range->size = size;
+	list_add_tail(&range->list, &cache->cacheable);
+	return ERROR_OK;
+}
+
+const struct command_registration riscv_mem_cache_command_handlers[] = {
+	{
+		.name = "mem_cache",
+		.handler = riscv_mem_cache_command,
+		.mode = COMMAND_ANY,
+		.usage = "[on|off|reset_counters]",
+		.help = "Enable or disable the host side cache of memory read while "
+			"all the targets are halted. Without an argument, print the "
+			"state and the hit/miss counters."
+	},
+	{
+		.name = "mem_cache_region",
+		.handler = riscv_mem_cache_region,
+		.mode = COMMAND_ANY,
+		.usage = "[address size]|clear",
+		.help = "Allow caching the given physical address range, which "
+			"nothing but the harts may write (no DMA, no MMIO), or remove "
+			"all the ranges. Without arguments, list the cacheable ranges."
+	},
+	COMMAND_REGISTRATION_DONE
+};
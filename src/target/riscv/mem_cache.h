@@ -0,0 +1,48 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+
+#ifndef OPENOCD_TARGET_RISCV_MEM_CACHE_H
+#define OPENOCD_TARGET_RISCV_MEM_CACHE_H
+
+#include <helper/command.h>
+#include <helper/list.h>
+#include "target/target.h"
+
+/* Host side cache of target memory, used while all the targets are halted.
+ * It's direct mapped and indexed by physical address. */
+struct riscv_mem_cache {
+	bool enabled;
+	unsigned int line_size;
+	unsigned int line_count;
+	/* Address of the line held in each slot. */
+	target_addr_t *tags;
+	bool *valid;
+	uint8_t *data;
+
+	/* The only ranges that are cached, as struct riscv_mem_cache_range.
+	 * Set by the user, who knows which memory nothing but the harts
+	 * writes (no DMA, no MMIO). */
+	struct list_head cacheable;
+
+	uint64_t hits;
+	uint64_t misses;
+};
+
+void riscv_mem_cache_init(struct riscv_mem_cache *cache);
+void riscv_mem_cache_free(struct riscv_mem_cache *cache);
+
+/* Read physical memory, going through the cache when it's enabled. */
+int riscv_mem_cache_read(struct target *target, target_addr_t address,
+		uint32_t size, uint32_t count, uint8_t *buffer);
+
+/* Drop the cached contents of all the RISC-V targets. To be called whenever
+ * a hart may have changed memory, e.g. when it's resumed or stepped. */
+void riscv_mem_cache_invalidate_all(void);
+
+/* Drop the cached lines overlapping the range in all the RISC-V targets. */
+void riscv_mem_cache_invalidate_range(target_addr_t address, target_addr_t size);
+
+COMMAND_HELPER(riscv_mem_cache_print_info, struct target *target);
+
+extern const struct command_registration riscv_mem_cache_command_handlers[];
+
+#endif /* OPENOCD_TARGET_RISCV_MEM_CACHE_H */
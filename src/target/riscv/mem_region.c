@@ -0,0 +1,305 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+/*
+ * Memory access methods per address range.
+ *
+ * `riscv set_mem_access` applies to the whole address space, but on many
+ * SoCs the best method depends on where the access goes: the system bus is
+ * fastest for DRAM, tightly coupled memories are only visible to the hart
+ * (program buffer), and some peripherals only work with abstract memory
+ * access or with a particular access width.
+ *
+ * A region lists the methods allowed in it. At first they are tried in the
+ * order given, each one getting used at least once. From then on, the
+ * fastest one seen so far (in bytes per second over all the accesses it
+ * made) is tried first. A method that failed several times in a row for an
+ * access size is tried after all the others for that size, until it works
+ * again. Methods that turn out not to work in the region are not tried
+ * again, until `riscv mem_region forget`.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <helper/align.h>
+#include <helper/log.h>
+#include "target/target.h"
+#include "mem_region.h"
+#include "riscv.h"
+
+void riscv_mem_region_free_all(struct list_head *regions)
+{
+	struct riscv_mem_region *region, *tmp;
+	list_for_each_entry_safe(region, tmp, regions, list) {
+		list_del(&region->list);
+		free(region);
+	}
+}
+
+struct riscv_mem_region *riscv_mem_region_find(struct target *target,
+		target_addr_t address, target_addr_t length)
+{
+	RISCV_INFO(r);
+	if (length == 0)
+		return NULL;
+	struct riscv_mem_region *region;
+	list_for_each_entry(region, &r->mem_regions, list) {
+		if (address >= region->start &&
+				address - region->start <= region->size - length &&
+				length <= region->size)
+			return region;
+	}
+	return NULL;
+}
+
+static struct riscv_mem_region_stats *region_stats(
+		struct riscv_mem_region *region, bool is_read)
+{
+	return is_read ? region->read_stats : region->write_stats;
+}
+
+/* After this many failures in a row, a method is tried last. */
+#define RISCV_MEM_REGION_MAX_FAILURES 3
+
+static unsigned int size_index(unsigned int size)
+{
+	unsigned int index = 0;
+	while (size > 1 && index + 1 < RISCV_MEM_REGION_SIZES) {
+		size >>= 1;
+		index++;
+	}
+	return index;
+}
+
+static bool keeps_failing(const struct riscv_mem_region_stats *stats,
+		unsigned int size)
+{
+	return stats->failures[size_index(size)] >= RISCV_MEM_REGION_MAX_FAILURES;
+}
+
+static float bytes_per_second(const struct riscv_mem_region_stats *stats)
+{
+	/* Accesses quicker than the clock resolution still count as fast. */
+	return stats->bytes / MAX(stats->seconds, 1e-6f);
+}
+
+unsigned int riscv_mem_region_order(const struct riscv_mem_region *region,
+		bool is_read, unsigned int size, riscv_mem_access_method_t *order)
+{
+	const struct riscv_mem_region_stats *stats =
+		is_read ? region->read_stats : region->write_stats;
+	unsigned int count = 0;
+
+	/* Methods that weren't measured yet come first, so each gets used. */
+	for (unsigned int i = 0; i < region->method_count; i++) {
+		const riscv_mem_access_method_t method = region->methods[i];
+		if (!(stats[method].unusable_sizes & size) && stats[method].bytes == 0 &&
+				!keeps_failing(&stats[method], size))
+			order[count++] = method;
+	}
+
+	/* Then the others, fastest first. */
+	const unsigned int measured_start = count;
+	for (unsigned int i = 0; i < region->method_count; i++) {
+		const riscv_mem_access_method_t method = region->methods[i];
+		if (stats[method].unusable_sizes & size || stats[method].bytes == 0 ||
+				keeps_failing(&stats[method], size))
+			continue;
+		unsigned int j = count++;
+		while (j > measured_start && bytes_per_second(&stats[method]) >
+				bytes_per_second(&stats[order[j - 1]])) {
+			order[j] = order[j - 1];
+			j--;
+		}
+		order[j] = method;
+	}
+
+	/* Then the ones that keep failing, in case they work again. */
+	for (unsigned int i = 0; i < region->method_count; i++) {
+		const riscv_mem_access_method_t method = region->methods[i];
+		if (!(stats[method].unusable_sizes & size) &&
+				keeps_failing(&stats[method], size))
+			order[count++] = method;
+	}
+
+	if (count > 0)
+		return count;
+
+	/* Nothing is known to work. Try them all, so the failure is reported
+	 * as usual. */
+	memcpy(order, region->methods, region->method_count * sizeof(*order));
+	return region->method_count;
+}
+
+void riscv_mem_region_record(struct target *target,
+		struct riscv_mem_region *region, bool is_read,
+		riscv_mem_access_method_t method, unsigned int size, bool success,
+		bool unusable, uint64_t bytes, float seconds)
+{
+	struct riscv_mem_region_stats *stats = &region_stats(region, is_read)[method];
+	unsigned int *failures = &stats->failures[size_index(size)];
+	if (success) {
+		stats->bytes += bytes;
+		stats->seconds += seconds;
+		*failures = 0;
+	} else if (!unusable) {
+		if (++*failures == RISCV_MEM_REGION_MAX_FAILURES)
+			LOG_TARGET_DEBUG(target, "Trying %s last for %u byte %s in 0x%"
+					TARGET_PRIxADDR "-0x%" TARGET_PRIxADDR ", after %u failures.",
+					riscv_mem_access_method_name(method), size,
+					is_read ? "reads" : "writes", region->start,
+					region->start + region->size - 1, *failures);
+	} else if (!(stats->unusable_sizes & size)) {
+		LOG_TARGET_DEBUG(target, "Not using %s for %u byte %s in 0x%" TARGET_PRIxADDR
+				"-0x%" TARGET_PRIxADDR " anymore.",
+				riscv_mem_access_method_name(method), size,
+				is_read ? "reads" : "writes", region->start,
+				region->start + region->size - 1);
+		stats->unusable_sizes |= size;
+	}
+}
+
+static void print_stats(struct command_invocation *cmd, const char *op,
+		const struct riscv_mem_region *region,
+		const struct riscv_mem_region_stats *stats)
+{
+	for (unsigned int i = 0; i < region->method_count; i++) {
+		const riscv_mem_access_method_t method = region->methods[i];
+		command_print_sameline(cmd, "  %s %s:", op,
+				riscv_mem_access_method_name(method));
+		if (stats[method].unusable_sizes) {
+			command_print_sameline(cmd, " unusable for");
+			for (unsigned int size = 1; size <= 16; size *= 2)
+				if (stats[method].unusable_sizes & size)
+					command_print_sameline(cmd, " %u", size);
+			command_print_sameline(cmd, " byte accesses,");
+		}
+		for (unsigned int size = 1; size <= 16; size *= 2)
+			if (keeps_failing(&stats[method], size))
+				command_print_sameline(cmd, " failing %u byte accesses,", size);
+		if (stats[method].bytes)
+			command_print(cmd, " %.3f MB/s over %" PRIu64 " bytes",
+					bytes_per_second(&stats[method]) / 1e6, stats[method].bytes);
+		else
+			command_print(cmd, " not measured");
+	}
+}
+
+static int parse_method(const char *arg, riscv_mem_access_method_t *method)
+{
+	for (unsigned int i = 0; i < RISCV_MEM_ACCESS_MAX_METHODS_NUM; i++) {
+		if (!strcmp(arg, riscv_mem_access_method_name(i))) {
+			*method = i;
+			return ERROR_OK;
+		}
+	}
+	LOG_ERROR("Unknown memory access method '%s'. "
+			"Must be one of: 'progbuf', 'sysbus' or 'abstract'.", arg);
+	return ERROR_COMMAND_ARGUMENT_INVALID;
+}
+
+COMMAND_HANDLER(riscv_mem_region_command)
+{
+	struct target *target = get_current_target(CMD_CTX);
+	RISCV_INFO(r);
+
+	if (CMD_ARGC == 0) {
+		const struct riscv_mem_region *region;
+		list_for_each_entry(region, &r->mem_regions, list) {
+			command_print_sameline(CMD, "0x%" TARGET_PRIxADDR " 0x%" TARGET_PRIxADDR,
+					region->start, region->size);
+			if (region->width)
+				command_print_sameline(CMD, " -width %u", region->width);
+			for (unsigned int i = 0; i + 1 < region->method_count; i++)
+				command_print_sameline(CMD, " %s",
+						riscv_mem_access_method_name(region->methods[i]));
+			command_print(CMD, " %s",
+					riscv_mem_access_method_name(
+						region->methods[region->method_count - 1]));
+			print_stats(CMD, "read", region, region->read_stats);
+			print_stats(CMD, "write", region, region->write_stats);
+		}
+		return ERROR_OK;
+	}
+
+	if (CMD_ARGC == 1) {
+		if (!strcmp(CMD_ARGV[0], "clear")) {
+			riscv_mem_region_free_all(&r->mem_regions);
+			return ERROR_OK;
+		}
+		if (!strcmp(CMD_ARGV[0], "forget")) {
+			struct riscv_mem_region *region;
+			list_for_each_entry(region, &r->mem_regions, list) {
+				memset(region->read_stats, 0, sizeof(region->read_stats));
+				memset(region->write_stats, 0, sizeof(region->write_stats));
+			}
+			return ERROR_OK;
+		}
+		return ERROR_COMMAND_SYNTAX_ERROR;
+	}
+
+	struct riscv_mem_region region = { 0 };
+	COMMAND_PARSE_ADDRESS(CMD_ARGV[0], region.start);
+	COMMAND_PARSE_ADDRESS(CMD_ARGV[1], region.size);
+	if (region.size == 0 || region.start + (region.size - 1) < region.start) {
+		LOG_ERROR("Invalid memory region.");
+		return ERROR_COMMAND_ARGUMENT_INVALID;
+	}
+
+	for (unsigned int i = 2; i < CMD_ARGC; i++) {
+		if (!strcmp(CMD_ARGV[i], "-width")) {
+			if (++i == CMD_ARGC)
+				return ERROR_COMMAND_SYNTAX_ERROR;
+			COMMAND_PARSE_NUMBER(uint, CMD_ARGV[i], region.width);
+			if (region.width == 0 || region.width > 16 ||
+					!IS_PWR_OF_2(region.width)) {
+				LOG_ERROR("The access width must be 1, 2, 4, 8 or 16 bytes.");
+				return ERROR_COMMAND_ARGUMENT_INVALID;
+			}
+			continue;
+		}
+		riscv_mem_access_method_t method;
+		int result = parse_method(CMD_ARGV[i], &method);
+		if (result != ERROR_OK)
+			return result;
+		for (unsigned int j = 0; j < region.method_count; j++) {
+			if (region.methods[j] == method) {
+				LOG_ERROR("Memory access method '%s' is given twice.", CMD_ARGV[i]);
+				return ERROR_COMMAND_ARGUMENT_INVALID;
+			}
+		}
+		region.methods[region.method_count++] = method;
+	}
+
+	/* Without methods, the region allows the ones from `riscv set_mem_access`. */
+	if (region.method_count == 0) {
+		memcpy(region.methods, r->mem_access_methods, sizeof(region.methods));
+		region.method_count = r->num_enabled_mem_access_methods;
+	}
+
+	struct riscv_mem_region *entry = malloc(sizeof(*entry));
+	if (!entry) {
+		LOG_ERROR("Failed to allocate memory.");
+		return ERROR_FAIL;
+	}
+	*entry = region;
+	/* The regions are searched in the order they were added. */
+	list_add_tail(&entry->list, &r->mem_regions);
+	return ERROR_OK;
+}
+
+const struct command_registration riscv_mem_region_command_handlers[] = {
+	{
+		.name = "mem_region",
+		.handler = riscv_mem_region_command,
+		.mode = COMMAND_ANY,
+		.usage = "[address size [-width bytes] [progbuf|sysbus|abstract ...]]|"
+			"clear|forget",
+		.help = "Set the memory access methods (and optionally the access "
+			"width) to use for an address range, or forget what was "
+			"learned about the regions, or remove them all. Without "
+			"arguments, list the regions and how the methods performed."
+	},
+	COMMAND_REGISTRATION_DONE
+};
@@ -0,0 +1,64 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+
+#ifndef OPENOCD_TARGET_RISCV_MEM_REGION_H
+#define OPENOCD_TARGET_RISCV_MEM_REGION_H
+
+#include <helper/command.h>
+#include <helper/list.h>
+#include "target/target.h"
+#include "riscv.h"
+
+/* Access sizes of 1, 2, 4, 8 and 16 bytes. */
+#define RISCV_MEM_REGION_SIZES 5
+
+struct riscv_mem_region_stats {
+	/* Bytes transferred and time spent by the successful accesses. */
+	uint64_t bytes;
+	float seconds;
+	/* Access sizes (in bytes, as a mask) that are known not to work. */
+	unsigned int unusable_sizes;
+	/* Failures since the last success, per access size. */
+	unsigned int failures[RISCV_MEM_REGION_SIZES];
+};
+
+/* An address range with its own memory access methods, set with
+ * `riscv mem_region`. Within it, the methods are tried fastest first, as
+ * measured while they are used, methods that keep failing there are tried
+ * last, and methods that don't work there aren't tried again. */
+struct riscv_mem_region {
+	struct list_head list;
+	target_addr_t start;
+	target_addr_t size;
+	/* The methods allowed in the region, in the order they were given. */
+	riscv_mem_access_method_t methods[RISCV_MEM_ACCESS_MAX_METHODS_NUM];
+	unsigned int method_count;
+	/* Access size to use, in bytes. 0 to use the size that was asked for. */
+	unsigned int width;
+	/* What was learned about each method, for reads and writes. */
+	struct riscv_mem_region_stats read_stats[RISCV_MEM_ACCESS_MAX_METHODS_NUM];
+	struct riscv_mem_region_stats write_stats[RISCV_MEM_ACCESS_MAX_METHODS_NUM];
+};
+
+void riscv_mem_region_free_all(struct list_head *regions);
+
+/* Return the region that contains all of [address, address + length), or
+ * NULL. */
+struct riscv_mem_region *riscv_mem_region_find(struct target *target,
+		target_addr_t address, target_addr_t length);
+
+/* Fill "order" with the methods to try for an access of "size" bytes
+ * words in "region", and return how many there are. */
+unsigned int riscv_mem_region_order(const struct riscv_mem_region *region,
+		bool is_read, unsigned int size, riscv_mem_access_method_t *order);
+
+/* Learn from the outcome of an access made with "method". "unusable" means
+ * that it can't work for this size in the region, as opposed to failing for
+ * a reason that may go away (e.g. a bus error at one address). */
+void riscv_mem_region_record(struct target *target,
+		struct riscv_mem_region *region, bool is_read,
+		riscv_mem_access_method_t method, unsigned int size, bool success,
+		bool unusable, uint64_t bytes, float seconds);
+
+extern const struct command_registration riscv_mem_region_command_handlers[];
+
+#endif /* OPENOCD_TARGET_RISCV_MEM_REGION_H */
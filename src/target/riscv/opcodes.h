@@ -9,6 +9,7 @@
 #define T0      5
 #define S0      8
 #define S1      9
+#define A0      10
 
 static uint32_t bits(uint32_t value, unsigned int hi, unsigned int lo)
 {
@@ -128,6 +129,24 @@ static uint32_t lb(unsigned int rd, unsigned int base, uint16_t offset)
 	return imm_i(offset) | inst_rs1(base) | inst_rd(rd) | MATCH_LB;
 }
 
+static uint32_t lwu(unsigned int rd, unsigned int base, uint16_t offset) __attribute__ ((unused));
+static uint32_t lwu(unsigned int rd, unsigned int base, uint16_t offset)
+{
+	return imm_i(offset) | inst_rs1(base) | inst_rd(rd) | MATCH_LWU;
+}
+
+static uint32_t lhu(unsigned int rd, unsigned int base, uint16_t offset) __attribute__ ((unused));
+static uint32_t lhu(unsigned int rd, unsigned int base, uint16_t offset)
+{
+	return imm_i(offset) | inst_rs1(base) | inst_rd(rd) | MATCH_LHU;
+}
+
+static uint32_t lbu(unsigned int rd, unsigned int base, uint16_t offset) __attribute__ ((unused));
+static uint32_t lbu(unsigned int rd, unsigned int base, uint16_t offset)
+{
+	return imm_i(offset) | inst_rs1(base) | inst_rd(rd) | MATCH_LBU;
+}
+
 static uint32_t csrw(unsigned int source, unsigned int csr) __attribute__ ((unused));
 static uint32_t csrw(unsigned int source, unsigned int csr)
 {
@@ -291,10 +310,23 @@ static uint32_t xori(unsigned int dest, unsigned int src, uint16_t imm)
 	return imm_i(imm) | inst_rs1(src) | inst_rd(dest) | MATCH_XORI;
 }
 
+/* RV64 shift amounts take 6 bits, so they don't fit in inst_rs2(). */
 static uint32_t srli(unsigned int dest, unsigned int src, uint8_t shamt) __attribute__ ((unused));
 static uint32_t srli(unsigned int dest, unsigned int src, uint8_t shamt)
 {
-	return inst_rs2(shamt) | inst_rs1(src) | inst_rd(dest) | MATCH_SRLI;
+	return (bits(shamt, 5, 0) << 20) | inst_rs1(src) | inst_rd(dest) | MATCH_SRLI;
+}
+
+static uint32_t slli(unsigned int dest, unsigned int src, uint8_t shamt) __attribute__ ((unused));
+static uint32_t slli(unsigned int dest, unsigned int src, uint8_t shamt)
+{
+	return (bits(shamt, 5, 0) << 20) | inst_rs1(src) | inst_rd(dest) | MATCH_SLLI;
+}
+
+static uint32_t or(unsigned int dest, unsigned int src1, unsigned int src2) __attribute__ ((unused));
+static uint32_t or(unsigned int dest, unsigned int src1, unsigned int src2)
+{
+	return inst_rs2(src2) | inst_rs1(src1) | inst_rd(dest) | MATCH_OR;
 }
 
 static uint32_t fence_rw_rw(void) __attribute__((unused));
@@ -342,4 +374,16 @@ static uint32_t vslide1down_vx(unsigned int vd, unsigned int vs2,
 	return ((vm & 1) << 25) | inst_rs2(vs2) | inst_rs1(rs1) | inst_rd(vd) | MATCH_VSLIDE1DOWN_VX;
 }
 
+static uint32_t vs1r_v(unsigned int vs3, unsigned int rs1) __attribute__((unused));
+static uint32_t vs1r_v(unsigned int vs3, unsigned int rs1)
+{
+	return inst_rs1(rs1) | inst_rd(vs3) | MATCH_VS1R_V;
+}
+
+static uint32_t vl1re8_v(unsigned int vd, unsigned int rs1) __attribute__((unused));
+static uint32_t vl1re8_v(unsigned int vd, unsigned int rs1)
+{
+	return inst_rs1(rs1) | inst_rd(vd) | MATCH_VL1RE8_V;
+}
+
 #endif /* OPENOCD_TARGET_RISCV_OPCODES_H */
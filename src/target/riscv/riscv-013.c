@@ -17,10 +17,12 @@
 #include "target/algorithm.h"
 #include "target/target_type.h"
 #include <helper/align.h>
+#include <helper/bits.h>
 #include <helper/log.h>
 #include "jtag/jtag.h"
 #include "target/register.h"
 #include "target/breakpoints.h"
+#include "target/smp.h"
 #include "helper/time_support.h"
 #include "helper/list.h"
 #include "riscv.h"
@@ -33,6 +35,8 @@
 #include "asm.h"
 #include "batch.h"
 #include "debug_reg_printer.h"
+#include "delay_profile.h"
+#include "mem_region.h"
 #include "field_helpers.h"
 
 static int riscv013_on_step_or_resume(struct target *target, bool step);
@@ -177,11 +181,23 @@ typedef struct {
 	 * response.
 	 */
 	struct riscv_scan_delays learned_delays;
+	/* Identifies the delay profile "learned_delays" are stored in. Only
+	 * valid once "delay_profile_key_valid" is set by examine(). */
+	struct riscv_delay_profile_key delay_profile_key;
+	bool delay_profile_key_valid;
+	/* riscv_delay_profile_generation() when the key was made. */
+	unsigned int delay_profile_generation;
+	/* "learned_delays" started from a profile, and weren't reset since. They
+	 * are not stored then, since they can only have gone up. */
+	bool delays_preloaded;
 
 	bool abstract_read_csr_supported;
 	bool abstract_write_csr_supported;
 	bool abstract_read_fpr_supported;
 	bool abstract_write_fpr_supported;
+	/* Registers whose batched abstract read raised an exception, so
+	 * riscv013_get_registers() skips them. */
+	DECLARE_BITMAP(abstract_read_failed, GDB_REGNO_COUNT);
 
 	yes_no_maybe_t has_aampostincrement;
 
@@ -200,8 +216,16 @@ typedef struct {
 	 * necessary. */
 	bool dcsr_ebreak_is_set;
 
-	/* This hart was placed into a halt group in examine(). */
-	bool haltgroup_supported;
+	/* haltreq was set by request_halt() and wasn't cleared yet. */
+	bool haltreq_set;
+
+	/* Halt and resume group this hart was placed in, 0 if none. */
+	unsigned int haltgroup;
+	unsigned int resumegroup;
+	/* The hart was taken out of its resume group, because it was stepped or
+	 * resumed without the other harts in the group. It's put back the next
+	 * time it's resumed together with them. */
+	bool resumegroup_left;
 } riscv013_info_t;
 
 static LIST_HEAD(dm_list);
@@ -384,18 +408,24 @@ static void select_dmi(struct target *target)
 		jtag_add_ir_scan(target->tap, &select_dbus, TAP_IDLE);
 }
 
-static int increase_dmi_busy_delay(struct target *target)
+/* Account for a busy condition, and make the scans of "delay_class" wait
+ * longer. */
+static int increase_delay(struct target *target,
+		enum riscv_scan_delay_class delay_class)
 {
 	RISCV013_INFO(info);
+	riscv_info(target)->stats.busy_retries[delay_class]++;
+	return riscv_scan_increase_delay(&info->learned_delays, delay_class);
+}
 
+static int increase_dmi_busy_delay(struct target *target)
+{
 	int res = dtmcontrol_scan(target, DTM_DTMCS_DMIRESET,
 			NULL /* discard result */);
 	if (res != ERROR_OK)
 		return res;
 
-	res = riscv_scan_increase_delay(&info->learned_delays,
-			RISCV_DELAY_BASE);
-	return res;
+	return increase_delay(target, RISCV_DELAY_BASE);
 }
 
 static void reset_learned_delays(struct target *target)
@@ -420,6 +450,7 @@ static void decrement_reset_delays_counter(struct target *target, size_t finishe
 	LOG_TARGET_DEBUG(target,
 			"resetting learned delays (reset_delays_wait counter expired)");
 	reset_learned_delays(target);
+	get_info(target)->delays_preloaded = false;
 }
 
 static uint32_t riscv013_get_dmi_address(const struct target *target, uint32_t address)
@@ -530,9 +561,7 @@ static int dmstatus_read(struct target *target, uint32_t *dmstatus,
 
 static int increase_ac_busy_delay(struct target *target)
 {
-	riscv013_info_t *info = get_info(target);
-	return riscv_scan_increase_delay(&info->learned_delays,
-			RISCV_DELAY_ABSTRACT_COMMAND);
+	return increase_delay(target, RISCV_DELAY_ABSTRACT_COMMAND);
 }
 
 static uint32_t __attribute__((unused)) abstract_register_size(unsigned int width)
@@ -563,6 +592,9 @@ static int wait_for_idle(struct target *target, uint32_t *abstractcs)
 		return ERROR_FAIL;
 	}
 
+	struct riscv_stats *stats = &riscv_info(target)->stats;
+	const int64_t start_us = timeval_us();
+	stats->idle_waits++;
 	time_t start = time(NULL);
 	do {
 		if (dm_read(target, abstractcs, DM_ABSTRACTCS) != ERROR_OK) {
@@ -576,9 +608,11 @@ static int wait_for_idle(struct target *target, uint32_t *abstractcs)
 
 		if (get_field(*abstractcs, DM_ABSTRACTCS_BUSY) == 0) {
 			dm->abstract_cmd_maybe_busy = false;
+			stats->idle_wait_us += timeval_us() - start_us;
 			return ERROR_OK;
 		}
 	} while ((time(NULL) - start) < riscv_get_command_timeout_sec());
+	stats->idle_wait_us += timeval_us() - start_us;
 
 	LOG_TARGET_ERROR(target,
 		"Timed out after %ds waiting for busy to go low (abstractcs=0x%" PRIx32 "). "
@@ -612,6 +646,15 @@ static size_t abstract_cmd_fill_batch(struct riscv_batch *batch,
 	return riscv_batch_add_dm_read(batch, DM_ABSTRACTCS, RISCV_DELAY_BASE);
 }
 
+/* Return abstractcs.cmderr, counting it in `riscv stats` if it's set. */
+static uint32_t abstractcs_cmderr(struct target *target, uint32_t abstractcs)
+{
+	const uint32_t cmderr = get_field32(abstractcs, DM_ABSTRACTCS_CMDERR);
+	if (cmderr != CMDERR_NONE)
+		riscv_info(target)->stats.abstract_command_errors++;
+	return cmderr;
+}
+
 static int abstract_cmd_batch_check_and_clear_cmderr(struct target *target,
 		const struct riscv_batch *batch, size_t abstractcs_read_key,
 		uint32_t *cmderr)
@@ -628,7 +671,7 @@ static int abstract_cmd_batch_check_and_clear_cmderr(struct target *target,
 		if (res != ERROR_OK)
 			goto clear_cmderr;
 	}
-	*cmderr = get_field32(abstractcs, DM_ABSTRACTCS_CMDERR);
+	*cmderr = abstractcs_cmderr(target, abstractcs);
 	if (*cmderr == CMDERR_NONE)
 		return ERROR_OK;
 	res = ERROR_FAIL;
@@ -868,6 +911,186 @@ static int register_read_abstract(struct target *target, riscv_reg_t *value,
 	return register_read_abstract_with_size(target, value, number, size);
 }
 
+static bool can_read_register_abstract(struct target *target,
+		enum gdb_regno number)
+{
+	RISCV013_INFO(info);
+	if (number < GDB_REGNO_COUNT && test_bit(number, info->abstract_read_failed))
+		return false;
+	if (number <= GDB_REGNO_XPR31)
+		return true;
+	if (number >= GDB_REGNO_FPR0 && number <= GDB_REGNO_FPR31)
+		return info->abstract_read_fpr_supported;
+	if (number >= GDB_REGNO_CSR0 && number <= GDB_REGNO_CSR4095)
+		return info->abstract_read_csr_supported;
+	return false;
+}
+
+/* Each register takes an abstract command, up to two data reads and an
+ * abstractcs read. */
+#define READ_REGISTERS_SCANS_PER_REG 4
+/* Times the registers left after a busy command are tried again. */
+#define READ_REGISTERS_MAX_BUSY_RETRIES 2
+
+/* Learn from the cmderr of the abstract command that read "number", so that
+ * the next batch doesn't fail the same way. */
+static void get_registers_handle_cmderr(struct target *target,
+		enum gdb_regno number, uint32_t cmderr)
+{
+	RISCV013_INFO(info);
+	switch (cmderr) {
+	case CMDERR_BUSY:
+		/* A command was started while the previous one was still
+		 * running, so give them more time next time. */
+		increase_ac_busy_delay(target);
+		break;
+	case CMDERR_NOT_SUPPORTED:
+		if (number >= GDB_REGNO_FPR0 && number <= GDB_REGNO_FPR31) {
+			info->abstract_read_fpr_supported = false;
+			LOG_TARGET_INFO(target, "Disabling abstract command reads from FPRs.");
+		} else if (number >= GDB_REGNO_CSR0 && number <= GDB_REGNO_CSR4095) {
+			info->abstract_read_csr_supported = false;
+			LOG_TARGET_INFO(target, "Disabling abstract command reads from CSRs.");
+		} else if (number < GDB_REGNO_COUNT) {
+			set_bit(number, info->abstract_read_failed);
+		}
+		break;
+	default:
+		/* The register is read another way from now on. */
+		if (number < GDB_REGNO_COUNT)
+			set_bit(number, info->abstract_read_failed);
+		break;
+	}
+}
+
+/* Read the registers from "regnos[start]" on in one batch. Returns the index
+ * of the register whose command failed in "failed" (or "count" if none did),
+ * with its cmderr in "cmderr". */
+static int get_registers_batch(struct target *target, unsigned int count,
+		const enum gdb_regno *regnos, riscv_reg_t *values, bool *read,
+		unsigned int start, unsigned int *failed, uint32_t *cmderr)
+{
+	dm013_info_t *dm = get_dm(target);
+	if (!dm)
+		return ERROR_FAIL;
+
+	*failed = count;
+	*cmderr = CMDERR_NONE;
+	size_t *data_keys = calloc(count, sizeof(*data_keys));
+	size_t *abstractcs_keys = calloc(count, sizeof(*abstractcs_keys));
+	struct riscv_batch *batch = riscv_batch_alloc(target,
+			(count - start) * READ_REGISTERS_SCANS_PER_REG);
+	if (!data_keys || !abstractcs_keys || !batch) {
+		free(data_keys);
+		free(abstractcs_keys);
+		riscv_batch_free(batch);
+		return ERROR_FAIL;
+	}
+
+	int res = ERROR_OK;
+	unsigned int queued = 0;
+	for (unsigned int i = start; i < count; i++) {
+		if (!can_read_register_abstract(target, regnos[i]))
+			continue;
+		const unsigned int size = register_size(target, regnos[i]);
+		const uint32_t command = riscv013_access_register_command(target,
+				regnos[i], size, AC_ACCESS_REGISTER_TRANSFER);
+		riscv_batch_add_dm_write(batch, DM_COMMAND, command,
+				/* read_back */ true, RISCV_DELAY_ABSTRACT_COMMAND);
+		data_keys[i] = riscv_batch_add_dm_read(batch, DM_DATA0,
+				RISCV_DELAY_BASE);
+		if (size > 32)
+			riscv_batch_add_dm_read(batch, DM_DATA1, RISCV_DELAY_BASE);
+		/* Tells whether the data above is this register's. */
+		abstractcs_keys[i] = riscv_batch_add_dm_read(batch, DM_ABSTRACTCS,
+				RISCV_DELAY_BASE);
+		queued++;
+	}
+	if (queued == 0)
+		goto cleanup;
+
+	/* Abstract commands are executed while running the batch. */
+	dm->abstract_cmd_maybe_busy = true;
+
+	res = batch_run_timeout(target, batch);
+	if (res != ERROR_OK)
+		goto cleanup;
+
+	for (unsigned int i = start; i < count; i++) {
+		if (!can_read_register_abstract(target, regnos[i]))
+			continue;
+		const uint32_t abstractcs = riscv_batch_get_dmi_read_data(batch,
+				abstractcs_keys[i]);
+		*cmderr = get_field32(abstractcs, DM_ABSTRACTCS_CMDERR);
+		if (*cmderr != CMDERR_NONE) {
+			/* The DM ignored all the commands after this one. */
+			*failed = i;
+			uint32_t cleared_cmderr;
+			abstract_cmd_batch_check_and_clear_cmderr(target, batch,
+					abstractcs_keys[i], &cleared_cmderr);
+			break;
+		}
+		values[i] = riscv_batch_get_dmi_read_data(batch, data_keys[i]);
+		if (register_size(target, regnos[i]) > 32)
+			values[i] |= (riscv_reg_t)riscv_batch_get_dmi_read_data(batch,
+					data_keys[i] + 1) << 32;
+		read[i] = true;
+	}
+
+cleanup:
+	free(data_keys);
+	free(abstractcs_keys);
+	riscv_batch_free(batch);
+	return res;
+}
+
+/**
+ * Read several registers with back-to-back abstract commands in a single
+ * batch. The caller has to make sure the registers exist and, for FPRs, that
+ * mstatus.FS is not Off.
+ *
+ * The commands are not separated by abstractcs polls. If one of them is still
+ * busy when the next access happens, or fails, cmderr is set and the DM
+ * ignores the rest of the commands. abstractcs is read after each register,
+ * so the values read before that are kept. The rest is read with another
+ * batch, after learning from the error: a register that can't be read with an
+ * abstract command isn't tried again with this function.
+ *
+ * "read[i]" is set for the registers that were read. Registers that can't be
+ * accessed with abstract commands are skipped.
+ */
+int riscv013_get_registers(struct target *target, unsigned int count,
+		const enum gdb_regno *regnos, riscv_reg_t *values, bool *read)
+{
+	for (unsigned int i = 0; i < count; i++)
+		read[i] = false;
+
+	if (dm013_select_target(target) != ERROR_OK)
+		return ERROR_FAIL;
+
+	unsigned int start = 0;
+	unsigned int busy_retries = 0;
+	while (start < count) {
+		unsigned int failed;
+		uint32_t cmderr;
+		int res = get_registers_batch(target, count, regnos, values, read,
+				start, &failed, &cmderr);
+		if (res != ERROR_OK || failed == count)
+			return res;
+
+		LOG_TARGET_DEBUG(target, "Batched read of %s failed (cmderr=%" PRIu32 ").",
+				riscv_reg_gdb_regno_name(target, regnos[failed]), cmderr);
+		get_registers_handle_cmderr(target, regnos[failed], cmderr);
+		if (cmderr != CMDERR_BUSY)
+			start = failed + 1;
+		else if (busy_retries++ == READ_REGISTERS_MAX_BUSY_RETRIES)
+			return ERROR_OK;
+		else
+			start = failed;
+	}
+	return ERROR_OK;
+}
+
 static int register_write_abstract(struct target *target, enum gdb_regno number,
 		riscv_reg_t value)
 {
@@ -1650,7 +1873,7 @@ static int halt_set_dcsr_ebreak(struct target *target)
 	 */
 
 
-	if (info->haltgroup_supported) {
+	if (info->haltgroup) {
 		bool supported;
 		if (set_group(target, &supported, 0, HALT_GROUP) != ERROR_OK)
 			return ERROR_FAIL;
@@ -1672,13 +1895,13 @@ static int halt_set_dcsr_ebreak(struct target *target)
 	}
 
 	/* Add it back to the halt group. */
-	if (info->haltgroup_supported) {
+	if (info->haltgroup) {
 		bool supported;
-		if (set_group(target, &supported, target->smp, HALT_GROUP) != ERROR_OK)
+		if (set_group(target, &supported, info->haltgroup, HALT_GROUP) != ERROR_OK)
 			return ERROR_FAIL;
 		if (!supported)
-			LOG_TARGET_ERROR(target, "Couldn't place hart back in halt group %d. "
-						 "Some harts may be unexpectedly halted.", target->smp);
+			LOG_TARGET_ERROR(target, "Couldn't place hart back in halt group %u. "
+						 "Some harts may be unexpectedly halted.", info->haltgroup);
 	}
 
 	return result;
@@ -1686,6 +1909,15 @@ static int halt_set_dcsr_ebreak(struct target *target)
 
 /*** OpenOCD target functions. ***/
 
+static void riscv013_update_delay_profile(struct target *target)
+{
+	RISCV013_INFO(info);
+	if (info->delay_profile_key_valid && !info->delays_preloaded &&
+			info->delay_profile_generation == riscv_delay_profile_generation())
+		riscv_delay_profile_update(&info->delay_profile_key,
+				&info->learned_delays);
+}
+
 static void deinit_target(struct target *target)
 {
 	LOG_TARGET_DEBUG(target, "Deinitializing target.");
@@ -1693,6 +1925,11 @@ static void deinit_target(struct target *target)
 	if (!info)
 		return;
 
+	if (info->version_specific) {
+		riscv013_update_delay_profile(target);
+		riscv_delay_profile_save_if_dirty();
+	}
+
 	riscv013_dm_free(target);
 
 	free(info->version_specific);
@@ -1717,6 +1954,135 @@ static int set_group(struct target *target, bool *supported, unsigned int group,
 	return ERROR_OK;
 }
 
+/* Like set_group(), but for a DM external trigger instead of the selected
+ * harts. */
+static int set_ext_trigger_group(struct target *target, bool *supported,
+		unsigned int trigger, unsigned int group, grouptype_t grouptype)
+{
+	uint32_t write_val = DM_DMCS2_HGWRITE | DM_DMCS2_HGSELECT;
+	assert(group <= 31);
+	assert(trigger < RISCV_MAX_DM_EXT_TRIGGERS);
+	write_val = set_field(write_val, DM_DMCS2_DMEXTTRIGGER, trigger);
+	write_val = set_field(write_val, DM_DMCS2_GROUP, group);
+	write_val = set_field(write_val, DM_DMCS2_GROUPTYPE, (grouptype == HALT_GROUP) ? 0 : 1);
+	if (dm_write(target, DM_DMCS2, write_val) != ERROR_OK)
+		return ERROR_FAIL;
+	uint32_t read_val;
+	if (dm_read(target, &read_val, DM_DMCS2) != ERROR_OK)
+		return ERROR_FAIL;
+	*supported = get_field(read_val, DM_DMCS2_DMEXTTRIGGER) == trigger &&
+		get_field(read_val, DM_DMCS2_GROUP) == group;
+	return ERROR_OK;
+}
+
+/* Place the hart and the DM external triggers into the halt and resume groups
+ * configured with `riscv hart_group` and `riscv ext_trigger_group`. By
+ * default all the harts of an SMP group are put in the same halt group, so
+ * when one of them halts the others are halted by the hardware. */
+static int configure_groups(struct target *target)
+{
+	RISCV_INFO(r);
+	RISCV013_INFO(info);
+
+	const unsigned int haltgroup = r->halt_group < 0 ? target->smp : r->halt_group;
+	const unsigned int resumegroup = r->resume_group < 0 ? target->smp : r->resume_group;
+
+	if (haltgroup != 0 || info->haltgroup != 0) {
+		if (dm013_select_target(target) != ERROR_OK)
+			return ERROR_FAIL;
+		bool supported;
+		if (set_group(target, &supported, haltgroup, HALT_GROUP) != ERROR_OK)
+			return ERROR_FAIL;
+		if (supported)
+			LOG_TARGET_INFO(target, "Core %d made part of halt group %u.", info->index,
+					haltgroup);
+		else
+			LOG_TARGET_INFO(target, "Core %d could not be made part of halt group %u.",
+					info->index, haltgroup);
+		info->haltgroup = supported ? haltgroup : 0;
+	}
+
+	if (resumegroup != 0 || info->resumegroup != 0) {
+		if (dm013_select_target(target) != ERROR_OK)
+			return ERROR_FAIL;
+		bool supported;
+		if (set_group(target, &supported, resumegroup, RESUME_GROUP) != ERROR_OK)
+			return ERROR_FAIL;
+		if (supported)
+			LOG_TARGET_INFO(target, "Core %d made part of resume group %u.", info->index,
+					resumegroup);
+		else
+			LOG_TARGET_INFO(target, "Core %d could not be made part of resume group %u.",
+					info->index, resumegroup);
+		info->resumegroup = supported ? resumegroup : 0;
+		info->resumegroup_left = false;
+	}
+
+	for (unsigned int i = 0; i < RISCV_MAX_DM_EXT_TRIGGERS; i++) {
+		const int groups[] = {
+			[HALT_GROUP] = r->ext_trigger_halt_group[i],
+			[RESUME_GROUP] = r->ext_trigger_resume_group[i]
+		};
+		for (grouptype_t type = HALT_GROUP; type <= RESUME_GROUP; type++) {
+			if (groups[type] < 0)
+				continue;
+			bool supported;
+			if (set_ext_trigger_group(target, &supported, i, groups[type],
+						type) != ERROR_OK)
+				return ERROR_FAIL;
+			if (!supported)
+				LOG_TARGET_WARNING(target, "DM external trigger %u could not be "
+						"made part of %s group %d.", i,
+						type == HALT_GROUP ? "halt" : "resume", groups[type]);
+		}
+	}
+	return ERROR_OK;
+}
+
+/* Whether resuming the prepped harts (or only "target" when stepping) would
+ * make the resume groups resume a hart that is supposed to stay halted. */
+static bool resume_drags_other_harts(struct target *target, bool step)
+{
+	dm013_info_t *dm = get_dm(target);
+	if (!dm)
+		return false;
+
+	uint32_t groups = 0;
+	target_list_t *entry;
+	list_for_each_entry(entry, &dm->target_list, list) {
+		struct target *t = entry->target;
+		if (t == target || (!step && riscv_info(t)->prepped))
+			groups |= BIT(get_info(t)->resumegroup);
+	}
+	/* Group 0 means "no group". */
+	groups &= ~BIT(0);
+	if (!groups)
+		return false;
+
+	list_for_each_entry(entry, &dm->target_list, list) {
+		struct target *t = entry->target;
+		if (t == target || (!step && riscv_info(t)->prepped))
+			continue;
+		if (t->state == TARGET_HALTED && (groups & BIT(get_info(t)->resumegroup)))
+			return true;
+	}
+	return false;
+}
+
+/* Take "target" out of its resume group, or put it back. */
+static int leave_resume_group(struct target *target, bool leave)
+{
+	RISCV013_INFO(info);
+	if (leave == info->resumegroup_left)
+		return ERROR_OK;
+	if (dm013_select_target(target) != ERROR_OK)
+		return ERROR_FAIL;
+	if (set_group(target, NULL, leave ? 0 : info->resumegroup, RESUME_GROUP) != ERROR_OK)
+		return ERROR_FAIL;
+	info->resumegroup_left = leave;
+	return ERROR_OK;
+}
+
 static int wait_for_idle_if_needed(struct target *target)
 {
 	dm013_info_t *dm = get_dm(target);
@@ -1931,6 +2297,20 @@ static int examine(struct target *target)
 	info->abits = get_field(dtmcontrol, DTM_DTMCS_ABITS);
 	info->dtmcs_idle = get_field(dtmcontrol, DTM_DTMCS_IDLE);
 
+	/* Start from the delays learned in an earlier session, if any. */
+	riscv_delay_profile_make_key(&info->delay_profile_key, target, dtmcontrol);
+	info->delay_profile_key_valid = true;
+	info->delay_profile_generation = riscv_delay_profile_generation();
+	if (riscv_delay_profile_preload(&info->delay_profile_key,
+				&info->learned_delays)) {
+		LOG_TARGET_DEBUG(target, "Using learned delays from the delay profile.");
+		/* Let them go down again later on. */
+		info->delays_preloaded = true;
+		RISCV_INFO(r);
+		if (r->reset_delays_wait < 0)
+			r->reset_delays_wait = RISCV_DELAY_PROFILE_SETTLE_SCANS;
+	}
+
 	if (!check_dbgbase_exists(target)) {
 		LOG_TARGET_ERROR(target, "Could not find debug module with DMI base address (dbgbase) = 0x%x", target->dbgbase);
 		return ERROR_FAIL;
@@ -2039,16 +2419,8 @@ static int examine(struct target *target)
 		target->debug_reason = DBG_REASON_UNDEFINED;
 	}
 
-	if (target->smp) {
-		if (set_group(target, &info->haltgroup_supported, target->smp, HALT_GROUP) != ERROR_OK)
-			return ERROR_FAIL;
-		if (info->haltgroup_supported)
-			LOG_TARGET_INFO(target, "Core %d made part of halt group %d.", info->index,
-					target->smp);
-		else
-			LOG_TARGET_INFO(target, "Core %d could not be made part of halt group %d.",
-					info->index, target->smp);
-	}
+	if (configure_groups(target) != ERROR_OK)
+		return ERROR_FAIL;
 
 	/* Some regression suites rely on seeing 'Examined RISC-V core' to know
 	 * when they can connect with gdb/telnet.
@@ -2058,6 +2430,29 @@ static int examine(struct target *target)
 	return ERROR_OK;
 }
 
+struct target *riscv013_identical_hart(struct target *target)
+{
+	dm013_info_t *dm = get_dm(target);
+	if (!dm)
+		return NULL;
+	const riscv013_info_t *info = get_info(target);
+	const struct riscv_info *r = riscv_info(target);
+	target_list_t *entry;
+	list_for_each_entry(entry, &dm->target_list, list) {
+		struct target *t = entry->target;
+		if (t == target || !target_was_examined(t))
+			continue;
+		const riscv013_info_t *t_info = get_info(t);
+		const struct riscv_info *t_r = riscv_info(t);
+		if (t_r->xlen == r->xlen && t_r->misa == r->misa &&
+				t_info->datasize == info->datasize &&
+				t_info->dataaccess == info->dataaccess &&
+				t_info->dataaddr == info->dataaddr)
+			return t;
+	}
+	return NULL;
+}
+
 static int riscv013_authdata_read(struct target *target, uint32_t *value, unsigned int index)
 {
 	if (index > 0) {
@@ -2249,103 +2644,400 @@ static int cleanup_after_vector_access(struct target *target,
 	return cleanup_after_register_access(target, mstatus, GDB_REGNO_VL);
 }
 
-int riscv013_get_register_buf(struct target *target, uint8_t *value,
-		enum gdb_regno regno)
+/* Commands of the vector transfer batches. The program buffer is executed
+ * after s0 is transferred. */
+static uint32_t vector_transfer_command(struct target *target, uint32_t flags)
 {
-	assert(regno >= GDB_REGNO_V0 && regno <= GDB_REGNO_V31);
+	if (!(flags & AC_ACCESS_REGISTER_TRANSFER))
+		return set_field(0, AC_ACCESS_REGISTER_AARSIZE, 2) |
+			set_field(0, AC_ACCESS_REGISTER_REGNO, 0x1000) | flags;
+	return riscv013_access_register_command(target, GDB_REGNO_S0,
+			riscv_xlen(target), flags);
+}
 
-	if (dm013_select_target(target) != ERROR_OK)
-		return ERROR_FAIL;
+/**
+ * Move the whole register through a working area with a single whole
+ * register store or load. This doesn't depend on vtype/vl and is the fastest
+ * option, but needs a working area and V 1.0 whole register instructions.
+ *
+ * Returns ERROR_TARGET_RESOURCE_NOT_AVAILABLE if it can't be used or fails,
+ * in which case the vector register is unchanged.
+ */
+static int vector_transfer_staged(struct target *target, unsigned int vnum,
+		uint8_t *read_value, const uint8_t *write_value)
+{
+	RISCV_INFO(r);
+	if (!has_sufficient_progbuf(target, 3))
+		return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
 
-	riscv_reg_t mstatus, vtype, vl;
-	unsigned int debug_vl, debug_vsew;
+	/* The hart in debug mode, as well as read_memory() and write_memory(),
+	 * use physical addresses, so a -work-area-virt address won't do. */
+	int mmu_enabled;
+	if (target->type->mmu(target, &mmu_enabled) != ERROR_OK || mmu_enabled)
+		return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
 
-	if (prep_for_vector_access(target, &mstatus, &vtype, &vl,
-				&debug_vl, &debug_vsew) != ERROR_OK)
-		return ERROR_FAIL;
+	struct working_area *area;
+	if (target_alloc_working_area_try(target, r->vlenb, &area) != ERROR_OK)
+		return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
 
-	if (riscv013_reg_save(target, GDB_REGNO_S0) != ERROR_OK)
-		return ERROR_FAIL;
+	int result = ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
+	if (!target->working_area_phys_spec ||
+			target->working_area != target->working_area_phys)
+		/* The working areas were set up while the MMU was enabled. */
+		goto release;
 
-	unsigned int vnum = regno - GDB_REGNO_V0;
+	if (write_value) {
+		/* This bypasses riscv_write_memory(), which keeps the memory
+		 * cache coherent with writes. Even a failed write may have
+		 * changed part of the area. */
+		riscv_mem_cache_invalidate_range(area->address, r->vlenb);
+		if (write_memory(target, area->address, 4, r->vlenb / 4,
+					write_value) != ERROR_OK)
+			goto release;
+	}
 
-	int result = ERROR_OK;
-	for (unsigned int i = 0; i < debug_vl; i++) {
-		/* Can't reuse the same program because riscv_program_exec() adds
-		 * ebreak to the end every time. */
-		struct riscv_program program;
-		riscv_program_init(&program, target);
-		riscv_program_insert(&program, vmv_x_s(S0, vnum));
-		riscv_program_insert(&program, vslide1down_vx(vnum, vnum, S0, true));
+	if (register_write_direct(target, GDB_REGNO_S0, area->address) != ERROR_OK)
+		goto release;
 
-		/* Executing the program might result in an exception if there is some
-		 * issue with the vector implementation/instructions we're using. If that
-		 * happens, attempt to restore as usual. We may have clobbered the
-		 * vector register we tried to read already.
-		 * For other failures, we just return error because things are probably
-		 * so messed up that attempting to restore isn't going to help. */
-		result = riscv_program_exec(&program, target);
-		if (result == ERROR_OK) {
-			riscv_reg_t v;
-			if (register_read_direct(target, &v, GDB_REGNO_S0) != ERROR_OK)
-				return ERROR_FAIL;
-			buf_set_u64(value, debug_vsew * i, debug_vsew, v);
-		} else {
-			LOG_TARGET_ERROR(target,
-					"Failed to execute vmv/vslide1down while reading %s",
-					riscv_reg_gdb_regno_name(target, regno));
-			break;
-		}
+	struct riscv_program program;
+	riscv_program_init(&program, target);
+	if (write_value) {
+		riscv_program_insert(&program, fence_rw_rw());
+		riscv_program_insert(&program, vl1re8_v(vnum, S0));
+	} else {
+		riscv_program_insert(&program, vs1r_v(vnum, S0));
+		riscv_program_insert(&program, fence_rw_rw());
+	}
+	if (riscv_program_exec(&program, target) != ERROR_OK) {
+		/* Most likely the whole register instructions aren't
+		 * implemented. Nothing was changed. */
+		LOG_TARGET_DEBUG(target, "Whole register %s failed.",
+				write_value ? "load" : "store");
+		result = ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
+		goto release;
+	}
+
+	if (read_value) {
+		/* The hart just stored to the working area. */
+		riscv_mem_cache_invalidate_range(area->address, r->vlenb);
+		if (read_memory(target, area->address, 4, r->vlenb / 4,
+					read_value, 4) == ERROR_OK)
+			result = ERROR_OK;
+	} else {
+		result = ERROR_OK;
 	}
 
-	if (cleanup_after_vector_access(target, mstatus, vtype, vl) != ERROR_OK)
-		return ERROR_FAIL;
-
+release:
+	target_free_working_area(target, area);
 	return result;
 }
 
-int riscv013_set_register_buf(struct target *target, enum gdb_regno regno,
-		const uint8_t *value)
+/**
+ * Read the register element by element like vector_read_by_element(), but
+ * with abstractauto set so that each read of data0 extracts the next element.
+ * All the elements are read with a single batch.
+ *
+ * The program counts its executions in s1. If the batch fails part way, that
+ * count is used to rotate the register back to its original state, and
+ * ERROR_TARGET_RESOURCE_NOT_AVAILABLE is returned.
+ */
+static int vector_read_autoexec(struct target *target, unsigned int vnum,
+		uint8_t *value, unsigned int debug_vl, unsigned int debug_vsew)
 {
-	assert(regno >= GDB_REGNO_V0 && regno <= GDB_REGNO_V31);
-
-	if (dm013_select_target(target) != ERROR_OK)
+	dm013_info_t *dm = get_dm(target);
+	if (!dm)
 		return ERROR_FAIL;
+	if (debug_vl < 3 || !has_sufficient_progbuf(target, 4))
+		return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
 
-	riscv_reg_t mstatus, vtype, vl;
-	unsigned int debug_vl, debug_vsew;
-
-	if (prep_for_vector_access(target, &mstatus, &vtype, &vl,
-				&debug_vl, &debug_vsew) != ERROR_OK)
+	if (riscv013_reg_save(target, GDB_REGNO_S1) != ERROR_OK)
 		return ERROR_FAIL;
-
-	if (riscv013_reg_save(target, GDB_REGNO_S0) != ERROR_OK)
+	if (register_write_direct(target, GDB_REGNO_S1, 0) != ERROR_OK)
 		return ERROR_FAIL;
 
-	unsigned int vnum = regno - GDB_REGNO_V0;
-
 	struct riscv_program program;
 	riscv_program_init(&program, target);
+	riscv_program_insert(&program, vmv_x_s(S0, vnum));
 	riscv_program_insert(&program, vslide1down_vx(vnum, vnum, S0, true));
-	int result = ERROR_OK;
-	for (unsigned int i = 0; i < debug_vl; i++) {
-		if (register_write_direct(target, GDB_REGNO_S0,
-					buf_get_u64(value, debug_vsew * i, debug_vsew)) != ERROR_OK)
-			return ERROR_FAIL;
-		result = riscv_program_exec(&program, target);
-		if (result != ERROR_OK)
-			break;
-	}
+	riscv_program_addi(&program, GDB_REGNO_S1, GDB_REGNO_S1, 1);
+	if (riscv_program_ebreak(&program) != ERROR_OK)
+		return ERROR_FAIL;
+	if (riscv_program_write(&program) != ERROR_OK)
+		return ERROR_FAIL;
 
-	if (cleanup_after_vector_access(target, mstatus, vtype, vl) != ERROR_OK)
+	const bool wide = riscv_xlen(target) > 32;
+	size_t *keys = calloc(debug_vl, sizeof(*keys));
+	struct riscv_batch *batch = riscv_batch_alloc(target, 3 * debug_vl + 8);
+	if (!keys || !batch) {
+		free(keys);
+		riscv_batch_free(batch);
 		return ERROR_FAIL;
+	}
 
-	return result;
-}
+	/* Execution n extracts element n - 1 into s0, and the transfer that
+	 * precedes execution n + 1 copies it to data0/data1. */
+	riscv_batch_add_dm_write(batch, DM_COMMAND,
+			vector_transfer_command(target, AC_ACCESS_REGISTER_POSTEXEC),
+			/* read_back */ true, RISCV_DELAY_ABSTRACT_COMMAND);
+	riscv_batch_add_dm_write(batch, DM_COMMAND,
+			vector_transfer_command(target, AC_ACCESS_REGISTER_TRANSFER |
+				AC_ACCESS_REGISTER_POSTEXEC),
+			/* read_back */ true, RISCV_DELAY_ABSTRACT_COMMAND);
+	riscv_batch_add_dm_write(batch, DM_ABSTRACTAUTO,
+			set_field(0, DM_ABSTRACTAUTO_AUTOEXECDATA, 1),
+			/* read_back */ true, RISCV_DELAY_BASE);
+	for (unsigned int i = 0; i < debug_vl - 2; i++) {
+		if (wide)
+			riscv_batch_add_dm_read(batch, DM_DATA1, RISCV_DELAY_BASE);
+		keys[i] = riscv_batch_add_dm_read(batch, DM_DATA0,
+				RISCV_DELAY_ABSTRACT_COMMAND);
+	}
+	riscv_batch_add_dm_write(batch, DM_ABSTRACTAUTO, 0,
+			/* read_back */ true, RISCV_DELAY_BASE);
+	if (wide)
+		riscv_batch_add_dm_read(batch, DM_DATA1, RISCV_DELAY_BASE);
+	keys[debug_vl - 2] = riscv_batch_add_dm_read(batch, DM_DATA0,
+			RISCV_DELAY_BASE);
+	/* The last element is still in s0. */
+	riscv_batch_add_dm_write(batch, DM_COMMAND,
+			vector_transfer_command(target, AC_ACCESS_REGISTER_TRANSFER),
+			/* read_back */ true, RISCV_DELAY_ABSTRACT_COMMAND);
+	if (wide)
+		riscv_batch_add_dm_read(batch, DM_DATA1, RISCV_DELAY_BASE);
+	keys[debug_vl - 1] = riscv_batch_add_dm_read(batch, DM_DATA0,
+			RISCV_DELAY_BASE);
+	const size_t abstractcs_read_key = riscv_batch_add_dm_read(batch,
+			DM_ABSTRACTCS, RISCV_DELAY_BASE);
 
-static uint32_t sb_sbaccess(unsigned int size_bytes)
-{
-	switch (size_bytes) {
+	dm->abstract_cmd_maybe_busy = true;
+	int result = batch_run_timeout(target, batch);
+	uint32_t cmderr = CMDERR_NONE;
+	if (result == ERROR_OK)
+		result = abstract_cmd_batch_check_and_clear_cmderr(target, batch,
+				abstractcs_read_key, &cmderr);
+
+	if (result == ERROR_OK) {
+		for (unsigned int i = 0; i < debug_vl; i++) {
+			riscv_reg_t v = riscv_batch_get_dmi_read_data(batch, keys[i]);
+			if (wide)
+				v |= (riscv_reg_t)riscv_batch_get_dmi_read_data(batch,
+						keys[i] - 1) << 32;
+			buf_set_u64(value, debug_vsew * i, debug_vsew, v);
+		}
+		goto cleanup;
+	}
+
+	/* Put the register back the way it was. */
+	if (cmderr == CMDERR_BUSY)
+		increase_ac_busy_delay(target);
+	if (dm_write(target, DM_ABSTRACTAUTO, 0) != ERROR_OK)
+		goto cleanup;
+	riscv_reg_t executions;
+	if (register_read_direct(target, &executions, GDB_REGNO_S1) != ERROR_OK)
+		goto cleanup;
+	LOG_TARGET_DEBUG(target, "Batched read of v%u failed after %" PRIu64
+			" of %u elements.", vnum, executions, debug_vl);
+	for (unsigned int i = executions % debug_vl; i && i < debug_vl; i++) {
+		if (riscv013_execute_progbuf(target, &cmderr) != ERROR_OK) {
+			LOG_TARGET_ERROR(target, "Failed to restore v%u.", vnum);
+			goto cleanup;
+		}
+	}
+	result = ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
+
+cleanup:
+	free(keys);
+	riscv_batch_free(batch);
+	return result;
+}
+
+/**
+ * Write the register element by element like vector_write_by_element(), but
+ * with abstractauto set so that each write of data0 slides the next element
+ * in. All the elements are written with a single batch.
+ *
+ * The elements slid in replace the whole register, so on failure
+ * ERROR_TARGET_RESOURCE_NOT_AVAILABLE is returned and the write can simply be
+ * done again.
+ */
+static int vector_write_autoexec(struct target *target, unsigned int vnum,
+		const uint8_t *value, unsigned int debug_vl, unsigned int debug_vsew)
+{
+	dm013_info_t *dm = get_dm(target);
+	if (!dm)
+		return ERROR_FAIL;
+	if (debug_vl < 2 || !has_sufficient_progbuf(target, 2))
+		return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
+
+	struct riscv_program program;
+	riscv_program_init(&program, target);
+	riscv_program_insert(&program, vslide1down_vx(vnum, vnum, S0, true));
+	if (riscv_program_ebreak(&program) != ERROR_OK)
+		return ERROR_FAIL;
+	if (riscv_program_write(&program) != ERROR_OK)
+		return ERROR_FAIL;
+
+	const bool wide = riscv_xlen(target) > 32;
+	struct riscv_batch *batch = riscv_batch_alloc(target, 2 * debug_vl + 4);
+	if (!batch)
+		return ERROR_FAIL;
+
+	for (unsigned int i = 0; i < debug_vl; i++) {
+		const riscv_reg_t v = buf_get_u64(value, debug_vsew * i, debug_vsew);
+		if (wide)
+			riscv_batch_add_dm_write(batch, DM_DATA1, (uint32_t)(v >> 32),
+					/* read_back */ true, RISCV_DELAY_BASE);
+		riscv_batch_add_dm_write(batch, DM_DATA0, (uint32_t)v,
+				/* read_back */ true,
+				i == 0 ? RISCV_DELAY_BASE : RISCV_DELAY_ABSTRACT_COMMAND);
+		if (i == 0) {
+			riscv_batch_add_dm_write(batch, DM_COMMAND,
+					vector_transfer_command(target,
+						AC_ACCESS_REGISTER_TRANSFER |
+						AC_ACCESS_REGISTER_WRITE |
+						AC_ACCESS_REGISTER_POSTEXEC),
+					/* read_back */ true, RISCV_DELAY_ABSTRACT_COMMAND);
+			riscv_batch_add_dm_write(batch, DM_ABSTRACTAUTO,
+					set_field(0, DM_ABSTRACTAUTO_AUTOEXECDATA, 1),
+					/* read_back */ true, RISCV_DELAY_BASE);
+		}
+	}
+	riscv_batch_add_dm_write(batch, DM_ABSTRACTAUTO, 0,
+			/* read_back */ true, RISCV_DELAY_BASE);
+	const size_t abstractcs_read_key = riscv_batch_add_dm_read(batch,
+			DM_ABSTRACTCS, RISCV_DELAY_BASE);
+
+	dm->abstract_cmd_maybe_busy = true;
+	int result = batch_run_timeout(target, batch);
+	uint32_t cmderr = CMDERR_NONE;
+	if (result == ERROR_OK)
+		result = abstract_cmd_batch_check_and_clear_cmderr(target, batch,
+				abstractcs_read_key, &cmderr);
+	riscv_batch_free(batch);
+	if (result == ERROR_OK)
+		return ERROR_OK;
+
+	if (cmderr == CMDERR_BUSY)
+		increase_ac_busy_delay(target);
+	if (dm_write(target, DM_ABSTRACTAUTO, 0) != ERROR_OK)
+		return ERROR_FAIL;
+	LOG_TARGET_DEBUG(target, "Batched write of v%u failed.", vnum);
+	return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
+}
+
+static int vector_read_by_element(struct target *target, unsigned int vnum,
+		uint8_t *value, unsigned int debug_vl, unsigned int debug_vsew)
+{
+	for (unsigned int i = 0; i < debug_vl; i++) {
+		/* Can't reuse the same program because riscv_program_exec() adds
+		 * ebreak to the end every time. */
+		struct riscv_program program;
+		riscv_program_init(&program, target);
+		riscv_program_insert(&program, vmv_x_s(S0, vnum));
+		riscv_program_insert(&program, vslide1down_vx(vnum, vnum, S0, true));
+
+		/* Executing the program might result in an exception if there is some
+		 * issue with the vector implementation/instructions we're using. If that
+		 * happens, attempt to restore as usual. We may have clobbered the
+		 * vector register we tried to read already.
+		 * For other failures, we just return error because things are probably
+		 * so messed up that attempting to restore isn't going to help. */
+		if (riscv_program_exec(&program, target) != ERROR_OK) {
+			LOG_TARGET_ERROR(target,
+					"Failed to execute vmv/vslide1down while reading v%u", vnum);
+			return ERROR_TARGET_FAILURE;
+		}
+		riscv_reg_t v;
+		if (register_read_direct(target, &v, GDB_REGNO_S0) != ERROR_OK)
+			return ERROR_FAIL;
+		buf_set_u64(value, debug_vsew * i, debug_vsew, v);
+	}
+	return ERROR_OK;
+}
+
+static int vector_write_by_element(struct target *target, unsigned int vnum,
+		const uint8_t *value, unsigned int debug_vl, unsigned int debug_vsew)
+{
+	struct riscv_program program;
+	riscv_program_init(&program, target);
+	riscv_program_insert(&program, vslide1down_vx(vnum, vnum, S0, true));
+	for (unsigned int i = 0; i < debug_vl; i++) {
+		if (register_write_direct(target, GDB_REGNO_S0,
+					buf_get_u64(value, debug_vsew * i, debug_vsew)) != ERROR_OK)
+			return ERROR_FAIL;
+		if (riscv_program_exec(&program, target) != ERROR_OK)
+			return ERROR_TARGET_FAILURE;
+	}
+	return ERROR_OK;
+}
+
+int riscv013_get_register_buf(struct target *target, uint8_t *value,
+		enum gdb_regno regno)
+{
+	assert(regno >= GDB_REGNO_V0 && regno <= GDB_REGNO_V31);
+
+	if (dm013_select_target(target) != ERROR_OK)
+		return ERROR_FAIL;
+
+	riscv_reg_t mstatus, vtype, vl;
+	unsigned int debug_vl, debug_vsew;
+
+	if (prep_for_vector_access(target, &mstatus, &vtype, &vl,
+				&debug_vl, &debug_vsew) != ERROR_OK)
+		return ERROR_FAIL;
+
+	unsigned int vnum = regno - GDB_REGNO_V0;
+
+	/* Whatever fails, try to restore vtype, vl and mstatus. */
+	int result = riscv013_reg_save(target, GDB_REGNO_S0);
+	if (result == ERROR_OK)
+		result = vector_transfer_staged(target, vnum, value, NULL);
+	if (result == ERROR_TARGET_RESOURCE_NOT_AVAILABLE)
+		result = vector_read_autoexec(target, vnum, value, debug_vl, debug_vsew);
+	if (result == ERROR_TARGET_RESOURCE_NOT_AVAILABLE)
+		result = vector_read_by_element(target, vnum, value, debug_vl, debug_vsew);
+
+	if (cleanup_after_vector_access(target, mstatus, vtype, vl) != ERROR_OK)
+		return ERROR_FAIL;
+
+	return result == ERROR_OK ? ERROR_OK : ERROR_FAIL;
+}
+
+int riscv013_set_register_buf(struct target *target, enum gdb_regno regno,
+		const uint8_t *value)
+{
+	assert(regno >= GDB_REGNO_V0 && regno <= GDB_REGNO_V31);
+
+	if (dm013_select_target(target) != ERROR_OK)
+		return ERROR_FAIL;
+
+	riscv_reg_t mstatus, vtype, vl;
+	unsigned int debug_vl, debug_vsew;
+
+	if (prep_for_vector_access(target, &mstatus, &vtype, &vl,
+				&debug_vl, &debug_vsew) != ERROR_OK)
+		return ERROR_FAIL;
+
+	unsigned int vnum = regno - GDB_REGNO_V0;
+
+	/* Whatever fails, try to restore vtype, vl and mstatus. */
+	int result = riscv013_reg_save(target, GDB_REGNO_S0);
+	if (result == ERROR_OK)
+		result = vector_transfer_staged(target, vnum, NULL, value);
+	if (result == ERROR_TARGET_RESOURCE_NOT_AVAILABLE)
+		result = vector_write_autoexec(target, vnum, value, debug_vl, debug_vsew);
+	if (result == ERROR_TARGET_RESOURCE_NOT_AVAILABLE)
+		result = vector_write_by_element(target, vnum, value, debug_vl, debug_vsew);
+
+	if (cleanup_after_vector_access(target, mstatus, vtype, vl) != ERROR_OK)
+		return ERROR_FAIL;
+
+	return result == ERROR_OK ? ERROR_OK : ERROR_FAIL;
+}
+
+static uint32_t sb_sbaccess(unsigned int size_bytes)
+{
+	switch (size_bytes) {
 		case 1:
 			return set_field(0, DM_SBCS_SBACCESS, 0);
 		case 2:
@@ -2420,28 +3112,57 @@ static int batch_run(struct target *target, struct riscv_batch *batch)
 	return ERROR_OK;
 }
 
-/* It is expected that during creation of the batch
- * "riscv_batch_add_dm_write(..., false)" was not used.
+/* Runs the batches with riscv_batch_run_pipelined(), RISCV_BATCH_PIPELINE_DEPTH
+ * at a time. Like batch_run(), a DMI busy response only increases the delay.
+ * Since all the scans following a busy one are ignored by the DTM, the
+ * batches after the one that got busy are not run and "dmi_busy_encountered"
+ * is set instead.
  */
-static int batch_run_timeout(struct target *target, struct riscv_batch *batch)
+static int batch_run_pipelined(struct target *target,
+		struct riscv_batch * const *batches, size_t count,
+		bool *dmi_busy_encountered)
 {
+	RISCV_INFO(r);
 	RISCV013_INFO(info);
 	select_dmi(target);
-	riscv_batch_add_nop(batch);
+	for (size_t i = 0; i < count; ++i)
+		riscv_batch_add_nop(batches[i]);
+
+	*dmi_busy_encountered = false;
+	for (size_t next = 0; next < count; ) {
+		const size_t in_flight = MIN(count - next,
+				(size_t)RISCV_BATCH_PIPELINE_DEPTH);
+		const int result = riscv_batch_run_pipelined(batches + next, in_flight,
+				&info->learned_delays,
+				/*resets_delays*/ r->reset_delays_wait >= 0,
+				r->reset_delays_wait);
+		if (result != ERROR_OK)
+			return result;
+		for (size_t i = next; i < next + in_flight; ++i)
+			decrement_reset_delays_counter(target, batches[i]->used_scans);
+		if (riscv_batch_was_batch_busy(batches[next + in_flight - 1])) {
+			*dmi_busy_encountered = true;
+			return increase_dmi_busy_delay(target);
+		}
+		next += in_flight;
+	}
+	return ERROR_OK;
+}
 
-	size_t finished_scans = 0;
+/* Replays the already run "batch" from its first failed scan until it
+ * completes without a DMI busy response or the command timeout expires.
+ * If "delay_raised" is set, the busy response was already accounted for by
+ * another batch on the same DTM, so the first replay doesn't raise the delay.
+ */
+static int batch_recover_busy_timeout(struct target *target,
+		struct riscv_batch *batch, size_t finished_scans, bool delay_raised)
+{
+	RISCV013_INFO(info);
 	const time_t start = time(NULL);
 	const unsigned int old_base_delay = riscv_scan_get_delay(&info->learned_delays,
 			RISCV_DELAY_BASE);
 	int result;
-	do {
-		RISCV_INFO(r);
-		result = riscv_batch_run_from(batch, finished_scans,
-				&info->learned_delays,
-				/*resets_delays*/  r->reset_delays_wait >= 0,
-				r->reset_delays_wait);
-		if (result != ERROR_OK)
-			return result;
+	while (true) {
 		const size_t new_finished_scans = riscv_batch_finished_scans(batch);
 		assert(new_finished_scans >= finished_scans);
 		decrement_reset_delays_counter(target, new_finished_scans - finished_scans);
@@ -2450,10 +3171,23 @@ static int batch_run_timeout(struct target *target, struct riscv_batch *batch)
 			assert(finished_scans == batch->used_scans);
 			return ERROR_OK;
 		}
-		result = increase_dmi_busy_delay(target);
+		if (delay_raised) {
+			delay_raised = false;
+		} else {
+			result = increase_dmi_busy_delay(target);
+			if (result != ERROR_OK)
+				return result;
+		}
+		if (time(NULL) - start >= riscv_get_command_timeout_sec())
+			break;
+		RISCV_INFO(r);
+		result = riscv_batch_run_from(batch, finished_scans,
+				&info->learned_delays,
+				/*resets_delays*/  r->reset_delays_wait >= 0,
+				r->reset_delays_wait);
 		if (result != ERROR_OK)
 			return result;
-	} while (time(NULL) - start < riscv_get_command_timeout_sec());
+	}
 
 	assert(result == ERROR_OK);
 	assert(riscv_batch_was_batch_busy(batch));
@@ -2472,6 +3206,150 @@ static int batch_run_timeout(struct target *target, struct riscv_batch *batch)
 	return ERROR_TIMEOUT_REACHED;
 }
 
+/* It is expected that during creation of the batch
+ * "riscv_batch_add_dm_write(..., false)" was not used.
+ */
+static int batch_run_timeout(struct target *target, struct riscv_batch *batch)
+{
+	RISCV_INFO(r);
+	RISCV013_INFO(info);
+	select_dmi(target);
+	riscv_batch_add_nop(batch);
+
+	const int result = riscv_batch_run_from(batch, 0, &info->learned_delays,
+			/*resets_delays*/  r->reset_delays_wait >= 0,
+			r->reset_delays_wait);
+	if (result != ERROR_OK)
+		return result;
+	return batch_recover_busy_timeout(target, batch, 0, false);
+}
+
+/* Pipelined counterpart of batch_run_timeout(). The batches are kept in
+ * flight RISCV_BATCH_PIPELINE_DEPTH at a time. When one of them gets a DMI
+ * busy response, it is replayed from the first failed scan and the pipeline
+ * is restarted with the batch that follows it.
+ *
+ * It is expected that during creation of the batches
+ * "riscv_batch_add_dm_write(..., false)" was not used.
+ */
+static int batch_run_pipelined_timeout(struct target *target,
+		struct riscv_batch * const *batches, size_t count)
+{
+	RISCV_INFO(r);
+	RISCV013_INFO(info);
+	select_dmi(target);
+	for (size_t i = 0; i < count; ++i)
+		riscv_batch_add_nop(batches[i]);
+
+	size_t next = 0;
+	while (next < count) {
+		const size_t in_flight = MIN(count - next,
+				(size_t)RISCV_BATCH_PIPELINE_DEPTH);
+		/* Batches left over from a busy pipeline are replayed entirely. */
+		size_t finished_scans = batches[next]->was_run
+			? riscv_batch_finished_scans(batches[next]) : 0;
+		int result = riscv_batch_run_pipelined(batches + next, in_flight,
+				&info->learned_delays,
+				/*resets_delays*/ r->reset_delays_wait >= 0,
+				r->reset_delays_wait);
+		if (result != ERROR_OK)
+			return result;
+
+		const size_t end = next + in_flight;
+		for (; next < end; ++next) {
+			struct riscv_batch * const batch = batches[next];
+			if (!riscv_batch_was_batch_busy(batch)) {
+				decrement_reset_delays_counter(target,
+						batch->used_scans - finished_scans);
+				finished_scans = 0;
+				continue;
+			}
+			result = batch_recover_busy_timeout(target, batch, finished_scans,
+					false);
+			if (result != ERROR_OK)
+				return result;
+			++next;
+			break;
+		}
+	}
+	return ERROR_OK;
+}
+
+/* Runs batches that belong to different targets, usually of Debug Modules
+ * behind different TAPs, with a single JTAG queue execution. Each batch is
+ * queued with its own target's delays after selecting that target's DMI
+ * register, so the adapter round trip is paid once for all of them. A batch
+ * that got a DMI busy response is then replayed on its own, as in
+ * batch_run_timeout().
+ *
+ * It is expected that during creation of the batches
+ * "riscv_batch_add_dm_write(..., false)" was not used.
+ */
+static int batch_run_parallel_timeout(struct riscv_batch * const *batches,
+		size_t count)
+{
+	unsigned int *last_scan_delays = calloc(count, sizeof(*last_scan_delays));
+	bool *busy = calloc(count, sizeof(*busy));
+	if (!last_scan_delays || !busy) {
+		LOG_ERROR("Failed to allocate memory.");
+		free(last_scan_delays);
+		free(busy);
+		return ERROR_FAIL;
+	}
+
+	for (size_t i = 0; i < count; ++i) {
+		struct target * const target = batches[i]->target;
+		RISCV_INFO(r);
+		RISCV013_INFO(info);
+		select_dmi(target);
+		riscv_batch_add_nop(batches[i]);
+		last_scan_delays[i] = riscv_batch_queue_from(batches[i], 0,
+				&info->learned_delays,
+				/*resets_delays*/ r->reset_delays_wait >= 0,
+				r->reset_delays_wait);
+	}
+
+	keep_alive();
+	/* The flush is accounted to the first target only. */
+	int result = riscv_stats_execute_queue(batches[0]->target);
+	keep_alive();
+	if (result != ERROR_OK) {
+		LOG_ERROR("Unable to execute JTAG queue");
+		free(last_scan_delays);
+		free(busy);
+		return ERROR_FAIL;
+	}
+
+	for (size_t i = 0; i < count; ++i) {
+		struct target * const target = batches[i]->target;
+		RISCV_INFO(r);
+		RISCV013_INFO(info);
+		riscv_batch_collect_from(batches[i], 0, &info->learned_delays,
+				/*resets_delays*/ r->reset_delays_wait >= 0,
+				r->reset_delays_wait, last_scan_delays[i]);
+	}
+
+	/* A DTM that answered busy keeps answering busy until dmireset, so the
+	 * batches queued after the first busy one on the same DTM fail with it.
+	 * That is a single busy event: the delay is raised once per DTM, and the
+	 * other batches are just replayed. Whether a batch was busy is noted
+	 * before any of them is replayed. */
+	for (size_t i = 0; i < count; ++i)
+		busy[i] = riscv_batch_was_batch_busy(batches[i]);
+
+	for (size_t i = 0; result == ERROR_OK && i < count; ++i) {
+		bool delay_raised = false;
+		for (size_t j = 0; j < i && !delay_raised; ++j)
+			delay_raised = busy[j] &&
+				batches[j]->target->tap == batches[i]->target->tap;
+		result = batch_recover_busy_timeout(batches[i]->target, batches[i], 0,
+				delay_raised);
+	}
+	free(last_scan_delays);
+	free(busy);
+	return result;
+}
+
 static int sba_supports_access(struct target *target, unsigned int size_bytes)
 {
 	RISCV013_INFO(info);
@@ -2491,6 +3369,17 @@ static int sba_supports_access(struct target *target, unsigned int size_bytes)
 	}
 }
 
+static bool riscv013_can_access_memory_while_running(struct target *target,
+		unsigned int size_bytes)
+{
+	RISCV_INFO(r);
+	for (unsigned int i = 0; i < r->num_enabled_mem_access_methods; i++) {
+		if (r->mem_access_methods[i] == RISCV_MEM_ACCESS_SYSBUS)
+			return sba_supports_access(target, size_bytes);
+	}
+	return false;
+}
+
 static int sample_memory_bus_v1(struct target *target,
 								struct riscv_sample_buf *buf,
 								const riscv_sample_config_t *config,
@@ -2516,8 +3405,10 @@ static int sample_memory_bus_v1(struct target *target,
 	uint32_t sbaddress1 = 0;
 	bool sbaddress1_valid = false;
 
-	/* How often to read each value in a batch. */
-	const unsigned int repeat = 5;
+	/* How often to read each value in a batch. When streaming, the buffer
+	 * is emptied whenever it fills up, so use longer batches to spend less
+	 * time between them. */
+	const unsigned int repeat = buf->streaming ? 32 : 5;
 
 	unsigned int enabled_count = 0;
 	for (unsigned int i = 0; i < ARRAY_SIZE(config->bucket); i++) {
@@ -2583,7 +3474,8 @@ static int sample_memory_bus_v1(struct target *target,
 			}
 		}
 
-		if (buf->used + result_bytes >= buf->size) {
+		/* Leave room for the batch timestamp. */
+		if (buf->used + result_bytes + 5 >= buf->size) {
 			riscv_batch_free(batch);
 			break;
 		}
@@ -2615,8 +3507,7 @@ static int sample_memory_bus_v1(struct target *target,
 			/* Discard this batch when we encounter "busy error" state on the System Bus level.
 			 * We'll try next time with a larger System Bus read delay. */
 			dm_write(target, DM_SBCS, sbcs_read | DM_SBCS_SBBUSYERROR | DM_SBCS_SBERROR);
-			int res = riscv_scan_increase_delay(&info->learned_delays,
-					RISCV_DELAY_SYSBUS_READ);
+			int res = increase_delay(target, RISCV_DELAY_SYSBUS_READ);
 			riscv_batch_free(batch);
 			if (res != ERROR_OK)
 				return res;
@@ -2629,6 +3520,7 @@ static int sample_memory_bus_v1(struct target *target,
 			return ERROR_FAIL;
 		}
 
+		riscv_sample_buf_add_batch_timestamp(buf);
 		unsigned int read_count = 0;
 		for (unsigned int n = 0; n < repeat; n++) {
 			for (unsigned int i = 0; i < ARRAY_SIZE(config->bucket); i++) {
@@ -2714,6 +3606,329 @@ static int riscv013_get_hart_state(struct target *target, enum riscv_hart_state
 	return ERROR_FAIL;
 }
 
+enum poll_group {
+	POLL_GROUP_RUNNING,
+	POLL_GROUP_HALTED,
+	POLL_GROUP_COUNT
+};
+
+struct poll_group_info {
+	uint32_t *hawindow;
+	unsigned int count;
+	unsigned int first;
+	size_t dmstatus_key;
+};
+
+static int poll_harts(struct target *target, struct list_head *targets);
+static int request_halt(struct target *target, struct list_head *targets,
+		bool request);
+
+static bool in_poll_group(struct target *target, const dm013_info_t *dm,
+		enum poll_group *group)
+{
+	if (!target_was_examined(target) ||
+			riscv_info(target)->poll_harts != &poll_harts ||
+			get_info(target)->dm != dm)
+		return false;
+	switch (target->state) {
+		case TARGET_RUNNING:
+		case TARGET_DEBUG_RUNNING:
+			*group = POLL_GROUP_RUNNING;
+			return true;
+		case TARGET_HALTED:
+			*group = POLL_GROUP_HALTED;
+			return true;
+		default:
+			return false;
+	}
+}
+
+/* Whether the summary bits in "dmstatus" show that none of the selected harts
+ * left "group". */
+static bool poll_group_unchanged(enum poll_group group, uint32_t dmstatus)
+{
+	const int version = get_field(dmstatus, DM_DMSTATUS_VERSION);
+	if ((version != 2 && version != 3) ||
+			!get_field(dmstatus, DM_DMSTATUS_AUTHENTICATED) ||
+			get_field(dmstatus, DM_DMSTATUS_ANYHAVERESET) ||
+			get_field(dmstatus, DM_DMSTATUS_ANYNONEXISTENT) ||
+			get_field(dmstatus, DM_DMSTATUS_ANYUNAVAIL))
+		return false;
+	if (group == POLL_GROUP_RUNNING)
+		return get_field(dmstatus, DM_DMSTATUS_ALLRUNNING) &&
+			!get_field(dmstatus, DM_DMSTATUS_ANYHALTED);
+	return get_field(dmstatus, DM_DMSTATUS_ALLHALTED) &&
+		!get_field(dmstatus, DM_DMSTATUS_ANYRUNNING);
+}
+
+/* What is needed to poll the harts of one DM with the hart array window. */
+struct dm_poll {
+	dm013_info_t *dm;
+	struct poll_group_info groups[POLL_GROUP_COUNT];
+	/* NULL when no group has more than one hart. */
+	struct riscv_batch *batch;
+};
+
+static void poll_dm_harts_free(struct dm_poll *poll)
+{
+	if (poll->batch)
+		riscv_batch_free(poll->batch);
+	poll->batch = NULL;
+	for (unsigned int g = 0; g < POLL_GROUP_COUNT; g++) {
+		free(poll->groups[g].hawindow);
+		poll->groups[g].hawindow = NULL;
+	}
+}
+
+/* Build the batch that checks the harts of "dm" that are in "targets": for
+ * the running and for the halted ones, select them all with the hart array
+ * window and read dmstatus. */
+static int poll_dm_harts_prepare(dm013_info_t *dm, struct list_head *targets,
+		struct dm_poll *poll)
+{
+	const unsigned int hawindow_count = (dm->hart_count + 31) / 32;
+	struct poll_group_info * const groups = poll->groups;
+	struct target *any = NULL;
+
+	memset(poll, 0, sizeof(*poll));
+	poll->dm = dm;
+	for (unsigned int g = 0; g < POLL_GROUP_COUNT; g++) {
+		groups[g].hawindow = calloc(hawindow_count, sizeof(uint32_t));
+		if (!groups[g].hawindow)
+			return ERROR_FAIL;
+	}
+
+	struct target_list *entry;
+	foreach_smp_target(entry, targets) {
+		struct target *t = entry->target;
+		enum poll_group g;
+		if (!in_poll_group(t, dm, &g))
+			continue;
+		const unsigned int index = get_info(t)->index;
+		if (groups[g].count == 0)
+			groups[g].first = index;
+		groups[g].hawindow[index / 32] |= 1 << (index % 32);
+		groups[g].count++;
+		any = t;
+	}
+
+	/* With one hart there's nothing to gain over selecting it directly. */
+	unsigned int group_count = 0;
+	for (unsigned int g = 0; g < POLL_GROUP_COUNT; g++)
+		if (groups[g].count > 1)
+			group_count++;
+	if (group_count == 0)
+		return ERROR_OK;
+
+	/* `hartsel` should not be changed if `abstractcs.busy` is set. */
+	int result = wait_for_idle_if_needed(any);
+	if (result != ERROR_OK)
+		return result;
+
+	struct riscv_batch *batch = riscv_batch_alloc(any,
+			group_count * (2 + 2 * hawindow_count));
+	if (!batch)
+		return ERROR_FAIL;
+	for (unsigned int g = 0; g < POLL_GROUP_COUNT; g++) {
+		if (groups[g].count <= 1)
+			continue;
+		/* The hart in hartsel is selected in addition to those in the
+		 * window, so point it at a member of the group. */
+		uint32_t dmcontrol = set_dmcontrol_hartsel(DM_DMCONTROL_DMACTIVE,
+				groups[g].first);
+		dmcontrol = set_field(dmcontrol, DM_DMCONTROL_HASEL,
+				DM_DMCONTROL_HASEL_MULTIPLE);
+		riscv_batch_add_dm_write(batch, DM_DMCONTROL, dmcontrol,
+				/* read_back */ true, RISCV_DELAY_BASE);
+		for (unsigned int i = 0; i < hawindow_count; i++) {
+			riscv_batch_add_dm_write(batch, DM_HAWINDOWSEL, i,
+					/* read_back */ true, RISCV_DELAY_BASE);
+			riscv_batch_add_dm_write(batch, DM_HAWINDOW,
+					groups[g].hawindow[i], /* read_back */ true,
+					RISCV_DELAY_BASE);
+		}
+		groups[g].dmstatus_key = riscv_batch_add_dm_read(batch, DM_DMSTATUS,
+				RISCV_DELAY_BASE);
+	}
+	poll->batch = batch;
+	return ERROR_OK;
+}
+
+/* Mark the harts of the groups whose dmstatus shows no change, once the batch
+ * built by poll_dm_harts_prepare() has been run. */
+static void poll_dm_harts_finish(const struct dm_poll *poll,
+		struct list_head *targets)
+{
+	for (unsigned int g = 0; g < POLL_GROUP_COUNT; g++) {
+		if (poll->groups[g].count <= 1)
+			continue;
+		const uint32_t dmstatus = riscv_batch_get_dmi_read_data(poll->batch,
+				poll->groups[g].dmstatus_key);
+		const bool unchanged = poll_group_unchanged(g, dmstatus);
+		LOG_TARGET_DEBUG(poll->batch->target, "%s group of %u harts: "
+				"dmstatus=0x%08" PRIx32 "%s",
+				g == POLL_GROUP_RUNNING ? "running" : "halted",
+				poll->groups[g].count, dmstatus,
+				unchanged ? "" : ", checking each hart");
+		if (!unchanged)
+			continue;
+		struct target_list *entry;
+		foreach_smp_target(entry, targets) {
+			enum poll_group t_group;
+			if (in_poll_group(entry->target, poll->dm, &t_group) &&
+					t_group == g)
+				riscv_info(entry->target)->poll_unchanged = true;
+		}
+	}
+}
+
+/* The batches of all the DMs are run with a single JTAG queue execution, so
+ * polling several clusters (each with its own DM, often behind its own TAP)
+ * costs one adapter round trip instead of one per DM. */
+static int poll_harts(struct target *target, struct list_head *targets)
+{
+	size_t dm_count = 0;
+	dm013_info_t *dm;
+	list_for_each_entry(dm, &dm_list, list)
+		dm_count++;
+	if (dm_count == 0)
+		return ERROR_OK;
+
+	struct dm_poll *polls = calloc(dm_count, sizeof(*polls));
+	struct riscv_batch **batches = calloc(dm_count, sizeof(*batches));
+	int result = ERROR_OK;
+	if (!polls || !batches) {
+		LOG_TARGET_ERROR(target, "Failed to allocate memory.");
+		result = ERROR_FAIL;
+		goto out;
+	}
+
+	size_t poll_count = 0;
+	size_t batch_count = 0;
+	list_for_each_entry(dm, &dm_list, list) {
+		if (!dm->hasel_supported || dm->hart_count < 2)
+			continue;
+		struct dm_poll * const poll = &polls[poll_count++];
+		result = poll_dm_harts_prepare(dm, targets, poll);
+		if (result != ERROR_OK)
+			goto out;
+		if (poll->batch)
+			batches[batch_count++] = poll->batch;
+	}
+	if (batch_count == 0)
+		goto out;
+
+	result = batch_run_parallel_timeout(batches, batch_count);
+	for (size_t i = 0; i < poll_count; i++) {
+		if (!polls[i].batch)
+			continue;
+		/* hartsel doesn't match what dm013_select_hart() would have
+		 * written. */
+		polls[i].dm->current_hartid = HART_INDEX_UNKNOWN;
+		if (result == ERROR_OK)
+			poll_dm_harts_finish(&polls[i], targets);
+	}
+
+out:
+	if (polls)
+		for (size_t i = 0; i < dm_count; i++)
+			poll_dm_harts_free(&polls[i]);
+	free(polls);
+	free(batches);
+	return result == ERROR_OK ? ERROR_OK : ERROR_FAIL;
+}
+
+static bool needs_halt_request(struct target *target, const dm013_info_t *dm,
+		bool request)
+{
+	if (!target_was_examined(target) ||
+			riscv_info(target)->request_halt != &request_halt ||
+			get_info(target)->dm != dm)
+		return false;
+	if (request)
+		return riscv_info(target)->prepped;
+	return get_info(target)->haltreq_set;
+}
+
+/* Only worth it when the harts are spread over several DMs: on a single DM
+ * riscv013_halt_go() already halts all the prepped harts with one haltreq.
+ * Each hart is selected on its own, so this works without the hart array
+ * window. A hart keeps its halt request when another one is selected. */
+static int request_halt(struct target *target, struct list_head *targets,
+		bool request)
+{
+	size_t dm_count = 0;
+	dm013_info_t *dm;
+	list_for_each_entry(dm, &dm_list, list) {
+		struct target_list *entry;
+		foreach_smp_target(entry, targets) {
+			if (needs_halt_request(entry->target, dm, request)) {
+				dm_count++;
+				break;
+			}
+		}
+	}
+	if (dm_count == 0 || (request && dm_count < 2))
+		return ERROR_OK;
+
+	struct riscv_batch **batches = calloc(dm_count, sizeof(*batches));
+	if (!batches) {
+		LOG_TARGET_ERROR(target, "Failed to allocate memory.");
+		return ERROR_FAIL;
+	}
+
+	int result = ERROR_OK;
+	size_t batch_count = 0;
+	list_for_each_entry(dm, &dm_list, list) {
+		unsigned int count = 0;
+		struct target *any = NULL;
+		struct target_list *entry;
+		foreach_smp_target(entry, targets) {
+			if (needs_halt_request(entry->target, dm, request)) {
+				count++;
+				any = entry->target;
+			}
+		}
+		if (count == 0)
+			continue;
+
+		/* `haltreq` and `hartsel` should not be written if
+		 * `abstractcs.busy` is set. */
+		result = wait_for_idle_if_needed(any);
+		if (result != ERROR_OK)
+			goto out;
+		struct riscv_batch *batch = riscv_batch_alloc(any, count);
+		if (!batch) {
+			result = ERROR_FAIL;
+			goto out;
+		}
+		batches[batch_count++] = batch;
+		foreach_smp_target(entry, targets) {
+			struct target *t = entry->target;
+			if (!needs_halt_request(t, dm, request))
+				continue;
+			uint32_t dmcontrol = DM_DMCONTROL_DMACTIVE;
+			if (request)
+				dmcontrol |= DM_DMCONTROL_HALTREQ;
+			dmcontrol = set_dmcontrol_hartsel(dmcontrol, get_info(t)->index);
+			riscv_batch_add_dm_write(batch, DM_DMCONTROL, dmcontrol,
+					/* read_back */ true, RISCV_DELAY_BASE);
+			get_info(t)->haltreq_set = request;
+		}
+		dm->current_hartid = HART_INDEX_UNKNOWN;
+	}
+
+	LOG_TARGET_DEBUG(target, "%s haltreq on %zu DMs", request ? "Setting" :
+			"Clearing", batch_count);
+	result = batch_run_parallel_timeout(batches, batch_count);
+
+out:
+	for (size_t i = 0; i < batch_count; i++)
+		riscv_batch_free(batches[i]);
+	free(batches);
+	return result == ERROR_OK ? ERROR_OK : ERROR_FAIL;
+}
+
 static int handle_became_unavailable(struct target *target,
 		enum riscv_hart_state previous_riscv_state)
 {
@@ -2740,6 +3955,9 @@ static int init_target(struct command_context *cmd_ctx,
 
 	generic_info->select_target = &dm013_select_target;
 	generic_info->get_hart_state = &riscv013_get_hart_state;
+	generic_info->poll_harts = &poll_harts;
+	generic_info->request_halt = &request_halt;
+	generic_info->configure_groups = &configure_groups;
 	generic_info->resume_go = &riscv013_resume_go;
 	generic_info->step_current_hart = &riscv013_step_current_hart;
 	generic_info->resume_prep = &riscv013_resume_prep;
@@ -2761,6 +3979,9 @@ static int init_target(struct command_context *cmd_ctx,
 	generic_info->dmi_write = &dmi_write;
 	generic_info->get_dmi_address = &riscv013_get_dmi_address;
 	generic_info->read_memory = read_memory;
+	generic_info->can_access_memory_while_running =
+		&riscv013_can_access_memory_while_running;
+	generic_info->update_delay_profile = &riscv013_update_delay_profile;
 	generic_info->data_bits = &riscv013_data_bits;
 	generic_info->print_info = &riscv013_print_info;
 	generic_info->get_impebreak = &riscv013_get_impebreak;
@@ -3191,6 +4412,12 @@ static int read_memory_bus_v0(struct target *target, target_addr_t address,
 	return ERROR_OK;
 }
 
+static void free_batches(struct riscv_batch * const *batches, size_t count)
+{
+	for (size_t i = 0; i < count; ++i)
+		riscv_batch_free(batches[i]);
+}
+
 /**
  * Read the requested memory using the system bus interface.
  */
@@ -3209,13 +4436,9 @@ static int read_memory_bus_v1(struct target *target, target_addr_t address,
 	if (!dm)
 		return ERROR_FAIL;
 
-	RISCV013_INFO(info);
 	target_addr_t next_address = address;
 	target_addr_t end_address = address + (increment ? count : 1) * size;
 
-	/* TODO: Reading all the elements in a single batch will boost the
-	 * performance.
-	 */
 	while (next_address < end_address) {
 		uint32_t sbcs_write = set_field(0, DM_SBCS_SBREADONADDR, 1);
 		sbcs_write |= sb_sbaccess(size);
@@ -3240,33 +4463,55 @@ static int read_memory_bus_v1(struct target *target, target_addr_t address,
 		 * be unnecessary.
 		 */
 		uint32_t sbvalue[4] = {0};
-		for (uint32_t i = (next_address - address) / size; i < count - 1; i++) {
-			const uint32_t size_in_words = DIV_ROUND_UP(size, 4);
-			struct riscv_batch *batch = riscv_batch_alloc(target, size_in_words);
-			/* Read of sbdata0 must be performed as last because it
-			 * starts the new bus data transfer
-			 * (in case "sbcs.sbreadondata" was set above).
-			 * We don't want to start the next bus read before we
-			 * fetch all the data from the last bus read. */
-			for (uint32_t j = size_in_words - 1; j > 0; --j)
-				riscv_batch_add_dm_read(batch, sbdata[j], RISCV_DELAY_BASE);
-			riscv_batch_add_dm_read(batch, sbdata[0], RISCV_DELAY_SYSBUS_READ);
-
-			int res = batch_run_timeout(target, batch);
+		const uint32_t size_in_words = DIV_ROUND_UP(size, 4);
+		uint32_t i = (next_address - address) / size;
+		while (i < count - 1) {
+			/* Keep several batches in flight to hide the adapter latency. */
+			struct riscv_batch *batches[RISCV_BATCH_PIPELINE_DEPTH];
+			size_t batch_count = 0;
+			uint32_t end = i;
+			while (batch_count < ARRAY_SIZE(batches) && end < count - 1) {
+				struct riscv_batch *batch = riscv_batch_alloc(target,
+						RISCV_BATCH_ALLOC_SIZE);
+				if (!batch) {
+					free_batches(batches, batch_count);
+					return ERROR_FAIL;
+				}
+				batches[batch_count++] = batch;
+				for (; end < count - 1 &&
+						riscv_batch_available_scans(batch) >= size_in_words; ++end) {
+					/* Read of sbdata0 must be performed as last because it
+					 * starts the new bus data transfer
+					 * (in case "sbcs.sbreadondata" was set above).
+					 * We don't want to start the next bus read before we
+					 * fetch all the data from the last bus read. */
+					for (uint32_t j = size_in_words - 1; j > 0; --j)
+						riscv_batch_add_dm_read(batch, sbdata[j], RISCV_DELAY_BASE);
+					riscv_batch_add_dm_read(batch, sbdata[0], RISCV_DELAY_SYSBUS_READ);
+				}
+			}
+
+			int res = batch_run_pipelined_timeout(target, batches, batch_count);
 			if (res != ERROR_OK) {
-				riscv_batch_free(batch);
+				free_batches(batches, batch_count);
 				return res;
 			}
 
-			const size_t last_key = batch->read_keys_used - 1;
-			for (size_t k = 0; k <= last_key; ++k) {
-				sbvalue[k] = riscv_batch_get_dmi_read_data(batch, last_key - k);
-				buf_set_u32(buffer + i * size + k * 4, 0, MIN(32, 8 * size), sbvalue[k]);
+			for (size_t b = 0; b < batch_count; ++b) {
+				const struct riscv_batch * const batch = batches[b];
+				for (size_t key = 0; key < batch->read_keys_used;
+						key += size_in_words, ++i) {
+					const size_t last_key = key + size_in_words - 1;
+					for (size_t k = 0; k < size_in_words; ++k) {
+						sbvalue[k] = riscv_batch_get_dmi_read_data(batch, last_key - k);
+						buf_set_u32(buffer + i * size + k * 4, 0, MIN(32, 8 * size), sbvalue[k]);
+					}
+					const target_addr_t read_addr = address + i * increment;
+					log_memory_access(read_addr, sbvalue, size, true);
+				}
 			}
-
-			riscv_batch_free(batch);
-			const target_addr_t read_addr = address + i * increment;
-			log_memory_access(read_addr, sbvalue, size, true);
+			assert(i == end);
+			free_batches(batches, batch_count);
 		}
 
 		uint32_t sbcs_read = 0;
@@ -3311,8 +4556,7 @@ static int read_memory_bus_v1(struct target *target, target_addr_t address,
 					return ERROR_FAIL;
 			}
 
-			int res = riscv_scan_increase_delay(&info->learned_delays,
-					RISCV_DELAY_SYSBUS_READ);
+			int res = increase_delay(target, RISCV_DELAY_SYSBUS_READ);
 			if (res != ERROR_OK)
 				return res;
 			continue;
@@ -3430,6 +4674,25 @@ bool is_mem_access_skipped(mem_access_result_t status)
 	return false;
 }
 
+/* Whether "status" means that the method can't work for this access size in
+ * this memory region, whatever the state of the hart. A failed access isn't
+ * enough to tell: it may be a bus error at one address or a transient DMI
+ * problem. Neither is an abstract access cmderr, which is also how a bus
+ * exception at one address is reported. */
+static bool is_mem_access_unusable(mem_access_result_t status)
+{
+	switch (status) {
+	case MEM_ACCESS_SKIPPED_PROGBUF_NOT_PRESENT:
+	case MEM_ACCESS_SKIPPED_PROGBUF_INSUFFICIENT:
+	case MEM_ACCESS_SKIPPED_UNSUPPORTED_ACCESS_SIZE:
+	case MEM_ACCESS_SKIPPED_XLEN_TOO_SHORT:
+	case MEM_ACCESS_SKIPPED_TOO_LARGE_ADDRESS:
+		return true;
+	default:
+		return false;
+	}
+}
+
 const char *mem_access_result_to_str(mem_access_result_t status)
 {
 	#define MEM_ACCESS_RESULT_HANDLER(name, kind, msg) \
@@ -3486,50 +4749,301 @@ static mem_access_result_t mem_should_skip_progbuf(struct target *target,
 }
 
 static mem_access_result_t
-mem_should_skip_sysbus(struct target *target, target_addr_t address,
-	uint32_t size, uint32_t increment, bool is_read)
+mem_should_skip_sysbus(struct target *target, target_addr_t address,
+	uint32_t size, uint32_t increment, bool is_read)
+{
+	RISCV013_INFO(info);
+	if (!sba_supports_access(target, size)) {
+		LOG_TARGET_DEBUG(target, "Skipping mem %s via system bus - unsupported size.",
+				is_read ? "read" : "write");
+		return MEM_ACCESS_SKIPPED_UNSUPPORTED_ACCESS_SIZE;
+	}
+	unsigned int sbasize = get_field(info->sbcs, DM_SBCS_SBASIZE);
+	if ((sizeof(address) * 8 > sbasize) && (address >> sbasize)) {
+		LOG_TARGET_DEBUG(target, "Skipping mem %s via system bus - sba only supports %u-bit address.",
+				is_read ? "read" : "write", sbasize);
+		return MEM_ACCESS_SKIPPED_TOO_LARGE_ADDRESS;
+	}
+	if (is_read && increment != size && (get_field(info->sbcs, DM_SBCS_SBVERSION) == 0 || increment != 0)) {
+		LOG_TARGET_DEBUG(target, "Skipping mem read via system bus - "
+				"sba reads only support size==increment or also size==0 for sba v1.");
+		return MEM_ACCESS_SKIPPED_UNSUPPORTED_INCREMENT_SIZE;
+	}
+
+	return MEM_ACCESS_OK;
+}
+
+static mem_access_result_t
+mem_should_skip_abstract(struct target *target, target_addr_t address,
+	uint32_t size, uint32_t increment, bool is_read)
+{
+	if (size > 8) {
+		/* TODO: Add 128b support if it's ever used. Involves modifying
+				 read/write_abstract_arg() to work on two 64b values. */
+		LOG_TARGET_DEBUG(target, "Skipping mem %s via abstract access - unsupported size: %d bits",
+				is_read ? "read" : "write", size * 8);
+		return MEM_ACCESS_SKIPPED_UNSUPPORTED_ACCESS_SIZE;
+	}
+	if ((sizeof(address) * 8 > riscv_xlen(target)) && (address >> riscv_xlen(target))) {
+		LOG_TARGET_DEBUG(target, "Skipping mem %s via abstract access - abstract access only supports %u-bit address.",
+				is_read ? "read" : "write", riscv_xlen(target));
+		return MEM_ACCESS_SKIPPED_TOO_LARGE_ADDRESS;
+	}
+	if (is_read && size != increment) {
+		LOG_TARGET_ERROR(target, "Skipping mem read via abstract access - "
+				"abstract command reads only support size==increment.");
+		return MEM_ACCESS_SKIPPED_UNSUPPORTED_INCREMENT_SIZE;
+	}
+	return MEM_ACCESS_OK;
+}
+
+/* Maximum number of DMI scans in one batch of a streaming abstract memory
+ * access (see read_memory_abstract_stream()). */
+#define ABSTRACT_MEMORY_STREAM_BATCH_SIZE 1024
+
+/*
+ * Runs a batch of a streaming abstract memory access and finds out how far
+ * it got. The batch arms abstractauto.autoexecdata, so it is disarmed here if
+ * the batch could not do it itself.
+ *
+ * "*next_index" is set to the index of the word arg1 points to, i.e. the one
+ * following the last word the target accessed. "*busy" tells whether the
+ * batch was cut short by a busy response (DMI or abstract command), in which
+ * case the caller has to restart the stream from there.
+ */
+static int abstract_memory_stream_run(struct target *target,
+		struct riscv_batch *batch, target_addr_t address, uint32_t size,
+		uint32_t first_index, uint32_t end_index, uint32_t *next_index,
+		bool *busy, uint32_t *cmderr)
+{
+	dm013_info_t *dm = get_dm(target);
+	if (!dm)
+		return ERROR_FAIL;
+
+	/* Abstract commands are executed while running the batch. */
+	dm->abstract_cmd_maybe_busy = true;
+	if (batch_run(target, batch) != ERROR_OK)
+		return ERROR_FAIL;
+	const bool dmi_busy = riscv_batch_was_batch_busy(batch);
+
+	uint32_t abstractcs;
+	if (wait_for_idle(target, &abstractcs) != ERROR_OK) {
+		dm_write(target, DM_ABSTRACTAUTO, 0);
+		return ERROR_FAIL;
+	}
+	/* After a DMI busy the rest of the batch was ignored, including the
+	 * write that disarms autoexecdata. */
+	if (dmi_busy && dm_write(target, DM_ABSTRACTAUTO, 0) != ERROR_OK)
+		return ERROR_FAIL;
+
+	*cmderr = abstractcs_cmderr(target, abstractcs);
+	*busy = dmi_busy || *cmderr == CMDERR_BUSY;
+	if (*cmderr != CMDERR_NONE) {
+		LOG_TARGET_DEBUG(target, "Streaming abstract memory access failed, "
+				"cmderr=0x%" PRIx32, *cmderr);
+		if (dm_write(target, DM_ABSTRACTAUTO, 0) != ERROR_OK)
+			return ERROR_FAIL;
+		if (riscv013_clear_abstract_error(target) != ERROR_OK)
+			return ERROR_FAIL;
+		if (*cmderr != CMDERR_BUSY)
+			return ERROR_OK;
+		if (increase_ac_busy_delay(target) != ERROR_OK)
+			return ERROR_FAIL;
+		*cmderr = CMDERR_NONE;
+	}
+
+	if (!*busy) {
+		*next_index = end_index;
+		return ERROR_OK;
+	}
+
+	/* Every command that was executed advanced arg1 by "size". */
+	riscv_reg_t next_address;
+	if (read_abstract_arg(target, &next_address, 1, riscv_xlen(target)) != ERROR_OK)
+		return ERROR_FAIL;
+	riscv_reg_t offset = next_address - address;
+	if (riscv_xlen(target) < 64)
+		offset &= UINT32_MAX;
+	if (offset % size || offset / size <= first_index ||
+			offset / size > end_index) {
+		LOG_TARGET_ERROR(target, "Abstract memory access stopped at an "
+				"unexpected address (0x%" PRIx64 ").", next_address);
+		return ERROR_FAIL;
+	}
+	*next_index = offset / size;
+	LOG_TARGET_DEBUG(target, "Streaming abstract memory access got busy, "
+			"restarting at 0x%" TARGET_PRIxADDR ".",
+			(target_addr_t)(address + *next_index * size));
+	return ERROR_OK;
+}
+
+/*
+ * Executes the abstract memory access "command" for the word at "index" the
+ * usual way. That leaves arg1 pointing to the next word, ready for the
+ * commands triggered by autoexecdata.
+ */
+static mem_access_result_t abstract_memory_stream_start(struct target *target,
+		uint32_t command, target_addr_t address, uint32_t size, uint32_t index,
+		const uint8_t *write_buffer)
+{
+	const unsigned int xlen = riscv_xlen(target);
+	if (write_abstract_arg(target, 1, address + index * size, xlen) != ERROR_OK)
+		return MEM_ACCESS_FAILED_DM_ACCESS_FAILED;
+	if (write_buffer && write_abstract_arg(target, 0,
+				buf_get_u64(write_buffer + index * size, 0, 8 * size),
+				xlen) != ERROR_OK)
+		return MEM_ACCESS_FAILED_DM_ACCESS_FAILED;
+	uint32_t cmderr;
+	if (riscv013_execute_abstract_command(target, command, &cmderr) != ERROR_OK)
+		return MEM_ACCESS_SKIPPED_ABSTRACT_ACCESS_CMDERR;
+	return MEM_ACCESS_OK;
+}
+
+/*
+ * Reads words ["index", "count") with abstract memory accesses, which must
+ * support aampostincrement.
+ *
+ * Instead of writing the command (and the address) for every word, the first
+ * command is executed the usual way and abstractauto.autoexecdata[0] is set.
+ * From then on, each read of data0 returns the current word and reads the
+ * next one, so a word costs a single DMI scan (two for 64-bit words) and
+ * the reads are queued in one large batch. On a busy response, arg1 tells
+ * which word is the first one that wasn't read yet, and the stream is
+ * restarted from there, like read_memory_progbuf_inner_on_ac_busy() does.
+ */
+static mem_access_result_t
+read_memory_abstract_stream(struct target *target, target_addr_t address,
+	uint32_t size, uint32_t count, uint8_t *buffer, uint32_t index)
 {
-	RISCV013_INFO(info);
-	if (!sba_supports_access(target, size)) {
-		LOG_TARGET_DEBUG(target, "Skipping mem %s via system bus - unsupported size.",
-				is_read ? "read" : "write");
-		return MEM_ACCESS_SKIPPED_UNSUPPORTED_ACCESS_SIZE;
-	}
-	unsigned int sbasize = get_field(info->sbcs, DM_SBCS_SBASIZE);
-	if ((sizeof(address) * 8 > sbasize) && (address >> sbasize)) {
-		LOG_TARGET_DEBUG(target, "Skipping mem %s via system bus - sba only supports %u-bit address.",
-				is_read ? "read" : "write", sbasize);
-		return MEM_ACCESS_SKIPPED_TOO_LARGE_ADDRESS;
-	}
-	if (is_read && increment != size && (get_field(info->sbcs, DM_SBCS_SBVERSION) == 0 || increment != 0)) {
-		LOG_TARGET_DEBUG(target, "Skipping mem read via system bus - "
-				"sba reads only support size==increment or also size==0 for sba v1.");
-		return MEM_ACCESS_SKIPPED_UNSUPPORTED_INCREMENT_SIZE;
-	}
+	const uint32_t command = access_memory_command(target, false, size << 3,
+			/* postincrement */ true, /* is_write */ false);
+	const uint32_t reads_per_element = size > 4 ? 2 : 1;
+	const uint32_t two_regs_used[] = {DM_DATA1, DM_DATA0};
+	const uint32_t one_reg_used[] = {DM_DATA0};
+	const uint32_t * const used_regs = size > 4 ? two_regs_used : one_reg_used;
+
+	while (index < count) {
+		mem_access_result_t skip_reason = abstract_memory_stream_start(target,
+				command, address, size, index, NULL);
+		if (skip_reason != MEM_ACCESS_OK)
+			return skip_reason;
+
+		/* data0 holds the word at "index", arg1 points to the next one. */
+		struct riscv_batch *batch = riscv_batch_alloc(target,
+				ABSTRACT_MEMORY_STREAM_BATCH_SIZE);
+		if (!batch)
+			return MEM_ACCESS_FAILED_DM_ACCESS_FAILED;
+		riscv_batch_add_dm_write(batch, DM_ABSTRACTAUTO,
+				set_field(0, DM_ABSTRACTAUTO_AUTOEXECDATA, 1),
+				/* read_back */ true, RISCV_DELAY_BASE);
+		/* Leave room to disarm, read the last word and the final NOP. */
+		uint32_t end = index + 1;
+		while (end < count && riscv_batch_available_scans(batch) >=
+				2 * reads_per_element + 2) {
+			/* Only the read of data0 starts the next access. */
+			for (uint32_t i = 0; i < reads_per_element; ++i)
+				riscv_batch_add_dm_read(batch, used_regs[i],
+						used_regs[i] == DM_DATA0 ?
+						RISCV_DELAY_ABSTRACT_COMMAND : RISCV_DELAY_BASE);
+			++end;
+		}
+		/* The read of the last word must not start another access. */
+		riscv_batch_add_dm_write(batch, DM_ABSTRACTAUTO, 0,
+				/* read_back */ true, RISCV_DELAY_BASE);
+		for (uint32_t i = 0; i < reads_per_element; ++i)
+			riscv_batch_add_dm_read(batch, used_regs[i], RISCV_DELAY_BASE);
+
+		uint32_t next_index, cmderr;
+		bool busy;
+		if (abstract_memory_stream_run(target, batch, address, size, index,
+					end, &next_index, &busy, &cmderr) != ERROR_OK) {
+			riscv_batch_free(batch);
+			return MEM_ACCESS_FAILED_DM_ACCESS_FAILED;
+		}
+		if (cmderr != CMDERR_NONE) {
+			riscv_batch_free(batch);
+			return MEM_ACCESS_SKIPPED_ABSTRACT_ACCESS_CMDERR;
+		}
 
+		/* After a busy response, the word at "next_index - 1" was read by
+		 * the target but the read of data0 that should have returned it
+		 * is the one that failed (or was ignored). */
+		const uint32_t good_end = busy ? next_index - 1 : end;
+		uint32_t j;
+		for (j = index; j < good_end; ++j) {
+			uint64_t value = 0;
+			uint32_t i;
+			for (i = 0; i < reads_per_element; ++i) {
+				const size_t key = (j - index) * reads_per_element + i;
+				/* A read that got a DMI busy response may still have
+				 * started the next access, but its data is lost. */
+				if (riscv_batch_get_dmi_read_op(batch, key) != DMI_STATUS_SUCCESS)
+					break;
+				value = (value << 32) | riscv_batch_get_dmi_read_data(batch, key);
+			}
+			if (i < reads_per_element)
+				break;
+			buf_set_u64(buffer + j * size, 0, 8 * size, value);
+		}
+		riscv_batch_free(batch);
+		index = j;
+	}
 	return MEM_ACCESS_OK;
 }
 
+/*
+ * Writes words ["index", "count") with abstract memory accesses, which must
+ * support aampostincrement. This is the counterpart of
+ * read_memory_abstract_stream(): with abstractauto.autoexecdata[0] set, each
+ * write of data0 writes the next word.
+ */
 static mem_access_result_t
-mem_should_skip_abstract(struct target *target, target_addr_t address,
-	uint32_t size, uint32_t increment, bool is_read)
-{
-	if (size > 8) {
-		/* TODO: Add 128b support if it's ever used. Involves modifying
-				 read/write_abstract_arg() to work on two 64b values. */
-		LOG_TARGET_DEBUG(target, "Skipping mem %s via abstract access - unsupported size: %d bits",
-				is_read ? "read" : "write", size * 8);
-		return MEM_ACCESS_SKIPPED_UNSUPPORTED_ACCESS_SIZE;
-	}
-	if ((sizeof(address) * 8 > riscv_xlen(target)) && (address >> riscv_xlen(target))) {
-		LOG_TARGET_DEBUG(target, "Skipping mem %s via abstract access - abstract access only supports %u-bit address.",
-				is_read ? "read" : "write", riscv_xlen(target));
-		return MEM_ACCESS_SKIPPED_TOO_LARGE_ADDRESS;
-	}
-	if (is_read && size != increment) {
-		LOG_TARGET_ERROR(target, "Skipping mem read via abstract access - "
-				"abstract command reads only support size==increment.");
-		return MEM_ACCESS_SKIPPED_UNSUPPORTED_INCREMENT_SIZE;
+write_memory_abstract_stream(struct target *target, target_addr_t address,
+	uint32_t size, uint32_t count, const uint8_t *buffer, uint32_t index)
+{
+	const uint32_t command = access_memory_command(target, false, size << 3,
+			/* postincrement */ true, /* is_write */ true);
+	const uint32_t writes_per_element = size > 4 ? 2 : 1;
+
+	while (index < count) {
+		mem_access_result_t skip_reason = abstract_memory_stream_start(target,
+				command, address, size, index, buffer);
+		if (skip_reason != MEM_ACCESS_OK)
+			return skip_reason;
+		if (++index == count)
+			break;
+
+		struct riscv_batch *batch = riscv_batch_alloc(target,
+				ABSTRACT_MEMORY_STREAM_BATCH_SIZE);
+		if (!batch)
+			return MEM_ACCESS_FAILED_DM_ACCESS_FAILED;
+		riscv_batch_add_dm_write(batch, DM_ABSTRACTAUTO,
+				set_field(0, DM_ABSTRACTAUTO_AUTOEXECDATA, 1),
+				/* read_back */ true, RISCV_DELAY_BASE);
+		/* Leave room to disarm and the final NOP. */
+		uint32_t end = index;
+		while (end < count && riscv_batch_available_scans(batch) >=
+				writes_per_element + 2) {
+			const uint64_t value = buf_get_u64(buffer + end * size, 0, 8 * size);
+			if (writes_per_element > 1)
+				riscv_batch_add_dm_write(batch, DM_DATA1, value >> 32,
+						/* read_back */ true, RISCV_DELAY_BASE);
+			riscv_batch_add_dm_write(batch, DM_DATA0, (uint32_t)value,
+					/* read_back */ true, RISCV_DELAY_ABSTRACT_COMMAND);
+			++end;
+		}
+		riscv_batch_add_dm_write(batch, DM_ABSTRACTAUTO, 0,
+				/* read_back */ true, RISCV_DELAY_BASE);
+
+		uint32_t cmderr;
+		bool busy;
+		const int result = abstract_memory_stream_run(target, batch, address,
+				size, index - 1, end, &index, &busy, &cmderr);
+		riscv_batch_free(batch);
+		if (result != ERROR_OK)
+			return MEM_ACCESS_FAILED_DM_ACCESS_FAILED;
+		if (cmderr != CMDERR_NONE)
+			return MEM_ACCESS_SKIPPED_ABSTRACT_ACCESS_CMDERR;
 	}
 	return MEM_ACCESS_OK;
 }
@@ -3562,20 +5076,21 @@ read_memory_abstract(struct target *target, target_addr_t address,
 	/* Create the command (physical address, postincrement, read) */
 	uint32_t command = access_memory_command(target, false, width, use_aampostincrement, false);
 
+	if (info->has_aampostincrement == YNM_YES && count > 1)
+		return read_memory_abstract_stream(target, address, size, count,
+				buffer, /* index */ 0);
+
 	/* Execute the reads */
 	uint8_t *p = buffer;
 	int result = ERROR_OK;
-	bool updateaddr = true;
 	unsigned int width32 = (width < 32) ? 32 : width;
 	for (uint32_t c = 0; c < count; c++) {
-		/* Update the address if it is the first time or aampostincrement is not supported by the target. */
-		if (updateaddr) {
-			/* Set arg1 to the address: address + c * size */
-			result = write_abstract_arg(target, 1, address + c * size, riscv_xlen(target));
-			if (result != ERROR_OK) {
-				LOG_TARGET_ERROR(target, "Failed to write arg1.");
-				return MEM_ACCESS_FAILED_DM_ACCESS_FAILED;
-			}
+		/* Set arg1 to the address: address + c * size. Once aampostincrement
+		 * is known to work, the rest is streamed instead. */
+		result = write_abstract_arg(target, 1, address + c * size, riscv_xlen(target));
+		if (result != ERROR_OK) {
+			LOG_TARGET_ERROR(target, "Failed to write arg1.");
+			return MEM_ACCESS_FAILED_DM_ACCESS_FAILED;
 		}
 
 		/* Execute the command */
@@ -3623,8 +5138,10 @@ read_memory_abstract(struct target *target, target_addr_t address,
 			return MEM_ACCESS_FAILED_DM_ACCESS_FAILED;
 		buf_set_u64(p, 0, 8 * size, value);
 
-		if (info->has_aampostincrement == YNM_YES)
-			updateaddr = false;
+		/* Now that aampostincrement is known to work, stream the rest. */
+		if (info->has_aampostincrement == YNM_YES && c + 1 < count)
+			return read_memory_abstract_stream(target, address, size, count,
+					buffer, c + 1);
 		p += size;
 	}
 
@@ -3659,9 +5176,12 @@ write_memory_abstract(struct target *target, target_addr_t address,
 	/* Create the command (physical address, postincrement, write) */
 	uint32_t command = access_memory_command(target, false, width, use_aampostincrement, true);
 
+	if (info->has_aampostincrement == YNM_YES && count > 1)
+		return write_memory_abstract_stream(target, address, size, count,
+				buffer, /* index */ 0);
+
 	/* Execute the writes */
 	const uint8_t *p = buffer;
-	bool updateaddr = true;
 	for (uint32_t c = 0; c < count; c++) {
 		/* Move data to arg0 */
 		riscv_reg_t value = buf_get_u64(p, 0, 8 * size);
@@ -3671,14 +5191,12 @@ write_memory_abstract(struct target *target, target_addr_t address,
 			return MEM_ACCESS_FAILED_DM_ACCESS_FAILED;
 		}
 
-		/* Update the address if it is the first time or aampostincrement is not supported by the target. */
-		if (updateaddr) {
-			/* Set arg1 to the address: address + c * size */
-			result = write_abstract_arg(target, 1, address + c * size, riscv_xlen(target));
-			if (result != ERROR_OK) {
-				LOG_TARGET_ERROR(target, "Failed to write arg1.");
-				return MEM_ACCESS_FAILED_DM_ACCESS_FAILED;
-			}
+		/* Set arg1 to the address: address + c * size. Once aampostincrement
+		 * is known to work, the rest is streamed instead. */
+		result = write_abstract_arg(target, 1, address + c * size, riscv_xlen(target));
+		if (result != ERROR_OK) {
+			LOG_TARGET_ERROR(target, "Failed to write arg1.");
+			return MEM_ACCESS_FAILED_DM_ACCESS_FAILED;
 		}
 
 		/* Execute the command */
@@ -3719,8 +5237,10 @@ write_memory_abstract(struct target *target, target_addr_t address,
 		if (result != ERROR_OK)
 			return MEM_ACCESS_SKIPPED_ABSTRACT_ACCESS_CMDERR;
 
-		if (info->has_aampostincrement == YNM_YES)
-			updateaddr = false;
+		/* Now that aampostincrement is known to work, stream the rest. */
+		if (info->has_aampostincrement == YNM_YES && c + 1 < count)
+			return write_memory_abstract_stream(target, address, size, count,
+					buffer, c + 1);
 		p += size;
 	}
 
@@ -3781,7 +5301,7 @@ static int read_memory_progbuf_inner_startup(struct target *target,
 	if (wait_for_idle(target, &abstractcs) != ERROR_OK)
 		goto clear_abstractauto_and_fail;
 
-	cmderr = get_field32(abstractcs, DM_ABSTRACTCS_CMDERR);
+	cmderr = abstractcs_cmderr(target, abstractcs);
 	switch (cmderr) {
 	case CMDERR_NONE:
 		return ERROR_OK;
@@ -3944,37 +5464,45 @@ static int read_memory_progbuf_inner_extract_batch_data(struct target *target,
  * Prior to calling this function the folowing conditions should be met:
  * - Appropriate program loaded to program buffer.
  * - DM_ABSTRACTAUTO_AUTOEXECDATA is set.
+ * "elements_in_batch[i]" is the number of elements "batches[i]" reads.
  */
-static int read_memory_progbuf_inner_run_and_process_batch(struct target *target,
-		struct riscv_batch *batch, struct memory_access_info access,
-		uint32_t start_index, uint32_t elements_to_read, uint32_t *elements_read)
+static int read_memory_progbuf_inner_run_and_process_batches(struct target *target,
+		struct riscv_batch * const *batches, const uint32_t *elements_in_batch,
+		size_t batch_count, struct memory_access_info access,
+		uint32_t start_index, uint32_t *elements_read)
 {
 	dm013_info_t *dm = get_dm(target);
 	if (!dm)
 		return ERROR_FAIL;
 
-	/* Abstract commands are executed while running the batch. */
+	uint32_t elements_to_read = 0;
+	for (size_t i = 0; i < batch_count; ++i)
+		elements_to_read += elements_in_batch[i];
+
+	/* Abstract commands are executed while running the batches. */
 	dm->abstract_cmd_maybe_busy = true;
-	if (batch_run(target, batch) != ERROR_OK)
+	bool dmi_busy_encountered;
+	if (batch_run_pipelined(target, batches, batch_count,
+				&dmi_busy_encountered) != ERROR_OK)
 		return ERROR_FAIL;
 
 	uint32_t abstractcs;
 	if (wait_for_idle(target, &abstractcs) != ERROR_OK)
 		return ERROR_FAIL;
 
-	uint32_t elements_to_extract_from_batch;
+	uint32_t elements_to_extract_from_batches;
 
-	uint32_t cmderr = get_field32(abstractcs, DM_ABSTRACTCS_CMDERR);
+	uint32_t cmderr = abstractcs_cmderr(target, abstractcs);
 	switch (cmderr) {
 	case CMDERR_NONE:
 		LOG_TARGET_DEBUG(target, "successful (partial?) memory read [%"
 				PRIu32 ", %" PRIu32 ")", start_index, start_index + elements_to_read);
-		elements_to_extract_from_batch = elements_to_read;
+		elements_to_extract_from_batches = elements_to_read;
 		break;
 	case CMDERR_BUSY:
 		LOG_TARGET_DEBUG(target, "memory read resulted in busy response");
 		if (read_memory_progbuf_inner_on_ac_busy(target, start_index,
-					&elements_to_extract_from_batch, access)
+					&elements_to_extract_from_batches, access)
 				!= ERROR_OK)
 			return ERROR_FAIL;
 		break;
@@ -3984,9 +5512,24 @@ static int read_memory_progbuf_inner_run_and_process_batch(struct target *target
 		return ERROR_FAIL;
 	}
 
-	if (read_memory_progbuf_inner_extract_batch_data(target, batch, start_index,
-				elements_to_extract_from_batch, elements_read, access) != ERROR_OK)
-		return ERROR_FAIL;
+	/* The batches are processed in order. Extraction stops at the first
+	 * batch that did not deliver all its elements, since every scan after a
+	 * DMI busy one was ignored. Batches that were not run at all are never
+	 * reached: the one before them was busy. */
+	*elements_read = 0;
+	for (size_t i = 0; i < batch_count &&
+			*elements_read < elements_to_extract_from_batches; ++i) {
+		const uint32_t to_extract = MIN(elements_in_batch[i],
+				elements_to_extract_from_batches - *elements_read);
+		uint32_t extracted;
+		if (read_memory_progbuf_inner_extract_batch_data(target, batches[i],
+					start_index + *elements_read, to_extract, &extracted,
+					access) != ERROR_OK)
+			return ERROR_FAIL;
+		*elements_read += extracted;
+		if (extracted != elements_in_batch[i])
+			break;
+	}
 
 	return ERROR_OK;
 }
@@ -4004,12 +5547,12 @@ static uint32_t read_memory_progbuf_inner_fill_batch(struct riscv_batch *batch,
 
 	for (uint32_t j = 0; j < end; ++j) {
 		/* TODO: reuse "abstract_data_read_fill_batch()" here.
-		 * TODO: Only the read of "DM_DATA0" starts an abstract
-		 * command, so the other read can use "RISCV_DELAY_BASE"
+		 * Only the read of "DM_DATA0" starts an abstract command.
 		 */
 		for (uint32_t i = 0; i < reads_per_element; ++i)
 			riscv_batch_add_dm_read(batch, used_regs[i],
-					RISCV_DELAY_ABSTRACT_COMMAND);
+					used_regs[i] == DM_DATA0 ?
+					RISCV_DELAY_ABSTRACT_COMMAND : RISCV_DELAY_BASE);
 	}
 	return end;
 }
@@ -4018,16 +5561,28 @@ static int read_memory_progbuf_inner_try_to_read(struct target *target,
 		struct memory_access_info access, uint32_t *elements_read,
 		uint32_t index, uint32_t loop_count)
 {
-	struct riscv_batch *batch = riscv_batch_alloc(target, RISCV_BATCH_ALLOC_SIZE);
-	if (!batch)
-		return ERROR_FAIL;
-
-	const uint32_t elements_to_read = read_memory_progbuf_inner_fill_batch(batch,
-			loop_count - index, access.element_size);
-
-	int result = read_memory_progbuf_inner_run_and_process_batch(target, batch,
-			access, index, elements_to_read, elements_read);
-	riscv_batch_free(batch);
+	/* Keep several batches in flight to hide the adapter latency. */
+	struct riscv_batch *batches[RISCV_BATCH_PIPELINE_DEPTH];
+	uint32_t elements_in_batch[RISCV_BATCH_PIPELINE_DEPTH];
+	size_t batch_count = 0;
+	uint32_t end = index;
+	do {
+		struct riscv_batch * const batch = riscv_batch_alloc(target,
+				RISCV_BATCH_ALLOC_SIZE);
+		if (!batch) {
+			free_batches(batches, batch_count);
+			return ERROR_FAIL;
+		}
+		elements_in_batch[batch_count] = read_memory_progbuf_inner_fill_batch(batch,
+				loop_count - end, access.element_size);
+		end += elements_in_batch[batch_count];
+		batches[batch_count++] = batch;
+	} while (batch_count < ARRAY_SIZE(batches) && end < loop_count);
+
+	int result = read_memory_progbuf_inner_run_and_process_batches(target,
+			batches, elements_in_batch, batch_count, access, index,
+			elements_read);
+	free_batches(batches, batch_count);
 	return result;
 }
 
@@ -4121,8 +5676,74 @@ static int riscv_program_load_mprv(struct riscv_program *p, enum gdb_regno d,
 	return ERROR_OK;
 }
 
+/**
+ * Narrow progbuf memory accesses can be packed into an XLEN-wide register:
+ * each iteration of the program then accesses "pack" consecutive words of the
+ * requested size, and the register crosses the DMI as a single element (in
+ * dm_data[0:1] for RV64), so there are fewer program executions, and fewer
+ * scans that have to wait for one, per byte. The memory is still accessed
+ * with the requested size.
+ *
+ * This returns how many words to pack, or 1 when packing doesn't pay off or
+ * the program doesn't fit in the program buffer.
+ */
+static unsigned int progbuf_pack_count(struct target *target, uint32_t size,
+		uint32_t count, bool is_read, bool mprven)
+{
+	for (unsigned int pack = riscv_xlen(target) / 8 / size; pack > 1; pack /= 2) {
+		/* A read needs a load, a shift and an or per word, a write a store
+		 * and a shift. Then the address increment, the MPRV toggling and
+		 * the ebreak. */
+		const unsigned int length = (is_read ? 3 * pack - 2 : 2 * pack - 1) +
+			1 + (mprven ? 2 : 0) + 1;
+		if (count / pack >= 2 && has_sufficient_progbuf(target, length))
+			return pack;
+	}
+	return 1;
+}
+
+static uint32_t load_unsigned(unsigned int rd, unsigned int base,
+		uint16_t offset, unsigned int size)
+{
+	switch (size) {
+	case 1:
+		return lbu(rd, base, offset);
+	case 2:
+		return lhu(rd, base, offset);
+	}
+	assert(size == 4);
+	return lwu(rd, base, offset);
+}
+
+/* Load "pack" consecutive "size" byte words from the address in s0 into s1,
+ * the first one in the least significant bits. a0 is clobbered. */
+static int riscv_program_load_packed_mprv(struct riscv_program *p,
+		unsigned int size, unsigned int pack, bool mprven)
+{
+	if (mprven && riscv_program_csrrsi(p, GDB_REGNO_ZERO, CSR_DCSR_MPRVEN,
+				GDB_REGNO_DCSR) != ERROR_OK)
+		return ERROR_FAIL;
+
+	if (riscv_program_insert(p, load_unsigned(S1, S0, 0, size)) != ERROR_OK)
+		return ERROR_FAIL;
+	for (unsigned int i = 1; i < pack; ++i) {
+		if (riscv_program_insert(p, load_unsigned(A0, S0, i * size, size)) != ERROR_OK)
+			return ERROR_FAIL;
+		if (riscv_program_insert(p, slli(A0, A0, i * size * 8)) != ERROR_OK)
+			return ERROR_FAIL;
+		if (riscv_program_insert(p, or(S1, S1, A0)) != ERROR_OK)
+			return ERROR_FAIL;
+	}
+
+	if (mprven && riscv_program_csrrci(p, GDB_REGNO_ZERO, CSR_DCSR_MPRVEN,
+				GDB_REGNO_DCSR) != ERROR_OK)
+		return ERROR_FAIL;
+
+	return ERROR_OK;
+}
+
 static int read_memory_progbuf_inner_fill_progbuf(struct target *target,
-		uint32_t increment, uint32_t size, bool mprven)
+		uint32_t increment, uint32_t size, unsigned int pack, bool mprven)
 {
 	const bool is_repeated_read = increment == 0;
 
@@ -4130,15 +5751,22 @@ static int read_memory_progbuf_inner_fill_progbuf(struct target *target,
 		return ERROR_FAIL;
 	if (riscv013_reg_save(target, GDB_REGNO_S1) != ERROR_OK)
 		return ERROR_FAIL;
-	if (is_repeated_read &&	riscv013_reg_save(target, GDB_REGNO_A0) != ERROR_OK)
+	if ((is_repeated_read || pack > 1) &&
+			riscv013_reg_save(target, GDB_REGNO_A0) != ERROR_OK)
 		return ERROR_FAIL;
 
 	struct riscv_program program;
 
 	riscv_program_init(&program, target);
-	if (riscv_program_load_mprv(&program, GDB_REGNO_S1, GDB_REGNO_S0, 0, size,
-				mprven) != ERROR_OK)
+	if (pack > 1) {
+		assert(!is_repeated_read);
+		if (riscv_program_load_packed_mprv(&program, size / pack, pack,
+					mprven) != ERROR_OK)
+			return ERROR_FAIL;
+	} else if (riscv_program_load_mprv(&program, GDB_REGNO_S1, GDB_REGNO_S0, 0,
+				size, mprven) != ERROR_OK) {
 		return ERROR_FAIL;
+	}
 	if (is_repeated_read) {
 		if (riscv_program_addi(&program, GDB_REGNO_A0, GDB_REGNO_A0, 1)
 				!= ERROR_OK)
@@ -4161,14 +5789,17 @@ static int read_memory_progbuf_inner_fill_progbuf(struct target *target,
  * Read the requested memory, taking care to minimize the number of reads and
  * re-read the data only if `abstract command busy` or `DMI busy`
  * is encountered in the process.
+ * Each element is made of "pack" words read separately (see
+ * progbuf_pack_count()).
  */
 static int read_memory_progbuf_inner(struct target *target,
-		struct memory_access_info access, uint32_t count, bool mprven)
+		struct memory_access_info access, uint32_t count, unsigned int pack,
+		bool mprven)
 {
 	assert(count > 1 && "If count == 1, read_memory_progbuf_inner_one must be called");
 
 	if (read_memory_progbuf_inner_fill_progbuf(target, access.increment,
-				access.element_size, mprven) != ERROR_OK)
+				access.element_size, pack, mprven) != ERROR_OK)
 		return ERROR_FAIL;
 
 	if (read_memory_progbuf_inner_startup(target, access.target_address,
@@ -4273,7 +5904,8 @@ read_memory_progbuf(struct target *target, target_addr_t address,
 
 	memset(buffer, 0, count*size);
 
-	if (execute_fence(target) != ERROR_OK)
+	RISCV_INFO(r);
+	if (!r->defer_fences && execute_fence(target) != ERROR_OK)
 		return MEM_ACCESS_SKIPPED_FENCE_EXEC_FAILED;
 
 	uint64_t mstatus = 0;
@@ -4283,15 +5915,36 @@ read_memory_progbuf(struct target *target, target_addr_t address,
 
 	const bool mprven = riscv_virt2phys_mode_is_hw(target)
 			&& get_field(mstatus, MSTATUS_MPRV);
+	int result = ERROR_OK;
+	const unsigned int pack = increment == size ?
+		progbuf_pack_count(target, size, count, /* is_read = */ true, mprven) : 1;
+	if (pack > 1) {
+		const uint32_t packed_count = count / pack;
+		const struct memory_access_info packed_access = {
+			.target_address = address,
+			.increment = size * pack,
+			.buffer_address = buffer,
+			.element_size = size * pack,
+		};
+		LOG_TARGET_DEBUG(target, "reading %u words at a time", pack);
+		result = read_memory_progbuf_inner(target, packed_access, packed_count,
+				pack, mprven);
+		/* The rest is read the usual way. */
+		address += (target_addr_t)packed_count * pack * size;
+		buffer += packed_count * pack * size;
+		count -= packed_count * pack;
+	}
+
 	const struct memory_access_info access = {
 		.target_address = address,
 		.increment = increment,
 		.buffer_address = buffer,
 		.element_size = size,
 	};
-	int result = (count == 1) ?
-		read_memory_progbuf_inner_one(target, access, mprven) :
-		read_memory_progbuf_inner(target, access, count, mprven);
+	if (result == ERROR_OK && count > 0)
+		result = (count == 1) ?
+			read_memory_progbuf_inner_one(target, access, mprven) :
+			read_memory_progbuf_inner(target, access, count, /* pack */ 1, mprven);
 
 	if (mstatus != mstatus_old &&
 			register_write_direct(target, GDB_REGNO_MSTATUS, mstatus_old) != ERROR_OK)
@@ -4323,6 +5976,43 @@ read_memory_sysbus(struct target *target, target_addr_t address,
 	return (ret == ERROR_OK) ? MEM_ACCESS_OK : MEM_ACCESS_FAILED;
 }
 
+/* Order in which to try the memory access methods for an access of "size"
+ * byte words in "region" (NULL when it isn't in one). */
+static unsigned int mem_access_order(struct target *target,
+		const struct riscv_mem_region *region, bool is_read, uint32_t size,
+		riscv_mem_access_method_t *order)
+{
+	RISCV_INFO(r);
+	if (region)
+		return riscv_mem_region_order(region, is_read, size, order);
+	memcpy(order, r->mem_access_methods, sizeof(r->mem_access_methods));
+	return r->num_enabled_mem_access_methods;
+}
+
+/* Read with "width" byte accesses instead of "size" byte ones. When that's
+ * not aligned, read the surrounding aligned words. */
+static int read_memory_width(struct target *target, unsigned int width,
+		target_addr_t address, uint32_t size, uint32_t count, uint8_t *buffer)
+{
+	const target_addr_t length = (target_addr_t)size * count;
+	const target_addr_t start = address & ~(target_addr_t)(width - 1);
+	const target_addr_t end = ALIGN_UP(address + length, width);
+	if (start == address && end == address + length)
+		return read_memory(target, address, width, length / width, buffer, width);
+
+	uint8_t *words = malloc(end - start);
+	if (!words) {
+		LOG_TARGET_ERROR(target, "Failed to allocate memory.");
+		return ERROR_FAIL;
+	}
+	int result = read_memory(target, start, width, (end - start) / width, words,
+			width);
+	if (result == ERROR_OK)
+		memcpy(buffer, words + (address - start), length);
+	free(words);
+	return result;
+}
+
 static int read_memory(struct target *target, target_addr_t address,
 		uint32_t size, uint32_t count, uint8_t *buffer, uint32_t increment)
 {
@@ -4340,9 +6030,20 @@ static int read_memory(struct target *target, target_addr_t address,
 		[RISCV_MEM_ACCESS_ABSTRACT] = MEM_ACCESS_DISABLED,
 	};
 
-	RISCV_INFO(r);
-	for (unsigned int i = 0; i < r->num_enabled_mem_access_methods; ++i) {
-		riscv_mem_access_method_t method = r->mem_access_methods[i];
+	struct riscv_mem_region *region = NULL;
+	if (increment == size)
+		region = riscv_mem_region_find(target, address, (target_addr_t)size * count);
+	if (region && region->width && region->width != size)
+		return read_memory_width(target, region->width, address, size, count,
+				buffer);
+
+	riscv_mem_access_method_t order[RISCV_MEM_ACCESS_MAX_METHODS_NUM];
+	const unsigned int method_count = mem_access_order(target, region,
+			/* is_read = */ true, size, order);
+	for (unsigned int i = 0; i < method_count; ++i) {
+		riscv_mem_access_method_t method = order[i];
+		struct duration duration;
+		duration_start(&duration);
 		switch (method) {
 			case RISCV_MEM_ACCESS_PROGBUF:
 				skip_reason[method] =
@@ -4365,13 +6066,26 @@ static int read_memory(struct target *target, target_addr_t address,
 				return ERROR_FAIL;
 		}
 
+		/* Whether the hart is halted says nothing about the region. */
+		if (region && skip_reason[method] != MEM_ACCESS_SKIPPED_TARGET_NOT_HALTED) {
+			duration_measure(&duration);
+			riscv_mem_region_record(target, region, /* is_read = */ true, method,
+					size, skip_reason[method] == MEM_ACCESS_OK,
+					is_mem_access_unusable(skip_reason[method]),
+					(uint64_t)size * count, duration_elapsed(&duration));
+		}
+
 		if (is_mem_access_failed(skip_reason[method]))
 			goto failure;
 
 		const bool success = (skip_reason[method] == MEM_ACCESS_OK);
 		log_mem_access_result(target, success, method, /* is_read = */ true);
-		if (success)
+		if (success) {
+			riscv_info(target)->stats.bytes_read[method] += (uint64_t)size * count;
 			return ERROR_OK;
+		}
+		if (i + 1 < method_count)
+			riscv_info(target)->stats.mem_access_fallbacks++;
 	}
 
 failure:
@@ -4439,7 +6153,6 @@ static int write_memory_bus_v0(struct target *target, target_addr_t address,
 static int write_memory_bus_v1(struct target *target, target_addr_t address,
 		uint32_t size, uint32_t count, const uint8_t *buffer)
 {
-	RISCV013_INFO(info);
 	uint32_t sbcs = sb_sbaccess(size);
 	sbcs = set_field(sbcs, DM_SBCS_SBAUTOINCREMENT, 1);
 	dm_write(target, DM_SBCS, sbcs);
@@ -4455,68 +6168,74 @@ static int write_memory_bus_v1(struct target *target, target_addr_t address,
 		LOG_TARGET_DEBUG(target, "Transferring burst starting at address 0x%" TARGET_PRIxADDR,
 				next_address);
 
-		struct riscv_batch *batch = riscv_batch_alloc(target, RISCV_BATCH_ALLOC_SIZE);
-		if (!batch)
-			return ERROR_FAIL;
-
-		for (uint32_t i = (next_address - address) / size; i < count; i++) {
-			const uint8_t *p = buffer + i * size;
-
-			if (riscv_batch_available_scans(batch) < (size + 3) / 4)
-				break;
-
-			uint32_t sbvalue[4] = { 0 };
-			if (size > 12) {
-				sbvalue[3] = ((uint32_t)p[12]) |
-						(((uint32_t)p[13]) << 8) |
-						(((uint32_t)p[14]) << 16) |
-						(((uint32_t)p[15]) << 24);
-				riscv_batch_add_dm_write(batch, DM_SBDATA3, sbvalue[3], false,
-						RISCV_DELAY_BASE);
+		/* Keep several batches in flight to hide the adapter latency. */
+		struct riscv_batch *batches[RISCV_BATCH_PIPELINE_DEPTH];
+		size_t batch_count = 0;
+		uint32_t i = (next_address - address) / size;
+		while (batch_count < ARRAY_SIZE(batches) && i < count) {
+			struct riscv_batch *batch = riscv_batch_alloc(target,
+					RISCV_BATCH_ALLOC_SIZE);
+			if (!batch) {
+				free_batches(batches, batch_count);
+				return ERROR_FAIL;
 			}
+			batches[batch_count++] = batch;
+			for (; i < count &&
+					riscv_batch_available_scans(batch) >= (size + 3) / 4; i++) {
+				const uint8_t *p = buffer + i * size;
+
+				uint32_t sbvalue[4] = { 0 };
+				if (size > 12) {
+					sbvalue[3] = ((uint32_t)p[12]) |
+							(((uint32_t)p[13]) << 8) |
+							(((uint32_t)p[14]) << 16) |
+							(((uint32_t)p[15]) << 24);
+					riscv_batch_add_dm_write(batch, DM_SBDATA3, sbvalue[3], false,
+							RISCV_DELAY_BASE);
+				}
 
-			if (size > 8) {
-				sbvalue[2] = ((uint32_t)p[8]) |
-						(((uint32_t)p[9]) << 8) |
-						(((uint32_t)p[10]) << 16) |
-						(((uint32_t)p[11]) << 24);
-				riscv_batch_add_dm_write(batch, DM_SBDATA2, sbvalue[2], false,
-						RISCV_DELAY_BASE);
-			}
-			if (size > 4) {
-				sbvalue[1] = ((uint32_t)p[4]) |
-						(((uint32_t)p[5]) << 8) |
-						(((uint32_t)p[6]) << 16) |
-						(((uint32_t)p[7]) << 24);
-				riscv_batch_add_dm_write(batch, DM_SBDATA1, sbvalue[1], false,
-						RISCV_DELAY_BASE);
-			}
+				if (size > 8) {
+					sbvalue[2] = ((uint32_t)p[8]) |
+							(((uint32_t)p[9]) << 8) |
+							(((uint32_t)p[10]) << 16) |
+							(((uint32_t)p[11]) << 24);
+					riscv_batch_add_dm_write(batch, DM_SBDATA2, sbvalue[2], false,
+							RISCV_DELAY_BASE);
+				}
+				if (size > 4) {
+					sbvalue[1] = ((uint32_t)p[4]) |
+							(((uint32_t)p[5]) << 8) |
+							(((uint32_t)p[6]) << 16) |
+							(((uint32_t)p[7]) << 24);
+					riscv_batch_add_dm_write(batch, DM_SBDATA1, sbvalue[1], false,
+							RISCV_DELAY_BASE);
+				}
 
-			sbvalue[0] = p[0];
-			if (size > 2) {
-				sbvalue[0] |= ((uint32_t)p[2]) << 16;
-				sbvalue[0] |= ((uint32_t)p[3]) << 24;
-			}
-			if (size > 1)
-				sbvalue[0] |= ((uint32_t)p[1]) << 8;
+				sbvalue[0] = p[0];
+				if (size > 2) {
+					sbvalue[0] |= ((uint32_t)p[2]) << 16;
+					sbvalue[0] |= ((uint32_t)p[3]) << 24;
+				}
+				if (size > 1)
+					sbvalue[0] |= ((uint32_t)p[1]) << 8;
 
-			riscv_batch_add_dm_write(batch, DM_SBDATA0, sbvalue[0], false,
-						RISCV_DELAY_SYSBUS_WRITE);
+				riscv_batch_add_dm_write(batch, DM_SBDATA0, sbvalue[0], false,
+							RISCV_DELAY_SYSBUS_WRITE);
 
-			log_memory_access(address + i * size, sbvalue, size, false);
+				log_memory_access(address + i * size, sbvalue, size, false);
 
-			next_address += size;
+				next_address += size;
+			}
 		}
 
-		/* Execute the batch of writes */
-		result = batch_run(target, batch);
-		if (result != ERROR_OK) {
-			riscv_batch_free(batch);
+		/* Execute the batches of writes */
+		bool dmi_busy_encountered;
+		result = batch_run_pipelined(target, batches, batch_count,
+				&dmi_busy_encountered);
+		free_batches(batches, batch_count);
+		if (result != ERROR_OK)
 			return result;
-		}
 
-		bool dmi_busy_encountered = riscv_batch_was_batch_busy(batch);
-		riscv_batch_free(batch);
 		if (dmi_busy_encountered)
 			LOG_TARGET_DEBUG(target, "DMI busy encountered during system bus write.");
 
@@ -4532,8 +6251,7 @@ static int write_memory_bus_v1(struct target *target, target_addr_t address,
 			/* Slow down before trying again.
 			 * FIXME: Possible overflow is ignored here.
 			 */
-			riscv_scan_increase_delay(&info->learned_delays,
-					RISCV_DELAY_SYSBUS_WRITE);
+			increase_delay(target, RISCV_DELAY_SYSBUS_WRITE);
 		}
 
 		if (get_field(sbcs, DM_SBCS_SBBUSYERROR) || dmi_busy_encountered) {
@@ -4696,10 +6414,11 @@ static target_addr_t write_memory_progbuf_fill_batch(struct riscv_batch *batch,
 }
 
 /**
- * This function runs the batch of writes and updates address_p with the
+ * This function runs the batches of writes and updates address_p with the
  * address of the next write.
  */
-static int write_memory_progbuf_run_batch(struct target *target, struct riscv_batch *batch,
+static int write_memory_progbuf_run_batches(struct target *target,
+		struct riscv_batch * const *batches, size_t batch_count,
 		target_addr_t *address_p, target_addr_t end_address, uint32_t size,
 		const uint8_t *buffer)
 {
@@ -4707,9 +6426,11 @@ static int write_memory_progbuf_run_batch(struct target *target, struct riscv_ba
 	if (!dm)
 		return ERROR_FAIL;
 
-	/* Abstract commands are executed while running the batch. */
+	/* Abstract commands are executed while running the batches. */
 	dm->abstract_cmd_maybe_busy = true;
-	if (batch_run(target, batch) != ERROR_OK)
+	bool dmi_busy_encountered;
+	if (batch_run_pipelined(target, batches, batch_count,
+				&dmi_busy_encountered) != ERROR_OK)
 		return ERROR_FAIL;
 
 	/* Note that if the scan resulted in a Busy DMI response, it
@@ -4720,8 +6441,7 @@ static int write_memory_progbuf_run_batch(struct target *target, struct riscv_ba
 	if (wait_for_idle(target, &abstractcs) != ERROR_OK)
 		return ERROR_FAIL;
 
-	uint32_t cmderr = get_field32(abstractcs, DM_ABSTRACTCS_CMDERR);
-	const bool dmi_busy_encountered = riscv_batch_was_batch_busy(batch);
+	uint32_t cmderr = abstractcs_cmderr(target, abstractcs);
 	if (cmderr == CMDERR_NONE && !dmi_busy_encountered) {
 		LOG_TARGET_DEBUG(target, "Successfully written memory block M[0x%" TARGET_PRIxADDR
 				".. 0x%" TARGET_PRIxADDR ")", *address_p, end_address);
@@ -4749,16 +6469,27 @@ static int write_memory_progbuf_try_to_write(struct target *target,
 		target_addr_t *address_p, target_addr_t end_address, uint32_t size,
 		const uint8_t *buffer)
 {
-	struct riscv_batch * const batch = riscv_batch_alloc(target, RISCV_BATCH_ALLOC_SIZE);
-	if (!batch)
-		return ERROR_FAIL;
-
-	const target_addr_t batch_end_addr = write_memory_progbuf_fill_batch(batch,
-			*address_p, end_address, size, buffer);
-
-	int result = write_memory_progbuf_run_batch(target, batch, address_p,
-			batch_end_addr, size, buffer);
-	riscv_batch_free(batch);
+	/* Keep several batches in flight to hide the adapter latency. */
+	struct riscv_batch *batches[RISCV_BATCH_PIPELINE_DEPTH];
+	size_t batch_count = 0;
+	target_addr_t batch_end_addr = *address_p;
+	do {
+		struct riscv_batch * const batch = riscv_batch_alloc(target,
+				RISCV_BATCH_ALLOC_SIZE);
+		if (!batch) {
+			free_batches(batches, batch_count);
+			return ERROR_FAIL;
+		}
+		batches[batch_count++] = batch;
+		const uint8_t * const batch_buffer = buffer +
+			(batch_end_addr - *address_p);
+		batch_end_addr = write_memory_progbuf_fill_batch(batch,
+				batch_end_addr, end_address, size, batch_buffer);
+	} while (batch_count < ARRAY_SIZE(batches) && batch_end_addr != end_address);
+
+	int result = write_memory_progbuf_run_batches(target, batches, batch_count,
+			address_p, batch_end_addr, size, buffer);
+	free_batches(batches, batch_count);
 	return result;
 }
 
@@ -4779,20 +6510,53 @@ static int riscv_program_store_mprv(struct riscv_program *p, enum gdb_regno d,
 	return ERROR_OK;
 }
 
+/* Store s1 as "pack" consecutive "size" byte words to the address in s0, the
+ * least significant bits first. a0 is clobbered. */
+static int riscv_program_store_packed_mprv(struct riscv_program *p,
+		unsigned int size, unsigned int pack, bool mprven)
+{
+	if (mprven && riscv_program_csrrsi(p, GDB_REGNO_ZERO, CSR_DCSR_MPRVEN,
+				GDB_REGNO_DCSR) != ERROR_OK)
+		return ERROR_FAIL;
+
+	if (riscv_program_store(p, GDB_REGNO_S1, GDB_REGNO_S0, 0, size) != ERROR_OK)
+		return ERROR_FAIL;
+	for (unsigned int i = 1; i < pack; ++i) {
+		if (riscv_program_insert(p, srli(A0, S1, i * size * 8)) != ERROR_OK)
+			return ERROR_FAIL;
+		if (riscv_program_store(p, GDB_REGNO_A0, GDB_REGNO_S0, i * size,
+					size) != ERROR_OK)
+			return ERROR_FAIL;
+	}
+
+	if (mprven && riscv_program_csrrci(p, GDB_REGNO_ZERO, CSR_DCSR_MPRVEN,
+				GDB_REGNO_DCSR) != ERROR_OK)
+		return ERROR_FAIL;
+
+	return ERROR_OK;
+}
+
 static int write_memory_progbuf_fill_progbuf(struct target *target,
-		uint32_t size, bool mprven)
+		uint32_t size, unsigned int pack, bool mprven)
 {
 	if (riscv013_reg_save(target, GDB_REGNO_S0) != ERROR_OK)
 		return ERROR_FAIL;
 	if (riscv013_reg_save(target, GDB_REGNO_S1) != ERROR_OK)
 		return ERROR_FAIL;
+	if (pack > 1 && riscv013_reg_save(target, GDB_REGNO_A0) != ERROR_OK)
+		return ERROR_FAIL;
 
 	struct riscv_program program;
 
 	riscv_program_init(&program, target);
-	if (riscv_program_store_mprv(&program, GDB_REGNO_S1, GDB_REGNO_S0, 0, size,
-				mprven) != ERROR_OK)
+	if (pack > 1) {
+		if (riscv_program_store_packed_mprv(&program, size / pack, pack,
+					mprven) != ERROR_OK)
+			return ERROR_FAIL;
+	} else if (riscv_program_store_mprv(&program, GDB_REGNO_S1, GDB_REGNO_S0, 0,
+				size, mprven) != ERROR_OK) {
 		return ERROR_FAIL;
+	}
 
 	if (riscv_program_addi(&program, GDB_REGNO_S0, GDB_REGNO_S0, size) != ERROR_OK)
 		return ERROR_FAIL;
@@ -4803,10 +6567,13 @@ static int write_memory_progbuf_fill_progbuf(struct target *target,
 	return riscv_program_write(&program);
 }
 
+/* Each of the "count" elements of "size" bytes is made of "pack" words
+ * written separately (see progbuf_pack_count()). */
 static int write_memory_progbuf_inner(struct target *target, target_addr_t start_addr,
-		uint32_t size, uint32_t count, const uint8_t *buffer, bool mprven)
+		uint32_t size, uint32_t count, const uint8_t *buffer, unsigned int pack,
+		bool mprven)
 {
-	if (write_memory_progbuf_fill_progbuf(target, size,
+	if (write_memory_progbuf_fill_progbuf(target, size, pack,
 				mprven) != ERROR_OK)
 		return ERROR_FAIL;
 
@@ -4857,14 +6624,30 @@ write_memory_progbuf(struct target *target, target_addr_t address,
 	const bool mprven = riscv_virt2phys_mode_is_hw(target)
 			&& get_field(mstatus, MSTATUS_MPRV);
 
-	int result = write_memory_progbuf_inner(target, address, size, count, buffer, mprven);
+	int result = ERROR_OK;
+	const unsigned int pack = progbuf_pack_count(target, size, count,
+			/* is_read = */ false, mprven);
+	if (pack > 1) {
+		const uint32_t packed_count = count / pack;
+		LOG_TARGET_DEBUG(target, "writing %u words at a time", pack);
+		result = write_memory_progbuf_inner(target, address, size * pack,
+				packed_count, buffer, pack, mprven);
+		/* The rest is written the usual way. */
+		address += (target_addr_t)packed_count * pack * size;
+		buffer += packed_count * pack * size;
+		count -= packed_count * pack;
+	}
+	if (result == ERROR_OK && count > 0)
+		result = write_memory_progbuf_inner(target, address, size, count, buffer,
+				/* pack */ 1, mprven);
 
 	/* Restore MSTATUS */
 	if (mstatus != mstatus_old)
 		if (register_write_direct(target, GDB_REGNO_MSTATUS, mstatus_old))
 			return MEM_ACCESS_FAILED;
 
-	if (execute_fence(target) != ERROR_OK)
+	RISCV_INFO(r);
+	if (!r->defer_fences && execute_fence(target) != ERROR_OK)
 		return MEM_ACCESS_SKIPPED_FENCE_EXEC_FAILED;
 
 	return result == ERROR_OK ? MEM_ACCESS_OK : MEM_ACCESS_FAILED;
@@ -4901,6 +6684,22 @@ write_memory_sysbus(struct target *target, target_addr_t address,
 static int write_memory(struct target *target, target_addr_t address,
 		uint32_t size, uint32_t count, const uint8_t *buffer)
 {
+	struct riscv_mem_region *region = riscv_mem_region_find(target, address,
+			(target_addr_t)size * count);
+	if (region && region->width && region->width != size) {
+		/* Unlike reads, unaligned writes can't be widened, and accesses of
+		 * another size are what the region is there to avoid. */
+		const target_addr_t length = (target_addr_t)size * count;
+		if (address % region->width != 0 || length % region->width != 0) {
+			LOG_TARGET_ERROR(target, "Can't write %" PRIu64 " bytes at 0x%"
+					TARGET_PRIxADDR " with the %u byte accesses the memory "
+					"region requires.", (uint64_t)length, address, region->width);
+			return ERROR_TARGET_UNALIGNED_ACCESS;
+		}
+		return write_memory(target, address, region->width,
+				length / region->width, buffer);
+	}
+
 	if (!IS_PWR_OF_2(size) || size < 1 || size > 16) {
 		LOG_TARGET_ERROR(target, "BUG: Unsupported size for memory write: %d", size);
 		return ERROR_FAIL;
@@ -4912,9 +6711,13 @@ static int write_memory(struct target *target, target_addr_t address,
 		[RISCV_MEM_ACCESS_ABSTRACT] = MEM_ACCESS_DISABLED
 	};
 
-	RISCV_INFO(r);
-	for (unsigned int i = 0; i < r->num_enabled_mem_access_methods; ++i) {
-		riscv_mem_access_method_t method = r->mem_access_methods[i];
+	riscv_mem_access_method_t order[RISCV_MEM_ACCESS_MAX_METHODS_NUM];
+	const unsigned int method_count = mem_access_order(target, region,
+			/* is_read = */ false, size, order);
+	for (unsigned int i = 0; i < method_count; ++i) {
+		riscv_mem_access_method_t method = order[i];
+		struct duration duration;
+		duration_start(&duration);
 		switch (method) {
 			case RISCV_MEM_ACCESS_PROGBUF:
 				skip_reason[method] =
@@ -4937,13 +6740,26 @@ static int write_memory(struct target *target, target_addr_t address,
 				return ERROR_FAIL;
 		}
 
+		/* Whether the hart is halted says nothing about the region. */
+		if (region && skip_reason[method] != MEM_ACCESS_SKIPPED_TARGET_NOT_HALTED) {
+			duration_measure(&duration);
+			riscv_mem_region_record(target, region, /* is_read = */ false, method,
+					size, skip_reason[method] == MEM_ACCESS_OK,
+					is_mem_access_unusable(skip_reason[method]),
+					(uint64_t)size * count, duration_elapsed(&duration));
+		}
+
 		if (is_mem_access_failed(skip_reason[method]))
 			goto failure;
 
 		const bool success = (skip_reason[method] == MEM_ACCESS_OK);
 		log_mem_access_result(target, success, method, /* is_read = */ false);
-		if (success)
+		if (success) {
+			riscv_info(target)->stats.bytes_written[method] += (uint64_t)size * count;
 			return ERROR_OK;
+		}
+		if (i + 1 < method_count)
+			riscv_info(target)->stats.mem_access_fallbacks++;
 	}
 
 failure:
@@ -5218,14 +7034,53 @@ static int riscv013_halt_go(struct target *target)
 
 static int riscv013_resume_go(struct target *target)
 {
-	if (select_prepped_harts(target) != ERROR_OK)
+	RISCV013_INFO(info);
+	dm013_info_t *dm = get_dm(target);
+	if (!dm)
 		return ERROR_FAIL;
 
+	if (info->resumegroup && !info->resumegroup_left) {
+		/* The hart may have been resumed already, together with another
+		 * hart of its resume group. */
+		if (dm013_select_target(target) != ERROR_OK)
+			return ERROR_FAIL;
+		uint32_t dmstatus;
+		if (dmstatus_read(target, &dmstatus, true) != ERROR_OK)
+			return ERROR_FAIL;
+		if (get_field(dmstatus, DM_DMSTATUS_ALLRUNNING)) {
+			LOG_TARGET_DEBUG(target, "Already resumed by its resume group.");
+			riscv_info(target)->prepped = false;
+			return ERROR_OK;
+		}
+	}
+
+	/* Harts that must stay halted would be resumed by the hardware, so take
+	 * the ones being resumed out of their groups. Otherwise put back the
+	 * ones that were taken out before. Either way they stay like that until
+	 * the next resume, so a hart that's resumed or stepped on its own over
+	 * and over doesn't write dmcs2 every time. */
+	const bool leave = resume_drags_other_harts(target, false);
+	target_list_t *entry;
+	list_for_each_entry(entry, &dm->target_list, list) {
+		struct target *t = entry->target;
+		if (riscv_info(t)->prepped && get_info(t)->resumegroup &&
+				leave_resume_group(t, leave) != ERROR_OK)
+			return ERROR_FAIL;
+	}
+
+	if (select_prepped_harts(target) != ERROR_OK)
+		return ERROR_FAIL;
 	return riscv013_step_or_resume_current_hart(target, false);
 }
 
 static int riscv013_step_current_hart(struct target *target)
 {
+	RISCV013_INFO(info);
+	/* Stay out of the resume group until the hart is resumed together with
+	 * the group again, see riscv013_resume_go(). */
+	if (info->resumegroup && resume_drags_other_harts(target, true) &&
+			leave_resume_group(target, true) != ERROR_OK)
+		return ERROR_FAIL;
 	return riscv013_step_or_resume_current_hart(target, true);
 }
 
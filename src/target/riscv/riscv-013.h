@@ -15,6 +15,8 @@ int riscv013_get_register(struct target *target,
 		riscv_reg_t *value, enum gdb_regno rid);
 int riscv013_get_register_buf(struct target *target, uint8_t *value,
 		enum gdb_regno regno);
+int riscv013_get_registers(struct target *target, unsigned int count,
+		const enum gdb_regno *regnos, riscv_reg_t *values, bool *read);
 int riscv013_set_register(struct target *target, enum gdb_regno rid,
 		riscv_reg_t value);
 int riscv013_set_register_buf(struct target *target, enum gdb_regno regno,
@@ -23,5 +25,8 @@ uint32_t riscv013_access_register_command(struct target *target, uint32_t number
 		unsigned int size, uint32_t flags);
 int riscv013_execute_abstract_command(struct target *target, uint32_t command,
 		uint32_t *cmderr);
+/* Return an examined hart on the same DM with the same XLEN, misa and
+ * hartinfo as "target", or NULL. */
+struct target *riscv013_identical_hart(struct target *target);
 
 #endif /* OPENOCD_TARGET_RISCV_RISCV_013_H */
@@ -296,6 +296,35 @@ static int examine_mtopi(struct target *target)
 	return riscv_reg_impl_set_exist(target, GDB_REGNO_MTOPEI, r->mtopei_readable);
 }
 
+/* Instead of examine_vlenb() and examine_mtopi(), use what they found on
+ * an identical hart. With many harts, this saves a good part of the time
+ * examine takes, since these probes may need the program buffer. */
+static int reuse_discovery(struct target *target, const struct target *twin)
+{
+	RISCV_INFO(r);
+	const struct riscv_info *twin_r = riscv_info(twin);
+
+	LOG_TARGET_DEBUG(target, "Using the optional registers found on %s.",
+			target_name(twin));
+	r->vlenb = twin_r->vlenb;
+	r->mtopi_readable = twin_r->mtopi_readable;
+	r->mtopei_readable = twin_r->mtopei_readable;
+
+	static const uint32_t regnos[] = {
+		GDB_REGNO_VLENB, GDB_REGNO_MTOPI, GDB_REGNO_MTOPEI
+	};
+	for (unsigned int i = 0; i < ARRAY_SIZE(regnos); i++) {
+		const bool exist = riscv_reg_impl_cache_entry(twin, regnos[i])->exist;
+		int res = riscv_reg_impl_init_cache_entry(target, regnos[i], exist,
+				riscv013_gdb_regno_reg_type(regnos[i]));
+		if (res != ERROR_OK)
+			return res;
+	}
+	if (r->vlenb)
+		LOG_TARGET_INFO(target, "Vector support with vlenb=%u", r->vlenb);
+	return ERROR_OK;
+}
+
 /**
  * This function assumes target's DM to be initialized (target is able to
  * access DMs registers, execute program buffer, etc.)
@@ -327,16 +356,21 @@ int riscv013_reg_examine_all(struct target *target)
 	if (res != ERROR_OK)
 		return res;
 
-	res = examine_vlenb(target);
+	RISCV_INFO(r);
+	const struct target *twin = r->share_discovery ?
+		riscv013_identical_hart(target) : NULL;
+	if (twin) {
+		res = reuse_discovery(target, twin);
+	} else {
+		res = examine_vlenb(target);
+		if (res == ERROR_OK)
+			res = examine_mtopi(target);
+	}
 	if (res != ERROR_OK)
 		return res;
 
 	riscv_reg_impl_init_vector_reg_type(target);
 
-	res = examine_mtopi(target);
-	if (res != ERROR_OK)
-		return res;
-
 	for (uint32_t regno = 0; regno < target->reg_cache->num_regs; ++regno) {
 		res = init_cache_entry(target, regno);
 		if (res != ERROR_OK)
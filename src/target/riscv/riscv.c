@@ -21,6 +21,13 @@
 #include "helper/time_support.h"
 #include "riscv.h"
 #include "riscv_reg.h"
+#include "delay_profile.h"
+#include "dmi_trace.h"
+#include "benchmark.h"
+#include "mem_cache.h"
+#include "mem_region.h"
+#include "trigger_cache.h"
+#include "sample_stream.h"
 #include "program.h"
 #include "gdb_regs.h"
 #include "rtos/rtos.h"
@@ -55,6 +62,17 @@ struct scan_field select_idcode = {
 
 static bscan_tunnel_type_t bscan_tunnel_type;
 #define BSCAN_TUNNEL_IR_WIDTH_NBITS 7
+/* A packed frame starts with the DR select bit, a zero width (which tells it
+ * apart from a single tunneled scan), the width of each scan, the number of
+ * scans minus one and the number of idle cycles after each scan. */
+#define BSCAN_PACKED_COUNT_NBITS 8
+#define BSCAN_PACKED_IDLE_NBITS 16
+#define BSCAN_PACKED_HEADER_NBITS (1 + 2 * BSCAN_TUNNEL_IR_WIDTH_NBITS + \
+		BSCAN_PACKED_COUNT_NBITS + BSCAN_PACKED_IDLE_NBITS)
+/* It ends with one bit for the clock skew and 3 bits of zero. */
+#define BSCAN_PACKED_TRAILER_NBITS 4
+/* Keep the frames, and the buffers for them, reasonably small. */
+#define BSCAN_PACKED_MAX_NBITS 65536
 uint8_t bscan_tunnel_ir_width; /* if zero, then tunneling is not present/active */
 static int bscan_tunnel_ir_id; /* IR ID of the JTAG TAP to access the tunnel. Valid when not 0 */
 
@@ -128,17 +146,6 @@ struct trigger {
 	int unique_id;
 };
 
-struct tdata2_cache {
-	struct list_head elem_tdata2;
-	riscv_reg_t tdata2;
-};
-
-struct tdata1_cache {
-	riscv_reg_t tdata1;
-	struct list_head tdata2_cache_head;
-	struct list_head elem_tdata1;
-};
-
 bool riscv_virt2phys_mode_is_hw(const struct target *target)
 {
 	assert(target);
@@ -168,6 +175,19 @@ const char *riscv_virt2phys_mode_to_str(riscv_virt2phys_mode_t mode)
 	return names[mode];
 }
 
+const char *riscv_mem_access_method_name(riscv_mem_access_method_t method)
+{
+	assert(method < RISCV_MEM_ACCESS_MAX_METHODS_NUM);
+
+	static const char *const names[] = {
+		[RISCV_MEM_ACCESS_PROGBUF] = "progbuf",
+		[RISCV_MEM_ACCESS_SYSBUS] = "sysbus",
+		[RISCV_MEM_ACCESS_ABSTRACT] = "abstract",
+	};
+
+	return names[method];
+}
+
 /* Wall-clock timeout for a command/access. Settable via RISC-V Target commands.*/
 static int riscv_command_timeout_sec_value = DEFAULT_COMMAND_TIMEOUT_SEC;
 
@@ -292,6 +312,9 @@ static enum riscv_halt_reason riscv_halt_reason(struct target *target);
 static void riscv_info_init(struct target *target, struct riscv_info *r);
 static void riscv_invalidate_register_cache(struct target *target);
 static int riscv_step_rtos_hart(struct target *target);
+static int flush_breakpoint_batch(struct target *target,
+		struct breakpoint_batch *batch, bool before_run);
+static int riscv_flush_breakpoints(struct target *target, bool before_run);
 
 static void riscv_sample_buf_maybe_add_timestamp(struct target *target, bool before)
 {
@@ -514,23 +537,14 @@ static int riscv_init_target(struct command_context *cmd_ctx,
 	return ERROR_OK;
 }
 
-static void free_wp_triggers_cache(struct target *target)
+static bool other_riscv_target_initialized(const struct target *target)
 {
-	RISCV_INFO(r);
-
-	for (unsigned int i = 0; i < r->trigger_count; ++i) {
-		struct tdata1_cache *elem_1, *tmp_1;
-		list_for_each_entry_safe(elem_1, tmp_1, &r->wp_triggers_negative_cache[i], elem_tdata1) {
-			struct tdata2_cache *elem_2, *tmp_2;
-			list_for_each_entry_safe(elem_2, tmp_2, &elem_1->tdata2_cache_head, elem_tdata2) {
-				list_del(&elem_2->elem_tdata2);
-				free(elem_2);
-			}
-			list_del(&elem_1->elem_tdata1);
-			free(elem_1);
-		}
+	for (struct target *t = all_targets; t; t = t->next) {
+		if (t != target && t->arch_info &&
+				!strcmp(target_type_name(t), "riscv"))
+			return true;
 	}
-	free(r->wp_triggers_negative_cache);
+	return false;
 }
 
 static void riscv_deinit_target(struct target *target)
@@ -545,16 +559,34 @@ static void riscv_deinit_target(struct target *target)
 	if (riscv_reg_flush_all(target) != ERROR_OK)
 		LOG_TARGET_ERROR(target, "Failed to flush registers. Ignoring this error.");
 
+	/* Don't leave cleared breakpoints in memory. The batch of an SMP group
+	 * is flushed by the hart that owns it. */
+	if (info && target->state == TARGET_HALTED &&
+			flush_breakpoint_batch(target, &info->breakpoint_batch,
+				/* before_run */ false) != ERROR_OK)
+		LOG_TARGET_ERROR(target, "Failed to write breakpoints. Ignoring this error.");
+
 	if (tt && info && info->version_specific)
 		tt->deinit_target(target);
 
 	riscv_reg_free_all(target);
-	free_wp_triggers_cache(target);
 
 	if (!info)
 		return;
 
+	riscv_trigger_cache_put(info->trigger_cache);
 	free(info->reserved_triggers);
+	riscv_mem_cache_free(&info->mem_cache);
+	riscv_mem_region_free_all(&info->mem_regions);
+	breakpoint_batch_free(&info->breakpoint_batch);
+	riscv_sample_stream_close(&info->sample_stream);
+	/* Targets are only deinitialized when OpenOCD exits. The trace is
+	 * shared by all of them, so the first one writes it out. */
+	riscv_dmi_trace_close();
+	/* The delay profiles are updated by every target as it goes, so only
+	 * the last one frees them. */
+	if (!other_riscv_target_initialized(target))
+		riscv_delay_profile_free();
 
 	range_list_t *entry, *tmp;
 	list_for_each_entry_safe(entry, tmp, &info->hide_csr, list) {
@@ -572,6 +604,11 @@ static void riscv_deinit_target(struct target *target)
 		free(entry);
 	}
 
+	list_for_each_entry_safe(entry, tmp, &info->prefetch_csr, list) {
+		free(entry->name);
+		free(entry);
+	}
+
 	free(target->arch_info);
 
 	target->arch_info = NULL;
@@ -656,18 +693,20 @@ static unsigned int count_trailing_ones(riscv_reg_t reg)
 	return 64;
 }
 
-static int set_trigger(struct target *target, unsigned int idx, riscv_reg_t tdata1, riscv_reg_t tdata2)
+static bool trigger_is_reserved(struct target *target, unsigned int idx)
 {
 	RISCV_INFO(r);
 	assert(r->reserved_triggers);
 	assert(idx < r->trigger_count);
-	if (r->reserved_triggers[idx]) {
-		LOG_TARGET_DEBUG(target,
-				"Trigger %u is reserved by 'reserve_trigger' command.", idx);
-		return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
-	}
+	if (!r->reserved_triggers[idx])
+		return false;
+	LOG_TARGET_DEBUG(target,
+			"Trigger %u is reserved by 'reserve_trigger' command.", idx);
+	return true;
+}
 
-	riscv_reg_t tdata1_rb, tdata2_rb;
+static int write_trigger(struct target *target, unsigned int idx, riscv_reg_t tdata1, riscv_reg_t tdata2)
+{
 	// Select which trigger to use
 	if (riscv_reg_set(target, GDB_REGNO_TSELECT, idx) != ERROR_OK)
 		return ERROR_FAIL;
@@ -681,9 +720,18 @@ static int set_trigger(struct target *target, unsigned int idx, riscv_reg_t tdat
 		return ERROR_FAIL;
 
 	// Set trigger data for tdata1
-	if (riscv_reg_set(target, GDB_REGNO_TDATA1, tdata1) != ERROR_OK)
+	return riscv_reg_set(target, GDB_REGNO_TDATA1, tdata1);
+}
+
+static int set_trigger(struct target *target, unsigned int idx, riscv_reg_t tdata1, riscv_reg_t tdata2)
+{
+	if (trigger_is_reserved(target, idx))
+		return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
+
+	if (write_trigger(target, idx, tdata1, tdata2) != ERROR_OK)
 		return ERROR_FAIL;
 
+	riscv_reg_t tdata1_rb, tdata2_rb;
 	// Read back tdata1, tdata2, (tdata3), and check if the configuration is supported
 	if (riscv_reg_get(target, &tdata1_rb, GDB_REGNO_TDATA1) != ERROR_OK)
 		return ERROR_FAIL;
@@ -799,96 +847,31 @@ static void log_trigger_request_info(struct trigger_request_info trig_info)
 	LOG_DEBUG("tdata1=%" PRIx64 ", tdata2=%" PRIx64, trig_info.tdata1, trig_info.tdata2);
 };
 
-static struct tdata1_cache *tdata1_cache_alloc(struct list_head *tdata1_cache_head, riscv_reg_t tdata1)
-{
-	struct tdata1_cache *elem = (struct tdata1_cache *)calloc(1, sizeof(struct tdata1_cache));
-	elem->tdata1 = tdata1;
-	INIT_LIST_HEAD(&elem->tdata2_cache_head);
-	list_add_tail(&elem->elem_tdata1, tdata1_cache_head);
-	return elem;
-}
-
-static void tdata2_cache_alloc(struct list_head *tdata2_cache_head, riscv_reg_t tdata2)
-{
-	struct tdata2_cache * const elem = calloc(1, sizeof(struct tdata2_cache));
-	elem->tdata2 = tdata2;
-	list_add(&elem->elem_tdata2, tdata2_cache_head);
-}
-
-struct tdata2_cache *tdata2_cache_search(struct list_head *tdata2_cache_head, riscv_reg_t find_tdata2)
-{
-	struct tdata2_cache *elem_2;
-	list_for_each_entry(elem_2, tdata2_cache_head, elem_tdata2) {
-		if (elem_2->tdata2 == find_tdata2)
-			return elem_2;
-	}
-	return NULL;
-}
-
-struct tdata1_cache *tdata1_cache_search(struct list_head *tdata1_cache_head, riscv_reg_t find_tdata1)
-{
-	struct tdata1_cache *elem_1;
-	list_for_each_entry(elem_1, tdata1_cache_head, elem_tdata1) {
-		if (elem_1->tdata1 == find_tdata1)
-			return elem_1;
-	}
-	return NULL;
-}
-
-static void create_wp_trigger_cache(struct target *target)
-{
-	RISCV_INFO(r);
-
-	r->wp_triggers_negative_cache = (struct list_head *)calloc(r->trigger_count,
-		sizeof(struct list_head));
-	for (unsigned int i = 0; i < r->trigger_count; ++i)
-		INIT_LIST_HEAD(&r->wp_triggers_negative_cache[i]);
-}
-
-static void wp_triggers_cache_add(struct target *target, unsigned int idx, riscv_reg_t tdata1,
-	riscv_reg_t tdata2, int error_code)
-{
-	RISCV_INFO(r);
-
-	struct tdata1_cache *tdata1_cache = tdata1_cache_search(&r->wp_triggers_negative_cache[idx], tdata1);
-	if (!tdata1_cache) {
-		tdata1_cache = tdata1_cache_alloc(&r->wp_triggers_negative_cache[idx], tdata1);
-	} else {
-		struct tdata2_cache *tdata2_cache = tdata2_cache_search(&tdata1_cache->tdata2_cache_head, tdata2);
-		if (tdata2_cache) {
-			list_move(&tdata2_cache->elem_tdata2, &tdata1_cache->tdata2_cache_head);
-			return;
-		}
-	}
-	tdata2_cache_alloc(&tdata1_cache->tdata2_cache_head, tdata2);
-}
-
-static bool wp_triggers_cache_search(struct target *target, unsigned int idx,
-	riscv_reg_t tdata1, riscv_reg_t tdata2)
+static int try_use_trigger_and_cache_result(struct target *target, unsigned int idx, riscv_reg_t tdata1,
+	riscv_reg_t tdata2)
 {
 	RISCV_INFO(r);
 
-	struct tdata1_cache *tdata1_cache = tdata1_cache_search(&r->wp_triggers_negative_cache[idx], tdata1);
-	if (!tdata1_cache)
-		return false;
-	struct tdata2_cache *tdata2_cache = tdata2_cache_search(&tdata1_cache->tdata2_cache_head, tdata2);
-	if (!tdata2_cache)
-		return false;
-	assert(tdata1_cache->tdata1 == tdata1 && tdata2_cache->tdata2 == tdata2);
-	return true;
-}
+	if (trigger_is_reserved(target, idx))
+		return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
 
-static int try_use_trigger_and_cache_result(struct target *target, unsigned int idx, riscv_reg_t tdata1,
-	riscv_reg_t tdata2)
-{
-	if (wp_triggers_cache_search(target, idx, tdata1, tdata2))
+	const enum riscv_trigger_support support = r->trigger_cache
+		? riscv_trigger_cache_lookup(r->trigger_cache, target, idx, tdata1,
+				tdata2)
+		: RISCV_TRIGGER_SUPPORT_UNKNOWN;
+	if (support == RISCV_TRIGGER_UNSUPPORTED)
 		return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
+	/* Already verified on this hart, so there's no need to read it back. */
+	if (support == RISCV_TRIGGER_SUPPORTED)
+		return write_trigger(target, idx, tdata1, tdata2) == ERROR_OK
+			? ERROR_OK : ERROR_FAIL;
 
 	int ret = set_trigger(target, idx, tdata1, tdata2);
 
-	/* Add these values to the cache to remember that they are not supported. */
-	if (ret == ERROR_TARGET_RESOURCE_NOT_AVAILABLE)
-		wp_triggers_cache_add(target, idx, tdata1, tdata2, ret);
+	/* Remember whether these values are supported. */
+	if (r->trigger_cache && (ret == ERROR_OK || ret == ERROR_TARGET_RESOURCE_NOT_AVAILABLE))
+		riscv_trigger_cache_record(r->trigger_cache, target, idx, tdata1,
+				tdata2, ret == ERROR_OK);
 	return ret;
 }
 
@@ -1390,6 +1373,15 @@ int riscv_write_by_any_size(struct target *target, target_addr_t address, uint32
 	return ERROR_FAIL;
 }
 
+bool riscv_can_access_memory_while_running(struct target *target,
+		unsigned int size_bytes)
+{
+	RISCV_INFO(r);
+	if (!r->can_access_memory_while_running)
+		return false;
+	return r->can_access_memory_while_running(target, size_bytes);
+}
+
 /**
  * Read one memory item using any memory access size that will work.
  * Read larger section of memory and pick out the required portion, if needed.
@@ -1422,6 +1414,42 @@ int riscv_read_by_any_size(struct target *target, target_addr_t address, uint32_
 	return ERROR_FAIL;
 }
 
+/* Software breakpoints are in memory shared by the SMP group, so the whole
+ * group uses the batch of its first hart. */
+static struct breakpoint_batch *riscv_breakpoint_batch(struct target *target)
+{
+	if (target->smp) {
+		struct target_list *head = list_first_entry(target->smp_targets,
+				struct target_list, lh);
+		return &riscv_info(head->target)->breakpoint_batch;
+	}
+	return &riscv_info(target)->breakpoint_batch;
+}
+
+static const struct breakpoint_batch_ops riscv_breakpoint_batch_ops = {
+	.write = riscv_write_by_any_size,
+};
+
+/* Write the deferred breakpoint updates through "target". "before_run" means
+ * that it is about to resume or step, which executes a fence anyway. */
+static int flush_breakpoint_batch(struct target *target,
+		struct breakpoint_batch *batch, bool before_run)
+{
+	if (!breakpoint_batch_is_pending(batch))
+		return ERROR_OK;
+	RISCV_INFO(r);
+	r->defer_fences = before_run;
+	int result = breakpoint_batch_flush(batch, target, &riscv_breakpoint_batch_ops);
+	r->defer_fences = false;
+	return result;
+}
+
+static int riscv_flush_breakpoints(struct target *target, bool before_run)
+{
+	return flush_breakpoint_batch(target, riscv_breakpoint_batch(target),
+			before_run);
+}
+
 static int riscv_add_breakpoint(struct target *target, struct breakpoint *breakpoint)
 {
 	LOG_TARGET_DEBUG(target, "@0x%" TARGET_PRIxADDR, breakpoint->address);
@@ -1439,16 +1467,31 @@ static int riscv_add_breakpoint(struct target *target, struct breakpoint *breakp
 			return ERROR_FAIL;
 		}
 
+		uint8_t buff[4] = { 0 };
+		buf_set_u32(buff, 0, breakpoint->length * CHAR_BIT, breakpoint->length == 4 ? ebreak() : ebreak_c());
+
 		/* Read the original instruction. */
+		uint8_t orig_instr[4];
 		if (riscv_read_by_any_size(
-				target, breakpoint->address, breakpoint->length, breakpoint->orig_instr) != ERROR_OK) {
+				target, breakpoint->address, breakpoint->length, orig_instr) != ERROR_OK) {
 			LOG_TARGET_ERROR(target, "Failed to read original instruction at 0x%" TARGET_PRIxADDR,
 					breakpoint->address);
 			return ERROR_FAIL;
 		}
 
-		uint8_t buff[4] = { 0 };
-		buf_set_u32(buff, 0, breakpoint->length * CHAR_BIT, breakpoint->length == 4 ? ebreak() : ebreak_c());
+		/* Only defer the write while halted. A running hart must see the
+		 * ebreak right away. */
+		RISCV_INFO(r);
+		struct breakpoint_batch *batch = riscv_breakpoint_batch(target);
+		if (r->batch_breakpoints && target->state == TARGET_HALTED) {
+			/* A breakpoint that was cleared but is still in memory reads
+			 * back as ebreak. */
+			breakpoint_batch_mask(batch, breakpoint->address,
+					breakpoint->length, orig_instr);
+			return breakpoint_batch_set(batch, breakpoint, buff, orig_instr);
+		}
+		memcpy(breakpoint->orig_instr, orig_instr, breakpoint->length);
+
 		/* Write the ebreak instruction. */
 		if (riscv_write_by_any_size(target, breakpoint->address, breakpoint->length, buff) != ERROR_OK) {
 			LOG_TARGET_ERROR(target, "Failed to write %d-byte breakpoint instruction at 0x%"
@@ -1511,6 +1554,17 @@ static int riscv_remove_breakpoint(struct target *target,
 		struct breakpoint *breakpoint)
 {
 	if (breakpoint->type == BKPT_SOFT) {
+		int result = breakpoint_batch_clear(riscv_breakpoint_batch(target),
+				breakpoint);
+		/* A running hart mustn't keep executing the ebreak. */
+		if (result == ERROR_OK && target->state != TARGET_HALTED)
+			return riscv_flush_breakpoints(target, /* before_run */ false);
+		if (result != ERROR_BREAKPOINT_NOT_FOUND)
+			return result;
+		/* Setting it failed when the batch was flushed. */
+		if (!breakpoint->is_set)
+			return ERROR_OK;
+
 		/* Write the original instruction. */
 		if (riscv_write_by_any_size(
 				target, breakpoint->address, breakpoint->length, breakpoint->orig_instr) != ERROR_OK) {
@@ -2205,8 +2259,11 @@ static int old_or_new_riscv_step_impl(struct target *target, int current,
 {
 	RISCV_INFO(r);
 	LOG_TARGET_DEBUG(target, "handle_breakpoints=%d", handle_breakpoints);
-	if (!r->get_hart_state)
+	if (!r->get_hart_state) {
+		if (riscv_flush_breakpoints(target, /* before_run */ false) != ERROR_OK)
+			return ERROR_FAIL;
 		return oldriscv_step(target, current, address, handle_breakpoints);
+	}
 	else
 		return riscv_openocd_step_impl(target, current, address, handle_breakpoints,
 			handle_callbacks);
@@ -2470,6 +2527,13 @@ int riscv_halt(struct target *target)
 				result = ERROR_FAIL;
 		}
 
+		/* Request the halt of the harts on all the DMs first, so they stop
+		 * near-simultaneously. halt_go() then finds most of them halted. */
+		if (r->request_halt && r->request_halt(target, target->smp_targets,
+					/* request */ true) != ERROR_OK)
+			LOG_TARGET_DEBUG(target, "Grouped halt request failed. "
+					"Halting each hart.");
+
 		foreach_smp_target(tlist, target->smp_targets) {
 			struct target *t = tlist->target;
 			struct riscv_info *i = riscv_info(t);
@@ -2479,6 +2543,12 @@ int riscv_halt(struct target *target)
 			}
 		}
 
+		/* A hart must not be left with haltreq set, or it would halt again
+		 * as soon as it's resumed. */
+		if (r->request_halt && r->request_halt(target, target->smp_targets,
+					/* request */ false) != ERROR_OK)
+			result = ERROR_FAIL;
+
 		foreach_smp_target(tlist, target->smp_targets) {
 			struct target *t = tlist->target;
 			if (halt_finish(t) != ERROR_OK)
@@ -2503,7 +2573,13 @@ static int riscv_assert_reset(struct target *target)
 	struct target_type *tt = get_target_type(target);
 	if (!tt)
 		return ERROR_FAIL;
+	/* The memory may change under the breakpoints after the reset. */
+	if (target->state == TARGET_HALTED &&
+			riscv_flush_breakpoints(target, /* before_run */ false) != ERROR_OK)
+		LOG_TARGET_WARNING(target, "Failed to write breakpoints before reset.");
 	riscv_invalidate_register_cache(target);
+	riscv_mem_cache_invalidate_all();
+	riscv_translation_cache_invalidate_all();
 	return tt->assert_reset(target);
 }
 
@@ -2584,6 +2660,10 @@ static int resume_prep(struct target *target, int current,
 			return ERROR_FAIL;
 	}
 
+	/* The step above may have put back a breakpoint, so this goes last. */
+	if (riscv_flush_breakpoints(target, /* before_run */ true) != ERROR_OK)
+		return ERROR_FAIL;
+
 	if (r->get_hart_state) {
 		if (r->resume_prep(target) != ERROR_OK)
 			return ERROR_FAIL;
@@ -2621,7 +2701,9 @@ static int resume_go(struct target *target, int current,
 static int resume_finish(struct target *target, int debug_execution)
 {
 	assert(target->state == TARGET_HALTED);
-	register_cache_invalidate(target->reg_cache);
+	riscv_invalidate_register_cache(target);
+	riscv_mem_cache_invalidate_all();
+	riscv_translation_cache_invalidate_all();
 
 	target->state = debug_execution ? TARGET_DEBUG_RUNNING : TARGET_RUNNING;
 	target->debug_reason = DBG_REASON_NOTHALTED;
@@ -2742,6 +2824,14 @@ static int riscv_mmu(struct target *target, int *enabled)
 	if (!riscv_virt2phys_mode_is_sw(target))
 		return ERROR_OK;
 
+	if (target->state == TARGET_DEBUG_RUNNING) {
+		/* An algorithm is running, so the registers can't be read. Use the
+		 * decision made when the algorithm was started. */
+		RISCV_INFO(r);
+		*enabled = r->algorithm.mmu_enabled;
+		return ERROR_OK;
+	}
+
 	/* Don't use MMU in explicit or effective M (machine) mode */
 	riscv_reg_t priv;
 	if (riscv_reg_get(target, &priv, GDB_REGNO_PRIV) != ERROR_OK) {
@@ -2826,6 +2916,53 @@ static int riscv_mmu(struct target *target, int *enabled)
 	return ERROR_OK;
 }
 
+static struct riscv_translation_cache_entry *translation_cache_find(
+		struct riscv_translation_cache *cache,
+		const virt2phys_info_t *info, target_addr_t ppn,
+		const virt2phys_info_t *extra_info, target_addr_t extra_ppn,
+		target_addr_t virtual)
+{
+	for (unsigned int i = 0; i < ARRAY_SIZE(cache->entries); i++) {
+		struct riscv_translation_cache_entry *entry = &cache->entries[i];
+		if (entry->valid && entry->info == info && entry->ppn == ppn &&
+				entry->extra_info == extra_info &&
+				entry->extra_ppn == extra_ppn &&
+				entry->virtual_page == virtual >> entry->page_shift)
+			return entry;
+	}
+	return NULL;
+}
+
+static void translation_cache_insert(struct riscv_translation_cache *cache,
+		const virt2phys_info_t *info, target_addr_t ppn,
+		const virt2phys_info_t *extra_info, target_addr_t extra_ppn,
+		unsigned int page_shift, target_addr_t virtual, target_addr_t physical)
+{
+	struct riscv_translation_cache_entry *entry = &cache->entries[cache->next];
+	cache->next = (cache->next + 1) % ARRAY_SIZE(cache->entries);
+	entry->valid = true;
+	entry->info = info;
+	entry->ppn = ppn;
+	entry->extra_info = extra_info;
+	entry->extra_ppn = extra_ppn;
+	entry->page_shift = page_shift;
+	entry->virtual_page = virtual >> page_shift;
+	entry->physical_page = physical >> page_shift;
+}
+
+void riscv_translation_cache_invalidate_all(void)
+{
+	/* Page tables may be shared between harts, so a hart that runs may
+	 * change the translations of all the others. */
+	for (struct target *target = all_targets; target; target = target->next) {
+		if (strcmp(target_type_name(target), "riscv") || !target->arch_info)
+			continue;
+		RISCV_INFO(r);
+		for (unsigned int i = 0; i < ARRAY_SIZE(r->translation_cache.entries); i++)
+			r->translation_cache.entries[i].valid = false;
+	}
+}
+
 /* Translate address from virtual to physical, using info and ppn.
  * If extra_info is non-NULL, then translate page table accesses for the primary
  * translation using extra_info and extra_ppn. */
@@ -2850,6 +2987,26 @@ static int riscv_address_translate(struct target *target,
 		return ERROR_FAIL;
 	}
 
+	/* The page tables can only change while the hart is halted if the
+	 * debugger writes to them, which invalidates the cache. */
+	struct riscv_translation_cache *cache = &r->translation_cache;
+	const bool use_cache = cache->enabled && target->state == TARGET_HALTED;
+	if (use_cache) {
+		const struct riscv_translation_cache_entry *entry =
+			translation_cache_find(cache, info, ppn, extra_info, extra_ppn,
+					virtual);
+		if (entry) {
+			cache->hits++;
+			*physical = (entry->physical_page << entry->page_shift) |
+				(virtual & (((target_addr_t)1 << entry->page_shift) - 1));
+			LOG_TARGET_DEBUG(target, "mode=%s; 0x%" TARGET_PRIxADDR " -> 0x%"
+					TARGET_PRIxADDR " (cached)", info->name, virtual, *physical);
+			return ERROR_OK;
+		}
+		cache->misses++;
+	}
+	const target_addr_t root_ppn = ppn;
+
 	uint64_t pte = 0;
 	target_addr_t table_address = ppn << RISCV_PGSHIFT;
 	int i = info->level - 1;
@@ -2901,6 +3058,9 @@ static int riscv_address_translate(struct target *target,
 		return ERROR_FAIL;
 	}
 
+	/* Everything below the leaf level comes from the virtual address. */
+	const unsigned int page_shift = info->pa_ppn_shift[i];
+
 	/* Make sure to clear out the high bits that may be set. */
 	*physical = virtual & (((target_addr_t)1 << info->va_bits) - 1);
 
@@ -2912,6 +3072,9 @@ static int riscv_address_translate(struct target *target,
 		*physical |= (ppn << info->pa_ppn_shift[i]);
 		i++;
 	}
+	if (use_cache)
+		translation_cache_insert(cache, info, root_ppn, extra_info, extra_ppn,
+				page_shift, virtual, *physical);
 	LOG_TARGET_DEBUG(target, "mode=%s; 0x%" TARGET_PRIxADDR " -> 0x%" TARGET_PRIxADDR,
 			 info->name, virtual, *physical);
 	return ERROR_OK;
@@ -3086,11 +3249,24 @@ static int riscv_virt2phys(struct target *target, target_addr_t virtual, target_
 			virtual, physical);
 }
 
+/* The deferred breakpoint updates are kept by virtual address, which can't be
+ * compared against a physical range, so make all of them before a physical
+ * access. */
+static int flush_breakpoints_for_phys_access(struct target *target)
+{
+	struct breakpoint_batch *batch = riscv_breakpoint_batch(target);
+	if (batch->flushing || !breakpoint_batch_is_pending(batch))
+		return ERROR_OK;
+	return riscv_flush_breakpoints(target, /* before_run */ false);
+}
+
 static int riscv_read_phys_memory(struct target *target, target_addr_t phys_address,
 			uint32_t size, uint32_t count, uint8_t *buffer)
 {
-	RISCV_INFO(r);
-	return r->read_memory(target, phys_address, size, count, buffer, size);
+	int result = flush_breakpoints_for_phys_access(target);
+	if (result != ERROR_OK)
+		return result;
+	return riscv_mem_cache_read(target, phys_address, size, count, buffer);
 }
 
 static int riscv_read_memory(struct target *target, target_addr_t address,
@@ -3108,16 +3284,36 @@ static int riscv_read_memory(struct target *target, target_addr_t address,
 		return result;
 	}
 
-	RISCV_INFO(r);
-	return r->read_memory(target, physical_addr, size, count, buffer, size);
+	if (riscv_virt2phys_mode_is_hw(target)) {
+		/* The hart translates the address with MPRV, using registers the
+		 * cache doesn't track, so don't cache what it maps to. */
+		RISCV_INFO(r);
+		result = r->read_memory(target, physical_addr, size, count, buffer,
+				size);
+	} else {
+		result = riscv_mem_cache_read(target, physical_addr, size, count,
+				buffer);
+	}
+	if (result == ERROR_OK)
+		/* Breakpoints that are cleared, but still in memory. */
+		breakpoint_batch_mask(riscv_breakpoint_batch(target), address,
+				(target_addr_t)size * count, buffer);
+	return result;
 }
 
 static int riscv_write_phys_memory(struct target *target, target_addr_t phys_address,
 			uint32_t size, uint32_t count, const uint8_t *buffer)
 {
+	int result = flush_breakpoints_for_phys_access(target);
+	if (result != ERROR_OK)
+		return result;
+
 	struct target_type *tt = get_target_type(target);
 	if (!tt)
 		return ERROR_FAIL;
+	riscv_mem_cache_invalidate_range(phys_address, (target_addr_t)size * count);
+	/* The write may have changed page tables. */
+	riscv_translation_cache_invalidate_all();
 	return tt->write_memory(target, phys_address, size, count, buffer);
 }
 
@@ -3136,9 +3332,27 @@ static int riscv_write_memory(struct target *target, target_addr_t address,
 		return result;
 	}
 
+	/* Make the deferred breakpoint updates first, so they don't overwrite
+	 * this write later on. */
+	struct breakpoint_batch *batch = riscv_breakpoint_batch(target);
+	if (!batch->flushing && breakpoint_batch_overlaps(batch, address,
+				(target_addr_t)size * count)) {
+		result = riscv_flush_breakpoints(target, /* before_run */ false);
+		if (result != ERROR_OK)
+			return result;
+	}
+
 	struct target_type *tt = get_target_type(target);
 	if (!tt)
 		return ERROR_FAIL;
+	if (riscv_virt2phys_mode_is_hw(target))
+		/* The physical address the hart will write isn't known. */
+		riscv_mem_cache_invalidate_all();
+	else
+		riscv_mem_cache_invalidate_range(physical_addr,
+				(target_addr_t)size * count);
+	/* The write may have changed page tables. */
+	riscv_translation_cache_invalidate_all();
 	return tt->write_memory(target, physical_addr, size, count, buffer);
 }
 
@@ -3181,6 +3395,9 @@ static int riscv_get_gdb_reg_list_internal(struct target *target,
 	if (!*reg_list)
 		return ERROR_FAIL;
 
+	if (is_read)
+		riscv_reg_prefetch(target);
+
 	for (int i = 0; i < *reg_list_size; i++) {
 		assert(!target->reg_cache->reg_list[i].valid ||
 				target->reg_cache->reg_list[i].size > 0);
@@ -3230,10 +3447,10 @@ static int riscv_arch_state(struct target *target)
 }
 
 /* Algorithm must end with a software breakpoint instruction. */
-static int riscv_run_algorithm(struct target *target, int num_mem_params,
+static int riscv_start_algorithm(struct target *target, int num_mem_params,
 		struct mem_param *mem_params, int num_reg_params,
 		struct reg_param *reg_params, target_addr_t entry_point,
-		target_addr_t exit_point, unsigned int timeout_ms, void *arch_info)
+		target_addr_t exit_point, void *arch_info)
 {
 	RISCV_INFO(info);
 
@@ -3255,14 +3472,19 @@ static int riscv_run_algorithm(struct target *target, int num_mem_params,
 		}
 	}
 
+	/* Memory accesses made while the algorithm is running can't read the
+	 * registers needed for address translation, so decide now whether
+	 * translation applies. */
+	if (riscv_mmu(target, &info->algorithm.mmu_enabled) != ERROR_OK)
+		return ERROR_FAIL;
+
 	/* Save registers */
 	struct reg *reg_pc = register_get_by_name(target->reg_cache, "pc", true);
 	if (!reg_pc || reg_pc->type->get(reg_pc) != ERROR_OK)
 		return ERROR_FAIL;
-	uint64_t saved_pc = buf_get_u64(reg_pc->value, 0, reg_pc->size);
-	LOG_TARGET_DEBUG(target, "saved_pc=0x%" PRIx64, saved_pc);
+	info->algorithm.saved_pc = buf_get_u64(reg_pc->value, 0, reg_pc->size);
+	LOG_TARGET_DEBUG(target, "saved_pc=0x%" PRIx64, info->algorithm.saved_pc);
 
-	uint64_t saved_regs[32];
 	for (int i = 0; i < num_reg_params; i++) {
 		LOG_TARGET_DEBUG(target, "save %s", reg_params[i].reg_name);
 		struct reg *r = register_get_by_name(target->reg_cache, reg_params[i].reg_name, false);
@@ -3284,7 +3506,7 @@ static int riscv_run_algorithm(struct target *target, int num_mem_params,
 
 		if (r->type->get(r) != ERROR_OK)
 			return ERROR_FAIL;
-		saved_regs[r->number] = buf_get_u64(r->value, 0, r->size);
+		info->algorithm.saved_regs[r->number] = buf_get_u64(r->value, 0, r->size);
 
 		if (reg_params[i].direction == PARAM_OUT || reg_params[i].direction == PARAM_IN_OUT) {
 			if (r->type->set(r, reg_params[i].value) != ERROR_OK)
@@ -3293,9 +3515,9 @@ static int riscv_run_algorithm(struct target *target, int num_mem_params,
 	}
 
 	/* Disable Interrupts before attempting to run the algorithm. */
-	uint64_t current_mstatus;
 	uint64_t irq_disabled_mask = MSTATUS_MIE | MSTATUS_HIE | MSTATUS_SIE | MSTATUS_UIE;
-	if (riscv_interrupts_disable(target, irq_disabled_mask, &current_mstatus) != ERROR_OK)
+	if (riscv_interrupts_disable(target, irq_disabled_mask,
+				&info->algorithm.saved_mstatus) != ERROR_OK)
 		return ERROR_FAIL;
 
 	/* Run algorithm */
@@ -3303,6 +3525,16 @@ static int riscv_run_algorithm(struct target *target, int num_mem_params,
 	if (riscv_resume(target, 0, entry_point, 0, 1, true) != ERROR_OK)
 		return ERROR_FAIL;
 
+	return ERROR_OK;
+}
+
+static int riscv_wait_algorithm(struct target *target, int num_mem_params,
+		struct mem_param *mem_params, int num_reg_params,
+		struct reg_param *reg_params, target_addr_t exit_point,
+		unsigned int timeout_ms, void *arch_info)
+{
+	RISCV_INFO(info);
+
 	int64_t start = timeval_ms();
 	while (target->state != TARGET_HALTED) {
 		LOG_TARGET_DEBUG(target, "poll()");
@@ -3343,7 +3575,8 @@ static int riscv_run_algorithm(struct target *target, int num_mem_params,
 	/* if (riscv_select_current_hart(target) != ERROR_OK)
 		return ERROR_FAIL; */
 
-	if (reg_pc->type->get(reg_pc) != ERROR_OK)
+	struct reg *reg_pc = register_get_by_name(target->reg_cache, "pc", true);
+	if (!reg_pc || reg_pc->type->get(reg_pc) != ERROR_OK)
 		return ERROR_FAIL;
 	uint64_t final_pc = buf_get_u64(reg_pc->value, 0, reg_pc->size);
 	if (exit_point && final_pc != exit_point) {
@@ -3353,12 +3586,12 @@ static int riscv_run_algorithm(struct target *target, int num_mem_params,
 	}
 
 	/* Restore Interrupts */
-	if (riscv_interrupts_restore(target, current_mstatus) != ERROR_OK)
+	if (riscv_interrupts_restore(target, info->algorithm.saved_mstatus) != ERROR_OK)
 		return ERROR_FAIL;
 
 	/* Restore registers */
 	uint8_t buf[8] = { 0 };
-	buf_set_u64(buf, 0, info->xlen, saved_pc);
+	buf_set_u64(buf, 0, info->xlen, info->algorithm.saved_pc);
 	if (reg_pc->type->set(reg_pc, buf) != ERROR_OK)
 		return ERROR_FAIL;
 
@@ -3374,7 +3607,7 @@ static int riscv_run_algorithm(struct target *target, int num_mem_params,
 		}
 		LOG_TARGET_DEBUG(target, "restore %s", reg_params[i].reg_name);
 		struct reg *r = register_get_by_name(target->reg_cache, reg_params[i].reg_name, false);
-		buf_set_u64(buf, 0, info->xlen, saved_regs[r->number]);
+		buf_set_u64(buf, 0, info->xlen, info->algorithm.saved_regs[r->number]);
 		if (r->type->set(r, buf) != ERROR_OK) {
 			LOG_TARGET_ERROR(target, "set(%s) failed", r->name);
 			return ERROR_FAIL;
@@ -3399,6 +3632,20 @@ static int riscv_run_algorithm(struct target *target, int num_mem_params,
 	return ERROR_OK;
 }
 
+static int riscv_run_algorithm(struct target *target, int num_mem_params,
+		struct mem_param *mem_params, int num_reg_params,
+		struct reg_param *reg_params, target_addr_t entry_point,
+		target_addr_t exit_point, unsigned int timeout_ms, void *arch_info)
+{
+	int retval = riscv_start_algorithm(target, num_mem_params, mem_params,
+			num_reg_params, reg_params, entry_point, exit_point, arch_info);
+	if (retval != ERROR_OK)
+		return retval;
+
+	return riscv_wait_algorithm(target, num_mem_params, mem_params,
+			num_reg_params, reg_params, exit_point, timeout_ms, arch_info);
+}
+
 static int riscv_checksum_memory(struct target *target,
 		target_addr_t address, uint32_t count,
 		uint32_t *checksum)
@@ -3492,6 +3739,16 @@ enum riscv_next_action {
 	RPH_RESUME,
 	RPH_REMAIN_HALTED
 };
+static int flush_registers_if_idle(struct target *target)
+{
+	RISCV_INFO(r);
+	/* If we've been idle for a while, flush the register cache. Just in case
+	 * OpenOCD is going to be disconnected without shutting down cleanly. */
+	if (timeval_ms() - r->last_activity > 100)
+		return riscv_reg_flush_all(target);
+	return ERROR_OK;
+}
+
 static int riscv_poll_hart(struct target *target, enum riscv_next_action *next_action)
 {
 	RISCV_INFO(r);
@@ -3535,12 +3792,8 @@ static int riscv_poll_hart(struct target *target, enum riscv_next_action *next_a
 		return ERROR_FAIL;
 	}
 
-	if (state == RISCV_STATE_HALTED && timeval_ms() - r->last_activity > 100) {
-		/* If we've been idle for a while, flush the register cache. Just in case
-		 * OpenOCD is going to be disconnected without shutting down cleanly. */
-		if (riscv_reg_flush_all(target) != ERROR_OK)
-			return ERROR_FAIL;
-	}
+	if (state == RISCV_STATE_HALTED && flush_registers_if_idle(target) != ERROR_OK)
+		return ERROR_FAIL;
 
 	if (target->state == TARGET_UNKNOWN || state != previous_riscv_state) {
 		switch (state) {
@@ -3623,45 +3876,66 @@ static int riscv_poll_hart(struct target *target, enum riscv_next_action *next_a
 	return ERROR_OK;
 }
 
-static int sample_memory(struct target *target)
+/* Sample into the sample buffer until "until_ms", or until it is full. */
+static int sample_memory_until(struct target *target, int64_t until_ms)
 {
 	RISCV_INFO(r);
 
-	if (!r->sample_buf.buf || !r->sample_config.enabled)
-		return ERROR_OK;
-
-	LOG_TARGET_DEBUG(target, "buf used/size: %d/%d", r->sample_buf.used, r->sample_buf.size);
-
-	uint64_t start = timeval_ms();
-	riscv_sample_buf_maybe_add_timestamp(target, true);
-	int result = ERROR_OK;
 	if (r->sample_memory) {
-		result = r->sample_memory(target, &r->sample_buf, &r->sample_config,
-									  start + TARGET_DEFAULT_POLLING_INTERVAL);
+		int result = r->sample_memory(target, &r->sample_buf, &r->sample_config,
+				until_ms);
 		if (result != ERROR_NOT_IMPLEMENTED)
-			goto exit;
+			return result;
 	}
 
-	/* Default slow path. */
-	while (timeval_ms() - start < TARGET_DEFAULT_POLLING_INTERVAL) {
+	/* Default slow path. While streaming, each sample is preceded by a
+	 * timestamp record (1 byte tag, 4 bytes time), which needs room too. */
+	const unsigned int timestamp_size = r->sample_buf.streaming ? 5 : 0;
+	while (timeval_ms() < until_ms) {
+		bool sampled = false;
 		for (unsigned int i = 0; i < ARRAY_SIZE(r->sample_config.bucket); i++) {
 			if (r->sample_config.bucket[i].enabled &&
-					r->sample_buf.used + 1 + r->sample_config.bucket[i].size_bytes < r->sample_buf.size) {
+					r->sample_buf.used + timestamp_size + 1 +
+					r->sample_config.bucket[i].size_bytes < r->sample_buf.size) {
 				assert(i < RISCV_SAMPLE_BUF_TIMESTAMP_BEFORE);
+				riscv_sample_buf_add_batch_timestamp(&r->sample_buf);
 				r->sample_buf.buf[r->sample_buf.used] = i;
-				result = riscv_read_phys_memory(
+				int result = riscv_read_phys_memory(
 					target, r->sample_config.bucket[i].address,
 					r->sample_config.bucket[i].size_bytes, 1,
 					r->sample_buf.buf + r->sample_buf.used + 1);
-				if (result == ERROR_OK)
-					r->sample_buf.used += 1 + r->sample_config.bucket[i].size_bytes;
-				else
-					goto exit;
+				if (result != ERROR_OK)
+					return result;
+				r->sample_buf.used += 1 + r->sample_config.bucket[i].size_bytes;
+				sampled = true;
 			}
 		}
+		if (!sampled)
+			break;
 	}
+	return ERROR_OK;
+}
+
+int riscv_sample_memory(struct target *target, unsigned int duration_ms)
+{
+	RISCV_INFO(r);
+
+	if (!r->sample_buf.buf || !r->sample_config.enabled)
+		return ERROR_OK;
+
+	LOG_TARGET_DEBUG(target, "buf used/size: %d/%d", r->sample_buf.used, r->sample_buf.size);
 
-exit:
+	const int64_t until_ms = timeval_ms() + duration_ms;
+	riscv_sample_buf_maybe_add_timestamp(target, true);
+	int result;
+	do {
+		result = sample_memory_until(target, until_ms);
+		/* When streaming, a full buffer is emptied right away so sampling
+		 * can go on. Otherwise it waits for `riscv dump_sample_buf`. */
+		if (riscv_sample_stream_flush(target) != ERROR_OK)
+			LOG_TARGET_WARNING(target, "Failed to stream memory samples.");
+	} while (result == ERROR_OK && r->sample_buf.streaming &&
+			timeval_ms() < until_ms);
 	riscv_sample_buf_maybe_add_timestamp(target, false);
 	if (result != ERROR_OK) {
 		LOG_TARGET_INFO(target, "Turning off memory sampling because it failed.");
@@ -3692,11 +3966,21 @@ int riscv_openocd_poll(struct target *target)
 		targets = &single_target_list;
 	}
 
+	struct target_list *entry;
+	foreach_smp_target(entry, targets)
+		riscv_info(entry->target)->poll_unchanged = false;
+
+	/* Polling many harts one by one costs a hart selection and a dmstatus
+	 * read each, so first find out which ones didn't change at all. */
+	RISCV_INFO(r);
+	if (target->smp && r->poll_harts &&
+			r->poll_harts(target, targets) != ERROR_OK)
+		LOG_TARGET_DEBUG(target, "Grouped poll failed. Polling each hart.");
+
 	unsigned int should_remain_halted = 0;
 	unsigned int should_resume = 0;
 	unsigned int halted = 0;
 	unsigned int running = 0;
-	struct target_list *entry;
 	foreach_smp_target(entry, targets) {
 		struct target *t = entry->target;
 		struct riscv_info *info = riscv_info(t);
@@ -3708,9 +3992,15 @@ int riscv_openocd_poll(struct target *target)
 		if (!target_was_examined(t))
 			continue;
 
-		enum riscv_next_action next_action;
-		if (riscv_poll_hart(t, &next_action) != ERROR_OK)
+		enum riscv_next_action next_action = RPH_NONE;
+		if (info->poll_unchanged) {
+			/* Still in the state we knew about, so there's nothing to
+			 * handle. */
+			if (t->state == TARGET_HALTED && flush_registers_if_idle(t) != ERROR_OK)
+				return ERROR_FAIL;
+		} else if (riscv_poll_hart(t, &next_action) != ERROR_OK) {
 			return ERROR_FAIL;
+		}
 
 		switch (next_action) {
 			case RPH_NONE:
@@ -3771,11 +4061,14 @@ int riscv_openocd_poll(struct target *target)
 			return ERROR_FAIL;
 	}
 
-	/* Sample memory if any target is running. */
+	/* Sample memory if any target is running. Streamed samples are taken
+	 * by the stream's own timer instead. */
+	if (riscv_sample_stream_active(&riscv_info(target)->sample_stream))
+		return ERROR_OK;
 	foreach_smp_target(entry, targets) {
 		struct target *t = entry->target;
 		if (t->state == TARGET_RUNNING) {
-			sample_memory(target);
+			riscv_sample_memory(target, TARGET_DEFAULT_POLLING_INTERVAL);
 			break;
 		}
 	}
@@ -3805,6 +4098,10 @@ static int riscv_openocd_step_impl(struct target *target, int current,
 			return ERROR_FAIL;
 	}
 
+	/* Removing the breakpoint may just have been deferred. */
+	if (riscv_flush_breakpoints(target, /* before_run */ true) != ERROR_OK)
+		return ERROR_FAIL;
+
 	if (riscv_enumerate_triggers(target) != ERROR_OK)
 		return ERROR_FAIL;
 
@@ -3836,7 +4133,9 @@ static int riscv_openocd_step_impl(struct target *target, int current,
 		LOG_TARGET_ERROR(target, "Unable to step rtos hart.");
 	}
 
-	register_cache_invalidate(target->reg_cache);
+	riscv_invalidate_register_cache(target);
+	riscv_mem_cache_invalidate_all();
+	riscv_translation_cache_invalidate_all();
 
 	if (info->isrmask_mode == RISCV_ISRMASK_STEPONLY)
 		if (riscv_interrupts_restore(target, current_mstatus) != ERROR_OK) {
@@ -3877,6 +4176,99 @@ int riscv_openocd_step(struct target *target, int current,
 		true /* handle_callbacks */);
 }
 
+/* Whether riscv_openocd_step_impl() changes more than dcsr around each step
+ * (interrupts masked for steps, watchpoints disabled for steps), so that it
+ * has to be used for every one of a series of steps. */
+static bool steps_need_full_treatment(struct target *target)
+{
+	RISCV_INFO(r);
+	return r->isrmask_mode == RISCV_ISRMASK_STEPONLY || target->watchpoints;
+}
+
+/* Take another step right after riscv_openocd_step_impl(), which leaves
+ * dcsr.step set. Unless "full", that's only a resume request, after which
+ * the registers have to be read again. No callbacks are called. */
+static int riscv_step_again(struct target *target, bool full,
+		int handle_breakpoints)
+{
+	if (full)
+		return riscv_openocd_step_impl(target, 1, 0, handle_breakpoints, false);
+
+	RISCV_INFO(r);
+	int result = r->select_target(target);
+	if (result == ERROR_OK)
+		result = r->step_current_hart(target);
+	riscv_invalidate_register_cache(target);
+	return result;
+}
+
+/* Tell everybody about a series of steps that was taken without callbacks. */
+static void riscv_steps_done(struct target *target)
+{
+	riscv_mem_cache_invalidate_all();
+	riscv_translation_cache_invalidate_all();
+
+	target->state = TARGET_RUNNING;
+	target_call_event_callbacks(target, TARGET_EVENT_RESUMED);
+	target->state = TARGET_HALTED;
+	target->debug_reason = DBG_REASON_SINGLESTEP;
+	target_call_event_callbacks(target, TARGET_EVENT_HALTED);
+}
+
+/* Single step while start <= pc < end, and report a single halt at the end.
+ * Only the first step gets the full treatment of riscv_openocd_step_impl(),
+ * unless steps_need_full_treatment(). The ones after it only read dpc back.
+ * Stepping stops after a polling interval, so OpenOCD stays responsive in
+ * long loops; gdb just asks to continue. */
+static int riscv_step_range(struct target *target, target_addr_t start,
+		target_addr_t end)
+{
+	RISCV_INFO(r);
+	if (!r->get_hart_state)
+		return old_or_new_riscv_step(target, 1, 0, 0);
+
+	/* So that a first step that doesn't move the pc is noticed too. */
+	riscv_reg_t pc, previous_pc;
+	if (riscv_reg_get(target, &previous_pc, GDB_REGNO_PC) != ERROR_OK)
+		return ERROR_FAIL;
+
+	if (riscv_openocd_step_impl(target, 1, 0, 0, false) != ERROR_OK)
+		return ERROR_FAIL;
+
+	const bool full_steps = steps_need_full_treatment(target);
+	const int64_t start_ms = timeval_ms();
+	unsigned int steps = 1;
+	int result;
+	while (true) {
+		result = riscv_reg_get(target, &pc, GDB_REGNO_PC);
+		if (result != ERROR_OK)
+			break;
+		/* An unchanged pc means the step halted without executing anything
+		 * (ebreak, trigger) or a jump to itself. Either way gdb should see
+		 * it. */
+		if (pc < start || pc >= end || pc == previous_pc ||
+				breakpoint_find(target, pc) ||
+				timeval_ms() - start_ms >= TARGET_DEFAULT_POLLING_INTERVAL)
+			break;
+		previous_pc = pc;
+
+		result = riscv_step_again(target, full_steps, 0);
+		if (result != ERROR_OK)
+			break;
+		steps++;
+	}
+	LOG_TARGET_DEBUG(target, "Took %u steps in 0x%" TARGET_PRIxADDR "-0x%"
+			TARGET_PRIxADDR ", stopped at 0x%" PRIx64 ".", steps, start, end, pc);
+
+	if (result != ERROR_OK) {
+		riscv_mem_cache_invalidate_all();
+		riscv_translation_cache_invalidate_all();
+		return result;
+	}
+	riscv_steps_done(target);
+	return ERROR_OK;
+}
+
 /* Command Handlers */
 COMMAND_HANDLER(riscv_set_command_timeout_sec)
 {
@@ -4108,6 +4500,57 @@ COMMAND_HANDLER(riscv_set_expose_csrs)
 	return ret;
 }
 
+COMMAND_HANDLER(riscv_set_register_prefetch)
+{
+	struct target *target = get_current_target(CMD_CTX);
+	RISCV_INFO(info);
+
+	if (CMD_ARGC == 0) {
+		const char *mode = "off";
+		if (info->reg_prefetch == RISCV_REG_PREFETCH_GPR)
+			mode = "gpr";
+		else if (info->reg_prefetch == RISCV_REG_PREFETCH_FPR)
+			mode = "fpr";
+		command_print(CMD, "%s", mode);
+		return ERROR_OK;
+	}
+
+	if (CMD_ARGC != 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (!strcmp(CMD_ARGV[0], "off")) {
+		info->reg_prefetch = RISCV_REG_PREFETCH_OFF;
+	} else if (!strcmp(CMD_ARGV[0], "gpr")) {
+		info->reg_prefetch = RISCV_REG_PREFETCH_GPR;
+	} else if (!strcmp(CMD_ARGV[0], "fpr")) {
+		info->reg_prefetch = RISCV_REG_PREFETCH_FPR;
+	} else {
+		command_print(CMD, "Unsupported register prefetch mode: %s", CMD_ARGV[0]);
+		return ERROR_COMMAND_ARGUMENT_INVALID;
+	}
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(riscv_set_register_prefetch_csrs)
+{
+	if (CMD_ARGC == 0) {
+		LOG_ERROR("Command expects parameters.");
+		return ERROR_COMMAND_SYNTAX_ERROR;
+	}
+
+	struct target *target = get_current_target(CMD_CTX);
+	RISCV_INFO(info);
+	int ret = ERROR_OK;
+
+	for (unsigned int i = 0; i < CMD_ARGC; i++) {
+		ret = parse_ranges(&info->prefetch_csr, CMD_ARGV[i], "csr", 0xfff);
+		if (ret != ERROR_OK)
+			break;
+	}
+
+	return ret;
+}
+
 COMMAND_HANDLER(riscv_set_expose_custom)
 {
 	if (CMD_ARGC == 0) {
@@ -4401,6 +4844,105 @@ COMMAND_HANDLER(riscv_resume_order)
 	return ERROR_OK;
 }
 
+static int parse_group_type(const char *arg, bool *halt)
+{
+	if (!strcmp(arg, "halt")) {
+		*halt = true;
+	} else if (!strcmp(arg, "resume")) {
+		*halt = false;
+	} else {
+		LOG_ERROR("Unknown group type: %s", arg);
+		return ERROR_COMMAND_SYNTAX_ERROR;
+	}
+	return ERROR_OK;
+}
+
+static int apply_groups(struct target *target)
+{
+	RISCV_INFO(r);
+	if (!target_was_examined(target) || !r->configure_groups)
+		return ERROR_OK;
+	return r->configure_groups(target);
+}
+
+COMMAND_HANDLER(riscv_hart_group)
+{
+	struct target *target = get_current_target(CMD_CTX);
+	RISCV_INFO(r);
+
+	if (CMD_ARGC < 1 || CMD_ARGC > 2)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	bool halt;
+	int result = parse_group_type(CMD_ARGV[0], &halt);
+	if (result != ERROR_OK)
+		return result;
+	int *group = halt ? &r->halt_group : &r->resume_group;
+
+	if (CMD_ARGC == 1) {
+		if (*group < 0)
+			command_print(CMD, "smp (%d)", target->smp);
+		else
+			command_print(CMD, "%d", *group);
+		return ERROR_OK;
+	}
+
+	if (!strcmp(CMD_ARGV[1], "smp")) {
+		*group = -1;
+	} else {
+		unsigned int value;
+		COMMAND_PARSE_NUMBER(uint, CMD_ARGV[1], value);
+		if (value > 31) {
+			LOG_ERROR("Group numbers go from 0 to 31.");
+			return ERROR_COMMAND_ARGUMENT_INVALID;
+		}
+		*group = value;
+	}
+	return apply_groups(target);
+}
+
+COMMAND_HANDLER(riscv_ext_trigger_group)
+{
+	struct target *target = get_current_target(CMD_CTX);
+	RISCV_INFO(r);
+
+	if (CMD_ARGC == 0) {
+		for (unsigned int i = 0; i < RISCV_MAX_DM_EXT_TRIGGERS; i++) {
+			if (r->ext_trigger_halt_group[i] >= 0)
+				command_print(CMD, "halt %u %d", i, r->ext_trigger_halt_group[i]);
+			if (r->ext_trigger_resume_group[i] >= 0)
+				command_print(CMD, "resume %u %d", i, r->ext_trigger_resume_group[i]);
+		}
+		return ERROR_OK;
+	}
+
+	if (CMD_ARGC != 3)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	bool halt;
+	int result = parse_group_type(CMD_ARGV[0], &halt);
+	if (result != ERROR_OK)
+		return result;
+	unsigned int trigger, group;
+	COMMAND_PARSE_NUMBER(uint, CMD_ARGV[1], trigger);
+	COMMAND_PARSE_NUMBER(uint, CMD_ARGV[2], group);
+	if (trigger >= RISCV_MAX_DM_EXT_TRIGGERS) {
+		LOG_ERROR("DM external triggers go from 0 to %d.",
+				RISCV_MAX_DM_EXT_TRIGGERS - 1);
+		return ERROR_COMMAND_ARGUMENT_INVALID;
+	}
+	if (group > 31) {
+		LOG_ERROR("Group numbers go from 0 to 31.");
+		return ERROR_COMMAND_ARGUMENT_INVALID;
+	}
+
+	if (halt)
+		r->ext_trigger_halt_group[trigger] = group;
+	else
+		r->ext_trigger_resume_group[trigger] = group;
+	return apply_groups(target);
+}
+
 COMMAND_HANDLER(riscv_use_bscan_tunnel)
 {
 	uint8_t irwidth = 0;
@@ -4424,8 +4966,12 @@ COMMAND_HANDLER(riscv_use_bscan_tunnel)
 		LOG_INFO("Nested Tap based Bscan Tunnel Selected");
 	else if (tunnel_type == BSCAN_TUNNEL_DATA_REGISTER)
 		LOG_INFO("Simple Register based Bscan Tunnel Selected");
-	else
+	else if (tunnel_type == BSCAN_TUNNEL_PACKED)
+		LOG_INFO("Packed Nested Tap based Bscan Tunnel Selected");
+	else {
 		LOG_INFO("Invalid Tunnel type selected ! : selecting default Nested Tap Type");
+		tunnel_type = BSCAN_TUNNEL_NESTED_TAP;
+	}
 
 	bscan_tunnel_type = tunnel_type;
 	bscan_tunnel_ir_width = irwidth;
@@ -4474,6 +5020,153 @@ COMMAND_HANDLER(riscv_set_maskisr)
 	return ERROR_OK;
 }
 
+COMMAND_HANDLER(riscv_set_breakpoint_batching)
+{
+	struct target *target = get_current_target(CMD_CTX);
+	RISCV_INFO(r);
+
+	if (CMD_ARGC == 0) {
+		command_print(CMD, "breakpoint batching: %s",
+				r->batch_breakpoints ? "on" : "off");
+		return ERROR_OK;
+	} else if (CMD_ARGC != 1) {
+		return ERROR_COMMAND_SYNTAX_ERROR;
+	}
+
+	COMMAND_PARSE_ON_OFF(CMD_ARGV[0], r->batch_breakpoints);
+	if (!r->batch_breakpoints && target->state == TARGET_HALTED)
+		return riscv_flush_breakpoints(target, /* before_run */ false);
+	return ERROR_OK;
+}
+
+/* Step "count" times and write the pc of every instruction that was stepped
+ * (and the given registers, before it executed) to a CSV file. */
+COMMAND_HANDLER(riscv_trace_steps)
+{
+	struct target *target = get_current_target(CMD_CTX);
+	RISCV_INFO(r);
+
+	if (CMD_ARGC < 2)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	unsigned int count;
+	COMMAND_PARSE_NUMBER(uint, CMD_ARGV[0], count);
+
+	if (!r->get_hart_state) {
+		LOG_TARGET_ERROR(target, "Only supported on v0.13 or v1.0 targets.");
+		return ERROR_FAIL;
+	}
+	if (target->state != TARGET_HALTED) {
+		LOG_TARGET_ERROR(target, "The target must be halted.");
+		return ERROR_TARGET_NOT_HALTED;
+	}
+
+	/* pc and dcsr come first, then the registers to trace. */
+	const unsigned int reg_count = CMD_ARGC - 2;
+	enum gdb_regno *regnos = calloc(reg_count + 2, sizeof(*regnos));
+	riscv_reg_t *values = calloc(reg_count + 2, sizeof(*values));
+	if (!regnos || !values) {
+		LOG_ERROR("Failed to allocate memory.");
+		free(regnos);
+		free(values);
+		return ERROR_FAIL;
+	}
+	regnos[0] = GDB_REGNO_PC;
+	regnos[1] = GDB_REGNO_DCSR;
+	for (unsigned int i = 0; i < reg_count; i++) {
+		struct reg *reg = register_get_by_name(target->reg_cache,
+				CMD_ARGV[i + 2], true);
+		if (!reg || !reg->exist) {
+			LOG_TARGET_ERROR(target, "Unknown register '%s'.", CMD_ARGV[i + 2]);
+			free(regnos);
+			free(values);
+			return ERROR_COMMAND_ARGUMENT_INVALID;
+		}
+		regnos[i + 2] = reg->number;
+	}
+
+	FILE *file = fopen(CMD_ARGV[1], "w");
+	if (!file) {
+		LOG_ERROR("Can't open %s for writing.", CMD_ARGV[1]);
+		free(regnos);
+		free(values);
+		return ERROR_FAIL;
+	}
+	fprintf(file, "pc");
+	for (unsigned int i = 0; i < reg_count; i++)
+		fprintf(file, ",%s", riscv_reg_gdb_regno_name(target, regnos[i + 2]));
+	fprintf(file, "\n");
+
+	const bool full_steps = steps_need_full_treatment(target);
+	/* Stepping off a breakpoint may write memory, which the next step has to
+	 * fence. */
+	bool full = true;
+	unsigned int steps = 0;
+	riscv_reg_t previous_pc = 0;
+	int result = ERROR_OK;
+	while (true) {
+		result = riscv_reg_get_many(target, reg_count + 2, regnos, values);
+		if (result != ERROR_OK)
+			break;
+		const riscv_reg_t pc = values[0];
+		/* An ebreak, a trigger or an interrupt stops the hart without
+		 * retiring the instruction, so the trace would repeat it. */
+		const unsigned int cause = get_field(values[1], CSR_DCSR_CAUSE);
+		if (steps > 0 && (pc == previous_pc || cause != CSR_DCSR_CAUSE_STEP)) {
+			LOG_TARGET_WARNING(target, "Step %u at 0x%" PRIx64 " didn't retire "
+					"an instruction (pc=0x%" PRIx64 ", dcsr.cause=%u).", steps,
+					previous_pc, pc, cause);
+			break;
+		}
+		if (steps == count)
+			break;
+
+		fprintf(file, "0x%" PRIx64, pc);
+		for (unsigned int i = 0; i < reg_count; i++)
+			fprintf(file, ",0x%" PRIx64, values[i + 2]);
+		fprintf(file, "\n");
+
+		const bool at_breakpoint = breakpoint_find(target, pc);
+		result = riscv_step_again(target, full || full_steps || at_breakpoint, 1);
+		if (result != ERROR_OK)
+			break;
+		steps++;
+		previous_pc = pc;
+		full = at_breakpoint;
+		keep_alive();
+	}
+
+	if (fclose(file)) {
+		LOG_ERROR("Error writing the trace to %s.", CMD_ARGV[1]);
+		result = ERROR_FAIL;
+	}
+	free(regnos);
+	free(values);
+
+	if (steps > 0)
+		riscv_steps_done(target);
+	if (result != ERROR_OK)
+		LOG_TARGET_ERROR(target, "Stopped tracing after %u steps.", steps);
+	return result;
+}
+
+COMMAND_HANDLER(riscv_set_shared_discovery)
+{
+	struct target *target = get_current_target(CMD_CTX);
+	RISCV_INFO(r);
+
+	if (CMD_ARGC == 0) {
+		command_print(CMD, "shared discovery: %s",
+				r->share_discovery ? "on" : "off");
+		return ERROR_OK;
+	} else if (CMD_ARGC != 1) {
+		return ERROR_COMMAND_SYNTAX_ERROR;
+	}
+
+	COMMAND_PARSE_ON_OFF(CMD_ARGV[0], r->share_discovery);
+	return ERROR_OK;
+}
+
 COMMAND_HANDLER(riscv_set_ebreakm)
 {
 	struct target *target = get_current_target(CMD_CTX);
@@ -4881,6 +5574,10 @@ COMMAND_HANDLER(handle_dump_sample_buf_command)
 				uint32_t timestamp = buf_get_u32(r->sample_buf.buf + i, 0, 32);
 				i += 4;
 				command_print(CMD, "timestamp after: %u", timestamp);
+			} else if (command == RISCV_SAMPLE_BUF_TIMESTAMP_BATCH) {
+				uint32_t timestamp = buf_get_u32(r->sample_buf.buf + i, 0, 32);
+				i += 4;
+				command_print(CMD, "timestamp batch: %u us", timestamp);
 			} else if (command < ARRAY_SIZE(r->sample_config.bucket)) {
 				command_print_sameline(CMD, "0x%" TARGET_PRIxADDR ": ",
 									   r->sample_config.bucket[command].address);
@@ -4945,6 +5642,18 @@ COMMAND_HANDLER(handle_info)
 		riscv_enumerate_triggers(target) == ERROR_OK;
 	riscv_print_info_line_if_available(CMD, "hart", "trigger_count",
 				r->trigger_count, trigger_count_available);
+	CALL_COMMAND_HANDLER(riscv_mem_cache_print_info, target);
+	if (r->translation_cache.enabled) {
+		const struct riscv_translation_cache *cache = &r->translation_cache;
+		const uint64_t lookups = cache->hits + cache->misses;
+		command_print(CMD, "%-21s %3" PRIu64, "translation_cache.hits",
+				cache->hits);
+		command_print(CMD, "%-21s %3" PRIu64, "translation_cache.misses",
+				cache->misses);
+		/* In percent. */
+		riscv_print_info_line(CMD, "translation_cache", "hit_rate",
+				lookups ? (unsigned int)(cache->hits * 100 / lookups) : 0);
+	}
 	if (r->print_info)
 		return CALL_COMMAND_HANDLER(r->print_info, target);
 
@@ -4993,6 +5702,9 @@ COMMAND_HANDLER(riscv_exec_progbuf)
 		return ERROR_FAIL;
 	int error = riscv_program_exec(&prog, target);
 	riscv_invalidate_register_cache(target);
+	/* The program may have stored to memory or executed a fence. */
+	riscv_mem_cache_invalidate_all();
+	riscv_translation_cache_invalidate_all();
 
 	if (error != ERROR_OK) {
 		LOG_TARGET_ERROR(target, "exec_progbuf: Program buffer execution failed.");
@@ -5128,6 +5840,28 @@ COMMAND_HANDLER(handle_riscv_virt2phys_mode)
 	return ERROR_OK;
 }
 
+COMMAND_HANDLER(handle_riscv_translation_cache)
+{
+	struct riscv_info *info = riscv_info(get_current_target(CMD_CTX));
+	struct riscv_translation_cache *cache = &info->translation_cache;
+	if (CMD_ARGC == 0) {
+		command_print(CMD, "%s", cache->enabled ? "on" : "off");
+		return ERROR_OK;
+	}
+
+	if (CMD_ARGC != 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	bool enable;
+	COMMAND_PARSE_ON_OFF(CMD_ARGV[0], enable);
+	cache->enabled = enable;
+	for (unsigned int i = 0; i < ARRAY_SIZE(cache->entries); i++)
+		cache->entries[i].valid = false;
+	cache->hits = 0;
+	cache->misses = 0;
+	return ERROR_OK;
+}
+
 static const struct command_registration riscv_exec_command_handlers[] = {
 	{
 		.name = "dump_sample_buf",
@@ -5207,6 +5941,22 @@ static const struct command_registration riscv_exec_command_handlers[] = {
 			"gdb target description and `reg` command output. "
 			"This must be executed before `init`."
 	},
+	{
+		.name = "register_prefetch",
+		.handler = riscv_set_register_prefetch,
+		.mode = COMMAND_ANY,
+		.usage = "[off|gpr|fpr]",
+		.help = "Read the GPRs and dpc (gpr), as well as the FPRs (fpr), in "
+			"one batch on the first register access after the hart halts."
+	},
+	{
+		.name = "register_prefetch_csrs",
+		.handler = riscv_set_register_prefetch_csrs,
+		.mode = COMMAND_ANY,
+		.usage = "n0[-m0][,n1[-m1]]...",
+		.help = "Configure a list of inclusive ranges for CSRs to read along "
+			"with the registers selected by `riscv register_prefetch`."
+	},
 	{
 		.name = "authdata_read",
 		.handler = riscv_authdata_read,
@@ -5273,6 +6023,23 @@ static const struct command_registration riscv_exec_command_handlers[] = {
 			"supported. Normal order is from lowest hart index to highest. "
 			"Reversed order is from highest hart index to lowest."
 	},
+	{
+		.name = "hart_group",
+		.handler = riscv_hart_group,
+		.mode = COMMAND_ANY,
+		.usage = "halt|resume [group|smp]",
+		.help = "Set the debug module halt or resume group of the current "
+			"hart. 'smp' uses the SMP group number. By default harts are in "
+			"the halt group of their SMP group and in no resume group."
+	},
+	{
+		.name = "ext_trigger_group",
+		.handler = riscv_ext_trigger_group,
+		.mode = COMMAND_ANY,
+		.usage = "[halt|resume trigger group]",
+		.help = "Place a debug module external trigger in a halt or resume "
+			"group. Without arguments, list the configured triggers."
+	},
 	{
 		.name = "set_ir",
 		.handler = riscv_set_ir,
@@ -5303,6 +6070,32 @@ static const struct command_registration riscv_exec_command_handlers[] = {
 		.help = "mask riscv interrupts",
 		.usage = "['off'|'steponly']",
 	},
+	{
+		.name = "set_breakpoint_batching",
+		.handler = riscv_set_breakpoint_batching,
+		.mode = COMMAND_ANY,
+		.usage = "[on|off]",
+		.help = "When on, software breakpoints are written to memory all at "
+			"once right before the hart resumes or steps. Defaults to on."
+	},
+	{
+		.name = "trace_steps",
+		.handler = riscv_trace_steps,
+		.mode = COMMAND_EXEC,
+		.usage = "count file [register ...]",
+		.help = "Single step count times and write the pc of each stepped "
+			"instruction, and the given registers before it executed, to a "
+			"CSV file."
+	},
+	{
+		.name = "set_shared_discovery",
+		.handler = riscv_set_shared_discovery,
+		.mode = COMMAND_ANY,
+		.usage = "[on|off]",
+		.help = "When on, examine doesn't probe the optional registers of "
+			"a hart that is identical to one examined before, and uses "
+			"what was found for that one. Defaults to off."
+	},
 	{
 		.name = "set_ebreakm",
 		.handler = riscv_set_ebreakm,
@@ -5381,6 +6174,35 @@ static const struct command_registration riscv_exec_command_handlers[] = {
 				"hw - translate vaddr to paddr by hardware, "
 				"off - no address translation."
 	},
+	{
+		.name = "translation_cache",
+		.handler = handle_riscv_translation_cache,
+		.mode = COMMAND_ANY,
+		.usage = "[on|off]",
+		.help = "Enable or disable caching the translations found by "
+				"walking the page tables while the hart is halted."
+	},
+	{
+		.chain = riscv_delay_profile_command_handlers
+	},
+	{
+		.chain = riscv_mem_cache_command_handlers
+	},
+	{
+		.chain = riscv_mem_region_command_handlers
+	},
+	{
+		.chain = riscv_sample_stream_command_handlers
+	},
+	{
+		.chain = riscv_benchmark_command_handlers
+	},
+	{
+		.chain = riscv_dmi_trace_command_handlers
+	},
+	{
+		.chain = riscv_stats_command_handlers
+	},
 	COMMAND_REGISTRATION_DONE
 };
 
@@ -5446,6 +6268,7 @@ struct target_type riscv_target = {
 	.halt = riscv_halt,
 	.resume = riscv_target_resume,
 	.step = old_or_new_riscv_step,
+	.step_range = riscv_step_range,
 
 	.assert_reset = riscv_assert_reset,
 	.deassert_reset = riscv_deassert_reset,
@@ -5474,6 +6297,8 @@ struct target_type riscv_target = {
 	.arch_state = riscv_arch_state,
 
 	.run_algorithm = riscv_run_algorithm,
+	.start_algorithm = riscv_start_algorithm,
+	.wait_algorithm = riscv_wait_algorithm,
 
 	.commands = riscv_command_handlers,
 
@@ -5508,8 +6333,12 @@ static void riscv_info_init(struct target *target, struct riscv_info *r)
 	r->num_enabled_mem_access_methods = RISCV_MEM_ACCESS_MAX_METHODS_NUM;
 	for (size_t i = 0; i < RISCV_MEM_ACCESS_MAX_METHODS_NUM; ++i)
 		r->mem_access_warn[i] = true;
+	INIT_LIST_HEAD(&r->mem_regions);
+	breakpoint_batch_init(&r->breakpoint_batch);
+	r->batch_breakpoints = true;
 
 	INIT_LIST_HEAD(&r->expose_csr);
+	INIT_LIST_HEAD(&r->prefetch_csr);
 	INIT_LIST_HEAD(&r->expose_custom);
 	INIT_LIST_HEAD(&r->hide_csr);
 
@@ -5522,6 +6351,20 @@ static void riscv_info_init(struct target *target, struct riscv_info *r)
 	r->wp_allow_equality_match_trigger = true;
 	r->wp_allow_ge_lt_trigger = true;
 	r->wp_allow_napot_trigger = true;
+
+	riscv_mem_cache_init(&r->mem_cache);
+	r->translation_cache.enabled = true;
+	riscv_sample_stream_init(&r->sample_stream);
+
+	r->reg_prefetch = RISCV_REG_PREFETCH_OFF;
+	r->reg_prefetch_pending = true;
+
+	r->halt_group = -1;
+	r->resume_group = 0;
+	for (unsigned int i = 0; i < RISCV_MAX_DM_EXT_TRIGGERS; i++) {
+		r->ext_trigger_halt_group[i] = -1;
+		r->ext_trigger_resume_group[i] = -1;
+	}
 }
 
 static int riscv_resume_go_all_harts(struct target *target)
@@ -5639,6 +6482,8 @@ static void riscv_invalidate_register_cache(struct target *target)
 
 	LOG_TARGET_DEBUG(target, "Invalidating register cache.");
 	register_cache_invalidate(target->reg_cache);
+	RISCV_INFO(r);
+	r->reg_prefetch_pending = true;
 }
 
 int riscv_get_hart_state(struct target *target, enum riscv_hart_state *state)
@@ -5845,10 +6690,100 @@ int riscv_enumerate_triggers(struct target *target)
 	LOG_TARGET_INFO(target, "Found %d triggers", r->trigger_count);
 	free(r->reserved_triggers);
 	r->reserved_triggers = calloc(t, sizeof(*r->reserved_triggers));
-	create_wp_trigger_cache(target);
+	riscv_trigger_cache_put(r->trigger_cache);
+	r->trigger_cache = riscv_trigger_cache_get(target);
 	return ERROR_OK;
 }
 
+bool riscv_bscan_tunnel_is_packed(void)
+{
+	return bscan_tunnel_ir_width != 0 && bscan_tunnel_type == BSCAN_TUNNEL_PACKED;
+}
+
+unsigned int riscv_bscan_packed_max_scans(unsigned int scan_bits,
+		unsigned int idle)
+{
+	if (idle >= 1u << BSCAN_PACKED_IDLE_NBITS)
+		return 0;
+	const unsigned int room = (BSCAN_PACKED_MAX_NBITS -
+			BSCAN_PACKED_HEADER_NBITS - BSCAN_PACKED_TRAILER_NBITS) /
+		(scan_bits + idle);
+	return MIN(MAX(room, 1u), 1u << BSCAN_PACKED_COUNT_NBITS);
+}
+
+int riscv_bscan_packed_frame_init(riscv_bscan_packed_frame_t *frame,
+		const struct scan_field *fields, unsigned int count, unsigned int idle)
+{
+	const unsigned int scan_bits = fields[0].num_bits;
+	assert(count > 0 && count <= 1u << BSCAN_PACKED_COUNT_NBITS);
+	assert(scan_bits < 1u << BSCAN_TUNNEL_IR_WIDTH_NBITS);
+	assert(idle < 1u << BSCAN_PACKED_IDLE_NBITS);
+
+	const unsigned int num_bits = BSCAN_PACKED_HEADER_NBITS +
+		count * (scan_bits + idle) + BSCAN_PACKED_TRAILER_NBITS;
+	frame->out = calloc(DIV_ROUND_UP(num_bits, 8), 1);
+	frame->in = calloc(DIV_ROUND_UP(num_bits, 8), 1);
+	if (!frame->out || !frame->in) {
+		LOG_ERROR("Failed to allocate a packed BSCAN tunnel frame.");
+		riscv_bscan_packed_frame_free(frame);
+		return ERROR_FAIL;
+	}
+	frame->scan_count = count;
+	frame->scan_bits = scan_bits;
+	frame->idle = idle;
+
+	unsigned int offset = 0;
+	buf_set_u32(frame->out, offset, 1, 1);
+	offset += 1;
+	buf_set_u32(frame->out, offset, BSCAN_TUNNEL_IR_WIDTH_NBITS, 0);
+	offset += BSCAN_TUNNEL_IR_WIDTH_NBITS;
+	buf_set_u32(frame->out, offset, BSCAN_TUNNEL_IR_WIDTH_NBITS, scan_bits);
+	offset += BSCAN_TUNNEL_IR_WIDTH_NBITS;
+	buf_set_u32(frame->out, offset, BSCAN_PACKED_COUNT_NBITS, count - 1);
+	offset += BSCAN_PACKED_COUNT_NBITS;
+	buf_set_u32(frame->out, offset, BSCAN_PACKED_IDLE_NBITS, idle);
+	offset += BSCAN_PACKED_IDLE_NBITS;
+	/* The idle cycles and the trailer are zeros. */
+	for (unsigned int i = 0; i < count; i++) {
+		assert(fields[i].num_bits == scan_bits);
+		buf_set_buf(fields[i].out_value, 0, frame->out, offset, scan_bits);
+		offset += scan_bits + idle;
+	}
+
+	frame->field.num_bits = num_bits;
+	frame->field.out_value = frame->out;
+	frame->field.in_value = frame->in;
+	return ERROR_OK;
+}
+
+void riscv_add_bscan_packed_frame(struct target *target,
+		riscv_bscan_packed_frame_t *frame)
+{
+	jtag_add_ir_scan(target->tap, &select_user4, TAP_IDLE);
+	jtag_add_dr_scan(target->tap, 1, &frame->field, TAP_IDLE);
+}
+
+void riscv_bscan_packed_frame_collect(const riscv_bscan_packed_frame_t *frame,
+		struct scan_field *fields)
+{
+	/* As for single tunneled scans, TDO lags TDI by one clock. */
+	unsigned int offset = BSCAN_PACKED_HEADER_NBITS + 1;
+	for (unsigned int i = 0; i < frame->scan_count; i++) {
+		if (fields[i].in_value)
+			buf_set_buf(frame->in, offset, fields[i].in_value, 0,
+					frame->scan_bits);
+		offset += frame->scan_bits + frame->idle;
+	}
+}
+
+void riscv_bscan_packed_frame_free(riscv_bscan_packed_frame_t *frame)
+{
+	free(frame->out);
+	free(frame->in);
+	frame->out = NULL;
+	frame->in = NULL;
+}
+
 void riscv_add_bscan_tunneled_scan(struct target *target, const struct scan_field *field,
 					riscv_bscan_tunneled_scan_context_t *ctxt)
 {
@@ -8,7 +8,11 @@ struct riscv_program;
 #include <stdint.h>
 #include "opcodes.h"
 #include "gdb_regs.h"
+#include "mem_cache.h"
+#include "sample_stream.h"
+#include "stats.h"
 #include "jtag/jtag.h"
+#include "target/breakpoints.h"
 #include "target/semihosting_common.h"
 #include "target/target.h"
 #include "target/register.h"
@@ -21,6 +25,7 @@ struct riscv_program;
 #define RISCV_MAX_TRIGGERS 32
 #define RISCV_MAX_HWBPS 16
 #define RISCV_MAX_DMS 100
+#define RISCV_MAX_DM_EXT_TRIGGERS 16
 
 #define DEFAULT_COMMAND_TIMEOUT_SEC 5
 
@@ -57,6 +62,9 @@ typedef enum riscv_mem_access_method {
 	RISCV_MEM_ACCESS_MAX_METHODS_NUM
 } riscv_mem_access_method_t;
 
+/* The name `riscv set_mem_access` and the other commands use for "method". */
+const char *riscv_mem_access_method_name(riscv_mem_access_method_t method);
+
 typedef enum riscv_virt2phys_mode {
 	RISCV_VIRT2PHYS_MODE_HW,
 	RISCV_VIRT2PHYS_MODE_SW,
@@ -82,6 +90,14 @@ enum riscv_isrmasking_mode {
 	RISCV_ISRMASK_STEPONLY,
 };
 
+enum riscv_reg_prefetch {
+	RISCV_REG_PREFETCH_OFF,
+	/* GPRs and dpc */
+	RISCV_REG_PREFETCH_GPR,
+	/* GPRs, dpc and FPRs */
+	RISCV_REG_PREFETCH_FPR,
+};
+
 enum riscv_hart_state {
 	RISCV_STATE_NON_EXISTENT,
 	RISCV_STATE_RUNNING,
@@ -98,10 +114,15 @@ typedef struct {
 
 #define RISCV_SAMPLE_BUF_TIMESTAMP_BEFORE	0x80
 #define RISCV_SAMPLE_BUF_TIMESTAMP_AFTER	0x81
+/* Followed by the low 32 bits of the host time in microseconds, when the
+ * samples that follow were read. Only used while streaming. */
+#define RISCV_SAMPLE_BUF_TIMESTAMP_BATCH	0x82
 struct riscv_sample_buf {
 	uint8_t *buf;
 	unsigned int used;
 	unsigned int size;
+	/* The samples are sent to a stream after every poll. */
+	bool streaming;
 };
 
 typedef struct {
@@ -121,6 +142,46 @@ typedef struct {
 
 #define DTM_DTMCS_VERSION_UNKNOWN ((unsigned int)-1)
 
+typedef struct {
+	const char *name;
+	int level;
+	unsigned int va_bits;
+	/* log2(PTESIZE) */
+	unsigned int pte_shift;
+	unsigned int vpn_shift[PG_MAX_LEVEL];
+	unsigned int vpn_mask[PG_MAX_LEVEL];
+	unsigned int pte_ppn_shift[PG_MAX_LEVEL];
+	unsigned int pte_ppn_mask[PG_MAX_LEVEL];
+	unsigned int pa_ppn_shift[PG_MAX_LEVEL];
+	unsigned int pa_ppn_mask[PG_MAX_LEVEL];
+} virt2phys_info_t;
+
+#define RISCV_TRANSLATION_CACHE_SIZE 64
+
+/* A leaf translation found by walking the page tables. The walk is identified
+ * by the mode and root page of the translation and, for two-stage
+ * translation, of the stage used to access the page tables. */
+struct riscv_translation_cache_entry {
+	bool valid;
+	const virt2phys_info_t *info;
+	target_addr_t ppn;
+	const virt2phys_info_t *extra_info;
+	target_addr_t extra_ppn;
+	/* log2 of the page size, larger for superpages. */
+	unsigned int page_shift;
+	target_addr_t virtual_page;
+	target_addr_t physical_page;
+};
+
+struct riscv_translation_cache {
+	bool enabled;
+	struct riscv_translation_cache_entry entries[RISCV_TRANSLATION_CACHE_SIZE];
+	/* Entry to be replaced next. */
+	unsigned int next;
+	uint64_t hits;
+	uint64_t misses;
+};
+
 struct reg_name_table {
 	unsigned int num_entries;
 	char **reg_names;
@@ -147,15 +208,19 @@ struct riscv_info {
 
 	bool mtopi_readable;
 	bool mtopei_readable;
+	/* Skip probing the optional registers at examine when an identical hart
+	 * (same DM, XLEN, misa and hartinfo) was examined already, and use what
+	 * was found for it. Set with `riscv set_shared_discovery`. */
+	bool share_discovery;
 
 	/* The number of triggers per hart. */
 	unsigned int trigger_count;
 
-	/* Data structure to record known unsupported tdata1+tdata2 trigger CSR values.
+	/* Known supported and unsupported tdata1+tdata2 trigger CSR values.
 	 * This is to avoid repetitive attempts to set trigger configurations that are already
-	 * known to be unsupported in the HW.
-	 * A separate data structure is created for each trigger. */
-	struct list_head *wp_triggers_negative_cache;
+	 * known to be unsupported in the HW, and reading back the ones known to work.
+	 * Harts with identical triggers may share it (see trigger_cache.h). */
+	struct riscv_trigger_cache *trigger_cache;
 
 	/* record the tinfo of each trigger */
 	unsigned int trigger_tinfo[RISCV_MAX_TRIGGERS];
@@ -190,13 +255,55 @@ struct riscv_info {
 	/* Used by riscv_openocd_poll(). */
 	bool halted_needs_event_callback;
 	enum target_event halted_callback_event;
+	/* Set by poll_harts() when this hart is known to still be in the state
+	 * recorded in target->state, so it doesn't need to be polled on its
+	 * own. */
+	bool poll_unchanged;
 
 	enum riscv_isrmasking_mode isrmask_mode;
 
+	/* Halt and resume group to place this hart in, as set with
+	 * `riscv hart_group`. -1 means the SMP group number (0 when not part of
+	 * an SMP group). */
+	int halt_group;
+	int resume_group;
+	/* Groups to place the DM external triggers in, as set with
+	 * `riscv ext_trigger_group`. -1 means they are left alone. */
+	int ext_trigger_halt_group[RISCV_MAX_DM_EXT_TRIGGERS];
+	int ext_trigger_resume_group[RISCV_MAX_DM_EXT_TRIGGERS];
+
+	/* State saved by riscv_start_algorithm() and restored by
+	 * riscv_wait_algorithm(). */
+	struct {
+		uint64_t saved_pc;
+		uint64_t saved_regs[32];
+		uint64_t saved_mstatus;
+		/* Whether address translation applies to memory accesses made
+		 * while the algorithm is running. */
+		int mmu_enabled;
+	} algorithm;
+
+	/* Host side cache of memory read while halted. Off by default. */
+	struct riscv_mem_cache mem_cache;
+
+	/* Software page table walks done while halted. */
+	struct riscv_translation_cache translation_cache;
+
 	/* Helper functions that target the various RISC-V debug spec
 	 * implementations. */
 	int (*select_target)(struct target *target);
 	int (*get_hart_state)(struct target *target, enum riscv_hart_state *state);
+	/* Place the hart and the DM external triggers into the configured halt
+	 * and resume groups. */
+	int (*configure_groups)(struct target *target);
+	/* Check many of the harts in "targets" at once. Set poll_unchanged on
+	 * the ones whose state didn't change. */
+	int (*poll_harts)(struct target *target, struct list_head *targets);
+	/* Set haltreq of the prepped harts in "targets", or clear it again on
+	 * the harts it was set on, with one JTAG queue execution for all their
+	 * DMs. halt_go() still checks that each hart halted. */
+	int (*request_halt)(struct target *target, struct list_head *targets,
+			bool request);
 	/* Resume this target, as well as every other prepped target that can be
 	 * resumed near-simultaneously. Clear the prepped flag on any target that
 	 * was resumed. */
@@ -256,6 +363,14 @@ struct riscv_info {
 	int (*read_memory)(struct target *target, target_addr_t address,
 			uint32_t size, uint32_t count, uint8_t *buffer, uint32_t increment);
 
+	/* Returns true if memory accesses of the given size work while the hart
+	 * is running (e.g. through the System Bus). */
+	bool (*can_access_memory_while_running)(struct target *target,
+			unsigned int size_bytes);
+
+	/* Store the scan delays learned for this target in its delay profile. */
+	void (*update_delay_profile)(struct target *target);
+
 	unsigned int (*data_bits)(struct target *target);
 
 	COMMAND_HELPER((*print_info), struct target *target);
@@ -289,6 +404,23 @@ struct riscv_info {
 	 * for all. Following flags are used to warn only once about failing memory access method. */
 	bool mem_access_warn[RISCV_MEM_ACCESS_MAX_METHODS_NUM];
 
+	/* Address ranges with their own memory access methods, as
+	 * struct riscv_mem_region. They take precedence over the list above. */
+	struct list_head mem_regions;
+
+	/* Counters for `riscv stats`, which can reset them. */
+	struct riscv_stats stats;
+
+	/* Software breakpoint memory updates, deferred until the hart runs when
+	 * batch_breakpoints is set. In SMP groups, the first hart's batch is
+	 * used by all of them. */
+	struct breakpoint_batch breakpoint_batch;
+	bool batch_breakpoints;
+	/* Set while the deferred breakpoints are written right before the hart
+	 * runs. Memory accesses then skip their fences, since one is executed
+	 * before resuming or stepping anyway. */
+	bool defer_fences;
+
 	/* In addition to the ones in the standard spec, we'll also expose additional
 	 * CSRs in this list. */
 	struct list_head expose_csr;
@@ -301,8 +433,16 @@ struct riscv_info {
 	 * but do not appear in gdb targets description or reg command output. */
 	struct list_head hide_csr;
 
+	/* Registers read with a single batch when GDB reads the register list
+	 * for the first time after the register cache was invalidated (e.g.
+	 * after a halt). CSRs to read in addition are listed in prefetch_csr. */
+	enum riscv_reg_prefetch reg_prefetch;
+	struct list_head prefetch_csr;
+	bool reg_prefetch_pending;
+
 	riscv_sample_config_t sample_config;
 	struct riscv_sample_buf sample_buf;
+	struct riscv_sample_stream sample_stream;
 
 	/* Track when we were last asked to do something substantial. */
 	int64_t last_activity;
@@ -328,19 +468,22 @@ typedef struct {
 	struct scan_field tunneled_dr[4];
 } riscv_bscan_tunneled_scan_context_t;
 
+/* Several DMI scans sent through the BSCAN tunnel in a single DR scan, see
+ * riscv_bscan_packed_frame_init(). */
 typedef struct {
-	const char *name;
-	int level;
-	unsigned int va_bits;
-	/* log2(PTESIZE) */
-	unsigned int pte_shift;
-	unsigned int vpn_shift[PG_MAX_LEVEL];
-	unsigned int vpn_mask[PG_MAX_LEVEL];
-	unsigned int pte_ppn_shift[PG_MAX_LEVEL];
-	unsigned int pte_ppn_mask[PG_MAX_LEVEL];
-	unsigned int pa_ppn_shift[PG_MAX_LEVEL];
-	unsigned int pa_ppn_mask[PG_MAX_LEVEL];
-} virt2phys_info_t;
+	/* Index of the first scan in the batch. */
+	size_t first_scan;
+	unsigned int scan_count;
+	unsigned int scan_bits;
+	/* Idle cycles the tunnel spends after each scan. */
+	unsigned int idle;
+	uint8_t *out;
+	uint8_t *in;
+	struct scan_field field;
+} riscv_bscan_packed_frame_t;
+
+/* Forget the translations cached by all the RISC-V targets. */
+void riscv_translation_cache_invalidate_all(void);
 
 bool riscv_virt2phys_mode_is_hw(const struct target *target);
 bool riscv_virt2phys_mode_is_sw(const struct target *target);
@@ -371,7 +514,13 @@ int dtmcontrol_scan(struct target *target, uint32_t out, uint32_t *in_ptr);
 
 extern struct scan_field *bscan_tunneled_select_dmi;
 extern uint32_t bscan_tunneled_select_dmi_num_fields;
-typedef enum { BSCAN_TUNNEL_NESTED_TAP, BSCAN_TUNNEL_DATA_REGISTER } bscan_tunnel_type_t;
+typedef enum {
+	BSCAN_TUNNEL_NESTED_TAP,
+	BSCAN_TUNNEL_DATA_REGISTER,
+	/* Like BSCAN_TUNNEL_NESTED_TAP, but batches of DMI scans are sent as
+	 * packed frames of several scans each. */
+	BSCAN_TUNNEL_PACKED
+} bscan_tunnel_type_t;
 extern uint8_t bscan_tunnel_ir_width;
 
 void select_dmi_via_bscan(struct target *target);
@@ -379,6 +528,9 @@ void select_dmi_via_bscan(struct target *target);
 /*** OpenOCD Interface */
 int riscv_openocd_poll(struct target *target);
 
+/* Sample the memory configured with `riscv memory_sample` for "duration_ms". */
+int riscv_sample_memory(struct target *target, unsigned int duration_ms);
+
 int riscv_halt(struct target *target);
 
 int riscv_openocd_step(
@@ -433,6 +585,30 @@ enum semihosting_result riscv_semihosting(struct target *target, int *retval);
 void riscv_add_bscan_tunneled_scan(struct target *target, const struct scan_field *field,
 		riscv_bscan_tunneled_scan_context_t *ctxt);
 
+/* Whether batches of DMI scans should go through the tunnel in packed
+ * frames. */
+bool riscv_bscan_tunnel_is_packed(void);
+/* The number of scans of "scan_bits" bits, each followed by "idle" idle
+ * cycles, that fit in one packed frame. 0 if "idle" is too large for the
+ * frame format. */
+unsigned int riscv_bscan_packed_max_scans(unsigned int scan_bits,
+		unsigned int idle);
+/* Build a packed frame out of the "count" scans in "fields". */
+int riscv_bscan_packed_frame_init(riscv_bscan_packed_frame_t *frame,
+		const struct scan_field *fields, unsigned int count, unsigned int idle);
+void riscv_add_bscan_packed_frame(struct target *target,
+		riscv_bscan_packed_frame_t *frame);
+/* Once the frame was scanned, copy the result of each scan to the in_value of
+ * its field. */
+void riscv_bscan_packed_frame_collect(const riscv_bscan_packed_frame_t *frame,
+		struct scan_field *fields);
+void riscv_bscan_packed_frame_free(riscv_bscan_packed_frame_t *frame);
+
+/* Returns true if memory of the given access size can be read and written
+ * while the hart is running, which is needed by asynchronous algorithms. */
+bool riscv_can_access_memory_while_running(struct target *target,
+		unsigned int size_bytes);
+
 int riscv_read_by_any_size(struct target *target, target_addr_t address, uint32_t size, uint8_t *buffer);
 int riscv_write_by_any_size(struct target *target, target_addr_t address, uint32_t size, uint8_t *buffer);
 
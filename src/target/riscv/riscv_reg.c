@@ -852,6 +852,14 @@ static int riscv_set_or_write_register(struct target *target,
 		return ERROR_FAIL;
 	}
 
+	/* The memory cache is physically indexed, but stay on the safe side
+	 * when the address space is switched. */
+	if (regid == GDB_REGNO_SATP)
+		riscv_mem_cache_invalidate_all();
+	if (regid == GDB_REGNO_SATP || regid == GDB_REGNO_VSATP ||
+			regid == GDB_REGNO_HGATP)
+		riscv_translation_cache_invalidate_all();
+
 	if (target->state != TARGET_HALTED) {
 		LOG_TARGET_DEBUG(target,
 				"Target not halted, writing to target: %s <- 0x%" PRIx64,
@@ -922,6 +930,88 @@ int riscv_reg_write(struct target *target, enum gdb_regno regid,
 			/* write_through */ true);
 }
 
+static void prefetch_queue(struct target *target, enum gdb_regno regno,
+		enum gdb_regno *regnos, unsigned int *count, bool *queued)
+{
+	if (queued[regno])
+		return;
+	const struct reg *reg = riscv_reg_impl_cache_entry(target, regno);
+	if (!reg->exist || reg->valid ||
+			!riscv_reg_impl_gdb_regno_cacheable(regno, /* is write? */ false))
+		return;
+	queued[regno] = true;
+	regnos[(*count)++] = regno;
+}
+
+/* Read the registers selected by `riscv register_prefetch` and
+ * `riscv register_prefetch_csrs` into the cache in one go. Whatever can't be
+ * read this way is left to be read on demand. */
+static void prefetch_registers(struct target *target)
+{
+	RISCV_INFO(r);
+	r->reg_prefetch_pending = false;
+	if (r->reg_prefetch == RISCV_REG_PREFETCH_OFF)
+		return;
+
+	enum gdb_regno *regnos = calloc(GDB_REGNO_COUNT, sizeof(*regnos));
+	riscv_reg_t *values = calloc(GDB_REGNO_COUNT, sizeof(*values));
+	bool *read = calloc(GDB_REGNO_COUNT, sizeof(*read));
+	bool *queued = calloc(GDB_REGNO_COUNT, sizeof(*queued));
+	if (!regnos || !values || !read || !queued) {
+		LOG_TARGET_ERROR(target, "Failed to allocate memory.");
+		goto cleanup;
+	}
+
+	unsigned int count = 0;
+	for (enum gdb_regno regno = GDB_REGNO_RA; regno <= GDB_REGNO_XPR31; regno++)
+		prefetch_queue(target, regno, regnos, &count, queued);
+	prefetch_queue(target, GDB_REGNO_DPC, regnos, &count, queued);
+
+	riscv_reg_t mstatus;
+	/* FPRs can only be accessed while mstatus.FS is not Off. */
+	if (r->reg_prefetch == RISCV_REG_PREFETCH_FPR &&
+			riscv_reg_impl_cache_entry(target, GDB_REGNO_FPR0)->exist &&
+			riscv_reg_get(target, &mstatus, GDB_REGNO_MSTATUS) == ERROR_OK &&
+			get_field(mstatus, MSTATUS_FS) != 0)
+		for (enum gdb_regno regno = GDB_REGNO_FPR0; regno <= GDB_REGNO_FPR31; regno++)
+			prefetch_queue(target, regno, regnos, &count, queued);
+
+	const range_list_t *range;
+	list_for_each_entry(range, &r->prefetch_csr, list)
+		for (unsigned int csr = range->low; csr <= range->high; csr++)
+			prefetch_queue(target, GDB_REGNO_CSR0 + csr, regnos, &count, queued);
+
+	if (count == 0 ||
+			riscv013_get_registers(target, count, regnos, values, read) != ERROR_OK)
+		goto cleanup;
+
+	unsigned int prefetched = 0;
+	for (unsigned int i = 0; i < count; i++) {
+		if (!read[i])
+			continue;
+		struct reg *reg = riscv_reg_impl_cache_entry(target, regnos[i]);
+		buf_set_u64(reg->value, 0, reg->size, values[i]);
+		reg->valid = true;
+		reg->dirty = false;
+		prefetched++;
+	}
+	LOG_TARGET_DEBUG(target, "Prefetched %u of %u registers.", prefetched, count);
+
+cleanup:
+	free(regnos);
+	free(values);
+	free(read);
+	free(queued);
+}
+
+void riscv_reg_prefetch(struct target *target)
+{
+	RISCV_INFO(r);
+	if (r->dtm_version != DTM_DTMCS_VERSION_0_11 && r->reg_prefetch_pending &&
+			target->state == TARGET_HALTED)
+		prefetch_registers(target);
+}
+
 /**
  * This function is used to get the value of a register. If possible, the value
  * in cache will be updated.
@@ -971,3 +1061,50 @@ int riscv_reg_get(struct target *target, riscv_reg_t *value,
 	LOG_TARGET_DEBUG(target, "Read %s: 0x%" PRIx64, reg->name, *value);
 	return ERROR_OK;
 }
+
+int riscv_reg_get_many(struct target *target, unsigned int count,
+		const enum gdb_regno *regnos, riscv_reg_t *values)
+{
+	RISCV_INFO(r);
+	if (r->dtm_version != DTM_DTMCS_VERSION_0_11 &&
+			target->state == TARGET_HALTED) {
+		enum gdb_regno *uncached = calloc(count, sizeof(*uncached));
+		riscv_reg_t *uncached_values = calloc(count, sizeof(*uncached_values));
+		bool *read = calloc(count, sizeof(*read));
+		unsigned int uncached_count = 0;
+		if (uncached && uncached_values && read) {
+			for (unsigned int i = 0; i < count; i++) {
+				const enum gdb_regno regno =
+					regnos[i] == GDB_REGNO_PC ? GDB_REGNO_DPC : regnos[i];
+				const struct reg *reg = riscv_reg_impl_cache_entry(target, regno);
+				if (reg->exist && !reg->valid &&
+						riscv_reg_impl_gdb_regno_cacheable(regno, /* is write? */ false))
+					uncached[uncached_count++] = regno;
+			}
+		}
+		/* With a single register there is nothing to batch. */
+		if (uncached_count > 1 &&
+				riscv013_get_registers(target, uncached_count, uncached,
+					uncached_values, read) == ERROR_OK) {
+			for (unsigned int i = 0; i < uncached_count; i++) {
+				if (!read[i])
+					continue;
+				struct reg *reg = riscv_reg_impl_cache_entry(target, uncached[i]);
+				buf_set_u64(reg->value, 0, reg->size, uncached_values[i]);
+				reg->valid = true;
+				reg->dirty = false;
+			}
+		}
+		free(uncached);
+		free(uncached_values);
+		free(read);
+	}
+
+	/* Whatever wasn't read above is read one by one. */
+	for (unsigned int i = 0; i < count; i++) {
+		int result = riscv_reg_get(target, &values[i], regnos[i]);
+		if (result != ERROR_OK)
+			return result;
+	}
+	return ERROR_OK;
+}
@@ -31,8 +31,21 @@ int riscv_reg_set(struct target *target, enum gdb_regno i, riscv_reg_t v);
  * (write-through mode).
  */
 int riscv_reg_write(struct target *target, enum gdb_regno i, riscv_reg_t v);
+/**
+ * Read the registers selected by `riscv register_prefetch` into the cache
+ * with a single batch, if that wasn't done since the cache was invalidated.
+ * Meant for when the whole register file is about to be read, as for GDB's
+ * `g` packet.
+ */
+void riscv_reg_prefetch(struct target *target);
 /** Get register, from the cache if it's in there. */
 int riscv_reg_get(struct target *target, riscv_reg_t *value,
 		enum gdb_regno r);
+/**
+ * Get several registers, like riscv_reg_get(). The ones that aren't cached
+ * are read with a single batch where the target allows it.
+ */
+int riscv_reg_get_many(struct target *target, unsigned int count,
+		const enum gdb_regno *regnos, riscv_reg_t *values);
 
 #endif /* OPENOCD_TARGET_RISCV_RISCV_REG_H */
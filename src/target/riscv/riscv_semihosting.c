@@ -82,15 +82,20 @@ enum semihosting_result riscv_semihosting(struct target *target, int *retval)
 		0x40705013	/* srai    zero,zero,0x7 */
 	};
 
-	/* Read three uncompressed instructions: The previous, the current one (pointed to by PC) and the next one */
-	for (int i = 0; i < 3; i++) {
-		uint8_t buf[4];
-		/* Instruction memories may not support arbitrary read size. Use any size that will work. */
+	/* Read three uncompressed instructions: The previous, the current one (pointed to by PC) and the next one.
+	 * Read them all at once, which is a single memory access in the common case. */
+	uint8_t buf[sizeof(magic)];
+	if (pc % 4 || target_read_memory(target, pc - 4, 4, ARRAY_SIZE(magic), buf) != ERROR_OK) {
+		for (unsigned int i = 0; i < ARRAY_SIZE(magic); i++) {
+			/* Instruction memories may not support arbitrary read size. Use any size that will work. */
+			*retval = riscv_read_by_any_size(target, (pc - 4) + 4 * i, 4, buf + 4 * i);
+			if (*retval != ERROR_OK)
+				return SEMIHOSTING_ERROR;
+		}
+	}
+	for (unsigned int i = 0; i < ARRAY_SIZE(magic); i++) {
 		target_addr_t address = (pc - 4) + 4 * i;
-		*retval = riscv_read_by_any_size(target, address, 4, buf);
-		if (*retval != ERROR_OK)
-			return SEMIHOSTING_ERROR;
-		uint32_t value = target_buffer_get_u32(target, buf);
+		uint32_t value = target_buffer_get_u32(target, buf + 4 * i);
 		LOG_TARGET_DEBUG(target, "compare 0x%08x from 0x%" PRIx64 " against 0x%08x",
 			value, address, magic[i]);
 		if (value != magic[i]) {
@@ -105,23 +110,17 @@ enum semihosting_result riscv_semihosting(struct target *target, int *retval)
 	 */
 	if (!semihosting->hit_fileio) {
 		/* RISC-V uses A0 and A1 to pass function arguments */
-		riscv_reg_t r0;
-		riscv_reg_t r1;
-
-		result = riscv_reg_get(target, &r0, GDB_REGNO_A0);
-		if (result != ERROR_OK) {
-			LOG_TARGET_ERROR(target, "Could not read semihosting operation code (register a0)");
-			return SEMIHOSTING_ERROR;
-		}
+		static const enum gdb_regno regnos[] = { GDB_REGNO_A0, GDB_REGNO_A1 };
+		riscv_reg_t values[ARRAY_SIZE(regnos)];
 
-		result = riscv_reg_get(target, &r1, GDB_REGNO_A1);
+		result = riscv_reg_get_many(target, ARRAY_SIZE(regnos), regnos, values);
 		if (result != ERROR_OK) {
-			LOG_TARGET_ERROR(target, "Could not read semihosting operation code (register a1)");
+			LOG_TARGET_ERROR(target, "Could not read semihosting operation code and parameter (registers a0, a1)");
 			return SEMIHOSTING_ERROR;
 		}
 
-		semihosting->op = r0;
-		semihosting->param = r1;
+		semihosting->op = values[0];
+		semihosting->param = values[1];
 		semihosting->word_size_bytes = riscv_xlen(target) / 8;
 
 		/* Check for ARM operation numbers. */
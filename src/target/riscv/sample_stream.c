@@ -0,0 +1,322 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+/*
+ * Streaming of memory samples taken while the hart is running.
+ *
+ * Without a stream, samples pile up in a fixed buffer until it's dumped with
+ * `riscv dump_sample_buf`, and sampling stops once the buffer is full. With a
+ * stream, every batch of samples gets a microsecond timestamp and the buffer
+ * is emptied into a file or to TCP clients whenever it fills up, which is
+ * enough to plot variables live. Sampling is then driven by a timer of its
+ * own instead of by polling, as long as there is a file or a connected TCP
+ * client: it samples for SAMPLE_STREAM_SLICE_MS at a time, so the rest of
+ * OpenOCD is served in between. Nothing is sampled while the hart is halted.
+ *
+ * The stream starts with the 8 bytes "RVSAMPL\x01". Then each sample is a
+ * record of:
+ *   u8  bucket, as set with `riscv memory_sample`
+ *   u8  size of the value in bytes
+ *   u32 microseconds since the stream was started (wraps around)
+ *   value, "size" bytes
+ * All the multi-byte fields are little endian.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <helper/log.h>
+#include <helper/time_support.h>
+#include <server/server.h>
+#include "target/target.h"
+#include "sample_stream.h"
+#include "riscv.h"
+
+#define SAMPLE_STREAM_SERVICE_NAME	"riscv_sample_stream"
+#define SAMPLE_STREAM_VERSION		1
+#define SAMPLE_RECORD_HEADER_SIZE	6
+/* How long each call of the stream's timer samples for. */
+#define SAMPLE_STREAM_SLICE_MS		10
+
+static const uint8_t stream_header[8] = {
+	'R', 'V', 'S', 'A', 'M', 'P', 'L', SAMPLE_STREAM_VERSION
+};
+
+struct riscv_sample_stream_connection {
+	struct list_head list;
+	struct connection *connection;
+};
+
+struct riscv_sample_stream_service {
+	struct riscv_sample_stream *stream;
+};
+
+void riscv_sample_stream_init(struct riscv_sample_stream *stream)
+{
+	memset(stream, 0, sizeof(*stream));
+	INIT_LIST_HEAD(&stream->connections);
+}
+
+static int sample_stream_timer(void *priv)
+{
+	struct target *target = priv;
+	RISCV_INFO(r);
+	const struct riscv_sample_stream *stream = &r->sample_stream;
+	/* Nobody to send the samples to. */
+	if (!stream->file && list_empty(&stream->connections))
+		return ERROR_OK;
+	if (target->state != TARGET_RUNNING)
+		return ERROR_OK;
+	/* A failure turns sampling off, there's nothing else to do about it. */
+	riscv_sample_memory(target, SAMPLE_STREAM_SLICE_MS);
+	return ERROR_OK;
+}
+
+void riscv_sample_stream_close(struct riscv_sample_stream *stream)
+{
+	if (!stream->destination)
+		return;
+	target_unregister_timer_callback(sample_stream_timer, stream->target);
+	if (stream->file) {
+		fclose(stream->file);
+		stream->file = NULL;
+	}
+	if (stream->destination[0] == ':')
+		/* Also closes all the connections. */
+		remove_service(SAMPLE_STREAM_SERVICE_NAME, &stream->destination[1]);
+	free(stream->destination);
+	stream->destination = NULL;
+}
+
+void riscv_sample_buf_add_batch_timestamp(struct riscv_sample_buf *buf)
+{
+	if (!buf->streaming || buf->used + 5 >= buf->size)
+		return;
+	const uint32_t now = timeval_us() & 0xffffffff;
+	buf->buf[buf->used++] = RISCV_SAMPLE_BUF_TIMESTAMP_BATCH;
+	h_u32_to_le(buf->buf + buf->used, now);
+	buf->used += 4;
+}
+
+static int stream_write(struct riscv_sample_stream *stream, const uint8_t *data,
+		size_t size)
+{
+	if (stream->file) {
+		if (fwrite(data, 1, size, stream->file) != size) {
+			LOG_ERROR("Error writing memory samples to %s.", stream->destination);
+			return ERROR_FAIL;
+		}
+		fflush(stream->file);
+	}
+
+	struct riscv_sample_stream_connection *c;
+	list_for_each_entry(c, &stream->connections, list)
+		if (connection_write(c->connection, data, size) != (int)size)
+			LOG_ERROR("Error writing memory samples to a connection.");
+	return ERROR_OK;
+}
+
+int riscv_sample_stream_flush(struct target *target)
+{
+	RISCV_INFO(r);
+	struct riscv_sample_stream *stream = &r->sample_stream;
+	struct riscv_sample_buf *buf = &r->sample_buf;
+	if (!riscv_sample_stream_active(stream) || buf->used == 0)
+		return ERROR_OK;
+
+	/* A record is never more than twice the size of the sample it comes
+	 * from (4 byte values are the smallest). */
+	uint8_t *records = malloc(2 * buf->used);
+	if (!records) {
+		LOG_TARGET_ERROR(target, "Failed to allocate memory.");
+		return ERROR_FAIL;
+	}
+
+	size_t size = 0;
+	uint32_t timestamp = (timeval_us() - stream->start_us) & 0xffffffff;
+	int result = ERROR_OK;
+	for (unsigned int i = 0; i < buf->used; ) {
+		const uint8_t command = buf->buf[i++];
+		if (command == RISCV_SAMPLE_BUF_TIMESTAMP_BATCH) {
+			timestamp = le_to_h_u32(buf->buf + i) - (uint32_t)stream->start_us;
+			i += 4;
+		} else if (command == RISCV_SAMPLE_BUF_TIMESTAMP_BEFORE ||
+				command == RISCV_SAMPLE_BUF_TIMESTAMP_AFTER) {
+			i += 4;
+		} else if (command < ARRAY_SIZE(r->sample_config.bucket)) {
+			const unsigned int value_size = r->sample_config.bucket[command].size_bytes;
+			records[size++] = command;
+			records[size++] = value_size;
+			h_u32_to_le(records + size, timestamp);
+			size += 4;
+			memcpy(records + size, buf->buf + i, value_size);
+			size += value_size;
+			i += value_size;
+			stream->records++;
+		} else {
+			LOG_TARGET_ERROR(target, "Found invalid command byte in sample buf: "
+					"0x%2x at offset 0x%x", command, i - 1);
+			result = ERROR_FAIL;
+			break;
+		}
+	}
+
+	if (result == ERROR_OK)
+		result = stream_write(stream, records, size);
+	free(records);
+	buf->used = 0;
+	return result;
+}
+
+static int sample_stream_new_connection(struct connection *connection)
+{
+	struct riscv_sample_stream_service *service = connection->service->priv;
+	struct riscv_sample_stream_connection *c = malloc(sizeof(*c));
+	if (!c) {
+		LOG_ERROR("Out of memory");
+		return ERROR_FAIL;
+	}
+	c->connection = connection;
+	list_add_tail(&c->list, &service->stream->connections);
+	if (connection_write(connection, stream_header, sizeof(stream_header)) !=
+			(int)sizeof(stream_header))
+		LOG_ERROR("Error writing memory samples to a connection.");
+	return ERROR_OK;
+}
+
+static int sample_stream_input(struct connection *connection)
+{
+	/* Nothing is expected from the client. Just notice when it goes away. */
+	uint8_t dummy[64];
+	int bytes_read = connection_read(connection, dummy, sizeof(dummy));
+
+	if (bytes_read == 0) {
+		return ERROR_SERVER_REMOTE_CLOSED;
+	} else if (bytes_read == -1) {
+		LOG_ERROR("error during read: %s", strerror(errno));
+		return ERROR_SERVER_REMOTE_CLOSED;
+	}
+	return ERROR_OK;
+}
+
+static int sample_stream_connection_closed(struct connection *connection)
+{
+	struct riscv_sample_stream_service *service = connection->service->priv;
+	struct riscv_sample_stream_connection *c, *tmp;
+	list_for_each_entry_safe(c, tmp, &service->stream->connections, list) {
+		if (c->connection == connection) {
+			list_del(&c->list);
+			free(c);
+			return ERROR_OK;
+		}
+	}
+	LOG_ERROR("Failed to find connection to close!");
+	return ERROR_FAIL;
+}
+
+static const struct service_driver sample_stream_service_driver = {
+	.name = SAMPLE_STREAM_SERVICE_NAME,
+	.new_connection_during_keep_alive_handler = NULL,
+	.new_connection_handler = sample_stream_new_connection,
+	.input_handler = sample_stream_input,
+	.connection_closed_handler = sample_stream_connection_closed,
+	.keep_client_alive_handler = NULL,
+};
+
+static int open_stream(struct target *target, struct riscv_sample_stream *stream,
+		const char *destination)
+{
+	stream->destination = strdup(destination);
+	if (!stream->destination) {
+		LOG_ERROR("Failed to allocate memory.");
+		return ERROR_FAIL;
+	}
+
+	if (destination[0] == ':') {
+		struct riscv_sample_stream_service *service = malloc(sizeof(*service));
+		if (!service) {
+			LOG_ERROR("Out of memory");
+			goto error;
+		}
+		service->stream = stream;
+		if (add_service(&sample_stream_service_driver, &destination[1],
+					CONNECTION_LIMIT_UNLIMITED, service) != ERROR_OK) {
+			LOG_ERROR("Can't start the memory sample server on port %s.",
+					&destination[1]);
+			free(service);
+			goto error;
+		}
+	} else {
+		stream->file = fopen(destination, "wb");
+		if (!stream->file) {
+			LOG_ERROR("Can't open %s for writing.", destination);
+			goto error;
+		}
+		if (fwrite(stream_header, 1, sizeof(stream_header), stream->file) !=
+				sizeof(stream_header)) {
+			LOG_ERROR("Error writing memory samples to %s.", destination);
+			fclose(stream->file);
+			stream->file = NULL;
+			goto error;
+		}
+	}
+
+	stream->target = target;
+	stream->start_us = timeval_us();
+	stream->records = 0;
+	if (target_register_timer_callback(sample_stream_timer, 1,
+				TARGET_TIMER_TYPE_PERIODIC, target) == ERROR_OK)
+		return ERROR_OK;
+	riscv_sample_stream_close(stream);
+	return ERROR_FAIL;
+
+error:
+	free(stream->destination);
+	stream->destination = NULL;
+	return ERROR_FAIL;
+}
+
+COMMAND_HANDLER(riscv_sample_stream_command)
+{
+	struct target *target = get_current_target(CMD_CTX);
+	RISCV_INFO(r);
+	struct riscv_sample_stream *stream = &r->sample_stream;
+
+	if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (CMD_ARGC == 0) {
+		if (riscv_sample_stream_active(stream))
+			command_print(CMD, "streaming memory samples to %s, %" PRIu64 " records",
+					stream->destination, stream->records);
+		else
+			command_print(CMD, "memory samples are not streamed");
+		return ERROR_OK;
+	}
+
+	riscv_sample_stream_close(stream);
+	r->sample_buf.streaming = false;
+	if (!strcmp(CMD_ARGV[0], "off"))
+		return ERROR_OK;
+
+	int result = open_stream(target, stream, CMD_ARGV[0]);
+	if (result != ERROR_OK)
+		return result;
+	/* Drop what was sampled so far, it has no precise timestamps. */
+	r->sample_buf.used = 0;
+	r->sample_buf.streaming = true;
+	return ERROR_OK;
+}
+
+const struct command_registration riscv_sample_stream_command_handlers[] = {
+	{
+		.name = "sample_stream",
+		.handler = riscv_sample_stream_command,
+		.mode = COMMAND_ANY,
+		.usage = "[filename|:port|off]",
+		.help = "Stream the samples taken by `riscv memory_sample` to a file "
+			"or to TCP clients as they are taken. Without an argument, print "
+			"where they go."
+	},
+	COMMAND_REGISTRATION_DONE
+};
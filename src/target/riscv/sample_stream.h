@@ -0,0 +1,47 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+
+#ifndef OPENOCD_TARGET_RISCV_SAMPLE_STREAM_H
+#define OPENOCD_TARGET_RISCV_SAMPLE_STREAM_H
+
+#include <stdio.h>
+#include <helper/command.h>
+#include <helper/list.h>
+#include "target/target.h"
+
+struct riscv_sample_buf;
+
+/* Where memory samples go when they are streamed out as they are taken,
+ * instead of waiting in the sample buffer for `riscv dump_sample_buf`. */
+struct riscv_sample_stream {
+	/* A file name, or ":port" for a TCP server. NULL when not streaming. */
+	char *destination;
+	FILE *file;
+	/* TCP connections, as struct riscv_sample_stream_connection. */
+	struct list_head connections;
+	/* Target whose samples are streamed, and whose sampling is driven by the
+	 * stream's timer. */
+	struct target *target;
+	/* Host time the stream was started at, in microseconds. */
+	int64_t start_us;
+	uint64_t records;
+};
+
+void riscv_sample_stream_init(struct riscv_sample_stream *stream);
+void riscv_sample_stream_close(struct riscv_sample_stream *stream);
+
+static inline bool riscv_sample_stream_active(const struct riscv_sample_stream *stream)
+{
+	return stream->destination;
+}
+
+/* Append a timestamp for the samples that follow in "buf", if it's being
+ * streamed and there's room for it. */
+void riscv_sample_buf_add_batch_timestamp(struct riscv_sample_buf *buf);
+
+/* Send what was sampled into the sample buffer of "target" to the stream,
+ * and empty the buffer. */
+int riscv_sample_stream_flush(struct target *target);
+
+extern const struct command_registration riscv_sample_stream_command_handlers[];
+
+#endif /* OPENOCD_TARGET_RISCV_SAMPLE_STREAM_H */
@@ -0,0 +1,108 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+/*
+ * Performance counters of the RISC-V debug stack.
+ *
+ * The counters are kept per target and are cheap enough to be always on.
+ * `riscv stats` returns them as a Tcl dict, so a script can record them at
+ * the end of each session and catch regressions, e.g. after an adapter or
+ * firmware upgrade, by comparing scans, busy retries or time spent waiting
+ * on the JTAG queue.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <assert.h>
+#include <helper/log.h>
+#include <helper/time_support.h>
+#include "jtag/jtag.h"
+#include "target/target.h"
+#include "stats.h"
+#include "batch.h"
+#include "riscv.h"
+
+/* stats.h can't include batch.h and riscv.h, which include it. */
+static_assert(RISCV_DELAY_SYSBUS_WRITE + 1 == RISCV_STATS_DELAY_CLASS_COUNT,
+		"RISCV_STATS_DELAY_CLASS_COUNT doesn't match riscv_scan_delay_class");
+static_assert(RISCV_MEM_ACCESS_MAX_METHODS_NUM ==
+		RISCV_STATS_MEM_ACCESS_METHOD_COUNT,
+		"RISCV_STATS_MEM_ACCESS_METHOD_COUNT doesn't match riscv_mem_access_method_t");
+
+static const char * const delay_class_names[RISCV_STATS_DELAY_CLASS_COUNT] = {
+	[RISCV_DELAY_BASE] = "dm_access",
+	[RISCV_DELAY_ABSTRACT_COMMAND] = "abstract_command",
+	[RISCV_DELAY_SYSBUS_READ] = "sysbus_read",
+	[RISCV_DELAY_SYSBUS_WRITE] = "sysbus_write",
+};
+
+int riscv_stats_execute_queue(struct target *target)
+{
+	struct riscv_stats *stats = &riscv_info(target)->stats;
+	const int64_t start = timeval_us();
+	const int result = jtag_execute_queue();
+	stats->jtag_flushes++;
+	stats->jtag_queue_us += timeval_us() - start;
+	return result;
+}
+
+static void print_array(struct command_invocation *cmd, const char *name,
+		const uint64_t *values, const char * const *names, unsigned int count)
+{
+	command_print_sameline(cmd, "%s {", name);
+	for (unsigned int i = 0; i < count; i++)
+		command_print_sameline(cmd, "%s%s %" PRIu64, i ? " " : "", names[i],
+				values[i]);
+	command_print_sameline(cmd, "} ");
+}
+
+COMMAND_HANDLER(riscv_stats_command)
+{
+	struct target *target = get_current_target(CMD_CTX);
+	RISCV_INFO(r);
+	struct riscv_stats *stats = &r->stats;
+
+	if (CMD_ARGC == 1) {
+		if (strcmp(CMD_ARGV[0], "reset"))
+			return ERROR_COMMAND_SYNTAX_ERROR;
+		memset(stats, 0, sizeof(*stats));
+		return ERROR_OK;
+	}
+	if (CMD_ARGC != 0)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	const char *method_names[RISCV_STATS_MEM_ACCESS_METHOD_COUNT];
+	for (unsigned int i = 0; i < RISCV_STATS_MEM_ACCESS_METHOD_COUNT; i++)
+		method_names[i] = riscv_mem_access_method_name(i);
+
+	command_print_sameline(CMD, "dmi_scans %" PRIu64 " jtag_flushes %" PRIu64
+			" jtag_queue_us %" PRIu64 " ", stats->dmi_scans,
+			stats->jtag_flushes, stats->jtag_queue_us);
+	print_array(CMD, "busy_retries", stats->busy_retries, delay_class_names,
+			RISCV_STATS_DELAY_CLASS_COUNT);
+	command_print_sameline(CMD, "abstract_commands %" PRIu64
+			" abstract_command_errors %" PRIu64 " idle_waits %" PRIu64
+			" idle_wait_us %" PRIu64 " ", stats->abstract_commands,
+			stats->abstract_command_errors, stats->idle_waits,
+			stats->idle_wait_us);
+	print_array(CMD, "bytes_read", stats->bytes_read, method_names,
+			RISCV_STATS_MEM_ACCESS_METHOD_COUNT);
+	print_array(CMD, "bytes_written", stats->bytes_written, method_names,
+			RISCV_STATS_MEM_ACCESS_METHOD_COUNT);
+	command_print(CMD, "mem_access_fallbacks %" PRIu64,
+			stats->mem_access_fallbacks);
+	return ERROR_OK;
+}
+
+const struct command_registration riscv_stats_command_handlers[] = {
+	{
+		.name = "stats",
+		.handler = riscv_stats_command,
+		.mode = COMMAND_EXEC,
+		.usage = "[reset]",
+		.help = "Return the performance counters of the current target as a "
+			"dict, or clear them."
+	},
+	COMMAND_REGISTRATION_DONE
+};
@@ -0,0 +1,45 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+
+#ifndef OPENOCD_TARGET_RISCV_STATS_H
+#define OPENOCD_TARGET_RISCV_STATS_H
+
+#include <stdint.h>
+#include <helper/command.h>
+
+struct target;
+
+/* One per enum riscv_scan_delay_class. Checked in stats.c. */
+#define RISCV_STATS_DELAY_CLASS_COUNT	4
+/* One per riscv_mem_access_method_t. Checked in stats.c. */
+#define RISCV_STATS_MEM_ACCESS_METHOD_COUNT	3
+
+/* Where the time of a debug session goes, per target. Shown by `riscv stats`
+ * and cleared by `riscv stats reset`. */
+struct riscv_stats {
+	uint64_t dmi_scans;
+	/* JTAG queue executions that ran batches, and the time spent in them. */
+	uint64_t jtag_flushes;
+	uint64_t jtag_queue_us;
+	/* Busy conditions that had to be retried, per delay class. */
+	uint64_t busy_retries[RISCV_STATS_DELAY_CLASS_COUNT];
+	/* Abstract commands started, including re-runs by abstractauto. */
+	uint64_t abstract_commands;
+	/* Abstract commands that ended with cmderr set. */
+	uint64_t abstract_command_errors;
+	/* Polling of abstractcs until an abstract command is done. */
+	uint64_t idle_waits;
+	uint64_t idle_wait_us;
+	/* Memory transferred with each access method. */
+	uint64_t bytes_read[RISCV_STATS_MEM_ACCESS_METHOD_COUNT];
+	uint64_t bytes_written[RISCV_STATS_MEM_ACCESS_METHOD_COUNT];
+	/* Memory accesses that moved on to the next method because one
+	 * couldn't do it. */
+	uint64_t mem_access_fallbacks;
+};
+
+/* Run jtag_execute_queue(), accounting the flush to "target". */
+int riscv_stats_execute_queue(struct target *target);
+
+extern const struct command_registration riscv_stats_command_handlers[];
+
+#endif /* OPENOCD_TARGET_RISCV_STATS_H */
@@ -0,0 +1,208 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+/*
+ * Whether a trigger can be set to a given tdata1/tdata2 pair is only found
+ * out by writing it and reading it back, and setting a watchpoint may try
+ * several triggers and encodings before one sticks. The outcomes are kept in
+ * a hash table keyed by the trigger index and the tdata1/tdata2 pair.
+ *
+ * With `riscv set_shared_discovery on`, harts on the same Debug Module whose
+ * triggers report the same tinfo (and that have the same XLEN) share one
+ * table, so in a homogeneous cluster configurations rejected by one hart
+ * aren't tried on the others. Identical tinfo doesn't prove that another
+ * hart accepts the same values, so an accepted configuration only skips the
+ * read back on the hart that verified it, and another hart rejecting it
+ * doesn't change that. That hart keeps trying the configuration.
+ *
+ * Watchpoints on ever new addresses would make the table grow without end,
+ * so each bucket keeps at most TRIGGER_CACHE_BUCKET_ENTRIES entries, and the
+ * one that was used least recently makes room for a new one.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <helper/list.h>
+#include <helper/log.h>
+#include "trigger_cache.h"
+
+#define TRIGGER_CACHE_BUCKET_COUNT	64
+#define TRIGGER_CACHE_BUCKET_ENTRIES	16
+
+struct trigger_cache_entry {
+	struct list_head list;
+	unsigned int idx;
+	riscv_reg_t tdata1;
+	riscv_reg_t tdata2;
+	bool supported;
+	/* The hart that read the accepted configuration back. */
+	const struct target *verified_by;
+};
+
+struct riscv_trigger_cache {
+	/* In shared_caches, if the cache is shared. */
+	struct list_head list;
+	bool shared;
+	unsigned int refcount;
+
+	/* What the harts using the cache have in common: the Debug Module
+	 * (TAP and dbgbase), XLEN and triggers. */
+	unsigned int abs_chain_position;
+	uint32_t dbgbase;
+	unsigned int xlen;
+	unsigned int trigger_count;
+	unsigned int trigger_tinfo[RISCV_MAX_TRIGGERS];
+
+	/* Most recently used entries first. */
+	struct list_head buckets[TRIGGER_CACHE_BUCKET_COUNT];
+	unsigned int bucket_sizes[TRIGGER_CACHE_BUCKET_COUNT];
+};
+
+static LIST_HEAD(shared_caches);
+
+static unsigned int bucket_index(unsigned int idx, riscv_reg_t tdata1,
+		riscv_reg_t tdata2)
+{
+	uint64_t hash = tdata1 * 0x9e3779b97f4a7c15ull;
+	hash ^= tdata2 + 0x9e3779b97f4a7c15ull + (hash << 6) + (hash >> 2);
+	hash ^= idx + 0x9e3779b97f4a7c15ull + (hash << 6) + (hash >> 2);
+	return (hash ^ (hash >> 32)) % TRIGGER_CACHE_BUCKET_COUNT;
+}
+
+static bool same_triggers(const struct riscv_trigger_cache *cache,
+		struct target *target)
+{
+	RISCV_INFO(r);
+	return cache->abs_chain_position == target->tap->abs_chain_position &&
+		cache->dbgbase == target->dbgbase &&
+		cache->xlen == riscv_xlen(target) &&
+		cache->trigger_count == r->trigger_count &&
+		!memcmp(cache->trigger_tinfo, r->trigger_tinfo,
+				r->trigger_count * sizeof(*r->trigger_tinfo));
+}
+
+struct riscv_trigger_cache *riscv_trigger_cache_get(struct target *target)
+{
+	RISCV_INFO(r);
+	struct riscv_trigger_cache *cache;
+
+	if (r->share_discovery) {
+		list_for_each_entry(cache, &shared_caches, list) {
+			if (same_triggers(cache, target)) {
+				LOG_TARGET_DEBUG(target, "Sharing the trigger cache with %u "
+						"other hart(s).", cache->refcount);
+				cache->refcount++;
+				return cache;
+			}
+		}
+	}
+
+	cache = calloc(1, sizeof(*cache));
+	if (!cache) {
+		LOG_TARGET_ERROR(target, "Failed to allocate the trigger cache.");
+		return NULL;
+	}
+	cache->refcount = 1;
+	cache->abs_chain_position = target->tap->abs_chain_position;
+	cache->dbgbase = target->dbgbase;
+	cache->xlen = riscv_xlen(target);
+	cache->trigger_count = r->trigger_count;
+	memcpy(cache->trigger_tinfo, r->trigger_tinfo,
+			r->trigger_count * sizeof(*r->trigger_tinfo));
+	for (unsigned int i = 0; i < TRIGGER_CACHE_BUCKET_COUNT; i++)
+		INIT_LIST_HEAD(&cache->buckets[i]);
+	INIT_LIST_HEAD(&cache->list);
+	if (r->share_discovery) {
+		cache->shared = true;
+		list_add_tail(&cache->list, &shared_caches);
+	}
+	return cache;
+}
+
+void riscv_trigger_cache_put(struct riscv_trigger_cache *cache)
+{
+	if (!cache)
+		return;
+	assert(cache->refcount > 0);
+	if (--cache->refcount > 0)
+		return;
+
+	for (unsigned int i = 0; i < TRIGGER_CACHE_BUCKET_COUNT; i++) {
+		struct trigger_cache_entry *entry, *tmp;
+		list_for_each_entry_safe(entry, tmp, &cache->buckets[i], list) {
+			list_del(&entry->list);
+			free(entry);
+		}
+	}
+	if (cache->shared)
+		list_del(&cache->list);
+	free(cache);
+}
+
+static struct trigger_cache_entry *find_entry(
+		struct riscv_trigger_cache *cache, unsigned int idx,
+		riscv_reg_t tdata1, riscv_reg_t tdata2)
+{
+	struct list_head *bucket =
+		&cache->buckets[bucket_index(idx, tdata1, tdata2)];
+	struct trigger_cache_entry *entry;
+	list_for_each_entry(entry, bucket, list) {
+		if (entry->idx == idx && entry->tdata1 == tdata1 &&
+				entry->tdata2 == tdata2) {
+			list_move(&entry->list, bucket);
+			return entry;
+		}
+	}
+	return NULL;
+}
+
+enum riscv_trigger_support riscv_trigger_cache_lookup(
+		struct riscv_trigger_cache *cache, const struct target *target,
+		unsigned int idx, riscv_reg_t tdata1, riscv_reg_t tdata2)
+{
+	const struct trigger_cache_entry *entry =
+		find_entry(cache, idx, tdata1, tdata2);
+	if (!entry)
+		return RISCV_TRIGGER_SUPPORT_UNKNOWN;
+	if (!entry->supported)
+		return RISCV_TRIGGER_UNSUPPORTED;
+	return entry->verified_by == target ? RISCV_TRIGGER_SUPPORTED
+		: RISCV_TRIGGER_SUPPORT_UNKNOWN;
+}
+
+void riscv_trigger_cache_record(struct riscv_trigger_cache *cache,
+		const struct target *target, unsigned int idx, riscv_reg_t tdata1,
+		riscv_reg_t tdata2, bool supported)
+{
+	struct trigger_cache_entry *entry = find_entry(cache, idx, tdata1, tdata2);
+	if (entry) {
+		if (entry->supported && entry->verified_by != target)
+			/* The first hart to verify a configuration keeps trusting
+			 * it, even if another hart rejects it. */
+			return;
+		entry->verified_by = supported ? target : NULL;
+		entry->supported = supported;
+		return;
+	}
+	const unsigned int bucket = bucket_index(idx, tdata1, tdata2);
+	if (cache->bucket_sizes[bucket] == TRIGGER_CACHE_BUCKET_ENTRIES) {
+		/* Reuse the least recently used entry. */
+		entry = list_last_entry(&cache->buckets[bucket],
+				struct trigger_cache_entry, list);
+		list_del(&entry->list);
+		cache->bucket_sizes[bucket]--;
+	} else {
+		entry = malloc(sizeof(*entry));
+		/* Not remembering is harmless, the trigger gets probed again. */
+		if (!entry)
+			return;
+	}
+	entry->idx = idx;
+	entry->tdata1 = tdata1;
+	entry->tdata2 = tdata2;
+	entry->supported = supported;
+	entry->verified_by = supported ? target : NULL;
+	list_add(&entry->list, &cache->buckets[bucket]);
+	cache->bucket_sizes[bucket]++;
+}
@@ -0,0 +1,42 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+
+#ifndef OPENOCD_TARGET_RISCV_TRIGGER_CACHE_H
+#define OPENOCD_TARGET_RISCV_TRIGGER_CACHE_H
+
+#include "target/target.h"
+#include "riscv.h"
+
+/* Known outcomes of setting a trigger to a tdata1/tdata2 pair, so that
+ * configurations the hardware rejects aren't tried again, and the ones a
+ * hart accepted don't have to be read back for verification on that hart. */
+struct riscv_trigger_cache;
+
+enum riscv_trigger_support {
+	RISCV_TRIGGER_SUPPORT_UNKNOWN,
+	RISCV_TRIGGER_SUPPORTED,
+	RISCV_TRIGGER_UNSUPPORTED
+};
+
+/* Return the cache for the triggers of "target", which must have been
+ * enumerated. With `riscv set_shared_discovery on`, harts on the same Debug
+ * Module with the same XLEN and the same tinfo for every trigger get the same
+ * cache. Returns NULL if the allocation fails. */
+struct riscv_trigger_cache *riscv_trigger_cache_get(struct target *target);
+
+/* Drop a reference returned by riscv_trigger_cache_get(). */
+void riscv_trigger_cache_put(struct riscv_trigger_cache *cache);
+
+/* RISCV_TRIGGER_SUPPORTED is only returned to the hart that verified the
+ * configuration. Other harts sharing the cache get
+ * RISCV_TRIGGER_SUPPORT_UNKNOWN, so they still read the trigger back. */
+enum riscv_trigger_support riscv_trigger_cache_lookup(
+		struct riscv_trigger_cache *cache, const struct target *target,
+		unsigned int idx, riscv_reg_t tdata1, riscv_reg_t tdata2);
+
+/* A configuration accepted by one hart stays RISCV_TRIGGER_SUPPORTED for that
+ * hart when another hart rejects it. */
+void riscv_trigger_cache_record(struct riscv_trigger_cache *cache,
+		const struct target *target, unsigned int idx, riscv_reg_t tdata1,
+		riscv_reg_t tdata2, bool supported);
+
+#endif /* OPENOCD_TARGET_RISCV_TRIGGER_CACHE_H */
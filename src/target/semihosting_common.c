@@ -292,6 +292,51 @@ static inline int semihosting_getchar(struct semihosting *semihosting, int fd)
 	return getchar();
 }
 
+/* Strings are read from the target in blocks of this many bytes. */
+#define SEMIHOSTING_STRING_BLOCK_SIZE 64
+
+/**
+ * Walk the null-terminated string at @a addr, printing it to stdout when
+ * @a print is set, and return its length in @a length.
+ *
+ * The string is read in aligned blocks rather than byte by byte, since each
+ * read may be a slow debug access. A block never goes past the aligned block
+ * that holds the terminator. If a block can't be read at once, the rest of
+ * the string is read a byte at a time, rather than failing a block read
+ * again for every block.
+ */
+static int semihosting_walk_string(struct target *target, uint64_t addr,
+	bool print, size_t *length)
+{
+	struct semihosting *semihosting = target->semihosting;
+	uint8_t block[SEMIHOSTING_STRING_BLOCK_SIZE];
+	bool byte_mode = false;
+	*length = 0;
+	while (true) {
+		uint32_t count = SEMIHOSTING_STRING_BLOCK_SIZE -
+			addr % SEMIHOSTING_STRING_BLOCK_SIZE;
+		int retval = ERROR_FAIL;
+		if (!byte_mode) {
+			retval = target_read_buffer(target, addr, count, block);
+			byte_mode = retval != ERROR_OK;
+		}
+		if (byte_mode) {
+			count = 1;
+			retval = target_read_memory(target, addr, 1, 1, block);
+			if (retval != ERROR_OK)
+				return retval;
+		}
+		for (uint32_t i = 0; i < count; i++) {
+			if (!block[i])
+				return ERROR_OK;
+			if (print)
+				semihosting_putchar(semihosting, semihosting->stdout_fd, block[i]);
+			(*length)++;
+		}
+		addr += count;
+	}
+}
+
 /**
  * User operation parameter string storage buffer. Contains valid data when the
  * TARGET_EVENT_SEMIHOSTING_USER_CMD_xxxxx event callbacks are running.
@@ -1451,33 +1496,22 @@ int semihosting_common(struct target *target)
 			 * None. The RETURN REGISTER is corrupted.
 			 */
 			if (semihosting->is_fileio) {
-				size_t count = 0;
-				uint64_t addr = semihosting->param;
-				for (;; addr++) {
-					unsigned char c;
-					retval = target_read_memory(target, addr, 1, 1, &c);
-					if (retval != ERROR_OK)
-						return retval;
-					if (c == '\0')
-						break;
-					count++;
-				}
+				size_t count;
+				retval = semihosting_walk_string(target, semihosting->param,
+					false, &count);
+				if (retval != ERROR_OK)
+					return retval;
 				semihosting->hit_fileio = true;
 				fileio_info->identifier = "write";
 				fileio_info->param_1 = 1;
 				fileio_info->param_2 = semihosting->param;
 				fileio_info->param_3 = count;
 			} else {
-				uint64_t addr = semihosting->param;
-				do {
-					unsigned char c;
-					retval = target_read_memory(target, addr++, 1, 1, &c);
-					if (retval != ERROR_OK)
-						return retval;
-					if (!c)
-						break;
-					semihosting_putchar(semihosting, semihosting->stdout_fd, c);
-				} while (1);
+				size_t count;
+				retval = semihosting_walk_string(target, semihosting->param,
+					true, &count);
+				if (retval != ERROR_OK)
+					return retval;
 				semihosting->result = 0;
 			}
 			break;
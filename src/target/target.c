@@ -1429,6 +1429,25 @@ int target_step(struct target *target,
 	return retval;
 }
 
+int target_step_range(struct target *target, target_addr_t start,
+		target_addr_t end)
+{
+	int retval;
+
+	target_call_event_callbacks(target, TARGET_EVENT_STEP_START);
+
+	if (target->type->step_range)
+		retval = target->type->step_range(target, start, end);
+	else
+		retval = target->type->step(target, 1, 0, 0);
+	if (retval != ERROR_OK)
+		return retval;
+
+	target_call_event_callbacks(target, TARGET_EVENT_STEP_END);
+
+	return retval;
+}
+
 int target_get_gdb_fileio_info(struct target *target, struct gdb_fileio_info *fileio_info)
 {
 	if (target->state != TARGET_HALTED) {
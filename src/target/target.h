@@ -543,6 +543,15 @@ bool target_supports_gdb_connection(const struct target *target);
  */
 int target_step(struct target *target,
 		int current, target_addr_t address, int handle_breakpoints);
+/**
+ * Step the target from the current pc until the pc is no longer in
+ * [@a start, @a end), or the target halts for another reason.
+ *
+ * This routine is a wrapper for target->type->step_range. Targets that don't
+ * implement it take a single step, which is a valid (if slow) range step.
+ */
+int target_step_range(struct target *target, target_addr_t start,
+		target_addr_t end);
 /**
  * Run an algorithm on the @a target given.
  *
@@ -46,6 +46,11 @@ struct target_type {
 			int handle_breakpoints, int debug_execution);
 	int (*step)(struct target *target, int current, target_addr_t address,
 			int handle_breakpoints);
+	/* Optional. Step from the current pc until the pc leaves
+	 * [start, end), or the target stops for another reason. May stop early,
+	 * e.g. to stay responsive. Used for gdb's vCont;r packet. */
+	int (*step_range)(struct target *target, target_addr_t start,
+			target_addr_t end);
 	/* target reset control. assert reset can be invoked when OpenOCD and
 	 * the target is out of sync.
 	 *
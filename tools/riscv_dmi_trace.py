@@ -0,0 +1,154 @@
+#!/usr/bin/env python3
+# SPDX-License-Identifier: GPL-2.0-or-later
+
+"""Decode a trace written by `riscv dmi_trace` and print statistics.
+
+The DMI is pipelined: the status and data shifted in during a scan belong to
+the operation of the scan before it on the same TAP. The trace is replayed
+scan by scan to pair each operation with its result, then summarized per DM
+register and operation (count, busy and failed responses, batch latency), per
+delay class (Run-Test/Idle cycles spent) and per JTAG queue execution.
+
+The host only knows when a whole batch of scans completed, so the latency of
+an operation is that of the batch it was in: from queueing the batch to its
+results being available. `riscv_dmsim replay` gives the time each operation
+takes in the simulated DM instead.
+
+With --dump, every operation is printed as it's replayed instead.
+"""
+
+import argparse
+import struct
+import sys
+from collections import defaultdict
+
+HEADER = b"RVDMITR\x01"
+RECORD = struct.Struct("<QIIIIHBBBxH")
+
+OPS = {0: "nop", 1: "read", 2: "write"}
+STATUSES = {0: "ok", 2: "failed", 3: "busy", 0xff: "?"}
+DELAY_CLASSES = {0: "DM access", 1: "abstract command", 2: "sysbus read",
+                 3: "sysbus write"}
+
+DM_REGISTERS = {
+    0x04: "data0", 0x05: "data1", 0x06: "data2", 0x07: "data3",
+    0x08: "data4", 0x09: "data5", 0x0a: "data6", 0x0b: "data7",
+    0x0c: "data8", 0x0d: "data9", 0x0e: "data10", 0x0f: "data11",
+    0x10: "dmcontrol", 0x11: "dmstatus", 0x12: "hartinfo", 0x13: "haltsum1",
+    0x14: "hawindowsel", 0x15: "hawindow", 0x16: "abstractcs",
+    0x17: "command", 0x18: "abstractauto", 0x19: "confstrptr0",
+    0x1a: "confstrptr1", 0x1b: "confstrptr2", 0x1c: "confstrptr3",
+    0x1d: "nextdm", 0x1f: "custom",
+    0x20: "progbuf0", 0x21: "progbuf1", 0x22: "progbuf2", 0x23: "progbuf3",
+    0x24: "progbuf4", 0x25: "progbuf5", 0x26: "progbuf6", 0x27: "progbuf7",
+    0x28: "progbuf8", 0x29: "progbuf9", 0x2a: "progbuf10",
+    0x2b: "progbuf11", 0x2c: "progbuf12", 0x2d: "progbuf13",
+    0x2e: "progbuf14", 0x2f: "progbuf15",
+    0x30: "authdata", 0x32: "dmcs2", 0x34: "haltsum2", 0x35: "haltsum3",
+    0x37: "sbaddress3", 0x38: "sbcs", 0x39: "sbaddress0",
+    0x3a: "sbaddress1", 0x3b: "sbaddress2", 0x3c: "sbdata0",
+    0x3d: "sbdata1", 0x3e: "sbdata2", 0x3f: "sbdata3", 0x40: "haltsum0",
+}
+
+
+def register_name(address):
+    name = DM_REGISTERS.get(address & 0x7f, "0x%02x" % (address & 0x7f))
+    base = address & ~0x7f
+    return "%s@0x%x" % (name, base) if base else name
+
+
+def read_records(path):
+    with open(path, "rb") as f:
+        if f.read(len(HEADER)) != HEADER:
+            sys.exit("%s is not a DMI trace (or has an unknown version)" % path)
+        while True:
+            data = f.read(RECORD.size)
+            if len(data) < RECORD.size:
+                return
+            yield RECORD.unpack(data)
+
+
+def percentile(values, fraction):
+    return values[min(len(values) - 1, int(len(values) * fraction))]
+
+
+def replay(records, dump):
+    """Pair every operation with the result shifted in by the next scan on the
+    same TAP. Returns the per-operation and per-delay-class statistics and
+    the per-flush scan counts."""
+    operations = defaultdict(lambda: {"batch_latency": [], "busy": 0,
+                                      "failed": 0, "unknown": 0})
+    delay_classes = defaultdict(lambda: [0, 0])
+    flushes = defaultdict(int)
+    pending = {}
+    for (timestamp, batch_latency, address, data_out, data_in, tap, op, status,
+            delay_class, idle) in records:
+        flushes[timestamp] += 1
+        delay_classes[delay_class][0] += 1
+        delay_classes[delay_class][1] += idle
+
+        previous = pending.pop(tap, None)
+        if previous:
+            p_address, p_op, p_data, p_batch_latency = previous
+            stats = operations[(register_name(p_address), OPS[p_op])]
+            stats["batch_latency"].append(p_batch_latency)
+            if status == 3:
+                stats["busy"] += 1
+            elif status == 2:
+                stats["failed"] += 1
+            elif status == 0xff:
+                stats["unknown"] += 1
+            if dump:
+                value = data_in if p_op == 1 else p_data
+                print("%12d tap%-2d %-5s %-16s %08x %s" % (
+                    timestamp, tap, OPS[p_op], register_name(p_address),
+                    value, STATUSES.get(status, "?")))
+        if op in (1, 2):
+            pending[tap] = (address, op, data_out, batch_latency)
+    return operations, delay_classes, flushes
+
+
+def print_summary(operations, delay_classes, flushes):
+    print("%-20s %-5s %8s %6s %6s %8s %8s %8s" % (
+        "register", "op", "count", "busy", "failed", "batch", "latency",
+        "(us)"))
+    print("%-20s %-5s %8s %6s %6s %8s %8s %8s" % (
+        "", "", "", "", "", "p50", "p99", "max"))
+    for (name, op), stats in sorted(
+            operations.items(),
+            key=lambda item: -len(item[1]["batch_latency"])):
+        latency = sorted(stats["batch_latency"])
+        print("%-20s %-5s %8d %6d %6d %8d %8d %8d" % (
+            name, op, len(latency), stats["busy"], stats["failed"],
+            percentile(latency, 0.5), percentile(latency, 0.99),
+            latency[-1]))
+
+    print()
+    print("%-20s %8s %12s" % ("delay class", "scans", "idle cycles"))
+    for delay_class, (scans, idle) in sorted(delay_classes.items()):
+        print("%-20s %8d %12d" % (
+            DELAY_CLASSES.get(delay_class, str(delay_class)), scans, idle))
+
+    if flushes:
+        scans = sorted(flushes.values())
+        print()
+        print("%d JTAG queue executions, %.1f scans each on average, "
+              "%d at most" % (len(scans), sum(scans) / len(scans), scans[-1]))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+            formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("trace", help="file written by `riscv dmi_trace`")
+    parser.add_argument("--dump", action="store_true",
+            help="print every operation instead of the statistics")
+    args = parser.parse_args()
+
+    operations, delay_classes, flushes = replay(read_records(args.trace),
+                                                args.dump)
+    if not args.dump:
+        print_summary(operations, delay_classes, flushes)
+
+
+if __name__ == "__main__":
+    main()